@@ -0,0 +1,452 @@
+#include "ans.h"
+
+#include "io.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ANS_STEP ( ( ANS_TABLE_SIZE >> 1 ) + ( ANS_TABLE_SIZE >> 3 ) + 3 ) // Odd step that spreads each symbol's states through the table.
+
+// Description:
+// How to encode a symbol from any state: the number of bits to write is
+// ( state + delta_bits ) >> 16, and the next state is found at
+// ( state >> bits ) + delta_state in the state table.
+//
+// Members:
+// uint32_t delta_bits - Added to the state to get the number of bits to write in the top half.
+// int32_t delta_state - Added to the state's kept bits to find the next state.
+typedef struct AnsSymbol {
+	uint32_t delta_bits;
+	int32_t delta_state;
+} AnsSymbol;
+
+// Description:
+// A struct for encoding with a tANS table.
+//
+// Members:
+// uint16_t states[ANS_TABLE_SIZE] - The next states of each symbol, grouped by symbol.
+// AnsSymbol symbols[ALPHABET] - How to encode each symbol.
+struct AnsEncoder {
+	uint16_t states[ ANS_TABLE_SIZE ];
+	AnsSymbol symbols[ ALPHABET ];
+};
+
+// Description:
+// A decoding table entry: the symbol a state decodes to, and how to find the
+// next state from the bits read after it.
+//
+// Members:
+// uint16_t base - The next state, before the bits read are added.
+// uint8_t symbol - The symbol.
+// uint8_t nbits - The number of bits to read.
+typedef struct AnsEntry {
+	uint16_t base;
+	uint8_t symbol;
+	uint8_t nbits;
+} AnsEntry;
+
+// Description:
+// A struct for decoding with a tANS table.
+//
+// Members:
+// AnsEntry entries[ANS_TABLE_SIZE] - The entry of each state.
+struct AnsDecoder {
+	AnsEntry entries[ ANS_TABLE_SIZE ];
+};
+
+// Description:
+// Gets the position of the highest set bit of a number.
+//
+// Parameters:
+// uint32_t x - The number, which can't be 0.
+//
+// Returns:
+// uint32_t - The position of its highest set bit.
+static inline uint32_t ans_high_bit( uint32_t x ) {
+	return 31 - __builtin_clz( x );
+}
+
+// Description:
+// Spreads the states of each symbol through the table, a step at a time, so
+// each symbol's states are scattered evenly instead of grouped.
+//
+// Parameters:
+// uint16_t counts[static ALPHABET] - The normalized count of each symbol.
+// uint8_t spread[static ANS_TABLE_SIZE] - The symbol of each state to set.
+//
+// Returns:
+// Nothing.
+static void ans_spread( uint16_t counts[ static ALPHABET ], uint8_t spread[ static ANS_TABLE_SIZE ] ) {
+	uint32_t position = 0;
+
+	for ( uint32_t s = 0; s < ALPHABET; s++ ) {
+		for ( uint32_t i = 0; i < counts[ s ]; i++ ) {
+			spread[ position ] = s;
+			position = ( position + ANS_STEP ) & ( ANS_TABLE_SIZE - 1 );
+		}
+	}
+}
+
+// Description:
+// Scales a histogram's counts to sum to ANS_TABLE_SIZE, keeping every symbol
+// that occurs at a count of at least 1. Counts start rounded down, then are
+// raised or lowered one at a time wherever that costs the fewest coded bits
+// (a symbol's bits go up by its frequency times log2( c / ( c - 1 ) ) when its
+// count c drops by one). The cost is convex in each count, so this finds the
+// counts that code the histogram in the fewest bits.
+//
+// Parameters:
+// uint64_t histogram[static ALPHABET] - The histogram.
+// uint16_t counts[static ALPHABET] - The normalized counts to set.
+//
+// Returns:
+// bool - Whether the histogram had any symbols.
+bool ans_normalize( uint64_t histogram[ static ALPHABET ], uint16_t counts[ static ALPHABET ] ) {
+	uint64_t total = 0;
+	uint32_t sum = 0;
+	memset( counts, 0, ALPHABET * sizeof( uint16_t ) );
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		total += histogram[ i ];
+	}
+
+	if ( total == 0 ) {
+		return false;
+	}
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		if ( histogram[ i ] != 0 ) {
+			uint64_t scaled = ( uint64_t ) ( ( double ) histogram[ i ] * ANS_TABLE_SIZE / total );
+			counts[ i ] = scaled != 0 ? scaled : 1;
+			sum += counts[ i ];
+		}
+	}
+
+	while ( sum != ANS_TABLE_SIZE ) {
+		bool raise = sum < ANS_TABLE_SIZE;
+		uint32_t best = ALPHABET;
+		double best_change = 0;
+
+		for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+			if ( histogram[ i ] == 0 || ( !raise && counts[ i ] == 1 ) ) {
+				continue;
+			}
+
+			// Bits saved by raising the count, or lost by lowering it.
+			double change = histogram[ i ] * ( raise ? log2( counts[ i ] + 1.0 ) - log2( counts[ i ] ) : log2( counts[ i ] ) - log2( counts[ i ] - 1.0 ) );
+
+			if ( best == ALPHABET || ( raise ? change > best_change : change < best_change ) ) {
+				best = i;
+				best_change = change;
+			}
+		}
+
+		counts[ best ] += raise ? 1 : -1;
+		sum += raise ? 1 : -1;
+	}
+
+	return true;
+}
+
+// Description:
+// Dumps normalized counts: a bitmap of the symbols that occur, then the count
+// of each of them as 16 bits, little-endian.
+//
+// Parameters:
+// uint16_t counts[static ALPHABET] - The normalized counts.
+// uint8_t dump[static ANS_MAX_COUNTS_SIZE] - The buffer to write the dump to.
+//
+// Returns:
+// uint16_t - The size of the dump.
+uint16_t ans_counts_dump( uint16_t counts[ static ALPHABET ], uint8_t dump[ static ANS_MAX_COUNTS_SIZE ] ) {
+	uint16_t nbytes = ALPHABET / 8;
+	memset( dump, 0, ALPHABET / 8 );
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		if ( counts[ i ] != 0 ) {
+			dump[ i / 8 ] |= 1 << ( i % 8 );
+			store_little_endian( dump + nbytes, counts[ i ], 2 );
+			nbytes += 2;
+		}
+	}
+
+	return nbytes;
+}
+
+// Description:
+// Parses a dump of normalized counts.
+//
+// Parameters:
+// uint8_t *dump - The dump.
+// uint16_t nbytes - The size of the dump.
+// uint16_t counts[static ALPHABET] - The normalized counts to set.
+//
+// Returns:
+// bool - Whether the dump was valid: the right size, with counts summing to ANS_TABLE_SIZE.
+bool ans_counts_parse( uint8_t *dump, uint16_t nbytes, uint16_t counts[ static ALPHABET ] ) {
+	uint32_t offset = ALPHABET / 8;
+	uint32_t sum = 0;
+
+	if ( nbytes < ALPHABET / 8 ) {
+		return false;
+	}
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		counts[ i ] = 0;
+
+		if ( dump[ i / 8 ] & ( 1 << ( i % 8 ) ) ) {
+			if ( offset + 2 > nbytes ) {
+				return false;
+			}
+
+			counts[ i ] = load_little_endian( dump + offset, 2 );
+			offset += 2;
+			sum += counts[ i ];
+
+			if ( counts[ i ] == 0 ) {
+				return false;
+			}
+		}
+	}
+
+	return offset == nbytes && sum == ANS_TABLE_SIZE;
+}
+
+// Description:
+// Creates an encoder for normalized counts.
+//
+// Parameters:
+// uint16_t counts[static ALPHABET] - The normalized counts, summing to ANS_TABLE_SIZE.
+//
+// Returns:
+// AnsEncoder * - A pointer to the newly created encoder.
+AnsEncoder *ans_encoder_create( uint16_t counts[ static ALPHABET ] ) {
+	AnsEncoder *e = ( AnsEncoder * ) calloc( 1, sizeof( AnsEncoder ) );
+
+	if ( e ) {
+		uint8_t spread[ ANS_TABLE_SIZE ];
+		uint32_t cumulative[ ALPHABET ];
+		uint32_t next[ ALPHABET ];
+		uint32_t total = 0;
+		ans_spread( counts, spread );
+
+		for ( uint32_t s = 0; s < ALPHABET; s++ ) {
+			cumulative[ s ] = next[ s ] = total;
+			total += counts[ s ];
+		}
+
+		for ( uint32_t u = 0; u < ANS_TABLE_SIZE; u++ ) { // Each symbol's states, in table order.
+			e->states[ next[ spread[ u ] ]++ ] = ANS_TABLE_SIZE + u;
+		}
+
+		for ( uint32_t s = 0; s < ALPHABET; s++ ) {
+			if ( counts[ s ] == 1 ) { // Every state writes all of its bits.
+				e->symbols[ s ].delta_bits = ( ANS_TABLE_LOG << 16 ) - ANS_TABLE_SIZE;
+				e->symbols[ s ].delta_state = cumulative[ s ] - 1;
+			} else if ( counts[ s ] > 1 ) { // States from min_state up write max_bits bits, the rest one fewer.
+				uint32_t max_bits = ANS_TABLE_LOG - ans_high_bit( counts[ s ] - 1 );
+				uint32_t min_state = ( uint32_t ) counts[ s ] << max_bits;
+				e->symbols[ s ].delta_bits = ( max_bits << 16 ) - min_state;
+				e->symbols[ s ].delta_state = cumulative[ s ] - counts[ s ];
+			}
+		}
+	}
+
+	return e;
+}
+
+// Description:
+// Frees the memory given to an encoder.
+//
+// Parameters:
+// AnsEncoder **e - A pointer to a pointer to the encoder.
+//
+// Returns:
+// Nothing.
+void ans_encoder_delete( AnsEncoder **e ) {
+	free( *e );
+	*e = NULL;
+}
+
+// Description:
+// Encodes a symbol, adding the bits it writes to a bit buffer.
+//
+// Parameters:
+// AnsEncoder *e - The encoder.
+// uint32_t *state - The state to encode from, set to the next state.
+// uint8_t symbol - The symbol.
+// uint64_t *bits - The bit buffer.
+// uint32_t *count - The number of bits in the buffer.
+//
+// Returns:
+// Nothing.
+static inline void ans_encode_symbol( AnsEncoder *e, uint32_t *state, uint8_t symbol, uint64_t *bits, uint32_t *count ) {
+	AnsSymbol s = e->symbols[ symbol ];
+	uint32_t nbits = ( *state + s.delta_bits ) >> 16;
+	*bits |= ( uint64_t ) ( *state & ( ( 1u << nbits ) - 1 ) ) << *count;
+	*count += nbits;
+	*state = e->states[ ( *state >> nbits ) + s.delta_state ];
+}
+
+// Description:
+// Encodes symbols as a block that ans_decode() can decode. Two states take
+// turns, so the decoder can work on two symbols at once. The symbols are
+// encoded last to first, so they decode first to last, and after their bits
+// come the final states and a 1 bit marking where the bits end.
+//
+// Parameters:
+// AnsEncoder *e - The encoder.
+// uint8_t *symbols - The symbols.
+// uint32_t nsymbols - The number of symbols.
+// uint8_t *out - The buffer to write the block to, with room for ANS_CODED_MAX(nsymbols) bytes.
+//
+// Returns:
+// uint32_t - The size of the block.
+uint32_t ans_encode( AnsEncoder *e, uint8_t *symbols, uint32_t nsymbols, uint8_t *out ) {
+	uint32_t state0 = ANS_TABLE_SIZE;
+	uint32_t state1 = ANS_TABLE_SIZE;
+	uint64_t bits = 0;
+	uint32_t count = 0;
+	uint8_t *p = out;
+	uint32_t i = nsymbols;
+
+	if ( i % 2 == 1 ) { // Even positions go with state 0.
+		i--;
+		ans_encode_symbol( e, &state0, symbols[ i ], &bits, &count );
+	}
+
+	while ( i != 0 ) { // At most 7 + 2 * ANS_TABLE_LOG bits are buffered.
+		i -= 2;
+		ans_encode_symbol( e, &state1, symbols[ i + 1 ], &bits, &count );
+		ans_encode_symbol( e, &state0, symbols[ i ], &bits, &count );
+		store_little_endian( p, bits, 8 );
+		p += count / 8;
+		bits >>= count & ~7u;
+		count %= 8;
+	}
+
+	bits |= ( uint64_t ) ( state1 - ANS_TABLE_SIZE ) << count;
+	count += ANS_TABLE_LOG;
+	bits |= ( uint64_t ) ( state0 - ANS_TABLE_SIZE ) << count;
+	count += ANS_TABLE_LOG;
+	bits |= ( uint64_t ) 1 << count++;
+	store_little_endian( p, bits, 8 );
+
+	return p - out + ( count + 7 ) / 8;
+}
+
+// Description:
+// Creates a decoder for normalized counts.
+//
+// Parameters:
+// uint16_t counts[static ALPHABET] - The normalized counts, summing to ANS_TABLE_SIZE.
+//
+// Returns:
+// AnsDecoder * - A pointer to the newly created decoder.
+AnsDecoder *ans_decoder_create( uint16_t counts[ static ALPHABET ] ) {
+	AnsDecoder *d = ( AnsDecoder * ) malloc( sizeof( AnsDecoder ) );
+
+	if ( d ) {
+		uint8_t spread[ ANS_TABLE_SIZE ];
+		uint32_t next[ ALPHABET ];
+		ans_spread( counts, spread );
+
+		for ( uint32_t s = 0; s < ALPHABET; s++ ) {
+			next[ s ] = counts[ s ];
+		}
+
+		for ( uint32_t u = 0; u < ANS_TABLE_SIZE; u++ ) {
+			uint32_t x = next[ spread[ u ] ]++;
+			uint32_t nbits = ANS_TABLE_LOG - ans_high_bit( x );
+			d->entries[ u ] = ( AnsEntry ) { ( x << nbits ) - ANS_TABLE_SIZE, spread[ u ], nbits };
+		}
+	}
+
+	return d;
+}
+
+// Description:
+// Frees the memory given to a decoder.
+//
+// Parameters:
+// AnsDecoder **d - A pointer to a pointer to the decoder.
+//
+// Returns:
+// Nothing.
+void ans_decoder_delete( AnsDecoder **d ) {
+	free( *d );
+	*d = NULL;
+}
+
+// Description:
+// Decodes a symbol, reading the bits of the next state backwards from a block.
+//
+// Parameters:
+// AnsDecoder *d - The decoder.
+// uint32_t *state - The state to decode, set to the next state.
+// uint8_t *coded - The block.
+// uint64_t *position - The number of unread bits at the start of the block.
+//
+// Returns:
+// uint8_t - The symbol.
+static inline uint8_t ans_decode_symbol( AnsDecoder *d, uint32_t *state, uint8_t *coded, uint64_t *position ) {
+	AnsEntry entry = d->entries[ *state ];
+	*position -= entry.nbits;
+	*state = entry.base + ( ( load_little_endian( coded + *position / 8, 8 ) >> ( *position % 8 ) ) & ( ( 1u << entry.nbits ) - 1 ) );
+
+	return entry.symbol;
+}
+
+// Description:
+// Decodes a block written by ans_encode(). The block is checked as it's read:
+// it has to end with a marker, its bits must run out exactly at its start, and
+// both states must end where the encoder started them.
+//
+// Parameters:
+// AnsDecoder *d - The decoder.
+// uint8_t *coded - The block, followed by ANS_SLACK readable bytes.
+// uint32_t ncoded - The size of the block.
+// uint8_t *out - Where to write the symbols.
+// uint32_t nsymbols - The number of symbols in the block.
+//
+// Returns:
+// bool - Whether the block was valid.
+bool ans_decode( AnsDecoder *d, uint8_t *coded, uint32_t ncoded, uint8_t *out, uint32_t nsymbols ) {
+	if ( ncoded == 0 || coded[ ncoded - 1 ] == 0 ) {
+		return false;
+	}
+
+	uint64_t position = ( uint64_t ) ( ncoded - 1 ) * 8 + ans_high_bit( coded[ ncoded - 1 ] ); // Bits before the marker.
+
+	if ( position < 2 * ANS_TABLE_LOG ) {
+		return false;
+	}
+
+	position -= ANS_TABLE_LOG;
+	uint32_t state0 = ( load_little_endian( coded + position / 8, 8 ) >> ( position % 8 ) ) & ( ANS_TABLE_SIZE - 1 );
+	position -= ANS_TABLE_LOG;
+	uint32_t state1 = ( load_little_endian( coded + position / 8, 8 ) >> ( position % 8 ) ) & ( ANS_TABLE_SIZE - 1 );
+	uint32_t i = 0;
+
+	for ( ; i + 4 <= nsymbols && position >= 4 * ANS_TABLE_LOG; i += 4 ) { // No state reads more than ANS_TABLE_LOG bits.
+		out[ i ] = ans_decode_symbol( d, &state0, coded, &position );
+		out[ i + 1 ] = ans_decode_symbol( d, &state1, coded, &position );
+		out[ i + 2 ] = ans_decode_symbol( d, &state0, coded, &position );
+		out[ i + 3 ] = ans_decode_symbol( d, &state1, coded, &position );
+	}
+
+	for ( ; i < nsymbols; i++ ) {
+		uint32_t *state = i % 2 == 0 ? &state0 : &state1;
+
+		if ( d->entries[ *state ].nbits > position ) { // Ran out of bits.
+			return false;
+		}
+
+		out[ i ] = ans_decode_symbol( d, state, coded, &position );
+	}
+
+	return position == 0 && state0 == 0 && state1 == 0;
+}
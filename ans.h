@@ -0,0 +1,39 @@
+#ifndef __ANS_H__
+#define __ANS_H__
+
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ANS_TABLE_LOG          13 // Bits of state: counts are normalized to sum to 8192.
+#define ANS_TABLE_SIZE         ( 1 << ANS_TABLE_LOG ) // States in the coding tables.
+#define ANS_BLOCK              ( 64 * BLOCK ) // 256KB of input per coded block.
+#define ANS_BLOCK_HEADER_SIZE  4 // 32-bit size of the coded block.
+#define ANS_MAX_COUNTS_SIZE    ( ALPHABET / 8 + 2 * ALPHABET ) // Bitmap of symbols, then 16-bit counts.
+#define ANS_CODED_MAX( n )     ( ( ( uint64_t ) ( n ) * ANS_TABLE_LOG + 2 * ANS_TABLE_LOG + 8 ) / 8 + 8 ) // Most bytes n symbols are coded to, plus 8 for whole-word stores.
+#define ANS_SLACK              8 // Readable bytes a decoder needs after a coded block.
+
+typedef struct AnsEncoder AnsEncoder;
+
+typedef struct AnsDecoder AnsDecoder;
+
+bool ans_normalize( uint64_t histogram[ static ALPHABET ], uint16_t counts[ static ALPHABET ] );
+
+uint16_t ans_counts_dump( uint16_t counts[ static ALPHABET ], uint8_t dump[ static ANS_MAX_COUNTS_SIZE ] );
+
+bool ans_counts_parse( uint8_t *dump, uint16_t nbytes, uint16_t counts[ static ALPHABET ] );
+
+AnsEncoder *ans_encoder_create( uint16_t counts[ static ALPHABET ] );
+
+void ans_encoder_delete( AnsEncoder **e );
+
+uint32_t ans_encode( AnsEncoder *e, uint8_t *symbols, uint32_t nsymbols, uint8_t *out );
+
+AnsDecoder *ans_decoder_create( uint16_t counts[ static ALPHABET ] );
+
+void ans_decoder_delete( AnsDecoder **d );
+
+bool ans_decode( AnsDecoder *d, uint8_t *coded, uint32_t ncoded, uint8_t *out, uint32_t nsymbols );
+
+#endif
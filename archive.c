@@ -0,0 +1,141 @@
+#include "archive.h"
+
+#include "defines.h"
+#include "file_header.h"
+#include "io.h"
+#include "raw_file_header.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ARCHIVE_START ( sizeof( RawFileHeader ) + ARCHIVE_HEADER_SIZE ) // Offset of the first segment.
+
+// Description:
+// Creates the archive header written after the file header.
+//
+// Parameters:
+// uint64_t end - The offset of the end of the last committed segment.
+// uint8_t header[static ARCHIVE_HEADER_SIZE] - The buffer to write the header to, little-endian.
+//
+// Returns:
+// Nothing.
+void archive_header_create( uint64_t end, uint8_t header[ static ARCHIVE_HEADER_SIZE ] ) {
+	store_little_endian( header, end, ARCHIVE_HEADER_SIZE );
+}
+
+// Description:
+// Parses the archive header written after the file header.
+//
+// Parameters:
+// uint8_t header[static ARCHIVE_HEADER_SIZE] - The header.
+//
+// Returns:
+// uint64_t - The offset of the end of the last committed segment.
+uint64_t archive_header_parse( uint8_t header[ static ARCHIVE_HEADER_SIZE ] ) {
+	return load_little_endian( header, ARCHIVE_HEADER_SIZE );
+}
+
+// Description:
+// Reads the file header and archive header at the start of an archive.
+//
+// Parameters:
+// int outfile - The archive.
+// FileHeader *header - The pointer to the FileHeader to set.
+// uint64_t *end - The pointer to the uint64_t to set to the end of the last committed segment.
+//
+// Returns:
+// bool - Whether the headers were read, and are an archive's.
+static bool archive_read_headers( int outfile, FileHeader *header, uint64_t *end ) {
+	uint8_t buffer[ ARCHIVE_START ];
+	RawFileHeader raw_header;
+
+	if ( pread_bytes( outfile, buffer, ARCHIVE_START, 0 ) != ARCHIVE_START ) {
+		return false;
+	}
+
+	memcpy( &raw_header, buffer, sizeof( raw_header ) );
+	*header = file_header_create( raw_header );
+	*end = archive_header_parse( buffer + sizeof( raw_header ) );
+
+	return header->magic_number == MAGIC_ARCHIVE && header->tree_size == 0 && *end >= ARCHIVE_START;
+}
+
+// Description:
+// Gets an archive ready for a segment to be appended to it, creating the
+// headers of an empty archive if the file is empty. The archive is locked
+// against other appends until it's closed, anything past the last committed
+// segment is left over from an append that never committed and is cut off, and
+// the file is positioned where the new segment goes.
+//
+// Parameters:
+// int outfile - The archive, opened for reading and writing.
+// bool *created - The pointer to the bool to set to whether the archive was empty and its headers were created.
+//
+// Returns:
+// bool - Whether the archive is ready for the segment.
+bool archive_begin( int outfile, bool *created ) {
+	struct stat archive_stats;
+	FileHeader header = { 0 };
+	uint64_t end = ARCHIVE_START;
+
+	*created = false;
+
+	if ( flock( outfile, LOCK_EX ) == -1 || fstat( outfile, &archive_stats ) == -1 || !S_ISREG( archive_stats.st_mode ) ) {
+		return false;
+	}
+
+	if ( archive_stats.st_size == 0 ) {
+		*created = true;
+		uint8_t buffer[ ARCHIVE_START ];
+		header.magic_number = MAGIC_ARCHIVE;
+		RawFileHeader raw_header = raw_file_header_create( header );
+		memcpy( buffer, &raw_header, sizeof( raw_header ) );
+		archive_header_create( end, buffer + sizeof( raw_header ) );
+
+		if ( pwrite_bytes( outfile, buffer, ARCHIVE_START, 0 ) != ARCHIVE_START ) {
+			return false;
+		}
+	} else if ( !archive_read_headers( outfile, &header, &end ) || end > ( uint64_t ) archive_stats.st_size ) {
+		return false;
+	} else if ( end < ( uint64_t ) archive_stats.st_size && ftruncate( outfile, end ) == -1 ) {
+		return false;
+	}
+
+	return lseek( outfile, end, SEEK_SET ) == ( off_t ) end;
+}
+
+// Description:
+// Commits the segment written since archive_begin, once it's on disk, by
+// rewriting the archive's original size and end offset. They sit next to each
+// other in the first sector, so one small write moves both: readers see the
+// archive either with the segment or without it.
+//
+// Parameters:
+// int outfile - The archive, positioned at the end of the segment.
+// uint64_t nbytes - The size of the segment's decoded bytes.
+//
+// Returns:
+// bool - Whether the segment was committed.
+bool archive_commit( int outfile, uint64_t nbytes ) {
+	FileHeader header = { 0 };
+	uint64_t end = 0;
+	off_t segment_end = lseek( outfile, 0, SEEK_CUR );
+
+	if ( segment_end == -1 || !archive_read_headers( outfile, &header, &end ) || fdatasync( outfile ) == -1 ) {
+		return false;
+	}
+
+	header.original_file_size += nbytes;
+	RawFileHeader raw_header = raw_file_header_create( header );
+	uint8_t buffer[ sizeof( raw_header.original_file_size ) + ARCHIVE_HEADER_SIZE ];
+	memcpy( buffer, raw_header.original_file_size, sizeof( raw_header.original_file_size ) );
+	archive_header_create( segment_end, buffer + sizeof( raw_header.original_file_size ) );
+	uint64_t offset = offsetof( RawFileHeader, original_file_size );
+
+	return pwrite_bytes( outfile, buffer, sizeof( buffer ), offset ) == sizeof( buffer ) && fdatasync( outfile ) == 0;
+}
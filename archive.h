@@ -0,0 +1,17 @@
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ARCHIVE_HEADER_SIZE 8 // 64-bit offset of the end of the last committed segment, after the file header.
+
+void archive_header_create( uint64_t end, uint8_t header[ static ARCHIVE_HEADER_SIZE ] );
+
+uint64_t archive_header_parse( uint8_t header[ static ARCHIVE_HEADER_SIZE ] );
+
+bool archive_begin( int outfile, bool *created );
+
+bool archive_commit( int outfile, uint64_t nbytes );
+
+#endif
@@ -0,0 +1,233 @@
+#define _GNU_SOURCE
+
+#include "batch.h"
+
+#include "thread_pool.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DECODED_SUFFIX ".out" // Suffix for decoded files whose name lacks the encoded suffix.
+
+// Description:
+// A struct for one file of a batch.
+//
+// Members:
+// BatchFunction function - The function that processes the file.
+// char *input_file_name - The input file name.
+// char *output_file_name - The output file name.
+// uint64_t input_size - Bytes read from the input file.
+// uint64_t output_size - Bytes written to the output file.
+// bool ok - Whether the file was processed successfully.
+typedef struct BatchJob {
+	BatchFunction function;
+	char *input_file_name;
+	char *output_file_name;
+	uint64_t input_size;
+	uint64_t output_size;
+	bool ok;
+} BatchJob;
+
+// Description:
+// Reads a list of file names, one per line.
+//
+// Parameters:
+// char *list_file_name - The file with the list, or "-" for stdin.
+// uint32_t *count - The pointer to the uint32_t to set to the number of file names.
+//
+// Returns:
+// char ** - The file names, or NULL on failure.
+char **batch_read_file_list( char *list_file_name, uint32_t *count ) {
+	FILE *list = strcmp( list_file_name, "-" ) == 0 ? stdin : fopen( list_file_name, "r" );
+
+	if ( !list ) {
+		return NULL;
+	}
+
+	uint32_t capacity = 64;
+	char **file_names = ( char ** ) malloc( capacity * sizeof( char * ) );
+	char *line = NULL;
+	size_t line_capacity = 0;
+	ssize_t length;
+	*count = 0;
+
+	while ( file_names && ( length = getline( &line, &line_capacity, list ) ) != -1 ) {
+		if ( length > 0 && line[ length - 1 ] == '\n' ) {
+			line[ --length ] = '\0';
+		}
+
+		if ( length == 0 ) { // Skip blank lines.
+			continue;
+		}
+
+		if ( *count == capacity ) {
+			capacity *= 2;
+			char **grown = ( char ** ) realloc( file_names, capacity * sizeof( char * ) );
+
+			if ( !grown ) {
+				batch_delete_file_list( &file_names, *count );
+				break;
+			}
+
+			file_names = grown;
+		}
+
+		if ( !( file_names[ *count ] = strdup( line ) ) ) {
+			batch_delete_file_list( &file_names, *count );
+			break;
+		}
+
+		( *count )++;
+	}
+
+	free( line );
+
+	if ( list != stdin ) {
+		fclose( list );
+	}
+
+	return file_names;
+}
+
+// Description:
+// Frees a list of file names read by batch_read_file_list().
+//
+// Parameters:
+// char ***file_names - A pointer to the list of file names.
+// uint32_t count - The number of file names.
+//
+// Returns:
+// Nothing.
+void batch_delete_file_list( char ***file_names, uint32_t count ) {
+	if ( *file_names ) {
+		for ( uint32_t i = 0; i < count; i++ ) {
+			free( ( *file_names )[ i ] );
+		}
+
+		free( *file_names );
+		*file_names = NULL;
+	}
+}
+
+// Description:
+// Builds the output file name for an input file: the suffix is appended (or stripped,
+// when decoding), and the directory is replaced with the output directory if there is one.
+//
+// Parameters:
+// char *input_file_name - The input file name.
+// BatchOptions *options - The batch options.
+//
+// Returns:
+// char * - The newly allocated output file name.
+char *batch_output_file_name( char *input_file_name, BatchOptions *options ) {
+	char *base_name = input_file_name;
+
+	if ( options->output_dir ) {
+		char *slash = strrchr( input_file_name, '/' );
+		base_name = slash ? slash + 1 : input_file_name;
+	}
+
+	size_t base_length = strlen( base_name );
+	size_t suffix_length = strlen( options->suffix );
+	char *suffix = options->suffix;
+
+	if ( options->strip_suffix ) {
+		if ( base_length > suffix_length && strcmp( base_name + base_length - suffix_length, options->suffix ) == 0 ) {
+			base_length -= suffix_length;
+			suffix = "";
+		} else {
+			suffix = DECODED_SUFFIX;
+		}
+	}
+
+	char *output_file_name = NULL;
+	int length;
+
+	if ( options->output_dir ) {
+		length = asprintf( &output_file_name, "%s/%.*s%s", options->output_dir, ( int ) base_length, base_name, suffix );
+	} else {
+		length = asprintf( &output_file_name, "%.*s%s", ( int ) base_length, base_name, suffix );
+	}
+
+	return length == -1 ? NULL : output_file_name;
+}
+
+// Description:
+// Processes one file of a batch on a worker thread.
+//
+// Parameters:
+// void *arg - The BatchJob of the file.
+//
+// Returns:
+// Nothing.
+static void batch_run_job( void *arg ) {
+	BatchJob *job = ( BatchJob * ) arg;
+	job->ok = job->output_file_name && job->function( job->input_file_name, job->output_file_name, &job->input_size, &job->output_size );
+}
+
+// Description:
+// Processes many files concurrently on a work-stealing thread pool.
+//
+// Parameters:
+// char **input_file_names - The input file names.
+// uint32_t count - The number of input files.
+// BatchOptions *options - The batch options.
+// BatchFunction function - The function that processes each file.
+//
+// Returns:
+// uint32_t - The number of files that failed.
+uint32_t batch_run( char **input_file_names, uint32_t count, BatchOptions *options, BatchFunction function ) {
+	BatchJob *jobs = ( BatchJob * ) calloc( count, sizeof( BatchJob ) );
+
+	if ( !jobs ) {
+		return count;
+	}
+
+	struct timespec start, end;
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	ThreadPool *pool = thread_pool_create( options->threads ? options->threads : thread_pool_default_threads( ) );
+
+	for ( uint32_t i = 0; i < count; i++ ) {
+		jobs[ i ].function = function;
+		jobs[ i ].input_file_name = input_file_names[ i ];
+		jobs[ i ].output_file_name = batch_output_file_name( input_file_names[ i ], options );
+		thread_pool_submit( pool, batch_run_job, &jobs[ i ] );
+	}
+
+	thread_pool_delete( &pool );
+	clock_gettime( CLOCK_MONOTONIC, &end );
+
+	uint32_t failures = 0;
+	uint64_t input_size = 0;
+	uint64_t output_size = 0;
+
+	for ( uint32_t i = 0; i < count; i++ ) {
+		if ( jobs[ i ].ok ) {
+			input_size += jobs[ i ].input_size;
+			output_size += jobs[ i ].output_size;
+		} else {
+			fprintf( stderr, "Error: failed to process %s.\n", jobs[ i ].input_file_name );
+			failures++;
+		}
+
+		free( jobs[ i ].output_file_name );
+	}
+
+	free( jobs );
+
+	if ( options->verbose ) {
+		double seconds = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+		fprintf( stderr, "Files processed: %" PRIu32 " (%" PRIu32 " failed)\n", count - failures, failures );
+		fprintf( stderr, "Total input size: %" PRIu64 " bytes\n", input_size );
+		fprintf( stderr, "Total output size: %" PRIu64 " bytes\n", output_size );
+		fprintf( stderr, "Elapsed time: %.3f s\n", seconds );
+		fprintf( stderr, "Throughput: %.2f MB/s in, %.2f MB/s out, %.0f files/s\n", input_size / seconds / 1e6, output_size / seconds / 1e6, count / seconds );
+	}
+
+	return failures;
+}
@@ -0,0 +1,25 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef bool ( *BatchFunction )( char *input_file_name, char *output_file_name, uint64_t *input_size, uint64_t *output_size );
+
+typedef struct BatchOptions {
+	char *suffix;
+	bool strip_suffix;
+	char *output_dir;
+	uint32_t threads;
+	bool verbose;
+} BatchOptions;
+
+char **batch_read_file_list( char *list_file_name, uint32_t *count );
+
+void batch_delete_file_list( char ***file_names, uint32_t count );
+
+char *batch_output_file_name( char *input_file_name, BatchOptions *options );
+
+uint32_t batch_run( char **input_file_names, uint32_t count, BatchOptions *options, BatchFunction function );
+
+#endif
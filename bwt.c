@@ -0,0 +1,497 @@
+#include "bwt.h"
+
+#include "defines.h"
+#include "io.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BWT_ALPHABET ( ALPHABET + 1 ) // Bytes plus the end-of-block sentinel.
+#define RUN_A        0 // Zero-run digit worth 1 at its position.
+#define RUN_B        1 // Zero-run digit worth 2 at its position.
+#define MTF_ESCAPE   255 // Prefix of move-to-front indices 254 and 255.
+#define MTF_DIRECT   253 // Largest move-to-front index written as a single byte.
+
+#define IS_LMS( t, i ) ( ( i ) > 0 && ( t )[ i ] && !( t )[ ( i ) - 1 ] ) // Leftmost S-type position.
+
+// Description:
+// A struct for the buffers of the Burrows-Wheeler transform and its inverse,
+// allocated on first use and reused for every block.
+//
+// Members:
+// int32_t *text - The block as integers, followed by the sentinel.
+// int32_t *suffixes - The suffix array of text.
+// uint8_t *last - The last column of the sorted rotations.
+// uint32_t *next - For each sorted rotation, the one starting a byte later.
+struct Bwt {
+	int32_t *text;
+	int32_t *suffixes;
+	uint8_t *last;
+	uint32_t *next;
+};
+
+// Description:
+// Creates the buffers for transforming blocks of up to BWT_BLOCK bytes.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// Bwt * - A pointer to the newly created transform.
+Bwt *bwt_create( ) {
+	Bwt *b = ( Bwt * ) calloc( 1, sizeof( Bwt ) );
+
+	if ( b && !( b->last = ( uint8_t * ) malloc( BWT_BLOCK + 1 ) ) ) {
+		bwt_delete( &b );
+	}
+
+	return b;
+}
+
+// Description:
+// Frees the memory given to a transform.
+//
+// Parameters:
+// Bwt **b - A pointer to a pointer to the transform.
+//
+// Returns:
+// Nothing.
+void bwt_delete( Bwt **b ) {
+	if ( *b ) {
+		free( ( *b )->text );
+		free( ( *b )->suffixes );
+		free( ( *b )->last );
+		free( ( *b )->next );
+		free( *b );
+		*b = NULL;
+	}
+}
+
+// Description:
+// Finds the start or end of each character's bucket in a suffix array.
+//
+// Parameters:
+// const int32_t *s - The string.
+// int32_t n - The length of the string.
+// int32_t *buckets - The array to set to the bucket boundaries.
+// int32_t k - The size of the alphabet.
+// bool end - Whether to find the ends of the buckets rather than the starts.
+//
+// Returns:
+// Nothing.
+static void find_buckets( const int32_t *s, int32_t n, int32_t *buckets, int32_t k, bool end ) {
+	int32_t sum = 0;
+	memset( buckets, 0, k * sizeof( int32_t ) );
+
+	for ( int32_t i = 0; i < n; i++ ) {
+		buckets[ s[ i ] ]++;
+	}
+
+	for ( int32_t i = 0; i < k; i++ ) {
+		sum += buckets[ i ];
+		buckets[ i ] = end ? sum : sum - buckets[ i ];
+	}
+}
+
+// Description:
+// Induces the order of the L-type suffixes from sorted S-type ones, then the
+// order of the S-type suffixes from the L-type ones.
+//
+// Parameters:
+// const int32_t *s - The string.
+// int32_t *sa - The suffix array, holding the seed suffixes.
+// uint8_t *types - Whether each suffix is S-type.
+// int32_t n - The length of the string.
+// int32_t *buckets - Scratch space for the buckets.
+// int32_t k - The size of the alphabet.
+//
+// Returns:
+// Nothing.
+static void induce_suffixes( const int32_t *s, int32_t *sa, uint8_t *types, int32_t n, int32_t *buckets, int32_t k ) {
+	find_buckets( s, n, buckets, k, false );
+
+	for ( int32_t i = 0; i < n; i++ ) {
+		int32_t j = sa[ i ] - 1;
+
+		if ( sa[ i ] > 0 && !types[ j ] ) {
+			sa[ buckets[ s[ j ] ]++ ] = j;
+		}
+	}
+
+	find_buckets( s, n, buckets, k, true );
+
+	for ( int32_t i = n - 1; i >= 0; i-- ) {
+		int32_t j = sa[ i ] - 1;
+
+		if ( sa[ i ] > 0 && types[ j ] ) {
+			sa[ --buckets[ s[ j ] ] ] = j;
+		}
+	}
+}
+
+// Description:
+// Builds the suffix array of a string in linear time by induced sorting (SA-IS):
+// the LMS substrings are sorted by induction, named, and the reduced string of
+// names is sorted recursively if the names aren't unique.
+//
+// Parameters:
+// const int32_t *s - The string, ending with a unique 0 smaller than every other character.
+// int32_t *sa - The array to set to the suffix array.
+// int32_t n - The length of the string, at least 2.
+// int32_t k - The size of the alphabet.
+//
+// Returns:
+// bool - Whether there was enough memory.
+static bool build_suffix_array( const int32_t *s, int32_t *sa, int32_t n, int32_t k ) {
+	uint8_t *types = ( uint8_t * ) malloc( n );
+	int32_t *buckets = ( int32_t * ) malloc( k * sizeof( int32_t ) );
+	bool ok = types && buckets;
+
+	if ( !ok ) {
+		free( types );
+		free( buckets );
+
+		return false;
+	}
+
+	types[ n - 1 ] = 1;
+	types[ n - 2 ] = 0;
+
+	for ( int32_t i = n - 3; i >= 0; i-- ) {
+		types[ i ] = s[ i ] < s[ i + 1 ] || ( s[ i ] == s[ i + 1 ] && types[ i + 1 ] );
+	}
+
+	// Sort the LMS substrings.
+	find_buckets( s, n, buckets, k, true );
+
+	for ( int32_t i = 0; i < n; i++ ) {
+		sa[ i ] = -1;
+	}
+
+	for ( int32_t i = 1; i < n; i++ ) {
+		if ( IS_LMS( types, i ) ) {
+			sa[ --buckets[ s[ i ] ] ] = i;
+		}
+	}
+
+	induce_suffixes( s, sa, types, n, buckets, k );
+
+	// Name them, and put the reduced string at the end of sa.
+	int32_t n1 = 0;
+
+	for ( int32_t i = 0; i < n; i++ ) {
+		if ( IS_LMS( types, sa[ i ] ) ) {
+			sa[ n1++ ] = sa[ i ];
+		}
+	}
+
+	for ( int32_t i = n1; i < n; i++ ) {
+		sa[ i ] = -1;
+	}
+
+	int32_t names = 0;
+	int32_t previous = -1;
+
+	for ( int32_t i = 0; i < n1; i++ ) {
+		int32_t position = sa[ i ];
+		bool differs = false;
+
+		for ( int32_t d = 0; d < n; d++ ) {
+			if ( previous == -1 || s[ position + d ] != s[ previous + d ] || types[ position + d ] != types[ previous + d ] ) {
+				differs = true;
+
+				break;
+			} else if ( d > 0 && ( IS_LMS( types, position + d ) || IS_LMS( types, previous + d ) ) ) {
+				break;
+			}
+		}
+
+		if ( differs ) {
+			names++;
+			previous = position;
+		}
+
+		sa[ n1 + position / 2 ] = names - 1;
+	}
+
+	for ( int32_t i = n - 1, j = n - 1; i >= n1; i-- ) {
+		if ( sa[ i ] >= 0 ) {
+			sa[ j-- ] = sa[ i ];
+		}
+	}
+
+	// Sort the reduced string.
+	int32_t *s1 = sa + n - n1;
+
+	if ( names < n1 ) {
+		ok = build_suffix_array( s1, sa, n1, names );
+	} else {
+		for ( int32_t i = 0; i < n1; i++ ) {
+			sa[ s1[ i ] ] = i;
+		}
+	}
+
+	// Induce the whole suffix array from the sorted LMS suffixes.
+	if ( ok ) {
+		find_buckets( s, n, buckets, k, true );
+
+		for ( int32_t i = 1, j = 0; i < n; i++ ) {
+			if ( IS_LMS( types, i ) ) {
+				s1[ j++ ] = i;
+			}
+		}
+
+		for ( int32_t i = 0; i < n1; i++ ) {
+			sa[ i ] = s1[ sa[ i ] ];
+		}
+
+		for ( int32_t i = n1; i < n; i++ ) {
+			sa[ i ] = -1;
+		}
+
+		for ( int32_t i = n1 - 1; i >= 0; i-- ) {
+			int32_t j = sa[ i ];
+			sa[ i ] = -1;
+			sa[ --buckets[ s[ j ] ] ] = j;
+		}
+
+		induce_suffixes( s, sa, types, n, buckets, k );
+	}
+
+	free( types );
+	free( buckets );
+
+	return ok;
+}
+
+// Description:
+// Writes a run of zero move-to-front indices as bijective base-2 digits, least
+// significant first, so a run of length r takes about log2(r) bytes.
+//
+// Parameters:
+// uint32_t run - The length of the run.
+// uint8_t *out - Where to write the digits.
+//
+// Returns:
+// uint8_t * - Where the digits end.
+static uint8_t *write_run( uint32_t run, uint8_t *out ) {
+	while ( run != 0 ) {
+		if ( run & 1 ) {
+			*out++ = RUN_A;
+			run = ( run - 1 ) / 2;
+		} else {
+			*out++ = RUN_B;
+			run = ( run - 2 ) / 2;
+		}
+	}
+
+	return out;
+}
+
+// Description:
+// Transforms a block: Burrows-Wheeler transform, then move-to-front, then runs
+// of zeros written as RUN_A/RUN_B digits. Other indices are shifted up by one to
+// make room, with MTF_ESCAPE in front of the two largest.
+//
+// Parameters:
+// Bwt *b - The transform.
+// uint8_t *in - The block.
+// uint32_t nbytes - The size of the block, from 1 to BWT_BLOCK.
+// uint8_t *out - Where to write the block header and coded block, BWT_CODED_MAX(nbytes) bytes.
+//
+// Returns:
+// uint32_t - The number of bytes written, or 0 if out of memory.
+uint32_t bwt_forward( Bwt *b, uint8_t *in, uint32_t nbytes, uint8_t *out ) {
+	if ( !b->text ) {
+		b->text = ( int32_t * ) malloc( ( BWT_BLOCK + 1 ) * sizeof( int32_t ) );
+		b->suffixes = ( int32_t * ) malloc( ( BWT_BLOCK + 1 ) * sizeof( int32_t ) );
+	}
+
+	if ( !b->text || !b->suffixes ) {
+		return 0;
+	}
+
+	for ( uint32_t i = 0; i < nbytes; i++ ) {
+		b->text[ i ] = in[ i ] + 1;
+	}
+
+	b->text[ nbytes ] = 0;
+
+	if ( !build_suffix_array( b->text, b->suffixes, nbytes + 1, BWT_ALPHABET ) ) {
+		return 0;
+	}
+
+	uint32_t primary = 0;
+
+	for ( uint32_t i = 0, j = 0; i <= nbytes; i++ ) { // The sentinel's row is left out and recorded instead.
+		if ( b->suffixes[ i ] == 0 ) {
+			primary = i;
+		} else {
+			b->last[ j++ ] = in[ b->suffixes[ i ] - 1 ];
+		}
+	}
+
+	uint8_t order[ ALPHABET ];
+	uint8_t *p = out + BWT_HEADER_SIZE;
+	uint32_t run = 0;
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		order[ i ] = i;
+	}
+
+	for ( uint32_t i = 0; i < nbytes; i++ ) {
+		uint8_t c = b->last[ i ];
+
+		if ( order[ 0 ] == c ) {
+			run++;
+
+			continue;
+		}
+
+		p = write_run( run, p );
+		run = 0;
+		uint32_t index = ( uint8_t * ) memchr( order, c, ALPHABET ) - order;
+		memmove( order + 1, order, index );
+		order[ 0 ] = c;
+
+		if ( index <= MTF_DIRECT ) {
+			*p++ = index + 1;
+		} else {
+			*p++ = MTF_ESCAPE;
+			*p++ = index - MTF_DIRECT - 1;
+		}
+	}
+
+	p = write_run( run, p );
+	store_little_endian( out, nbytes, 4 );
+	store_little_endian( out + 4, primary, 4 );
+	store_little_endian( out + 8, p - out - BWT_HEADER_SIZE, 4 );
+
+	return p - out;
+}
+
+// Description:
+// Parses and checks the header of a transformed block.
+//
+// Parameters:
+// uint8_t header[static BWT_HEADER_SIZE] - The header.
+// uint32_t *nbytes - The pointer to the uint32_t to set to the size of the block.
+// uint32_t *primary - The pointer to the uint32_t to set to the row of the sentinel.
+// uint32_t *ncoded - The pointer to the uint32_t to set to the size of the coded block.
+//
+// Returns:
+// bool - Whether the header is valid.
+bool bwt_parse_header( uint8_t header[ static BWT_HEADER_SIZE ], uint32_t *nbytes, uint32_t *primary, uint32_t *ncoded ) {
+	*nbytes = load_little_endian( header, 4 );
+	*primary = load_little_endian( header + 4, 4 );
+	*ncoded = load_little_endian( header + 8, 4 );
+
+	return *nbytes != 0 && *nbytes <= BWT_BLOCK && *primary <= *nbytes && *ncoded <= BWT_CODED_MAX( *nbytes ) - BWT_HEADER_SIZE;
+}
+
+// Description:
+// Undoes bwt_forward() for one block.
+//
+// Parameters:
+// Bwt *b - The transform.
+// uint8_t *coded - The coded block, after its header.
+// uint32_t ncoded - The size of the coded block.
+// uint32_t nbytes - The size of the block, from its header.
+// uint32_t primary - The row of the sentinel, from its header.
+// uint8_t *out - Where to write the block.
+//
+// Returns:
+// bool - Whether the coded block was valid (false also if out of memory).
+bool bwt_inverse( Bwt *b, uint8_t *coded, uint32_t ncoded, uint32_t nbytes, uint32_t primary, uint8_t *out ) {
+	if ( !b->next && !( b->next = ( uint32_t * ) malloc( ( BWT_BLOCK + 1 ) * sizeof( uint32_t ) ) ) ) {
+		return false;
+	}
+
+	uint8_t order[ ALPHABET ];
+	uint32_t filled = 0;
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		order[ i ] = i;
+	}
+
+	for ( uint32_t i = 0; i < ncoded; ) {
+		uint32_t c = coded[ i++ ];
+
+		if ( c == RUN_A || c == RUN_B ) {
+			uint64_t run = 0;
+
+			for ( uint32_t weight = 1;; weight <<= 1 ) {
+				run += ( uint64_t ) ( c + 1 ) * weight;
+
+				if ( run > nbytes - filled || i == ncoded || coded[ i ] > RUN_B ) {
+					break;
+				}
+
+				c = coded[ i++ ];
+			}
+
+			if ( run > nbytes - filled ) {
+				return false;
+			}
+
+			memset( b->last + filled, order[ 0 ], run );
+			filled += run;
+
+			continue;
+		}
+
+		uint32_t index = c - 1;
+
+		if ( c == MTF_ESCAPE ) {
+			if ( i == ncoded || coded[ i ] > ALPHABET - 1 - MTF_DIRECT - 1 ) {
+				return false;
+			}
+
+			index = MTF_DIRECT + 1 + coded[ i++ ];
+		}
+
+		if ( filled == nbytes ) {
+			return false;
+		}
+
+		uint8_t symbol = order[ index ];
+		memmove( order + 1, order, index );
+		order[ 0 ] = symbol;
+		b->last[ filled++ ] = symbol;
+	}
+
+	if ( filled != nbytes ) {
+		return false;
+	}
+
+	// Put the sentinel's row back, then link each row to the row one byte later.
+	uint32_t buckets[ ALPHABET ] = { 0 };
+	memmove( b->last + primary + 1, b->last + primary, nbytes - primary );
+
+	for ( uint32_t i = 0; i <= nbytes; i++ ) {
+		buckets[ b->last[ i ] ] += i != primary;
+	}
+
+	for ( uint32_t i = 0, sum = 1; i < ALPHABET; i++ ) { // Row 0 is the sentinel's.
+		uint32_t count = buckets[ i ];
+		buckets[ i ] = sum;
+		sum += count;
+	}
+
+	b->next[ 0 ] = primary;
+
+	for ( uint32_t i = 0; i <= nbytes; i++ ) {
+		if ( i != primary ) {
+			b->next[ buckets[ b->last[ i ] ]++ ] = i;
+		}
+	}
+
+	for ( uint32_t i = 0, row = b->next[ primary ]; i < nbytes; i++ ) {
+		out[ i ] = b->last[ row ];
+		row = b->next[ row ];
+	}
+
+	return true;
+}
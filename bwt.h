@@ -0,0 +1,25 @@
+#ifndef __BWT_H__
+#define __BWT_H__
+
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BWT_BLOCK                ( 256 * BLOCK ) // 1MB of input per transformed block.
+#define BWT_HEADER_SIZE          12 // Block size, primary index and coded size, 32 bits each.
+#define BWT_CODED_MAX( nbytes ) ( BWT_HEADER_SIZE + 2 * ( nbytes ) ) // Most bytes a block can be coded to.
+
+typedef struct Bwt Bwt;
+
+Bwt *bwt_create( );
+
+void bwt_delete( Bwt **b );
+
+uint32_t bwt_forward( Bwt *b, uint8_t *in, uint32_t nbytes, uint8_t *out );
+
+bool bwt_parse_header( uint8_t header[ static BWT_HEADER_SIZE ], uint32_t *nbytes, uint32_t *primary, uint32_t *ncoded );
+
+bool bwt_inverse( Bwt *b, uint8_t *coded, uint32_t ncoded, uint32_t nbytes, uint32_t primary, uint8_t *out );
+
+#endif
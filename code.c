@@ -4,6 +4,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 // Description:
 // Checks if a code is empty.
@@ -73,3 +74,81 @@ bool code_pop_bit( Code *c, uint8_t *bit ) {
 
 	return true;
 }
+
+// Description:
+// Packs a table of codes into 64-bit words for the bit accumulator. Only codes up
+// to MAX_PACKED_CODE bits are packed; longer ones are still written from the table.
+//
+// Parameters:
+// Code table[static ALPHABET] - The table of codes.
+// PackedCodes *packed - The packed codes to fill in.
+//
+// Returns:
+// Nothing.
+void code_table_pack( Code table[ static ALPHABET ], PackedCodes *packed ) {
+	packed->max_length = 0;
+	packed->table = table;
+	packed->pairs = NULL;
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		uint64_t bits = 0;
+		uint32_t length = table[ i ].top;
+
+		for ( uint32_t j = 0; j < sizeof( bits ); j++ ) { // Bit i of the code becomes bit i of the word.
+			bits |= ( uint64_t ) table[ i ].bytes[ j ] << ( 8 * j );
+		}
+
+		packed->bits[ i ] = length >= 64 ? bits : bits & ( ( ( uint64_t ) 1 << length ) - 1 ); // Drop stale bits past the end of the code.
+		packed->length[ i ] = length;
+
+		if ( length > packed->max_length ) {
+			packed->max_length = length;
+		}
+	}
+}
+
+// Description:
+// Builds the pair table of packed codes, so the encode kernels can append the
+// codes of two symbols at once. It has an entry for every two consecutive
+// bytes, first byte lowest: the two codes, first code lowest, shifted above
+// PAIR_LENGTH_BITS bits of their total length. The entry is zero if the codes
+// are longer than MAX_PAIR_CODE bits together.
+//
+// Parameters:
+// PackedCodes *packed - The packed codes to build the pair table of.
+//
+// Returns:
+// bool - Whether there was enough memory.
+bool code_pairs_create( PackedCodes *packed ) {
+	if ( !( packed->pairs = ( uint32_t * ) malloc( ALPHABET * ALPHABET * sizeof( uint32_t ) ) ) ) {
+		return false;
+	}
+
+	for ( uint32_t second = 0; second < ALPHABET; second++ ) {
+		for ( uint32_t first = 0; first < ALPHABET; first++ ) {
+			uint32_t length = packed->length[ first ] + packed->length[ second ];
+			uint32_t entry = 0;
+
+			if ( length <= MAX_PAIR_CODE ) {
+				entry = ( uint32_t ) ( packed->bits[ first ] | packed->bits[ second ] << packed->length[ first ] ) << PAIR_LENGTH_BITS | length;
+			}
+
+			packed->pairs[ second << 8 | first ] = entry;
+		}
+	}
+
+	return true;
+}
+
+// Description:
+// Frees the pair table of packed codes, if it has one.
+//
+// Parameters:
+// PackedCodes *packed - The packed codes.
+//
+// Returns:
+// Nothing.
+void code_pairs_delete( PackedCodes *packed ) {
+	free( packed->pairs );
+	packed->pairs = NULL;
+}
@@ -11,6 +11,14 @@ typedef struct Code {
 	uint8_t bytes[ MAX_CODE_SIZE ];
 } Code;
 
+typedef struct PackedCodes {
+	uint64_t bits[ ALPHABET ];
+	uint16_t length[ ALPHABET ];
+	uint16_t max_length;
+	Code *table;
+	uint32_t *pairs;
+} PackedCodes;
+
 bool code_empty( Code *c );
 
 bool code_full( Code *c );
@@ -19,4 +27,10 @@ bool code_push_bit( Code *c, uint8_t bit );
 
 bool code_pop_bit( Code *c, uint8_t *bit );
 
+void code_table_pack( Code table[ static ALPHABET ], PackedCodes *packed );
+
+bool code_pairs_create( PackedCodes *packed );
+
+void code_pairs_delete( PackedCodes *packed );
+
 #endif
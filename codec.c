@@ -0,0 +1,353 @@
+#include "codec.h"
+
+#include "code.h"
+#include "container.h"
+#include "decode_table.h"
+#include "defines.h"
+#include "dictionary.h"
+#include "file_header.h"
+#include "huffman.h"
+#include "io.h"
+#include "kernels.h"
+#include "raw_file_header.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CODEC_STEP ( 1u << 30 ) // Most symbols handed to a kernel at once.
+
+// Description:
+// Makes sure a buffer can hold a number of bytes, plus CODEC_SLACK zeroed bytes
+// after them. Keeps the buffer's memory if it's already big enough.
+//
+// Parameters:
+// CodecBuffer *b - The buffer.
+// uint64_t capacity - The number of bytes it has to hold.
+//
+// Returns:
+// bool - Whether the buffer is big enough.
+bool codec_buffer_reserve( CodecBuffer *b, uint64_t capacity ) {
+	if ( capacity > b->capacity || !b->data ) {
+		uint8_t *data = ( uint8_t * ) realloc( b->data, capacity + CODEC_SLACK );
+
+		if ( !data ) {
+			return false;
+		}
+
+		b->data = data;
+		b->capacity = capacity;
+	}
+
+	memset( b->data + capacity, 0, CODEC_SLACK );
+
+	return true;
+}
+
+// Description:
+// Frees the memory given to a buffer.
+//
+// Parameters:
+// CodecBuffer *b - The buffer.
+//
+// Returns:
+// Nothing.
+void codec_buffer_release( CodecBuffer *b ) {
+	free( b->data );
+	b->data = NULL;
+	b->size = 0;
+	b->capacity = 0;
+}
+
+// Description:
+// Creates the cached code and decode tables of a dictionary, so requests that use
+// it don't rebuild them.
+//
+// Parameters:
+// Dictionary *dictionary - The dictionary, now owned by the cached dictionary.
+//
+// Returns:
+// CodecDictionary * - A pointer to the newly created cached dictionary.
+CodecDictionary *codec_dictionary_create( Dictionary *dictionary ) {
+	CodecDictionary *d = ( CodecDictionary * ) calloc( 1, sizeof( CodecDictionary ) );
+
+	if ( !d ) {
+		return NULL;
+	}
+
+	d->dictionary = dictionary;
+	code_table_pack( dictionary->table, &d->codes );
+
+	if ( !( d->table = decode_table_create( dictionary->tree ) ) ) {
+		free( d );
+
+		return NULL;
+	}
+
+	return d;
+}
+
+// Description:
+// Frees the memory given to a cached dictionary, and its dictionary.
+//
+// Parameters:
+// CodecDictionary **d - A pointer to a pointer to the cached dictionary.
+//
+// Returns:
+// Nothing.
+void codec_dictionary_delete( CodecDictionary **d ) {
+	if ( *d ) {
+		decode_table_delete( &( *d )->table );
+		dictionary_delete( &( *d )->dictionary );
+		free( *d );
+		*d = NULL;
+	}
+}
+
+// Description:
+// Encodes symbols with codes too long for the encode kernels, a byte of each code
+// at a time.
+//
+// Parameters:
+// PackedCodes *codes - The codes.
+// uint8_t *symbols - The symbols.
+// uint64_t nsymbols - The number of symbols.
+// uint8_t *out - Where to write the codes, padded to a whole byte.
+//
+// Returns:
+// uint64_t - The number of bytes written.
+static uint64_t encode_long_codes( PackedCodes *codes, uint8_t *symbols, uint64_t nsymbols, uint8_t *out ) {
+	uint8_t *start = out;
+	uint64_t bits = 0;
+	uint32_t count = 0;
+
+	for ( uint64_t i = 0; i < nsymbols; i++ ) {
+		Code *c = &codes->table[ symbols[ i ] ];
+
+		for ( uint32_t j = 0; j < c->top; j += 8 ) {
+			uint32_t length = c->top - j < 8 ? c->top - j : 8;
+			bits |= ( uint64_t ) ( c->bytes[ j / 8 ] & ( ( 1u << length ) - 1 ) ) << count;
+			count += length;
+
+			if ( count >= 8 ) {
+				*out++ = bits;
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+	}
+
+	if ( count != 0 ) {
+		*out++ = bits;
+	}
+
+	return out - start;
+}
+
+// Description:
+// Compresses a buffer into the same format huffman_encode writes: with a tree of
+// its own, or with the header of a dictionary if one is given.
+//
+// Parameters:
+// uint8_t *in - The bytes to compress.
+// uint64_t nbytes - The number of bytes.
+// CodecDictionary *dictionary - The dictionary to encode with, or NULL.
+// CodecBuffer *out - The buffer to set to the compressed bytes.
+//
+// Returns:
+// CodecStatus - CODEC_OK, or CODEC_NO_MEMORY.
+CodecStatus codec_compress( uint8_t *in, uint64_t nbytes, CodecDictionary *dictionary, CodecBuffer *out ) {
+	uint64_t histogram[ ALPHABET ] = { 0 };
+	uint8_t header[ sizeof( RawFileHeader ) + MAX_TREE_SIZE ];
+	uint32_t header_size = 0;
+	Code table[ ALPHABET ] = { 0 };
+	PackedCodes own_codes;
+	PackedCodes *codes = &own_codes;
+	histogram_update( histogram, in, nbytes );
+
+	if ( dictionary ) {
+		codes = &dictionary->codes;
+		header_size = dictionary_file_header_create( dictionary->dictionary, nbytes, header );
+	} else {
+		Node *tree = build_tree( histogram );
+		build_codes( tree, table );
+		code_table_pack( table, &own_codes );
+		FileHeader file_header = { MAGIC, 0, nbytes };
+		header_size = sizeof( RawFileHeader ) + dump_tree( tree, header + sizeof( RawFileHeader ) );
+		file_header.tree_size = header_size - sizeof( RawFileHeader );
+		RawFileHeader raw_header = raw_file_header_create( file_header );
+		memcpy( header, &raw_header, sizeof( raw_header ) );
+		delete_tree( &tree );
+	}
+
+	uint64_t nbits = 0;
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		nbits += histogram[ i ] * codes->length[ i ];
+	}
+
+	if ( !codec_buffer_reserve( out, header_size + ( nbits + 7 ) / 8 + 8 ) ) { // The encode kernel may store a word past the last byte.
+		return CODEC_NO_MEMORY;
+	}
+
+	memcpy( out->data, header, header_size );
+	uint8_t *p = out->data + header_size;
+
+	if ( codes->max_length <= MAX_PACKED_CODE ) {
+		uint64_t bits = 0;
+		uint32_t count = 0;
+
+		for ( uint64_t i = 0; i < nbytes; i += CODEC_STEP ) {
+			p += encode_symbols( codes, in + i, nbytes - i < CODEC_STEP ? nbytes - i : CODEC_STEP, p, &bits, &count );
+		}
+
+		if ( count != 0 ) {
+			*p++ = bits;
+		}
+	} else {
+		p += encode_long_codes( codes, in, nbytes, p );
+	}
+
+	out->size = p - out->data;
+
+	return CODEC_OK;
+}
+
+// Description:
+// A struct for the buffer a decompressed result goes to, with its limit.
+//
+// Members:
+// CodecBuffer *buffer - The buffer.
+// uint64_t max_size - The largest decompressed size to allow.
+// bool too_large - Whether more than max_size bytes were asked for.
+typedef struct CodecOutput {
+	CodecBuffer *buffer;
+	uint64_t max_size;
+	bool too_large;
+} CodecOutput;
+
+// Description:
+// Makes room in the buffer of a decompressed result, for the output decoding
+// into it. The buffer grows by doubling, up to the limit.
+//
+// Parameters:
+// void *context - The CodecOutput.
+// uint64_t nbytes - The number of bytes needed.
+// uint64_t *reserved - The pointer to the uint64_t to set to the number of bytes there's room for.
+//
+// Returns:
+// uint8_t * - The buffer's memory, or NULL if it's too large or out of memory.
+static uint8_t *reserve_output( void *context, uint64_t nbytes, uint64_t *reserved ) {
+	CodecOutput *o = ( CodecOutput * ) context;
+
+	if ( nbytes > o->max_size ) {
+		o->too_large = true;
+
+		return NULL;
+	}
+
+	uint64_t capacity = nbytes > o->buffer->capacity ? 2 * o->buffer->capacity : o->buffer->capacity;
+	capacity = capacity < nbytes ? nbytes : capacity < o->max_size ? capacity : o->max_size;
+
+	if ( !codec_buffer_reserve( o->buffer, capacity ) ) {
+		return NULL;
+	}
+
+	*reserved = capacity;
+
+	return o->buffer->data;
+}
+
+// Description:
+// Decompresses a buffer in any format huffman_encode writes, including archives,
+// records and files joined with cat. The formats are parsed by the same code
+// huffman_decode uses, over the buffer instead of a file.
+//
+// Parameters:
+// uint8_t *in - The bytes to decompress, followed by CODEC_SLACK readable bytes.
+// uint64_t nbytes - The number of bytes.
+// CodecDictionary **dictionaries - The dictionaries files encoded with one may use.
+// uint32_t ndictionaries - The number of dictionaries.
+// uint64_t max_size - The largest decompressed size to allow.
+// CodecBuffer *out - The buffer to set to the decompressed bytes.
+//
+// Returns:
+// CodecStatus - CODEC_OK, or why the buffer couldn't be decompressed.
+CodecStatus codec_decompress( uint8_t *in, uint64_t nbytes, CodecDictionary **dictionaries, uint32_t ndictionaries, uint64_t max_size, CodecBuffer *out ) {
+	BitReader *reader = bit_reader_create_memory( in, nbytes );
+	CodecOutput context = { out, max_size, false };
+	Container container;
+	uint64_t compressed_size = 0;
+	out->size = 0;
+
+	if ( !reader ) {
+		return CODEC_NO_MEMORY;
+	}
+
+	if ( container_read_header( reader, &container, &compressed_size ) != CONTAINER_OK ) {
+		bit_reader_delete( &reader );
+
+		return CODEC_CORRUPT;
+	}
+
+	for ( uint32_t i = 0; i < ndictionaries && container.header.magic_number == MAGIC_DICTIONARY; i++ ) {
+		if ( dictionaries[ i ]->dictionary->id == container.dictionary_id ) {
+			container.dictionary_tree = dictionaries[ i ]->dictionary->tree;
+			container.dictionary_table = dictionaries[ i ]->table;
+		}
+	}
+
+	if ( container.header.magic_number == MAGIC_DICTIONARY && !container.dictionary_tree ) {
+		bit_reader_delete( &reader );
+
+		return CODEC_NO_DICTIONARY;
+	}
+
+	Output *output = container.size == OUTPUT_UNKNOWN_SIZE || container.size <= max_size ? output_create_memory( container.size, reserve_output, &context ) : NULL;
+	ContainerStatus status = output ? container_decode( reader, output, &container, &compressed_size ) : CONTAINER_NO_ROOM;
+	bool written = output && output_finish( output );
+	output_delete( &output );
+	bit_reader_delete( &reader );
+
+	if ( context.too_large || ( container.size != OUTPUT_UNKNOWN_SIZE && container.size > max_size ) ) {
+		return CODEC_TOO_LARGE;
+	}
+
+	if ( status == CONTAINER_NO_ROOM || ( status == CONTAINER_OK && !written ) ) {
+		return CODEC_NO_MEMORY;
+	}
+
+	if ( status == CONTAINER_UNJOINABLE ) {
+		return CODEC_UNJOINABLE;
+	}
+
+	if ( status != CONTAINER_OK ) {
+		return CODEC_CORRUPT;
+	}
+
+	out->size = container.size;
+
+	return CODEC_OK;
+}
+
+// Description:
+// Gets a message describing a codec status.
+//
+// Parameters:
+// CodecStatus status - The status.
+//
+// Returns:
+// char * - The message.
+char *codec_status_message( CodecStatus status ) {
+	switch ( status ) {
+	case CODEC_OK: return "success";
+	case CODEC_CORRUPT: return "input file corrupted";
+	case CODEC_NO_DICTIONARY: return "dictionary not available";
+	case CODEC_TOO_LARGE: return "input too large";
+	case CODEC_NO_MEMORY: return "out of memory";
+	case CODEC_UNJOINABLE: return "input joins a file that can't be joined with cat";
+	}
+
+	return "unknown error";
+}
@@ -0,0 +1,41 @@
+#ifndef __CODEC_H__
+#define __CODEC_H__
+
+#include "code.h"
+#include "decode_table.h"
+#include "dictionary.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CODEC_SLACK 8 // Zeroed bytes kept after a buffer's contents, for word loads past the end.
+
+typedef enum CodecStatus { CODEC_OK, CODEC_CORRUPT, CODEC_NO_DICTIONARY, CODEC_TOO_LARGE, CODEC_NO_MEMORY, CODEC_UNJOINABLE } CodecStatus;
+
+typedef struct CodecBuffer {
+	uint8_t *data;
+	uint64_t size;
+	uint64_t capacity;
+} CodecBuffer;
+
+typedef struct CodecDictionary {
+	Dictionary *dictionary;
+	PackedCodes codes;
+	DecodeTable *table;
+} CodecDictionary;
+
+bool codec_buffer_reserve( CodecBuffer *b, uint64_t capacity );
+
+void codec_buffer_release( CodecBuffer *b );
+
+CodecDictionary *codec_dictionary_create( Dictionary *dictionary );
+
+void codec_dictionary_delete( CodecDictionary **d );
+
+CodecStatus codec_compress( uint8_t *in, uint64_t nbytes, CodecDictionary *dictionary, CodecBuffer *out );
+
+CodecStatus codec_decompress( uint8_t *in, uint64_t nbytes, CodecDictionary **dictionaries, uint32_t ndictionaries, uint64_t max_size, CodecBuffer *out );
+
+char *codec_status_message( CodecStatus status );
+
+#endif
@@ -0,0 +1,1109 @@
+#include "container.h"
+
+#include "ans.h"
+#include "archive.h"
+#include "bwt.h"
+#include "decode_table.h"
+#include "defines.h"
+#include "dictionary.h"
+#include "file_header.h"
+#include "huffman.h"
+#include "io.h"
+#include "kernels.h"
+#include "lz.h"
+#include "output.h"
+#include "parallel_decode.h"
+#include "raw_file_header.h"
+#include "records.h"
+#include "split.h"
+#include "stats.h"
+#include "stream.h"
+#include "stride.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef enum Trailer { TRAILER_NONE, TRAILER_MEMBER, TRAILER_UNJOINABLE } Trailer; // What follows a decoded file.
+
+static uint32_t decode_threads = 1; // Threads to decode a single large file with.
+static Stats *stats = NULL; // Per-phase timings, if they're kept.
+
+// Description:
+// Sets how files are decoded from then on.
+//
+// Parameters:
+// uint32_t threads - Threads to decode a single large file with, from a seekable input file.
+// Stats *s - Where to keep per-phase timings, or NULL.
+//
+// Returns:
+// Nothing.
+void container_configure( uint32_t threads, Stats *s ) {
+	decode_threads = threads;
+	stats = s;
+}
+
+// Description:
+// Checks whether a magic number is that of a file coded on its own, which may
+// make up a segment of an archive or follow another file joined with cat.
+//
+// Parameters:
+// uint32_t magic_number - The magic number.
+//
+// Returns:
+// bool - Whether it's a file coded on its own.
+static bool is_member( uint32_t magic_number ) {
+	return magic_number == MAGIC || magic_number == MAGIC_STORED || magic_number == MAGIC_BWT || magic_number == MAGIC_ANS || magic_number == MAGIC_STRIDE || magic_number == MAGIC_LZ;
+}
+
+// Description:
+// Creates a parallel decoder for the code section of the input file, if it's
+// worth splitting into segments: the input has to be a regular file, with at
+// least two segments of codes and two segments' worth of symbols to decode (the
+// codes may be followed by another file's, so their size isn't known).
+//
+// Parameters:
+// int input_file - The input file, or -1 if the input is in memory.
+// uint64_t code_offset - Offset of the code section in the input file.
+// uint64_t nsymbols - The number of symbols to decode.
+// DecodeTable *table - The decode table.
+//
+// Returns:
+// ParallelDecoder * - The parallel decoder, or NULL to decode serially.
+static ParallelDecoder *create_parallel_decoder( int input_file, uint64_t code_offset, uint64_t nsymbols, DecodeTable *table ) {
+	struct stat input_file_stats;
+
+	if ( input_file == -1 || decode_threads < 2 || nsymbols < 2 * ( uint64_t ) PARALLEL_SEGMENT || fstat( input_file, &input_file_stats ) == -1 || !S_ISREG( input_file_stats.st_mode ) ) {
+		return NULL;
+	}
+
+	if ( ( uint64_t ) input_file_stats.st_size < code_offset + 2 * ( uint64_t ) PARALLEL_SEGMENT ) {
+		return NULL;
+	}
+
+	return parallel_decoder_create( input_file, code_offset, input_file_stats.st_size - code_offset, table, decode_threads );
+}
+
+// Description:
+// Decodes a number of symbols from the bit reader.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file.
+// DecodeTable *table - The decode table of the tree, or NULL if the tree has a single leaf.
+// Node *huffman_tree - The Huffman tree used to find symbols.
+// uint8_t *out - Where to write the symbols.
+// uint32_t nsymbols - The number of symbols to decode.
+// bool *corrupt - The pointer to the bool to set if the codes are invalid or end early.
+//
+// Returns:
+// uint32_t - The number of symbols decoded.
+static uint32_t read_symbols( BitReader *reader, DecodeTable *table, Node *huffman_tree, uint8_t *out, uint32_t nsymbols, bool *corrupt ) {
+	if ( !table ) {
+		memset( out, huffman_tree->symbol, nsymbols ); // Every symbol is the same, and has no bits.
+
+		return nsymbols;
+	}
+
+	BitWindow bits;
+	uint32_t decoded = 0;
+
+	while ( decoded < nsymbols && !*corrupt && bit_reader_window( reader, &bits ) ) {
+		decoded += decode_symbols( table, &bits, out + decoded, nsymbols - decoded, corrupt );
+		bit_reader_commit( reader, &bits );
+	}
+
+	if ( decoded < nsymbols ) { // Input ended before the last symbol.
+		*corrupt = true;
+	}
+
+	return decoded;
+}
+
+// Description:
+// Decodes codes read from the file and writes the decoded symbol to the output file.
+// Large files are decoded in parallel from the input file.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file.
+// Output *output - The output for the output file.
+// Node *huffman_tree - The Huffman tree used to find symbols.
+// DecodeTable *cached_table - The decode table of the tree if it's already built, such as a dictionary's, or NULL.
+// uint64_t file_size - The size of the decoded file in bytes.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes written to.
+//
+// Returns:
+// bool - Whether the codes were able to be decoded.
+static bool write_decoded_codes( BitReader *reader, Output *output, Node *huffman_tree, DecodeTable *cached_table, uint64_t file_size, uint64_t *compressed_size ) {
+	if ( !huffman_tree ) { // Empty tree, only valid for an empty file.
+		return file_size == 0;
+	}
+
+	uint64_t start = bit_reader_tell( reader );
+	uint64_t symbols_written = 0;
+	DecodeTable *table = cached_table;
+	bool corrupt = false;
+
+	if ( !table && ( huffman_tree->left || huffman_tree->right ) ) { // Root node is not a leaf. (Root node is a leaf when there is only one unique symbol.)
+		stats_phase( stats, "decode_table" );
+
+		if ( !( table = decode_table_create( huffman_tree ) ) ) {
+			stats_phase( stats, NULL );
+
+			return false;
+		}
+	}
+
+	stats_phase( stats, "decode" );
+	ParallelDecoder *parallel = table ? create_parallel_decoder( bit_reader_file( reader ), start / 8, file_size, table ) : NULL;
+
+	if ( parallel ) { // Segments of the code section are decoded from guessed boundaries, then stitched.
+		uint64_t nbits = 0;
+		corrupt = !parallel_decoder_decode( parallel, output, file_size, &nbits );
+		symbols_written = file_size;
+		bit_reader_skip( reader, nbits ); // Another file may follow.
+		parallel_decoder_delete( &parallel );
+	}
+
+	while ( symbols_written < file_size && !corrupt ) {
+		uint32_t wanted = 0;
+		uint8_t *window = output_window( output, &wanted );
+		wanted = wanted < file_size - symbols_written ? wanted : file_size - symbols_written; // The output may go on past this file, in an archive.
+		uint32_t decoded = read_symbols( reader, table, huffman_tree, window, wanted, &corrupt );
+		output_commit( output, decoded );
+		symbols_written += decoded;
+	}
+
+	stats_phase( stats, NULL );
+
+	if ( table != cached_table ) {
+		decode_table_delete( &table );
+	}
+
+	*compressed_size += ( bit_reader_tell( reader ) - start + 7 ) / 8; // Add total bytes read for codes.
+
+	return !corrupt;
+}
+
+// Description:
+// Decodes the transformed blocks of a file coded after a Burrows-Wheeler
+// transform, and writes their inverse to the output file.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file.
+// Output *output - The output for the output file.
+// Node *huffman_tree - The Huffman tree used to find symbols.
+// uint64_t file_size - The size of the decoded file in bytes.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// bool - Whether the blocks were able to be decoded.
+static bool write_transformed_codes( BitReader *reader, Output *output, Node *huffman_tree, uint64_t file_size, uint64_t *compressed_size ) {
+	if ( !huffman_tree ) { // Empty tree, only valid for an empty file.
+		return file_size == 0;
+	}
+
+	uint64_t start = bit_reader_tell( reader );
+	uint64_t bytes_written = 0;
+	DecodeTable *table = NULL;
+	Bwt *bwt = bwt_create( );
+	uint8_t *coded = ( uint8_t * ) malloc( BWT_CODED_MAX( BWT_BLOCK ) );
+	uint8_t *block = ( uint8_t * ) malloc( BWT_BLOCK );
+	bool corrupt = !bwt || !coded || !block;
+
+	if ( !corrupt && ( huffman_tree->left || huffman_tree->right ) ) {
+		stats_phase( stats, "decode_table" );
+		corrupt = !( table = decode_table_create( huffman_tree ) );
+	}
+
+	stats_phase( stats, "decode" );
+
+	while ( bytes_written < file_size && !corrupt ) {
+		uint32_t nbytes = 0;
+		uint32_t primary = 0;
+		uint32_t ncoded = 0;
+		read_symbols( reader, table, huffman_tree, coded, BWT_HEADER_SIZE, &corrupt );
+
+		if ( corrupt || !bwt_parse_header( coded, &nbytes, &primary, &ncoded ) || nbytes > file_size - bytes_written ) {
+			corrupt = true;
+
+			break;
+		}
+
+		read_symbols( reader, table, huffman_tree, coded, ncoded, &corrupt );
+		corrupt = corrupt || !bwt_inverse( bwt, coded, ncoded, nbytes, primary, block );
+
+		for ( uint32_t copied = 0; copied < nbytes && !corrupt; ) {
+			uint32_t wanted = 0;
+			uint8_t *window = output_window( output, &wanted );
+			wanted = wanted < nbytes - copied ? wanted : nbytes - copied;
+			memcpy( window, block + copied, wanted );
+			output_commit( output, wanted );
+			copied += wanted;
+		}
+
+		bytes_written += nbytes;
+	}
+
+	stats_phase( stats, NULL );
+	decode_table_delete( &table );
+	bwt_delete( &bwt );
+	free( coded );
+	free( block );
+	*compressed_size += ( bit_reader_tell( reader ) - start + 7 ) / 8; // Add total bytes read for codes.
+
+	return !corrupt;
+}
+
+// Description:
+// Decodes the blocks of a file coded with tANS. Blocks are decoded straight
+// into the output when its window has room for them, and copied otherwise.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file.
+// Output *output - The output for the output file.
+// uint8_t *dump - The dump of the normalized counts.
+// uint16_t dump_size - The size of the dump.
+// uint64_t file_size - The size of the decoded file in bytes.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// bool - Whether the blocks were able to be decoded.
+static bool write_ans_codes( BitReader *reader, Output *output, uint8_t *dump, uint16_t dump_size, uint64_t file_size, uint64_t *compressed_size ) {
+	uint16_t counts[ ALPHABET ];
+
+	if ( file_size == 0 || !ans_counts_parse( dump, dump_size, counts ) ) { // No counts, only valid for an empty file.
+		return file_size == 0 && dump_size == 0;
+	}
+
+	stats_phase( stats, "decode_table" );
+	uint64_t start = bit_reader_tell( reader );
+	uint64_t bytes_written = 0;
+	AnsDecoder *decoder = ans_decoder_create( counts );
+	uint8_t *coded = ( uint8_t * ) calloc( 1, ANS_CODED_MAX( ANS_BLOCK ) + ANS_SLACK );
+	uint8_t *block = ( uint8_t * ) malloc( ANS_BLOCK );
+	bool corrupt = !decoder || !coded || !block;
+	stats_phase( stats, "decode" );
+
+	while ( bytes_written < file_size && !corrupt ) {
+		uint8_t header[ ANS_BLOCK_HEADER_SIZE ];
+		uint32_t nbytes = file_size - bytes_written < ANS_BLOCK ? file_size - bytes_written : ANS_BLOCK;
+		uint32_t ncoded = 0;
+		uint32_t wanted = 0;
+
+		if ( bit_reader_read_bytes( reader, header, ANS_BLOCK_HEADER_SIZE ) != ANS_BLOCK_HEADER_SIZE ) {
+			corrupt = true;
+
+			break;
+		}
+
+		ncoded = load_little_endian( header, ANS_BLOCK_HEADER_SIZE );
+
+		if ( ncoded > ANS_CODED_MAX( nbytes ) || bit_reader_read_bytes( reader, coded, ncoded ) != ncoded ) {
+			corrupt = true;
+
+			break;
+		}
+
+		uint8_t *window = output_window( output, &wanted );
+
+		if ( wanted >= nbytes ) { // The whole block fits.
+			corrupt = !ans_decode( decoder, coded, ncoded, window, nbytes );
+			output_commit( output, corrupt ? 0 : nbytes );
+		} else {
+			corrupt = !ans_decode( decoder, coded, ncoded, block, nbytes );
+
+			for ( uint32_t copied = 0; copied < nbytes && !corrupt; ) {
+				wanted = wanted < nbytes - copied ? wanted : nbytes - copied;
+				memcpy( window, block + copied, wanted );
+				output_commit( output, wanted );
+				copied += wanted;
+				window = output_window( output, &wanted );
+			}
+		}
+
+		bytes_written += nbytes;
+	}
+
+	stats_phase( stats, NULL );
+	ans_decoder_delete( &decoder );
+	free( coded );
+	free( block );
+	*compressed_size += ( bit_reader_tell( reader ) - start ) / 8; // Add total bytes read for blocks.
+
+	return !corrupt;
+}
+
+// Description:
+// Decodes the blocks of a file encoded with --split, each with its own tree.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file.
+// Output *output - The output for the output file.
+// uint64_t file_size - The size of the decoded file in bytes.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// bool - Whether the blocks were able to be decoded.
+static bool write_split_codes( BitReader *reader, Output *output, uint64_t file_size, uint64_t *compressed_size ) {
+	uint64_t start = bit_reader_tell( reader );
+	uint64_t bytes_written = 0;
+	bool corrupt = false;
+	stats_phase( stats, "decode" );
+
+	while ( bytes_written < file_size && !corrupt ) {
+		uint8_t header[ SPLIT_BLOCK_HEADER_SIZE ];
+		uint8_t tree_dump[ MAX_TREE_SIZE ];
+		uint32_t nbytes = 0;
+		uint16_t tree_size = 0;
+
+		if ( bit_reader_read_bytes( reader, header, SPLIT_BLOCK_HEADER_SIZE ) != SPLIT_BLOCK_HEADER_SIZE ) {
+			corrupt = true;
+
+			break;
+		}
+
+		split_block_header_parse( header, &nbytes, &tree_size );
+
+		if ( nbytes == 0 || nbytes > file_size - bytes_written || tree_size > MAX_TREE_SIZE || bit_reader_read_bytes( reader, tree_dump, tree_size ) != tree_size ) {
+			corrupt = true;
+
+			break;
+		}
+
+		Node *huffman_tree = rebuild_tree( tree_size, tree_dump );
+		DecodeTable *table = NULL;
+		corrupt = !huffman_tree || ( ( huffman_tree->left || huffman_tree->right ) && !( table = decode_table_create( huffman_tree ) ) );
+
+		for ( uint32_t decoded = 0; decoded < nbytes && !corrupt; ) {
+			uint32_t wanted = 0;
+			uint8_t *window = output_window( output, &wanted );
+			wanted = wanted < nbytes - decoded ? wanted : nbytes - decoded;
+			wanted = read_symbols( reader, table, huffman_tree, window, wanted, &corrupt );
+			output_commit( output, wanted );
+			decoded += wanted;
+		}
+
+		decode_table_delete( &table );
+		delete_tree( &huffman_tree );
+		bit_reader_align( reader );
+		bytes_written += nbytes;
+	}
+
+	stats_phase( stats, NULL );
+	*compressed_size += ( bit_reader_tell( reader ) - start ) / 8; // Add total bytes read for blocks.
+
+	return !corrupt;
+}
+
+// Description:
+// Decodes a file encoded with --stride: reads the tree of each byte position in
+// a record, then decodes each block's columns with their own tables and puts
+// their bytes back in place.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file, after the file header.
+// Output *output - The output for the output file.
+// uint64_t file_size - The size of the decoded file in bytes.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// bool - Whether the file was able to be decoded.
+static bool write_stride_codes( BitReader *reader, Output *output, uint64_t file_size, uint64_t *compressed_size ) {
+	uint64_t start = bit_reader_tell( reader );
+	uint8_t header[ STRIDE_HEADER_SIZE ];
+
+	if ( bit_reader_read_bytes( reader, header, STRIDE_HEADER_SIZE ) != STRIDE_HEADER_SIZE ) {
+		return false;
+	}
+
+	uint32_t stride = load_little_endian( header, STRIDE_HEADER_SIZE );
+	Node **trees = ( Node ** ) calloc( stride, sizeof( Node * ) );
+	DecodeTable **tables = ( DecodeTable ** ) calloc( stride, sizeof( DecodeTable * ) );
+	uint8_t *columns = io_buffer_create( STRIDE_BLOCK );
+	uint8_t *block = io_buffer_create( STRIDE_BLOCK );
+	bool corrupt = stride == 0 || stride > STRIDE_MAX || !trees || !tables || !columns || !block;
+	uint32_t block_size = corrupt ? 0 : stride_block_size( stride );
+	uint64_t bytes_written = 0;
+	stats_phase( stats, "rebuild_tree" );
+
+	for ( uint32_t column = 0; column < stride && !corrupt; column++ ) {
+		uint8_t tree_dump[ STRIDE_TREE_HEADER + MAX_TREE_SIZE ];
+		corrupt = bit_reader_read_bytes( reader, tree_dump, STRIDE_TREE_HEADER ) != STRIDE_TREE_HEADER;
+		uint16_t tree_size = load_little_endian( tree_dump, STRIDE_TREE_HEADER );
+
+		if ( corrupt || tree_size > MAX_TREE_SIZE || bit_reader_read_bytes( reader, tree_dump, tree_size ) != tree_size ) {
+			corrupt = true;
+
+			break;
+		}
+
+		trees[ column ] = rebuild_tree( tree_size, tree_dump );
+		corrupt = tree_size != 0 && !trees[ column ];
+
+		if ( !corrupt && trees[ column ] && ( trees[ column ]->left || trees[ column ]->right ) ) {
+			corrupt = !( tables[ column ] = decode_table_create( trees[ column ] ) );
+		}
+	}
+
+	stats_phase( stats, "decode" );
+
+	while ( bytes_written < file_size && !corrupt ) {
+		uint32_t nbytes = file_size - bytes_written < block_size ? file_size - bytes_written : block_size;
+
+		for ( uint32_t column = 0, offset = 0; column < stride && !corrupt; column++ ) {
+			uint32_t count = stride_column_size( nbytes, stride, column );
+
+			if ( count != 0 && !trees[ column ] ) { // Only a position without bytes may have no tree.
+				corrupt = true;
+			} else if ( count != 0 && read_symbols( reader, tables[ column ], trees[ column ], columns + offset, count, &corrupt ) != count ) {
+				corrupt = true;
+			}
+
+			offset += count;
+		}
+
+		uint32_t wanted = 0;
+		uint8_t *window = output_window( output, &wanted );
+
+		if ( corrupt ) {
+			break;
+		} else if ( wanted >= nbytes ) { // The whole block fits.
+			stride_join( columns, nbytes, stride, window );
+			output_commit( output, nbytes );
+		} else {
+			stride_join( columns, nbytes, stride, block );
+
+			for ( uint32_t copied = 0; copied < nbytes; ) {
+				wanted = wanted < nbytes - copied ? wanted : nbytes - copied;
+				memcpy( window, block + copied, wanted );
+				output_commit( output, wanted );
+				copied += wanted;
+				window = output_window( output, &wanted );
+			}
+		}
+
+		bytes_written += nbytes;
+	}
+
+	stats_phase( stats, NULL );
+
+	for ( uint32_t column = 0; trees && tables && column < stride; column++ ) {
+		decode_table_delete( &tables[ column ] );
+		delete_tree( &trees[ column ] );
+	}
+
+	free( trees );
+	free( tables );
+	io_buffer_delete( &columns );
+	io_buffer_delete( &block );
+	*compressed_size += ( bit_reader_tell( reader ) - start + 7 ) / 8; // Add total bytes read for the trees and codes.
+
+	return !corrupt;
+}
+
+// Description:
+// Decodes a file encoded with --lz: for each block, reads the trees and extra
+// bits, decodes the literals, literal run lengths, match lengths and distances
+// with their own tables, then rebuilds the block from its literals and matches.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file, after the file header.
+// Output *output - The output for the output file.
+// uint64_t file_size - The size of the decoded file in bytes.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// bool - Whether the file was able to be decoded.
+static bool write_lz_codes( BitReader *reader, Output *output, uint64_t file_size, uint64_t *compressed_size ) {
+	uint64_t start = bit_reader_tell( reader );
+	LzDecoder *decoder = lz_decoder_create( );
+	LzBlock block;
+	bool allocated = lz_block_create( &block );
+	uint64_t bytes_written = 0;
+	bool corrupt = !decoder || !allocated;
+	stats_phase( stats, "decode" );
+
+	while ( bytes_written < file_size && !corrupt ) {
+		uint8_t header[ LZ_BLOCK_HEADER_SIZE ];
+		uint16_t tree_sizes[ LZ_STREAMS ];
+		Node *trees[ LZ_STREAMS ] = { NULL };
+		DecodeTable *tables[ LZ_STREAMS ] = { NULL };
+		corrupt = bit_reader_read_bytes( reader, header, LZ_BLOCK_HEADER_SIZE ) != LZ_BLOCK_HEADER_SIZE || !lz_block_header_parse( header, &block, tree_sizes ) || block.nbytes > file_size - bytes_written;
+
+		for ( uint32_t stream = 0; stream < LZ_STREAMS && !corrupt; stream++ ) {
+			uint8_t tree_dump[ MAX_TREE_SIZE ];
+
+			if ( bit_reader_read_bytes( reader, tree_dump, tree_sizes[ stream ] ) != tree_sizes[ stream ] ) {
+				corrupt = true;
+
+				break;
+			}
+
+			trees[ stream ] = rebuild_tree( tree_sizes[ stream ], tree_dump );
+			corrupt = ( tree_sizes[ stream ] != 0 || block.counts[ stream ] != 0 ) && !trees[ stream ]; // Only an empty stream may have no tree.
+
+			if ( !corrupt && trees[ stream ] && ( trees[ stream ]->left || trees[ stream ]->right ) ) {
+				corrupt = !( tables[ stream ] = decode_table_create( trees[ stream ] ) );
+			}
+		}
+
+		if ( !corrupt && bit_reader_read_bytes( reader, block.extra, block.extra_size ) != block.extra_size ) {
+			corrupt = true;
+		}
+
+		for ( uint32_t stream = 0; stream < LZ_STREAMS && !corrupt; stream++ ) {
+			if ( block.counts[ stream ] != 0 && read_symbols( reader, tables[ stream ], trees[ stream ], block.symbols[ stream ], block.counts[ stream ], &corrupt ) != block.counts[ stream ] ) {
+				corrupt = true;
+			}
+		}
+
+		for ( uint32_t stream = 0; stream < LZ_STREAMS; stream++ ) {
+			decode_table_delete( &tables[ stream ] );
+			delete_tree( &trees[ stream ] );
+		}
+
+		uint8_t *decoded = corrupt ? NULL : lz_decode( decoder, &block );
+		corrupt = !decoded;
+
+		for ( uint32_t copied = 0; !corrupt && copied < block.nbytes; ) {
+			uint32_t wanted = 0;
+			uint8_t *window = output_window( output, &wanted );
+			wanted = wanted < block.nbytes - copied ? wanted : block.nbytes - copied;
+			memcpy( window, decoded + copied, wanted );
+			output_commit( output, wanted );
+			copied += wanted;
+		}
+
+		bit_reader_align( reader );
+		bytes_written += block.nbytes;
+	}
+
+	stats_phase( stats, NULL );
+
+	if ( allocated ) {
+		lz_block_delete( &block );
+	}
+
+	lz_decoder_delete( &decoder );
+	*compressed_size += ( bit_reader_tell( reader ) - start ) / 8; // Add total bytes read for blocks.
+
+	return !corrupt;
+}
+
+// Description:
+// Decodes the segments of a stream encoded with --stream, handing each one to
+// the output as soon as it has been read, so the output keeps up with a
+// streaming encoder. Nothing past the segment being decoded is waited for.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file.
+// Output *output - The output for the output file, of unknown size.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+// uint64_t *decompressed_size - Pointer to uint64_t to set to the number of bytes decoded.
+//
+// Returns:
+// bool - Whether the segments were able to be decoded, up to the end of the stream.
+static bool write_stream_segments( BitReader *reader, Output *output, uint64_t *compressed_size, uint64_t *decompressed_size ) {
+	uint64_t start = bit_reader_tell( reader );
+	Node *huffman_tree = NULL;
+	DecodeTable *table = NULL;
+	uint8_t *codes = NULL;
+	uint64_t capacity = 0;
+	bool corrupt = false;
+	bool ended = false;
+	*decompressed_size = 0;
+	stats_phase( stats, "decode" );
+
+	while ( !corrupt && !ended ) {
+		uint8_t header[ STREAM_SEGMENT_HEADER_SIZE ];
+		uint8_t tree_dump[ MAX_TREE_SIZE ];
+		uint32_t nbytes = 0;
+		uint32_t ncoded = 0;
+		uint16_t tree_size = 0;
+
+		if ( bit_reader_read_bytes( reader, header, STREAM_SEGMENT_HEADER_SIZE ) != STREAM_SEGMENT_HEADER_SIZE ) {
+			corrupt = true;
+
+			break;
+		}
+
+		stream_segment_header_parse( header, &nbytes, &ncoded, &tree_size );
+
+		if ( nbytes == 0 ) { // The end of the stream.
+			corrupt = ncoded != 0 || tree_size != 0;
+			ended = true;
+
+			break;
+		}
+
+		if ( nbytes > STREAM_MAX_FLUSH || ncoded > ( uint64_t ) nbytes * MAX_CODE_SIZE + 1 || tree_size > MAX_TREE_SIZE || bit_reader_read_bytes( reader, tree_dump, tree_size ) != tree_size ) {
+			corrupt = true;
+
+			break;
+		}
+
+		if ( tree_size != 0 ) { // Otherwise the segment keeps the table before it.
+			decode_table_delete( &table );
+			delete_tree( &huffman_tree );
+			huffman_tree = rebuild_tree( tree_size, tree_dump );
+
+			if ( huffman_tree && ( huffman_tree->left || huffman_tree->right ) && !( table = decode_table_create( huffman_tree ) ) ) {
+				corrupt = true;
+
+				break;
+			}
+		}
+
+		if ( !huffman_tree ) {
+			corrupt = true;
+
+			break;
+		}
+
+		if ( !codes || ncoded > capacity ) {
+			uint8_t *grown = ( uint8_t * ) realloc( codes, ( uint64_t ) ncoded + sizeof( uint64_t ) );
+
+			if ( !grown ) {
+				corrupt = true;
+
+				break;
+			}
+
+			codes = grown;
+			capacity = ncoded;
+		}
+
+		if ( bit_reader_read_bytes( reader, codes, ncoded ) != ncoded ) {
+			corrupt = true;
+
+			break;
+		}
+
+		memset( codes + ncoded, 0, sizeof( uint64_t ) ); // Decoding loads whole words past the end.
+		BitWindow bits = { codes, 0, 8 * ( uint64_t ) ncoded, true };
+
+		for ( uint32_t decoded = 0; decoded < nbytes && !corrupt; ) {
+			uint32_t wanted = 0;
+			uint8_t *window = output_window( output, &wanted );
+			uint32_t count = wanted < nbytes - decoded ? wanted : nbytes - decoded;
+
+			if ( table ) {
+				count = decode_symbols( table, &bits, window, count, &corrupt );
+				corrupt = corrupt || count == 0; // Codes ended before the last symbol.
+			} else {
+				memset( window, huffman_tree->symbol, count ); // Every symbol is the same, and has no bits.
+			}
+
+			output_commit( output, count );
+			decoded += count;
+		}
+
+		corrupt = corrupt || ( bits.top + 7 ) / 8 != ncoded; // Each segment's codes fill exactly its code bytes.
+		output_sync( output );
+		*decompressed_size += nbytes;
+	}
+
+	stats_phase( stats, NULL );
+	decode_table_delete( &table );
+	delete_tree( &huffman_tree );
+	free( codes );
+	*compressed_size += ( bit_reader_tell( reader ) - start ) / 8; // Add total bytes read for segments.
+
+	return ended && !corrupt;
+}
+
+// Description:
+// Decodes every record of a file encoded with --records, in order, putting the
+// lengths of length-delimited records back in front of them.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file, which must be in memory or seekable, at the start of the codes.
+// Output *output - The output for the output file.
+// Node *huffman_tree - The Huffman tree used to find symbols.
+// RecordFormat format - How the records were delimited.
+// uint64_t count - The number of records.
+// uint64_t file_size - The size of the decoded file in bytes.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// bool - Whether the records were able to be decoded.
+static bool write_records( BitReader *reader, Output *output, Node *huffman_tree, RecordFormat format, uint64_t count, uint64_t file_size, uint64_t *compressed_size ) {
+	uint64_t code_start = bit_reader_tell( reader ) / 8;
+	uint64_t input_size = 0;
+
+	if ( !bit_reader_size( reader, &input_size ) || input_size < code_start || count > ( input_size - code_start ) / RECORD_INDEX_ENTRY ) {
+		return false;
+	}
+
+	uint64_t code_size = input_size - code_start - count * RECORD_INDEX_ENTRY;
+	DecodeTable *table = NULL;
+	bool corrupt = false;
+	uint8_t entries[ BLOCK ];
+	uint64_t bytes_written = 0;
+	uint8_t *window = NULL;
+	uint32_t room = 0;
+	uint32_t filled = 0;
+
+	if ( huffman_tree && ( huffman_tree->left || huffman_tree->right ) ) {
+		stats_phase( stats, "decode_table" );
+		corrupt = !( table = decode_table_create( huffman_tree ) );
+	}
+
+	stats_phase( stats, "decode" );
+
+	for ( uint64_t i = 0; i < count && !corrupt; i++ ) {
+		uint64_t entry = i % ( BLOCK / RECORD_INDEX_ENTRY );
+		uint64_t offset = 0;
+		uint32_t nbytes = 0;
+
+		if ( entry == 0 ) { // Read the next block of the index.
+			uint32_t wanted = count - i < BLOCK / RECORD_INDEX_ENTRY ? ( count - i ) * RECORD_INDEX_ENTRY : BLOCK;
+			corrupt = bit_reader_pread( reader, entries, wanted, code_start + code_size + i * RECORD_INDEX_ENTRY ) != wanted;
+		}
+
+		record_entry_parse( entries + entry * RECORD_INDEX_ENTRY, &offset, &nbytes );
+		uint32_t prefix = format == RECORDS_LENGTH ? RECORD_PREFIX_SIZE : 0;
+
+		if ( corrupt || offset != bit_reader_tell( reader ) / 8 - code_start || prefix + nbytes > file_size - bytes_written || ( !huffman_tree && nbytes != 0 ) ) {
+			corrupt = true;
+
+			break;
+		}
+
+		uint8_t length[ RECORD_PREFIX_SIZE ];
+		store_little_endian( length, nbytes, RECORD_PREFIX_SIZE );
+
+		for ( uint32_t done = 0; done < prefix + nbytes && !corrupt; ) { // Records share windows, which a record may straddle.
+			if ( filled == room ) {
+				output_commit( output, filled );
+				window = output_window( output, &room );
+				filled = 0;
+			}
+
+			uint32_t wanted = room - filled < prefix + nbytes - done ? room - filled : prefix + nbytes - done;
+
+			if ( done < prefix ) {
+				wanted = wanted < prefix - done ? wanted : prefix - done;
+				memcpy( window + filled, length + done, wanted );
+			} else {
+				wanted = read_symbols( reader, table, huffman_tree, window + filled, wanted, &corrupt );
+			}
+
+			filled += wanted;
+			done += wanted;
+		}
+
+		bit_reader_align( reader );
+		bytes_written += prefix + nbytes;
+	}
+
+	output_commit( output, filled );
+	stats_phase( stats, NULL );
+	decode_table_delete( &table );
+	*compressed_size += bit_reader_tell( reader ) / 8 - code_start + count * RECORD_INDEX_ENTRY;
+
+	return !corrupt && bytes_written == file_size && bit_reader_tell( reader ) / 8 - code_start == code_size;
+}
+
+
+// Description:
+// Copies the contents of a file stored uncompressed to the output file.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file.
+// Output *output - The output for the output file.
+// uint64_t file_size - The size of the stored file in bytes.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// bool - Whether the whole file was copied.
+static bool write_stored_bytes( BitReader *reader, Output *output, uint64_t file_size, uint64_t *compressed_size ) {
+	uint64_t bytes_written = 0;
+
+	stats_phase( stats, "copy" );
+
+	while ( bytes_written < file_size ) {
+		uint32_t wanted = 0;
+		uint8_t *window = output_window( output, &wanted );
+		wanted = wanted < file_size - bytes_written ? wanted : file_size - bytes_written;
+		uint32_t copied = bit_reader_read_bytes( reader, window, wanted );
+		output_commit( output, copied );
+		bytes_written += copied;
+
+		if ( copied != wanted ) {
+			break;
+		}
+	}
+
+	stats_phase( stats, NULL );
+	*compressed_size += bytes_written;
+
+	return bytes_written == file_size;
+}
+
+// Description:
+// Decodes a file coded on its own, with a tree or tANS counts of its own or
+// stored, once its header has been read. Such files make up the segments of an
+// archive.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file, after the file's header.
+// Output *output - The output for the output file.
+// FileHeader header - The file's header.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// bool - Whether the file was able to be decoded.
+static bool write_member( BitReader *reader, Output *output, FileHeader header, uint64_t *compressed_size ) {
+	if ( header.magic_number == MAGIC_STORED ) {
+		return write_stored_bytes( reader, output, header.original_file_size, compressed_size );
+	}
+
+	if ( header.magic_number == MAGIC_STRIDE ) { // The tree of each position follows the stride.
+		return header.tree_size == 0 && write_stride_codes( reader, output, header.original_file_size, compressed_size );
+	}
+
+	if ( header.magic_number == MAGIC_LZ ) { // Each block has its own trees.
+		return header.tree_size == 0 && write_lz_codes( reader, output, header.original_file_size, compressed_size );
+	}
+
+	uint8_t tree_dump[ MAX_TREE_SIZE ];
+
+	if ( header.tree_size > MAX_TREE_SIZE || bit_reader_read_bytes( reader, tree_dump, header.tree_size ) != header.tree_size ) {
+		return false;
+	}
+
+	*compressed_size += header.tree_size;
+
+	if ( header.magic_number == MAGIC_ANS ) { // tANS counts are stored where the tree is.
+		return write_ans_codes( reader, output, tree_dump, header.tree_size, header.original_file_size, compressed_size );
+	}
+
+	stats_phase( stats, "rebuild_tree" );
+	Node *huffman_tree = rebuild_tree( header.tree_size, tree_dump );
+	bool decoded = false;
+
+	if ( header.magic_number == MAGIC_BWT ) {
+		decoded = write_transformed_codes( reader, output, huffman_tree, header.original_file_size, compressed_size );
+	} else {
+		decoded = write_decoded_codes( reader, output, huffman_tree, NULL, header.original_file_size, compressed_size );
+	}
+
+	delete_tree( &huffman_tree );
+
+	return decoded;
+}
+
+// Description:
+// Checks whether a magic number is one that huffman_encode or huffman_train
+// writes, whether or not the file can be joined with cat.
+//
+// Parameters:
+// uint32_t magic_number - The magic number.
+//
+// Returns:
+// bool - Whether it's a known magic number.
+static bool is_known( uint32_t magic_number ) {
+	return is_member( magic_number ) || magic_number == MAGIC_DICTIONARY || magic_number == MAGIC_RECORDS || magic_number == MAGIC_SPLIT || magic_number == MAGIC_STREAM || magic_number == MAGIC_ARCHIVE || magic_number == DICTIONARY_MAGIC;
+}
+
+// Description:
+// Reads the header of the next file after one that was just decoded, for files
+// joined with cat. It starts on the byte boundary after the last file's codes.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file, after the last file's codes.
+// FileHeader *header - The pointer to the FileHeader to set.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// Trailer - TRAILER_MEMBER if a file that can be joined follows, TRAILER_UNJOINABLE if a file
+//           that can't be does, or TRAILER_NONE if nothing does. Other bytes after the last file are ignored.
+static Trailer read_next_member( BitReader *reader, FileHeader *header, uint64_t *compressed_size ) {
+	RawFileHeader raw_header;
+	bit_reader_align( reader );
+
+	if ( bit_reader_read_bytes( reader, ( uint8_t * ) &raw_header, sizeof( raw_header ) ) != sizeof( raw_header ) ) {
+		return TRAILER_NONE;
+	}
+
+	*header = file_header_create( raw_header );
+
+	if ( !is_known( header->magic_number ) ) {
+		return TRAILER_NONE;
+	}
+
+	*compressed_size += sizeof( raw_header );
+
+	return is_member( header->magic_number ) ? TRAILER_MEMBER : TRAILER_UNJOINABLE;
+}
+
+// Description:
+// Decodes the segments of an archive made with --append one after another. Each
+// is a file coded on its own, starting on a byte boundary, and the last ends
+// where the archive header says; anything after it was left by an append that
+// never committed.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file, after the archive header.
+// Output *output - The output for the output file.
+// uint64_t file_size - The size of the decoded archive in bytes.
+// uint64_t end - The offset of the end of the last segment.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// bool - Whether every segment was able to be decoded.
+static bool write_archive_segments( BitReader *reader, Output *output, uint64_t file_size, uint64_t end, uint64_t *compressed_size ) {
+	uint64_t bytes_written = 0;
+
+	while ( bit_reader_tell( reader ) / 8 < end ) {
+		RawFileHeader raw_header;
+
+		if ( bit_reader_read_bytes( reader, ( uint8_t * ) &raw_header, sizeof( raw_header ) ) != sizeof( raw_header ) ) {
+			return false;
+		}
+
+		FileHeader header = file_header_create( raw_header );
+		*compressed_size += sizeof( raw_header );
+		if ( !is_member( header.magic_number ) || header.original_file_size > file_size - bytes_written || !write_member( reader, output, header, compressed_size ) ) {
+			return false;
+		}
+
+		bytes_written += header.original_file_size;
+		bit_reader_align( reader );
+	}
+
+	return bytes_written == file_size && bit_reader_tell( reader ) / 8 == end;
+}
+
+// Description:
+// Reads the header of a compressed file, and what follows it that's needed
+// before the file can be decoded: a dictionary's ID, the tree of a file of
+// records, and the archive or records header.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file, at its start.
+// Container *c - The container to fill in. The caller finds the dictionary of a file encoded with one.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// ContainerStatus - CONTAINER_OK, CONTAINER_UNKNOWN if it isn't a compressed file, or CONTAINER_CORRUPT.
+ContainerStatus container_read_header( BitReader *reader, Container *c, uint64_t *compressed_size ) {
+	RawFileHeader raw_header = { 0 };
+	memset( c, 0, sizeof( *c ) );
+
+	// Read the magic number first, since headers of files encoded with a dictionary are shorter.
+	if ( bit_reader_read_bytes( reader, raw_header.magic_number, sizeof( raw_header.magic_number ) ) != sizeof( raw_header.magic_number ) ) {
+		return CONTAINER_UNKNOWN;
+	}
+
+	*compressed_size += sizeof( raw_header.magic_number );
+	c->header = file_header_create( raw_header );
+
+	if ( c->header.magic_number == MAGIC_DICTIONARY ) {
+		if ( !dictionary_file_header_read( reader, &c->dictionary_id, &c->header.original_file_size, compressed_size ) ) {
+			return CONTAINER_CORRUPT;
+		}
+
+		c->size = c->header.original_file_size;
+
+		return CONTAINER_OK;
+	}
+
+	if ( !is_member( c->header.magic_number ) && c->header.magic_number != MAGIC_RECORDS && c->header.magic_number != MAGIC_SPLIT && c->header.magic_number != MAGIC_STREAM && c->header.magic_number != MAGIC_ARCHIVE ) {
+		return CONTAINER_UNKNOWN;
+	}
+
+	uint32_t rest = sizeof( raw_header ) - sizeof( raw_header.magic_number );
+
+	if ( bit_reader_read_bytes( reader, ( uint8_t * ) &raw_header + sizeof( raw_header.magic_number ), rest ) != rest ) {
+		return CONTAINER_CORRUPT;
+	}
+
+	*compressed_size += rest;
+	c->header = file_header_create( raw_header );
+	c->size = c->header.magic_number == MAGIC_STREAM ? OUTPUT_UNKNOWN_SIZE : c->header.original_file_size;
+
+	if ( c->header.magic_number == MAGIC_ARCHIVE ) {
+		uint8_t archive_header[ ARCHIVE_HEADER_SIZE ];
+
+		if ( c->header.tree_size != 0 || bit_reader_read_bytes( reader, archive_header, ARCHIVE_HEADER_SIZE ) != ARCHIVE_HEADER_SIZE ) {
+			return CONTAINER_CORRUPT;
+		}
+
+		*compressed_size += ARCHIVE_HEADER_SIZE;
+		c->archive_end = archive_header_parse( archive_header );
+	}
+
+	if ( c->header.magic_number == MAGIC_RECORDS ) { // Other files read their own trees when they're decoded.
+		uint8_t records_header[ RECORDS_HEADER_SIZE ];
+
+		if ( c->header.tree_size > MAX_TREE_SIZE || bit_reader_read_bytes( reader, c->tree_dump, c->header.tree_size ) != c->header.tree_size ) {
+			return CONTAINER_CORRUPT;
+		}
+
+		if ( bit_reader_read_bytes( reader, records_header, RECORDS_HEADER_SIZE ) != RECORDS_HEADER_SIZE || !records_header_parse( records_header, &c->record_format, &c->record_count ) ) {
+			return CONTAINER_CORRUPT;
+		}
+
+		*compressed_size += c->header.tree_size + RECORDS_HEADER_SIZE;
+	}
+
+	return CONTAINER_OK;
+}
+
+// Description:
+// Decodes a compressed file whose header has been read, in any format
+// huffman_encode writes, along with any files joined to it with cat.
+//
+// Parameters:
+// BitReader *reader - The bit reader for the input file, after what container_read_header() read.
+// Output *output - The output for the output file, of the container's size.
+// Container *c - The container, whose size is set to the number of bytes decoded.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
+//
+// Returns:
+// ContainerStatus - CONTAINER_OK, CONTAINER_CORRUPT, CONTAINER_NO_ROOM if the output couldn't be extended for a joined file,
+//                   or CONTAINER_UNJOINABLE if a file that can't be joined with cat follows or precedes another.
+ContainerStatus container_decode( BitReader *reader, Output *output, Container *c, uint64_t *compressed_size ) {
+	FileHeader header = c->header;
+	Trailer trailer = TRAILER_NONE;
+	bool decoded = false;
+
+	if ( header.magic_number == MAGIC_DICTIONARY ) {
+		decoded = c->dictionary_tree && write_decoded_codes( reader, output, c->dictionary_tree, c->dictionary_table, header.original_file_size, compressed_size );
+		trailer = decoded ? read_next_member( reader, &header, compressed_size ) : TRAILER_NONE;
+	} else if ( header.magic_number == MAGIC_RECORDS ) { // The index is at the end, so nothing can follow.
+		stats_phase( stats, "rebuild_tree" );
+		Node *huffman_tree = rebuild_tree( header.tree_size, c->tree_dump );
+		decoded = write_records( reader, output, huffman_tree, c->record_format, c->record_count, c->size, compressed_size );
+		delete_tree( &huffman_tree );
+	} else if ( header.magic_number == MAGIC_STREAM ) {
+		decoded = header.tree_size == 0 && write_stream_segments( reader, output, compressed_size, &c->size );
+		trailer = decoded ? read_next_member( reader, &header, compressed_size ) : TRAILER_NONE;
+	} else if ( header.magic_number == MAGIC_SPLIT ) {
+		decoded = write_split_codes( reader, output, header.original_file_size, compressed_size );
+		trailer = decoded ? read_next_member( reader, &header, compressed_size ) : TRAILER_NONE;
+	} else if ( header.magic_number == MAGIC_ARCHIVE ) { // Segments past the end were never committed, so they're ignored.
+		decoded = write_archive_segments( reader, output, header.original_file_size, c->archive_end, compressed_size );
+	} else {
+		decoded = write_member( reader, output, header, compressed_size );
+
+		while ( decoded && ( trailer = read_next_member( reader, &header, compressed_size ) ) == TRAILER_MEMBER ) { // Files joined with cat.
+			if ( header.original_file_size > UINT64_MAX - 1 - c->size || !output_extend( output, header.original_file_size ) ) {
+				return CONTAINER_NO_ROOM;
+			}
+
+			decoded = write_member( reader, output, header, compressed_size );
+			c->size += header.original_file_size;
+		}
+	}
+
+	if ( !decoded ) {
+		return CONTAINER_CORRUPT;
+	}
+
+	return trailer == TRAILER_NONE ? CONTAINER_OK : CONTAINER_UNJOINABLE;
+}
@@ -0,0 +1,36 @@
+#ifndef __CONTAINER_H__
+#define __CONTAINER_H__
+
+#include "decode_table.h"
+#include "defines.h"
+#include "file_header.h"
+#include "io.h"
+#include "node.h"
+#include "output.h"
+#include "records.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum ContainerStatus { CONTAINER_OK, CONTAINER_UNKNOWN, CONTAINER_CORRUPT, CONTAINER_NO_ROOM, CONTAINER_UNJOINABLE } ContainerStatus;
+
+typedef struct Container {
+	FileHeader header;
+	uint64_t size;
+	uint32_t dictionary_id;
+	Node *dictionary_tree;
+	DecodeTable *dictionary_table;
+	uint8_t tree_dump[ MAX_TREE_SIZE ];
+	uint64_t archive_end;
+	RecordFormat record_format;
+	uint64_t record_count;
+} Container;
+
+void container_configure( uint32_t threads, Stats *stats );
+
+ContainerStatus container_read_header( BitReader *reader, Container *c, uint64_t *compressed_size );
+
+ContainerStatus container_decode( BitReader *reader, Output *output, Container *c, uint64_t *compressed_size );
+
+#endif
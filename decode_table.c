@@ -0,0 +1,116 @@
+#include "decode_table.h"
+
+#include "node.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Description:
+// Fills the entries of a decode table for every lookup window that starts with a path.
+//
+// Parameters:
+// DecodeTable *t - The decode table.
+// Node *node - The node reached by the path.
+// uint32_t path - The bits of the path, first bit lowest.
+// uint32_t depth - The length of the path in bits.
+//
+// Returns:
+// Nothing.
+static void decode_table_fill( DecodeTable *t, Node *node, uint32_t path, uint32_t depth ) {
+	if ( !node ) { // Invalid path: leave the entries as zero so decoding reports corruption.
+		return;
+	}
+
+	if ( !node->left && !node->right ) { // Leaf: every window starting with the path decodes to it.
+		for ( uint32_t rest = 0; rest < ( 1u << ( LOOKUP_BITS - depth ) ); rest++ ) {
+			t->entries[ path | rest << depth ] = depth << 8 | node->symbol;
+		}
+	} else if ( depth == LOOKUP_BITS ) { // Code longer than a window: decoding walks on from here.
+		t->nodes[ path ] = node;
+	} else {
+		decode_table_fill( t, node->left, path, depth + 1 );
+		decode_table_fill( t, node->right, path | 1u << depth, depth + 1 );
+	}
+}
+
+// Description:
+// Finds the whole codes at the start of a multi-symbol lookup window.
+//
+// Parameters:
+// Node *root - The root node of the Huffman tree.
+// uint32_t window - The bits of the window, first bit lowest.
+//
+// Returns:
+// uint32_t - The multi-symbol entry for the window.
+static uint32_t decode_table_multi_entry( Node *root, uint32_t window ) {
+	uint32_t symbols = 0;
+	uint32_t count = 0;
+	uint32_t used = 0;
+
+	while ( count < MULTI_SYMBOLS ) {
+		Node *node = root;
+		uint32_t depth = 0;
+
+		while ( node && ( node->left || node->right ) && used + depth < MULTI_LOOKUP_BITS ) {
+			node = ( 1 & ( window >> ( used + depth ) ) ) ? node->right : node->left;
+			depth++;
+		}
+
+		if ( !node || node->left || node->right ) { // Invalid code, or the rest of the window is too short for it.
+			break;
+		}
+
+		symbols |= ( uint32_t ) node->symbol << ( 8 * count );
+		count++;
+		used += depth;
+	}
+
+	return count == 0 ? 0 : used << 26 | count << 24 | symbols;
+}
+
+// Description:
+// Creates a table for decoding a Huffman tree a window of bits at a time. Entries
+// hold the code length in the high byte and the symbol in the low byte, or zero if
+// the code is longer than the window, in which case nodes holds where to continue.
+// Multi-symbol entries hold as many whole codes as fit a wider window: the
+// symbols in the low three bytes, first symbol lowest, then their count in two
+// bits and their total length in the four bits above, or zero if not even one
+// code fits. multi_useful says whether any window holds two codes; if not, the
+// extra lookup only slows decoding down.
+//
+// Parameters:
+// Node *root - The root node of the Huffman tree. Must not be a leaf.
+//
+// Returns:
+// DecodeTable * - A pointer to the newly created decode table.
+DecodeTable *decode_table_create( Node *root ) {
+	DecodeTable *t = ( DecodeTable * ) calloc( 1, sizeof( DecodeTable ) );
+
+	if ( t ) {
+		t->root = root;
+		decode_table_fill( t, root, 0, 0 );
+
+		for ( uint32_t i = 0; i < ( 1u << MULTI_LOOKUP_BITS ); i++ ) {
+			t->multi[ i ] = decode_table_multi_entry( root, i );
+			t->multi_useful |= ( ( t->multi[ i ] >> 24 ) & 3 ) > 1;
+		}
+	}
+
+	return t;
+}
+
+// Description:
+// Frees the memory given to a decode table. Doesn't delete the tree.
+//
+// Parameters:
+// DecodeTable **t - A pointer to a pointer to the decode table.
+//
+// Returns:
+// Nothing.
+void decode_table_delete( DecodeTable **t ) {
+	if ( *t ) {
+		free( *t );
+		*t = NULL;
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef __DECODE_TABLE_H__
+#define __DECODE_TABLE_H__
+
+#include "node.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOOKUP_BITS       11 // Bits peeked per table lookup.
+#define MULTI_LOOKUP_BITS 12 // Bits peeked per lookup of several symbols.
+#define MULTI_SYMBOLS     3 // Most symbols a multi-symbol entry holds.
+
+typedef struct DecodeTable {
+	uint32_t multi[ 1 << MULTI_LOOKUP_BITS ];
+	uint16_t entries[ 1 << LOOKUP_BITS ];
+	Node *nodes[ 1 << LOOKUP_BITS ];
+	Node *root;
+	bool multi_useful;
+} DecodeTable;
+
+DecodeTable *decode_table_create( Node *root );
+
+void decode_table_delete( DecodeTable **t );
+
+#endif
@@ -1,9 +1,26 @@
 #ifndef __DEFINES_H__
 #define __DEFINES_H__
 
-#define BLOCK         4096 // 4KB blocks for I/O.
-#define ALPHABET      256 // Number ASCII + extended ASCII characters.
-#define MAGIC         0x121DDBC0 // 32-bit magic number.
-#define MAX_CODE_SIZE ( ALPHABET / 8 ) // Bytes for a maximum, 256-bit code.
+#define BLOCK              4096 // 4KB blocks for I/O alignment.
+#define DEFAULT_BLOCK_SIZE ( 64 * BLOCK ) // 256KB default I/O buffer size.
+#define MAX_BLOCK_SIZE     ( 16384 * BLOCK ) // 64MB maximum I/O buffer size.
+#define ALPHABET           256 // Number ASCII + extended ASCII characters.
+#define MAGIC              0x121DDBC0 // 32-bit magic number.
+#define DICTIONARY_MAGIC   0x121DDBD0 // Magic number of dictionary files.
+#define MAGIC_DICTIONARY   0x121DDBC1 // Magic number of files encoded with a dictionary.
+#define MAGIC_STORED       0x121DDBC2 // Magic number of files stored uncompressed.
+#define MAGIC_BWT          0x121DDBC3 // Magic number of files coded after a Burrows-Wheeler transform.
+#define MAGIC_RECORDS      0x121DDBC4 // Magic number of files of separately decodable records.
+#define MAGIC_SPLIT        0x121DDBC5 // Magic number of files split into blocks with their own trees.
+#define MAGIC_ANS          0x121DDBC6 // Magic number of files coded with tANS instead of Huffman codes.
+#define MAGIC_STREAM       0x121DDBC7 // Magic number of streams encoded in flushed segments.
+#define MAGIC_ARCHIVE      0x121DDBC8 // Magic number of archives of segments appended one at a time.
+#define MAGIC_STRIDE       0x121DDBC9 // Magic number of files coded with a table per byte position of fixed-size records.
+#define MAGIC_LZ           0x121DDBCA // Magic number of files parsed into LZ77 literals and matches before coding.
+#define MAX_CODE_SIZE      ( ALPHABET / 8 ) // Bytes for a maximum, 256-bit code.
+#define MAX_TREE_SIZE      ( 3 * ALPHABET - 1 ) // Bytes for a tree dump with every symbol.
+#define MAX_PACKED_CODE    56 // Longest code that fits a 64-bit bit accumulator with a partial byte in it.
+#define MAX_PAIR_CODE      27 // Longest two codes stored together in a pair entry.
+#define PAIR_LENGTH_BITS   5 // Low bits of a pair entry holding the length of the two codes.
 
 #endif
@@ -0,0 +1,265 @@
+#include "dictionary.h"
+
+#include "code.h"
+#include "defines.h"
+#include "huffman.h"
+#include "io.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DICTIONARY_FILE_HEADER_SIZE 10 // Magic number, dictionary ID and tree size.
+
+// Description:
+// Hashes a tree dump with 32-bit FNV-1a, to give dictionaries a default ID.
+//
+// Parameters:
+// uint8_t *tree_dump - The tree dump.
+// uint16_t tree_size - The number of bytes in the tree dump.
+//
+// Returns:
+// uint32_t - The hash.
+static uint32_t hash_tree_dump( uint8_t *tree_dump, uint16_t tree_size ) {
+	uint32_t hash = 2166136261u;
+
+	for ( uint16_t i = 0; i < tree_size; i++ ) {
+		hash = ( hash ^ tree_dump[ i ] ) * 16777619u;
+	}
+
+	return hash;
+}
+
+// Description:
+// Builds the tree and code table of a dictionary from its tree dump.
+//
+// Parameters:
+// Dictionary *d - The dictionary.
+//
+// Returns:
+// bool - Whether the tree dump has a code for every symbol.
+static bool dictionary_build( Dictionary *d ) {
+	if ( d->tree_size != MAX_TREE_SIZE ) { // Every symbol needs a code, since inputs aren't scanned first.
+		return false;
+	}
+
+	d->tree = rebuild_tree( d->tree_size, d->tree_dump );
+	build_codes( d->tree, d->table );
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		if ( code_empty( &d->table[ i ] ) ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Description:
+// Creates a dictionary from the histogram of a sample corpus. Every symbol gets
+// a code, even if it doesn't appear in the corpus.
+//
+// Parameters:
+// uint64_t histogram[static ALPHABET] - The histogram of the corpus.
+// uint32_t id - The dictionary ID, or 0 to derive it from the code table.
+//
+// Returns:
+// Dictionary * - A pointer to the newly created dictionary.
+Dictionary *dictionary_create( uint64_t histogram[ static ALPHABET ], uint32_t id ) {
+	Dictionary *d = ( Dictionary * ) calloc( 1, sizeof( Dictionary ) );
+
+	if ( !d ) {
+		return NULL;
+	}
+
+	uint64_t smoothed[ ALPHABET ];
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		smoothed[ i ] = histogram[ i ] + 1; // Unseen symbols still need a (long) code.
+	}
+
+	Node *tree = build_tree( smoothed );
+	d->tree_size = dump_tree( tree, d->tree_dump );
+	delete_tree( &tree );
+	d->id = id ? id : hash_tree_dump( d->tree_dump, d->tree_size );
+
+	if ( !dictionary_build( d ) ) {
+		dictionary_delete( &d );
+	}
+
+	return d;
+}
+
+// Description:
+// Frees the memory given to a dictionary.
+//
+// Parameters:
+// Dictionary **d - A pointer to a pointer to the dictionary.
+//
+// Returns:
+// Nothing.
+void dictionary_delete( Dictionary **d ) {
+	if ( *d ) {
+		delete_tree( &( *d )->tree );
+		free( *d );
+		*d = NULL;
+	}
+}
+
+// Description:
+// Loads a dictionary from a file.
+//
+// Parameters:
+// char *file_name - The dictionary file name.
+//
+// Returns:
+// Dictionary * - A pointer to the loaded dictionary, or NULL on failure.
+Dictionary *dictionary_load( char *file_name ) {
+	int fd = open( file_name, O_RDONLY );
+
+	if ( fd == -1 ) {
+		return NULL;
+	}
+
+	Dictionary *d = ( Dictionary * ) calloc( 1, sizeof( Dictionary ) );
+	uint8_t header[ DICTIONARY_FILE_HEADER_SIZE ];
+
+	if ( d && read_bytes( fd, header, DICTIONARY_FILE_HEADER_SIZE ) == DICTIONARY_FILE_HEADER_SIZE && load_little_endian( header, 4 ) == DICTIONARY_MAGIC ) {
+		d->id = load_little_endian( header + 4, 4 );
+		d->tree_size = load_little_endian( header + 8, 2 );
+
+		if ( d->tree_size > MAX_TREE_SIZE || read_bytes( fd, d->tree_dump, d->tree_size ) != d->tree_size || !dictionary_build( d ) ) {
+			dictionary_delete( &d );
+		}
+	} else {
+		dictionary_delete( &d );
+	}
+
+	close( fd );
+
+	return d;
+}
+
+// Description:
+// Saves a dictionary to a file.
+//
+// Parameters:
+// Dictionary *d - The dictionary.
+// char *file_name - The dictionary file name.
+//
+// Returns:
+// bool - Whether the dictionary was saved successfully.
+bool dictionary_save( Dictionary *d, char *file_name ) {
+	int fd = open( file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+
+	if ( fd == -1 ) {
+		return false;
+	}
+
+	uint8_t header[ DICTIONARY_FILE_HEADER_SIZE ];
+	store_little_endian( header, DICTIONARY_MAGIC, 4 );
+	store_little_endian( header + 4, d->id, 4 );
+	store_little_endian( header + 8, d->tree_size, 2 );
+	bool saved = write_bytes( fd, header, DICTIONARY_FILE_HEADER_SIZE ) == DICTIONARY_FILE_HEADER_SIZE && write_bytes( fd, d->tree_dump, d->tree_size ) == d->tree_size;
+
+	return close( fd ) == 0 && saved;
+}
+
+// Description:
+// Builds the header of a file encoded with a dictionary: the magic number, the
+// dictionary ID and the original file size as a varint. There's no tree dump.
+//
+// Parameters:
+// Dictionary *d - The dictionary.
+// uint64_t original_file_size - The size of the original file.
+// uint8_t header[static DICTIONARY_HEADER_MAX_SIZE] - The buffer to write the header to.
+//
+// Returns:
+// uint32_t - The number of bytes in the header.
+uint32_t dictionary_file_header_create( Dictionary *d, uint64_t original_file_size, uint8_t header[ static DICTIONARY_HEADER_MAX_SIZE ] ) {
+	uint32_t nbytes = 8;
+	store_little_endian( header, MAGIC_DICTIONARY, 4 );
+	store_little_endian( header + 4, d->id, 4 );
+
+	do { // 7 bits per byte, with the high bit set on all but the last byte.
+		header[ nbytes ] = original_file_size & 0x7F;
+		original_file_size >>= 7;
+		header[ nbytes++ ] |= original_file_size ? 0x80 : 0;
+	} while ( original_file_size );
+
+	return nbytes;
+}
+
+// Description:
+// Reads the rest of the header of a file encoded with a dictionary, after its magic number.
+//
+// Parameters:
+// BitReader *r - The bit reader for the file, just past the magic number.
+// uint32_t *id - The pointer to the uint32_t to set to the dictionary ID.
+// uint64_t *original_file_size - The pointer to the uint64_t to set to the original file size.
+// uint64_t *header_size - The pointer to the uint64_t to add the number of bytes read to.
+//
+// Returns:
+// bool - Whether the header was read successfully.
+bool dictionary_file_header_read( BitReader *r, uint32_t *id, uint64_t *original_file_size, uint64_t *header_size ) {
+	uint8_t buf[ 4 ];
+
+	if ( bit_reader_read_bytes( r, buf, 4 ) != 4 ) {
+		return false;
+	}
+
+	*id = load_little_endian( buf, 4 );
+	*header_size += 4;
+	*original_file_size = 0;
+
+	for ( uint32_t shift = 0; shift < 64; shift += 7 ) {
+		if ( bit_reader_read_bytes( r, buf, 1 ) != 1 ) {
+			return false;
+		}
+
+		*original_file_size |= ( uint64_t ) ( buf[ 0 ] & 0x7F ) << shift;
+		*header_size += 1;
+
+		if ( !( buf[ 0 ] & 0x80 ) ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Description:
+// Parses the rest of the header of a file encoded with a dictionary from memory,
+// after its magic number.
+//
+// Parameters:
+// uint8_t *buf - The bytes after the magic number.
+// uint64_t nbytes - The number of bytes in buf.
+// uint32_t *id - The pointer to the uint32_t to set to the dictionary ID.
+// uint64_t *original_file_size - The pointer to the uint64_t to set to the size of the original file.
+// uint64_t *header_size - The pointer to the uint64_t to add the number of bytes parsed to.
+//
+// Returns:
+// bool - Whether the header was complete.
+bool dictionary_file_header_parse( uint8_t *buf, uint64_t nbytes, uint32_t *id, uint64_t *original_file_size, uint64_t *header_size ) {
+	if ( nbytes < 4 ) {
+		return false;
+	}
+
+	*id = load_little_endian( buf, 4 );
+	*original_file_size = 0;
+
+	for ( uint32_t i = 4, shift = 0; i < nbytes && shift < 64; i++, shift += 7 ) {
+		*original_file_size |= ( uint64_t ) ( buf[ i ] & 0x7F ) << shift;
+
+		if ( !( buf[ i ] & 0x80 ) ) {
+			*header_size += i + 1;
+
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,36 @@
+#ifndef __DICTIONARY_H__
+#define __DICTIONARY_H__
+
+#include "code.h"
+#include "defines.h"
+#include "io.h"
+#include "node.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DICTIONARY_HEADER_MAX_SIZE 18 // Magic number, dictionary ID and a 10-byte varint size.
+
+typedef struct Dictionary {
+	uint32_t id;
+	uint16_t tree_size;
+	uint8_t tree_dump[ MAX_TREE_SIZE ];
+	Node *tree;
+	Code table[ ALPHABET ];
+} Dictionary;
+
+Dictionary *dictionary_create( uint64_t histogram[ static ALPHABET ], uint32_t id );
+
+void dictionary_delete( Dictionary **d );
+
+Dictionary *dictionary_load( char *file_name );
+
+bool dictionary_save( Dictionary *d, char *file_name );
+
+uint32_t dictionary_file_header_create( Dictionary *d, uint64_t original_file_size, uint8_t header[ static DICTIONARY_HEADER_MAX_SIZE ] );
+
+bool dictionary_file_header_read( BitReader *r, uint32_t *id, uint64_t *original_file_size, uint64_t *header_size );
+
+bool dictionary_file_header_parse( uint8_t *buf, uint64_t nbytes, uint32_t *id, uint64_t *original_file_size, uint64_t *header_size );
+
+#endif
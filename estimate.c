@@ -0,0 +1,145 @@
+#include "estimate.h"
+
+#include "code.h"
+#include "defines.h"
+#include "huffman.h"
+#include "io.h"
+#include "kernels.h"
+#include "raw_file_header.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Description:
+// Computes the Shannon entropy of the bytes counted in a histogram.
+//
+// Parameters:
+// uint64_t histogram[static ALPHABET] - The histogram.
+//
+// Returns:
+// double - The entropy in bits per byte, or 0 if the histogram is empty.
+double histogram_entropy( uint64_t histogram[ static ALPHABET ] ) {
+	uint64_t total = 0;
+	double entropy = 0;
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		total += histogram[ i ];
+	}
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		if ( histogram[ i ] != 0 ) {
+			double p = ( double ) histogram[ i ] / total;
+			entropy -= p * log2( p );
+		}
+	}
+
+	return entropy;
+}
+
+// Description:
+// Predicts the compressed size of a file from the histogram of all or part of it,
+// by building the Huffman codes the encoder would build from it.
+//
+// Parameters:
+// uint64_t histogram[static ALPHABET] - The histogram of the sample.
+// uint64_t file_size - The size of the whole file.
+// Estimate *e - The estimate to fill in.
+//
+// Returns:
+// Nothing.
+void estimate_from_histogram( uint64_t histogram[ static ALPHABET ], uint64_t file_size, Estimate *e ) {
+	uint64_t sample_size = 0;
+	uint64_t coded_bits = 0;
+	uint32_t unique_symbols = 0;
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		sample_size += histogram[ i ];
+		unique_symbols += histogram[ i ] != 0;
+	}
+
+	Node *tree = build_tree( histogram );
+	Code table[ ALPHABET ] = { 0 };
+	build_codes( tree, table );
+	delete_tree( &tree );
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		coded_bits += histogram[ i ] * table[ i ].top;
+	}
+
+	e->file_size = file_size;
+	e->sample_size = sample_size;
+	e->entropy = histogram_entropy( histogram );
+	e->code_length = sample_size ? ( double ) coded_bits / sample_size : 0;
+	e->compressed_size = sizeof( RawFileHeader ) + ( unique_symbols ? 3 * unique_symbols - 1 : 0 ) + ( uint64_t ) ceil( file_size * e->code_length / 8 );
+}
+
+// Description:
+// Estimates how well a file compresses from ESTIMATE_SAMPLES blocks spread evenly
+// through it, without reading the rest. Small files are read whole, and so are
+// files that can't seek, whose estimates are then exact. Leaves a seekable file's
+// offset where it was.
+//
+// Parameters:
+// int infile - The input file.
+// Estimate *e - The estimate to fill in.
+//
+// Returns:
+// bool - Whether the file could be read.
+bool estimate_file( int infile, Estimate *e ) {
+	uint64_t histogram[ ALPHABET ] = { 0 };
+	uint8_t *buf = io_buffer_create( ESTIMATE_SAMPLE_SIZE );
+	off_t start = lseek( infile, 0, SEEK_CUR );
+	struct stat stats;
+
+	if ( !buf || fstat( infile, &stats ) == -1 ) {
+		io_buffer_delete( &buf );
+
+		return false;
+	}
+
+	uint64_t file_size = 0;
+	uint32_t bytes_read;
+
+	if ( start == -1 || ( uint64_t ) stats.st_size <= ( uint64_t ) ESTIMATE_SAMPLES * ESTIMATE_SAMPLE_SIZE ) { // Read it all.
+		while ( ( bytes_read = read_bytes( infile, buf, ESTIMATE_SAMPLE_SIZE ) ) != 0 ) {
+			histogram_update( histogram, buf, bytes_read );
+			file_size += bytes_read;
+		}
+	} else {
+		file_size = stats.st_size;
+
+		for ( uint32_t i = 0; i < ESTIMATE_SAMPLES; i++ ) {
+			uint64_t offset = ( file_size - ESTIMATE_SAMPLE_SIZE ) / ( ESTIMATE_SAMPLES - 1 ) * i / BLOCK * BLOCK; // Aligned, for direct I/O.
+
+			if ( lseek( infile, offset, SEEK_SET ) == -1 ) {
+				break;
+			}
+
+			histogram_update( histogram, buf, read_bytes( infile, buf, ESTIMATE_SAMPLE_SIZE ) );
+		}
+	}
+
+	if ( start != -1 ) {
+		lseek( infile, start, SEEK_SET );
+	}
+
+	io_buffer_delete( &buf );
+	estimate_from_histogram( histogram, file_size, e );
+
+	return true;
+}
+
+// Description:
+// Gets the predicted space saving of an estimate.
+//
+// Parameters:
+// Estimate *e - The estimate.
+//
+// Returns:
+// double - The predicted space saving, in percent.
+double estimate_saving( Estimate *e ) {
+	return e->file_size ? 100 * ( 1 - ( double ) e->compressed_size / e->file_size ) : 0;
+}
@@ -0,0 +1,28 @@
+#ifndef __ESTIMATE_H__
+#define __ESTIMATE_H__
+
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ESTIMATE_SAMPLES     16 // Blocks sampled from a file.
+#define ESTIMATE_SAMPLE_SIZE ( 16 * BLOCK ) // 64KB per sampled block.
+
+typedef struct Estimate {
+	uint64_t file_size;
+	uint64_t sample_size;
+	double entropy;
+	double code_length;
+	uint64_t compressed_size;
+} Estimate;
+
+double histogram_entropy( uint64_t histogram[ static ALPHABET ] );
+
+void estimate_from_histogram( uint64_t histogram[ static ALPHABET ], uint64_t file_size, Estimate *e );
+
+bool estimate_file( int infile, Estimate *e );
+
+double estimate_saving( Estimate *e );
+
+#endif
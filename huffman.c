@@ -6,6 +6,7 @@
 #include "priority_queue.h"
 #include "stack.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -43,6 +44,34 @@ Node *build_tree( uint64_t hist[ static ALPHABET ] ) {
 	return root_node;
 }
 
+// Description:
+// Walks a Huffman tree, recording the code of each leaf it reaches.
+//
+// Parameters:
+// Node *root - The root node of the subtree to walk.
+// Code *code - The code of the path to the subtree.
+// Code table[static ALPHABET] - The table of codes.
+//
+// Returns:
+// Nothing.
+static void build_codes_from( Node *root, Code *code, Code table[ static ALPHABET ] ) {
+	if ( !root ) { // Empty Huffman tree.
+		return;
+	}
+
+	if ( !root->left && !root->right ) { // Node is a leaf.
+		table[ root->symbol ] = *code;
+	} else { // Node is an interior node.
+		uint8_t popped_bit;
+		code_push_bit( code, 0 );
+		build_codes_from( root->left, code, table );
+		code_pop_bit( code, &popped_bit );
+		code_push_bit( code, 1 );
+		build_codes_from( root->right, code, table );
+		code_pop_bit( code, &popped_bit );
+	}
+}
+
 // Description:
 // Builds a table of codes from a Huffman tree.
 //
@@ -53,53 +82,101 @@ Node *build_tree( uint64_t hist[ static ALPHABET ] ) {
 // Returns:
 // Nothing.
 void build_codes( Node *root, Code table[ static ALPHABET ] ) {
-	static Code code = { 0 };
+	Code code = { 0 };
+	build_codes_from( root, &code, table );
+}
 
-	if ( !root ) { // Empty Huffman tree.
-		return;
+// Description:
+// Dumps a subtree of a Huffman tree in post-order.
+//
+// Parameters:
+// Node *root - The root node of the subtree.
+// uint8_t *tree - The buffer to write the subtree dump to.
+//
+// Returns:
+// uint16_t - The number of bytes in the subtree dump.
+static uint16_t dump_subtree( Node *root, uint8_t *tree ) {
+	if ( !root ) {
+		return 0;
 	}
 
+	uint16_t nbytes = dump_subtree( root->left, tree );
+	nbytes += dump_subtree( root->right, tree + nbytes );
+
 	if ( !root->left && !root->right ) { // Node is a leaf.
-		table[ root->symbol ] = code;
+		tree[ nbytes++ ] = 'L';
+		tree[ nbytes++ ] = root->symbol;
 	} else { // Node is an interior node.
-		uint8_t popped_bit;
-		code_push_bit( &code, 0 );
-		build_codes( root->left, table );
-		code_pop_bit( &code, &popped_bit );
-		code_push_bit( &code, 1 );
-		build_codes( root->right, table );
-		code_pop_bit( &code, &popped_bit );
+		tree[ nbytes++ ] = 'I';
 	}
+
+	return nbytes;
 }
 
 // Description:
-// Builds a Huffman tree from a post-order tree dump.
+// Dumps a Huffman tree in post-order: 'L' followed by the symbol for a leaf,
+// and 'I' for an interior node.
+//
+// Parameters:
+// Node *root - The root node of the Huffman tree.
+// uint8_t tree[static MAX_TREE_SIZE] - The buffer to write the tree dump to.
+//
+// Returns:
+// uint16_t - The number of bytes in the tree dump.
+uint16_t dump_tree( Node *root, uint8_t tree[ static MAX_TREE_SIZE ] ) {
+	return dump_subtree( root, tree );
+}
+
+// Description:
+// Builds a Huffman tree from a post-order tree dump. A corrupt dump, one that
+// doesn't describe exactly one tree, builds nothing.
 //
 // Parameters:
 // uint16_t nbytes - The number of bytes in the tree dump.
 // uint8_t tree[static nbytes] - The tree dump.
 //
 // Returns:
-// Node * - The root node of the built Huffman tree.
+// Node * - The root node of the built Huffman tree, or NULL if the dump is empty or corrupt.
 Node *rebuild_tree( uint16_t nbytes, uint8_t tree[ static nbytes ] ) {
 	Stack *huffman_stack = stack_create( nbytes );
+	Node *root_node = NULL;
+	bool valid = huffman_stack != NULL;
 
-	for ( uint16_t i = 0; i < nbytes; i++ ) {
-		if ( tree[ i ] == 'L' ) { // Leaf node.
+	for ( uint16_t i = 0; valid && i < nbytes; i++ ) {
+		if ( tree[ i ] == 'L' && i + 1 < nbytes ) { // Leaf node.
 			stack_push( huffman_stack, node_create( tree[ i + 1 ], 1 ) );
 			i++; // Skip next element.
 		} else if ( tree[ i ] == 'I' ) { // Interior node.
-			Node *left_child;
-			Node *right_child;
+			Node *left_child = NULL;
+			Node *right_child = NULL;
 			stack_pop( huffman_stack, &right_child );
 			stack_pop( huffman_stack, &left_child );
-			stack_push( huffman_stack, node_join( left_child, right_child ) );
+			valid = left_child != NULL;
+
+			if ( valid ) {
+				stack_push( huffman_stack, node_join( left_child, right_child ) );
+			} else {
+				delete_tree( &right_child );
+			}
+		} else {
+			valid = false;
 		}
 	}
 
-	Node *root_node = NULL;
-	stack_pop( huffman_stack, &root_node );
-	stack_delete( &huffman_stack );
+	if ( huffman_stack ) {
+		stack_pop( huffman_stack, &root_node );
+
+		if ( !valid || !stack_empty( huffman_stack ) ) { // Free the nodes of a dump that doesn't join into one tree.
+			Node *node = NULL;
+			delete_tree( &root_node );
+
+			while ( stack_pop( huffman_stack, &node ) ) {
+				delete_tree( &node );
+			}
+		}
+
+		stack_delete( &huffman_stack );
+	}
 
 	return root_node;
 }
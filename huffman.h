@@ -11,6 +11,8 @@ Node *build_tree( uint64_t hist[ static ALPHABET ] );
 
 void build_codes( Node *root, Code table[ static ALPHABET ] );
 
+uint16_t dump_tree( Node *root, uint8_t tree[ static MAX_TREE_SIZE ] );
+
 Node *rebuild_tree( uint16_t nbytes, uint8_t tree[ static nbytes ] );
 
 void delete_tree( Node **root );
@@ -0,0 +1,261 @@
+#include "codec.h"
+#include "defines.h"
+#include "dictionary.h"
+#include "io.h"
+#include "protocol.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OPTIONS          "hvdi:o:s:D:" // Valid options for the program.
+#define SIZE_OF_MESSAGE  256 // Max size of an error message from the daemon.
+
+static struct option long_options[] = {
+	{ "help", no_argument, NULL, 'h' },
+	{ "verbose", no_argument, NULL, 'v' },
+	{ "decompress", no_argument, NULL, 'd' },
+	{ "input", required_argument, NULL, 'i' },
+	{ "output", required_argument, NULL, 'o' },
+	{ "socket", required_argument, NULL, 's' },
+	{ "dictionary", required_argument, NULL, 'D' },
+	{ NULL, 0, NULL, 0 },
+};
+
+// Description:
+// Prints the help message to stderr.
+//
+// Parameters:
+// char *program_path - The path to the program.
+//
+// Returns:
+// Nothing.
+static void print_help( char *program_path ) {
+	fprintf( stderr,
+	    "SYNOPSIS\n   Compresses or decompresses a file through a running huffmand.\n\nUSAGE\n   %s [-hvd] [-i infile] [-o outfile] [-s socket] [-D dict]\n\nOPTIONS\n   -h             Prints the program help text.\n   -v             Prints "
+	    "compression statistics to stderr.\n   -d             Decompresses instead of compressing.\n   -i infile      Input file (default: stdin).\n   -o outfile     Output file (default: stdout).\n   -s socket      Unix socket huffmand "
+	    "listens on (default: $XDG_RUNTIME_DIR/" SOCKET_NAME ").\n   -D dict        Compresses with a dictionary made by huffman_train, which huffmand has to serve.\n",
+	    program_path );
+}
+
+// Description:
+// Reads all of a file into a buffer.
+//
+// Parameters:
+// int input_file - The input file.
+// CodecBuffer *b - The buffer to read into.
+//
+// Returns:
+// bool - Whether the file fit in memory and in a request.
+static bool read_input( int input_file, CodecBuffer *b ) {
+	uint32_t block_size = io_block_size( );
+	uint32_t bytes_read;
+	b->size = 0;
+
+	do {
+		if ( b->size + block_size > PROTOCOL_MAX_PAYLOAD || !codec_buffer_reserve( b, b->capacity < b->size + block_size ? 2 * ( b->size + block_size ) : b->capacity ) ) {
+			return false;
+		}
+
+		bytes_read = read_bytes( input_file, b->data + b->size, block_size );
+		b->size += bytes_read;
+	} while ( bytes_read != 0 );
+
+	return true;
+}
+
+// Description:
+// Sends a request to the daemon and writes the result to the output file.
+//
+// Parameters:
+// int fd - The connected socket.
+// Request *request - The request, with its size set.
+// uint8_t *payload - The payload of the request.
+// int output_file - The output file.
+// uint64_t *output_size - The pointer to the uint64_t to set to the size of the result.
+//
+// Returns:
+// bool - Whether the request succeeded.
+static bool run_request( int fd, Request *request, uint8_t *payload, int output_file, uint64_t *output_size ) {
+	Response response;
+	bool sent = protocol_write_request( fd, request ) && write_bytes( fd, payload, request->size ) == request->size;
+
+	if ( !protocol_read_response( fd, &response ) ) { // Read even if sending failed: a rejected request is answered before its payload is read.
+		fprintf( stderr, "Error: lost connection to huffmand.\n" );
+
+		return false;
+	}
+
+	if ( response.status != RESPONSE_OK || !sent ) {
+		char message[ SIZE_OF_MESSAGE ] = { 0 };
+		read_bytes( fd, ( uint8_t * ) message, response.size < SIZE_OF_MESSAGE - 1 ? response.size : SIZE_OF_MESSAGE - 1 );
+		fprintf( stderr, "Error: %s.\n", message );
+
+		return false;
+	}
+
+	uint32_t block_size = io_block_size( );
+	uint8_t *buffer = io_buffer_create( block_size );
+	uint64_t remaining = response.size;
+
+	while ( buffer && remaining != 0 ) {
+		uint32_t wanted = remaining < block_size ? remaining : block_size;
+
+		if ( read_bytes( fd, buffer, wanted ) != wanted ) {
+			fprintf( stderr, "Error: lost connection to huffmand.\n" );
+
+			break;
+		}
+
+		if ( write_bytes( output_file, buffer, wanted ) != wanted ) {
+			fprintf( stderr, "Error: failed to write outfile.\n" );
+
+			break;
+		}
+
+		remaining -= wanted;
+	}
+
+	io_buffer_delete( &buffer );
+	*output_size = response.size;
+
+	return remaining == 0;
+}
+
+// Description:
+// The entry point of the program.
+//
+// Parameters:
+// int argc - The argument count.
+// char **argv - The argument vector.
+//
+// Returns:
+// int - The exit status of the program (0 = success, otherwise error).
+int main( int argc, char **argv ) {
+	int opt = 0;
+	bool verbose = false;
+	char *input_file_name = NULL;
+	char *output_file_name = NULL;
+	char *socket_path = NULL;
+	char *dictionary_file_name = NULL;
+	Request request = { REQUEST_COMPRESS, 0, 0, 0 };
+
+	while ( ( opt = getopt_long( argc, argv, OPTIONS, long_options, NULL ) ) != -1 ) { // Process each option specified.
+		switch ( opt ) {
+		case 'h': print_help( *argv ); return 0; // Help.
+		case 'v': verbose = true; break; // Verbose.
+		case 'd': request.type = REQUEST_DECOMPRESS; break; // Decompress.
+		case 'i': input_file_name = optarg; break; // Input file.
+		case 'o': output_file_name = optarg; break; // Output file.
+		case 's': socket_path = optarg; break; // Socket path.
+		case 'D': dictionary_file_name = optarg; break; // Dictionary.
+		default: print_help( *argv ); return 1; // Invalid flag.
+		}
+	}
+
+	if ( dictionary_file_name && request.type == REQUEST_COMPRESS ) { // Only its ID is sent; huffmand has its tables.
+		Dictionary *dictionary = dictionary_load( dictionary_file_name );
+
+		if ( !dictionary ) {
+			fprintf( stderr, "Error: failed to load dictionary.\n" );
+
+			return 1;
+		}
+
+		request.flags |= REQUEST_DICTIONARY;
+		request.dictionary_id = dictionary->id;
+		dictionary_delete( &dictionary );
+	}
+
+	char *default_path = socket_path ? NULL : protocol_default_path( );
+	socket_path = socket_path ? socket_path : default_path;
+
+	if ( !socket_path ) {
+		fprintf( stderr, "Error: $XDG_RUNTIME_DIR isn't set, so a socket has to be given with -s.\n" );
+
+		return 1;
+	}
+
+	signal( SIGPIPE, SIG_IGN ); // A daemon that goes away shows up as a failed write.
+	int input_file = input_file_name ? open( input_file_name, O_RDONLY ) : STDIN_FILENO;
+
+	if ( input_file == -1 ) {
+		fprintf( stderr, "Error: failed to open infile.\n" );
+		free( default_path );
+
+		return 1;
+	}
+
+	CodecBuffer input = { 0 };
+
+	if ( !read_input( input_file, &input ) ) {
+		fprintf( stderr, "Error: input too large.\n" );
+		codec_buffer_release( &input );
+		free( default_path );
+
+		return 1;
+	}
+
+	int fd = protocol_connect( socket_path );
+
+	if ( fd == -1 ) {
+		fprintf( stderr, "Error: failed to connect to huffmand on %s.\n", socket_path );
+	}
+
+	free( default_path );
+
+	if ( fd == -1 ) {
+		codec_buffer_release( &input );
+
+		return 1;
+	}
+
+	int output_file = output_file_name ? open( output_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0600 ) : STDOUT_FILENO;
+	bool success = output_file != -1;
+	uint64_t output_size = 0;
+
+	if ( !success ) {
+		fprintf( stderr, "Error: failed to open outfile.\n" );
+	} else {
+		request.size = input.size;
+		success = run_request( fd, &request, input.data, output_file, &output_size );
+	}
+
+	if ( success && output_file_name ) { // Set permissions of output_file to that of input_file (0600 if input file isn't seekable).
+		struct stat input_file_stats;
+		fstat( input_file, &input_file_stats );
+		fchmod( output_file, lseek( input_file, 0, SEEK_CUR ) == -1 ? 0600 : input_file_stats.st_mode );
+	}
+
+	if ( success && verbose ) {
+		uint64_t original_size = request.type == REQUEST_COMPRESS ? input.size : output_size;
+		uint64_t compressed_size = request.type == REQUEST_COMPRESS ? output_size : input.size;
+		double space_saving = 100 * ( 1 - ( ( double ) compressed_size / original_size ) );
+		fprintf( stderr, "%s file size: %" PRIu64 " bytes\n", request.type == REQUEST_COMPRESS ? "Uncompressed" : "Compressed", request.type == REQUEST_COMPRESS ? original_size : compressed_size );
+		fprintf( stderr, "%s file size: %" PRIu64 " bytes\n", request.type == REQUEST_COMPRESS ? "Compressed" : "Decompressed", request.type == REQUEST_COMPRESS ? compressed_size : original_size );
+		fprintf( stderr, "Space saving: %.2f%%\n", space_saving );
+	}
+
+	if ( !success && output_file_name && output_file != -1 ) {
+		unlink( output_file_name );
+	}
+
+	close( fd );
+	codec_buffer_release( &input );
+
+	if ( output_file_name && output_file != -1 ) {
+		close( output_file );
+	}
+
+	if ( input_file_name ) {
+		close( input_file );
+	}
+
+	return success ? 0 : 1;
+}
@@ -1,8 +1,16 @@
+#include "batch.h"
+#include "container.h"
+#include "decode_table.h"
 #include "defines.h"
-#include "file_header.h"
+#include "dictionary.h"
 #include "huffman.h"
 #include "io.h"
-#include "raw_file_header.h"
+#include "kernels.h"
+#include "output.h"
+#include "records.h"
+#include "search.h"
+#include "stats.h"
+#include "thread_pool.h"
 
 #include <fcntl.h>
 #include <getopt.h>
@@ -10,13 +18,44 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-#define OPTIONS "hvi:o:" // Valid options for the program.
-
-static int input_file = -1;
-static int output_file = -1;
+#define OPTIONS         "hvi:o:b:j:S:O:F:D:e:" // Valid options for the program.
+#define DEFAULT_SUFFIX  ".huff" // Suffix stripped from compressed files in batch mode.
+#define SIZE_OF_MESSAGE 64 // Max size of a formatted error message.
+
+enum { OPTION_DIRECT = 256, OPTION_NO_FADVISE, OPTION_STATS_JSON, OPTION_NO_MMAP, OPTION_RECORD, OPTION_GREP_FILE, OPTION_GREP_OFFSETS, OPTION_GREP_COUNT }; // Long-only options.
+
+static struct option long_options[] = {
+	{ "help", no_argument, NULL, 'h' },
+	{ "verbose", no_argument, NULL, 'v' },
+	{ "input", required_argument, NULL, 'i' },
+	{ "output", required_argument, NULL, 'o' },
+	{ "block-size", required_argument, NULL, 'b' },
+	{ "direct", no_argument, NULL, OPTION_DIRECT },
+	{ "no-fadvise", no_argument, NULL, OPTION_NO_FADVISE },
+	{ "jobs", required_argument, NULL, 'j' },
+	{ "suffix", required_argument, NULL, 'S' },
+	{ "output-dir", required_argument, NULL, 'O' },
+	{ "files-from", required_argument, NULL, 'F' },
+	{ "dictionary", required_argument, NULL, 'D' },
+	{ "stats-json", required_argument, NULL, OPTION_STATS_JSON },
+	{ "no-mmap", no_argument, NULL, OPTION_NO_MMAP },
+	{ "record", required_argument, NULL, OPTION_RECORD },
+	{ "grep", required_argument, NULL, 'e' },
+	{ "grep-file", required_argument, NULL, OPTION_GREP_FILE },
+	{ "grep-offsets", no_argument, NULL, OPTION_GREP_OFFSETS },
+	{ "grep-count", no_argument, NULL, OPTION_GREP_COUNT },
+	{ NULL, 0, NULL, 0 },
+};
+
+static Dictionary *dictionary = NULL; // Shared code table for files encoded with one, if one was given.
+static Stats *stats = NULL; // Per-phase timings, kept when decompressing a single file with -v or --stats-json.
+static bool extract = false; // Whether to decode one record of a file encoded with --records.
+static uint64_t record_number = 0; // The record to decode, counting from 0.
+static Search *search = NULL; // Patterns to search the decoded bytes for instead of writing them out, if given.
 
 // Description:
 // Prints the help message to stderr.
@@ -28,28 +67,35 @@ static int output_file = -1;
 // Nothing.
 static void print_help( char *program_path ) {
 	fprintf( stderr,
-	    "SYNOPSIS\n   A Huffman decoder implementation.\n\nUSAGE\n   %s [-hv] [-i infile] [-o outfile]\n\nOPTIONS\n   -h             Prints the program help text.\n   -v             Prints "
-	    "compression statistics to stderr.\n   -i infile      Input file to decompress.\n   -o outfile     File to output the decompressed data to.\n",
-	    program_path );
+	    "SYNOPSIS\n   A Huffman decoder implementation.\n\nUSAGE\n   %s [-hv] [-i infile] [-o outfile] [-b size] [-D dict] [--direct] [--no-fadvise] [--no-mmap] [--stats-json file] [--record n]\n   %s [-v] [-i infile] [-o outfile] [-D dict] [--record n] -e pattern... [--grep-file file] [--grep-offsets | --grep-count]\n   %s [-hv] [-j threads] [-S suffix] [-O dir] [-F list] [file...]\n\nOPTIONS\n   -h             Prints the program help text.\n   -v             Prints "
+	    "compression statistics to stderr.\n   -i infile      Input file to decompress.\n   -o outfile     File to output the decompressed data to.\n   -b size        I/O buffer size, a multiple of 4K up to "
+	    "64M (default: 256K).\n   -D dict        Dictionary for files encoded with one.\n   --direct       Bypasses the page cache with O_DIRECT where the file system supports it.\n   --no-fadvise   Doesn't give the kernel readahead and cache eviction hints.\n   --no-mmap      Writes outfile with pwrite() instead of decoding into a mapping of it.\n   --stats-json file\n                  Saves per-phase timings and hardware counters as JSON (\"-\" for stderr).\n   --record n     Decodes only record n (from 0) of a file encoded with --records.\n\nSEARCH OPTIONS\n   -e pattern     Prints the decoded lines with pattern in them instead of the decoded file. May be given more than once.\n   --grep-file file\n                  Searches for each line of file as a pattern.\n   --grep-offsets Prints the byte offset and pattern of each match instead of lines.\n   --grep-count   Prints the number of matching lines instead of lines.\n\nBATCH OPTIONS\n   file...        Input files to decompress, each to "
+	    "its own output file.\n   -F list        Reads input file names from list, one per line (\"-\" for stdin).\n   -j threads     Number of files to decompress at once, or threads to decompress a single large file with (default: one per CPU).\n   -S suffix      "
+	    "Suffix stripped from output file names, or .out is appended if missing (default: .huff).\n   -O dir         Directory to write output files to (default: next to the input files).\n",
+	    program_path, program_path, program_path );
 }
 
 // Description:
-// Cleans up memory used by the program if it's been allocated.
+// Closes the input and output files and frees the bit reader if they've been allocated.
 //
 // Parameters:
-// Nothing.
+// int *input_file - A pointer to the input file.
+// int *output_file - A pointer to the output file.
+// BitReader **reader - A pointer to a pointer to the bit reader for the input file.
 //
 // Returns:
 // Nothing.
-static void cleanup_memory( ) {
-	if ( output_file != -1 ) {
-		close( output_file );
-		output_file = -1;
+static void cleanup_files( int *input_file, int *output_file, BitReader **reader ) {
+	bit_reader_delete( reader );
+
+	if ( *output_file != -1 ) {
+		close( *output_file );
+		*output_file = -1;
 	}
 
-	if ( input_file != -1 ) {
-		close( input_file );
-		input_file = -1;
+	if ( *input_file != -1 ) {
+		close( *input_file );
+		*input_file = -1;
 	}
 }
 
@@ -59,17 +105,19 @@ static void cleanup_memory( ) {
 // Parameters:
 // char *input_file_name - The input file name given by the user.
 // char *output_file_name - The output file name given by the user.
+// int *input_file - A pointer to the input file, set if input_file_name is given.
+// int *output_file - A pointer to the output file, set if output_file_name is given.
 //
 // Returns:
 // bool - Whether processing was successful.
-static bool process_input_output_files( char *input_file_name, char *output_file_name ) {
-	if ( input_file_name && ( input_file = open( input_file_name, O_RDONLY ) ) <= 0 ) {
+static bool process_input_output_files( char *input_file_name, char *output_file_name, int *input_file, int *output_file ) {
+	if ( input_file_name && ( *input_file = io_open( input_file_name, O_RDONLY, 0 ) ) <= 0 ) {
 		fprintf( stderr, "Error: failed to open infile.\n" );
 
 		return false;
 	}
 
-	if ( output_file_name && ( output_file = open( output_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0600 ) ) <= 0 ) {
+	if ( output_file_name && ( *output_file = io_open( output_file_name, O_RDWR | O_CREAT | O_TRUNC, 0600 ) ) <= 0 ) {
 		fprintf( stderr, "Error: failed to open outfile.\n" );
 
 		return false;
@@ -79,70 +127,361 @@ static bool process_input_output_files( char *input_file_name, char *output_file
 }
 
 // Description:
-// Decodes codes read from the file and writes the decoded symbol to the output file.
+// Finds the codes of one record of a file encoded with --records from its index.
 //
 // Parameters:
+// int input_file - The input file, which must be seekable.
+// uint64_t code_start - The offset of the codes in the input file.
+// uint64_t count - The number of records.
+// uint64_t *offset - The pointer to the uint64_t to set to the offset of the record's codes in the file.
+// uint64_t *size - The pointer to the uint64_t to set to the size of the record's codes.
+// uint64_t *nbytes - The pointer to the uint64_t to set to the length of the record.
+//
+// Returns:
+// bool - Whether the index entry was valid.
+static bool find_record( int input_file, uint64_t code_start, uint64_t count, uint64_t *offset, uint64_t *size, uint64_t *nbytes ) {
+	struct stat input_file_stats;
+
+	if ( fstat( input_file, &input_file_stats ) == -1 || ( uint64_t ) input_file_stats.st_size < code_start || count > ( input_file_stats.st_size - code_start ) / RECORD_INDEX_ENTRY ) {
+		return false;
+	}
+
+	uint64_t code_size = input_file_stats.st_size - code_start - count * RECORD_INDEX_ENTRY;
+	uint8_t entries[ 2 * RECORD_INDEX_ENTRY ];
+	uint32_t wanted = record_number + 1 < count ? 2 * RECORD_INDEX_ENTRY : RECORD_INDEX_ENTRY;
+	uint64_t end = code_size;
+	uint32_t length = 0;
+
+	if ( pread_bytes( input_file, entries, wanted, code_start + code_size + record_number * RECORD_INDEX_ENTRY ) != wanted ) {
+		return false;
+	}
+
+	record_entry_parse( entries, offset, &length );
+
+	if ( wanted > RECORD_INDEX_ENTRY ) { // The record's codes end where the next record's start.
+		uint32_t next_length = 0;
+		record_entry_parse( entries + RECORD_INDEX_ENTRY, &end, &next_length );
+	}
+
+	if ( *offset > end || end > code_size ) {
+		return false;
+	}
+
+	*size = end - *offset;
+	*offset += code_start;
+	*nbytes = length;
+
+	return true;
+}
+
+// Description:
+// Decodes one record of a file encoded with --records, with one read of its codes.
+//
+// Parameters:
+// int input_file - The input file.
+// Output *output - The output for the output file.
 // Node *huffman_tree - The Huffman tree used to find symbols.
-// uint64_t file_size - The size of the decoded file in bytes.
-// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes written to.
+// uint64_t offset - The offset of the record's codes in the file.
+// uint64_t size - The size of the record's codes.
+// uint64_t nbytes - The length of the record.
+// uint64_t *compressed_size - Pointer to uint64_t to add number of bytes read to.
 //
 // Returns:
-// bool - Whether the codes were able to be decoded.
-static bool write_decoded_codes( Node *huffman_tree, uint64_t file_size, uint64_t *compressed_size ) {
-	uint64_t bytes_read = 0;
-	uint32_t bits_read_in_byte = 0; // Use this instead of counting bits in a uint64_t to prevent overflow (even though it practically shouldn't happen).
-	uint64_t symbols_written = 0;
-	Node *current_node = huffman_tree;
-	uint8_t write_buffer[ BLOCK ] = { 0 };
-	uint32_t write_buffer_top = 0;
-	uint8_t bit;
-
-	while ( symbols_written < file_size ) {
-		if ( huffman_tree->left || huffman_tree->right ) { // Root node is not a leaf. (Root node is a leaf when there is only one unique symbol.)
-			if ( !read_bit( input_file, &bit ) ) {
-				return false;
-			}
+// bool - Whether the record was able to be decoded.
+static bool write_record( int input_file, Output *output, Node *huffman_tree, uint64_t offset, uint64_t size, uint64_t nbytes, uint64_t *compressed_size ) {
+	if ( !huffman_tree ) { // Empty tree, only valid for empty records.
+		return nbytes == 0;
+	}
 
-			// Increment bits_read_in_byte and bytes_read as needed.
-			bits_read_in_byte++;
+	if ( size > nbytes * MAX_CODE_SIZE + 1 ) { // More bytes than the longest codes could fill.
+		return false;
+	}
 
-			if ( bits_read_in_byte == 8 ) {
-				bytes_read++;
-				bits_read_in_byte = 0;
-			}
+	uint8_t *codes = ( uint8_t * ) calloc( size + sizeof( uint64_t ), 1 ); // Decoding loads whole words past the end.
+	DecodeTable *table = NULL;
+	bool corrupt = !codes || pread_bytes( input_file, codes, size, offset ) != size;
 
-			// Walk down the correct node.
-			if ( bit == 0 ) {
-				current_node = current_node->left;
-			} else { // Bit is a 1.
-				current_node = current_node->right;
-			}
+	if ( !corrupt && ( huffman_tree->left || huffman_tree->right ) ) {
+		corrupt = !( table = decode_table_create( huffman_tree ) );
+	}
 
-			if ( !current_node ) {
-				return false;
-			}
+	BitWindow bits = { codes, 0, 8 * size, true };
+	uint64_t decoded = 0;
+	stats_phase( stats, "decode" );
+
+	while ( decoded < nbytes && !corrupt ) {
+		uint32_t wanted = 0;
+		uint8_t *window = output_window( output, &wanted );
+		uint32_t count = wanted;
+
+		if ( table ) {
+			count = decode_symbols( table, &bits, window, wanted, &corrupt );
+			corrupt = corrupt || count == 0; // Codes ended before the last symbol.
+		} else {
+			memset( window, huffman_tree->symbol, wanted ); // Every symbol is the same, and has no bits.
 		}
 
-		if ( !current_node->left && !current_node->right ) { // Node is a leaf.
-			write_buffer[ write_buffer_top ] = current_node->symbol; // Write to buffer.
-			write_buffer_top++;
+		output_commit( output, count );
+		decoded += count;
+	}
+
+	stats_phase( stats, NULL );
+	decode_table_delete( &table );
+	free( codes );
+	*compressed_size += size + RECORD_INDEX_ENTRY;
 
-			if ( write_buffer_top == BLOCK ) { // Write buffer is full.
-				write_bytes( output_file, write_buffer, BLOCK );
-				write_buffer_top = 0;
-			}
+	return !corrupt;
+}
+
+// Description:
+// Reports a corrupted or unreadable input file and cleans up after it.
+//
+// Parameters:
+// char *message - The error message.
+// char *output_file_name - The output file name, deleted if given.
+// int *input_file - A pointer to the input file.
+// int *output_file - A pointer to the output file.
+// BitReader **reader - A pointer to a pointer to the bit reader for the input file.
+//
+// Returns:
+// bool - Always false.
+static bool fail_file( char *message, char *output_file_name, int *input_file, int *output_file, BitReader **reader ) {
+	fprintf( stderr, "%s", message );
+
+	if ( output_file_name ) {
+		unlink( output_file_name ); // Delete output file.
+	}
+
+	cleanup_files( input_file, output_file, reader );
 
-			symbols_written++;
-			current_node = huffman_tree;
+	return false;
+}
+
+// Description:
+// Decompresses a file.
+//
+// Parameters:
+// char *input_file_name - The input file name, or NULL for stdin.
+// char *output_file_name - The output file name, or NULL for stdout.
+// uint64_t *compressed_size - The pointer to the uint64_t to set to the input size.
+// uint64_t *decompressed_size - The pointer to the uint64_t to set to the output size.
+//
+// Returns:
+// bool - Whether the file was decompressed successfully.
+static bool decompress_file( char *input_file_name, char *output_file_name, uint64_t *compressed_size, uint64_t *decompressed_size ) {
+	int input_file = input_file_name ? -1 : STDIN_FILENO;
+	int output_file = output_file_name ? -1 : STDOUT_FILENO;
+	BitReader *reader = NULL;
+
+	if ( !process_input_output_files( input_file_name, output_file_name, &input_file, &output_file ) ) {
+		cleanup_files( &input_file, &output_file, &reader );
+
+		return false;
+	}
+
+	stats_phase( stats, "header" );
+	io_advise_sequential( input_file );
+	reader = bit_reader_create( input_file );
+
+	if ( !reader ) {
+		return fail_file( "Error: out of memory.\n", output_file_name, &input_file, &output_file, &reader );
+	}
+
+	*compressed_size = 0;
+	Container container;
+	ContainerStatus status = container_read_header( reader, &container, compressed_size );
+
+	if ( status == CONTAINER_UNKNOWN ) {
+		return fail_file( "Error: unable to read file header. Invalid input file or input file corrupted.\n", output_file_name, &input_file, &output_file, &reader );
+	}
+
+	if ( status != CONTAINER_OK ) {
+		return fail_file( "Error: input file corrupted.\n", output_file_name, &input_file, &output_file, &reader );
+	}
+
+	if ( container.header.magic_number == MAGIC_DICTIONARY ) {
+		if ( !dictionary || dictionary->id != container.dictionary_id ) {
+			char message[ SIZE_OF_MESSAGE ];
+			snprintf( message, SIZE_OF_MESSAGE, "Error: input file needs dictionary %08" PRIx32 ".\n", container.dictionary_id );
+
+			return fail_file( message, output_file_name, &input_file, &output_file, &reader );
+		}
+
+		container.dictionary_tree = dictionary->tree;
+	}
+
+	if ( output_file_name ) { // Write permissions to output_file, if it exists.
+		if ( lseek( input_file, 0, SEEK_CUR ) == -1 ) { // Input file is not seekable.
+			fchmod( output_file, 0600 );
+		} else { // Input file is seekable.
+			struct stat input_file_stats;
+			fstat( input_file, &input_file_stats );
+			fchmod( output_file, input_file_stats.st_mode );
+		}
+	}
+
+	if ( container.header.magic_number == MAGIC_RECORDS && lseek( input_file, 0, SEEK_CUR ) == -1 ) { // The index is at the end.
+		return fail_file( "Error: files encoded with --records can't be decoded from a pipe.\n", output_file_name, &input_file, &output_file, &reader );
+	}
+
+	uint64_t record_offset = 0;
+	uint64_t record_size = 0;
+	uint64_t output_size = container.size;
+
+	if ( extract ) {
+		if ( container.header.magic_number != MAGIC_RECORDS ) {
+			return fail_file( "Error: --record needs a file encoded with --records.\n", output_file_name, &input_file, &output_file, &reader );
+		}
+
+		if ( record_number >= container.record_count ) {
+			char message[ SIZE_OF_MESSAGE ];
+			snprintf( message, SIZE_OF_MESSAGE, "Error: input file only has %" PRIu64 " records.\n", container.record_count );
+
+			return fail_file( message, output_file_name, &input_file, &output_file, &reader );
+		}
+
+		if ( !find_record( input_file, bit_reader_tell( reader ) / 8, container.record_count, &record_offset, &record_size, &output_size ) ) {
+			return fail_file( "Error: input file corrupted.\n", output_file_name, &input_file, &output_file, &reader );
 		}
 	}
 
-	write_bytes( output_file, write_buffer, write_buffer_top ); // Flush write buffer.
-	*compressed_size += bits_read_in_byte == 0 ? bytes_read : bytes_read + 1; // Add total bytes read for codes.
+	// Only files opened here are preallocated and written in place; stdout may be a pipe or opened for appending.
+	// Searches scan the decoded bytes as they're produced, and write none of them out.
+	Output *output = search ? output_create_sink( output_size, search_scan, search ) : output_create( output_file, output_size, output_file_name != NULL );
+
+	if ( !output ) {
+		return fail_file( "Error: not enough space for outfile.\n", output_file_name, &input_file, &output_file, &reader );
+	}
+
+	if ( extract ) {
+		stats_phase( stats, "rebuild_tree" );
+		Node *huffman_tree = rebuild_tree( container.header.tree_size, container.tree_dump );
+		status = write_record( input_file, output, huffman_tree, record_offset, record_size, output_size, compressed_size ) ? CONTAINER_OK : CONTAINER_CORRUPT;
+		delete_tree( &huffman_tree );
+	} else {
+		status = container_decode( reader, output, &container, compressed_size );
+		output_size = container.size;
+	}
+
+	bool written = output_finish( output ) && ( !search || search_finish( search ) );
+	output_delete( &output );
+
+	if ( status == CONTAINER_NO_ROOM ) {
+		return fail_file( "Error: not enough space for outfile.\n", output_file_name, &input_file, &output_file, &reader );
+	}
+
+	if ( status == CONTAINER_UNJOINABLE ) {
+		return fail_file( "Error: only plain, --bwt, --ans, --stride, --lz and stored files can be joined with cat.\n", output_file_name, &input_file, &output_file, &reader );
+	}
+
+	if ( status != CONTAINER_OK ) {
+		return fail_file( "Error: input file corrupted.\n", output_file_name, &input_file, &output_file, &reader );
+	}
+
+	if ( !written ) {
+		return fail_file( "Error: failed to write outfile.\n", output_file_name, &input_file, &output_file, &reader );
+	}
+
+	*decompressed_size = output_size;
+	cleanup_files( &input_file, &output_file, &reader );
+
+	return true;
+}
+
+// Description:
+// Decompresses the files given on the command line or in a file list.
+//
+// Parameters:
+// char **file_names - The file names given on the command line.
+// uint32_t count - The number of file names given on the command line.
+// char *file_list_name - The file list to read file names from instead, if given.
+// BatchOptions *options - The batch options.
+//
+// Returns:
+// bool - Whether every file was decompressed successfully.
+static bool decompress_batch( char **file_names, uint32_t count, char *file_list_name, BatchOptions *options ) {
+	char **file_list = NULL;
+
+	if ( file_list_name && !( file_names = file_list = batch_read_file_list( file_list_name, &count ) ) ) {
+		fprintf( stderr, "Error: failed to read file list.\n" );
+
+		return false;
+	}
+
+	uint32_t failures = batch_run( file_names, count, options, decompress_file );
+	batch_delete_file_list( &file_list, count );
+
+	return failures == 0;
+}
+
+// Description:
+// Adds a pattern to search for to the list of patterns.
+//
+// Parameters:
+// char ***patterns - A pointer to the list of patterns, grown as needed.
+// uint32_t *npatterns - A pointer to the number of patterns.
+// char *pattern - The pattern to add.
+//
+// Returns:
+// bool - Whether memory was available for the pattern.
+static bool add_pattern( char ***patterns, uint32_t *npatterns, char *pattern ) {
+	char **grown = ( char ** ) realloc( *patterns, ( *npatterns + 1 ) * sizeof( char * ) );
+
+	if ( !grown ) {
+		return false;
+	}
+
+	*patterns = grown;
+	( *patterns )[ ( *npatterns )++ ] = pattern;
 
 	return true;
 }
 
+// Description:
+// Reads a file of patterns to search for, one per line, splitting the lines in
+// place so the patterns point into the file's contents.
+//
+// Parameters:
+// char *file_name - The name of the file of patterns.
+// char ***patterns - A pointer to the list of patterns to add to.
+// uint32_t *npatterns - A pointer to the number of patterns.
+// char **contents - A pointer to set to the file's contents, which must outlive the patterns.
+//
+// Returns:
+// bool - Whether the file was read.
+static bool read_patterns( char *file_name, char ***patterns, uint32_t *npatterns, char **contents ) {
+	int pattern_file = io_open( file_name, O_RDONLY, 0 );
+	struct stat pattern_file_stats;
+
+	if ( pattern_file <= 0 ) {
+		return false;
+	}
+
+	if ( fstat( pattern_file, &pattern_file_stats ) == -1 || pattern_file_stats.st_size >= UINT32_MAX || !( *contents = ( char * ) malloc( pattern_file_stats.st_size + 1 ) ) ) {
+		close( pattern_file );
+
+		return false;
+	}
+
+	uint32_t size = pattern_file_stats.st_size;
+	bool read = read_bytes( pattern_file, ( uint8_t * ) *contents, size ) == size;
+	close( pattern_file );
+	( *contents )[ size ] = '\0';
+
+	for ( char *line = *contents; read && line < *contents + size; ) { // A last line without a newline still counts.
+		char *end = memchr( line, '\n', *contents + size - line );
+
+		if ( end ) {
+			*end = '\0';
+		}
+
+		read = add_pattern( patterns, npatterns, line );
+		line = end ? end + 1 : *contents + size;
+	}
+
+	return read;
+}
+
 // Description:
 // The entry point of the program.
 //
@@ -157,94 +496,152 @@ int main( int argc, char **argv ) {
 	bool verbose = false;
 	char *input_file_name = NULL;
 	char *output_file_name = NULL;
-
-	while ( ( opt = getopt( argc, argv, OPTIONS ) ) != -1 ) { // Process each option specified.
+	char *file_list_name = NULL;
+	char *dictionary_file_name = NULL;
+	char *stats_json_file_name = NULL;
+	char **patterns = NULL;
+	uint32_t npatterns = 0;
+	char *pattern_file_contents = NULL;
+	SearchMode search_mode = SEARCH_LINES;
+	bool grep = false;
+	IOConfig io_config = { DEFAULT_BLOCK_SIZE, false, true };
+	BatchOptions batch_options = { DEFAULT_SUFFIX, true, NULL, 0, false };
+
+	while ( ( opt = getopt_long( argc, argv, OPTIONS, long_options, NULL ) ) != -1 ) { // Process each option specified.
 		switch ( opt ) {
 		case 'h': print_help( *argv ); return 0; // Help.
 		case 'v': verbose = true; break; // Verbose.
 		case 'i': input_file_name = optarg; break; // Input file.
 		case 'o': output_file_name = optarg; break; // Output file.
-		default: print_help( *argv ); return 1; // Invalid flag.
-		}
-	}
+		case OPTION_DIRECT: io_config.direct = true; break; // Direct I/O.
+		case OPTION_NO_FADVISE: io_config.advise = false; break; // No page cache hints.
+		case OPTION_NO_MMAP: output_configure( false ); break; // No mapped output.
+		case OPTION_RECORD: // Single record.
+			if ( !io_parse_number( optarg, &record_number ) ) {
+				fprintf( stderr, "Error: invalid record number.\n" );
+
+				return 1;
+			}
 
-	input_file = STDIN_FILENO;
-	output_file = STDOUT_FILENO;
+			extract = true;
+			break;
+		case 'j': // Batch threads.
+			if ( !thread_pool_parse_threads( optarg, &batch_options.threads ) ) {
+				fprintf( stderr, "Error: invalid thread count.\n" );
 
-	if ( !process_input_output_files( input_file_name, output_file_name ) ) {
-		cleanup_memory( );
+				return 1;
+			}
 
-		return 1;
-	}
+			break;
+		case 'S': batch_options.suffix = optarg; break; // Batch output suffix.
+		case 'O': batch_options.output_dir = optarg; break; // Batch output directory.
+		case 'F': file_list_name = optarg; break; // Batch file list.
+		case 'D': dictionary_file_name = optarg; break; // Dictionary.
+		case OPTION_STATS_JSON: stats_json_file_name = optarg; break; // JSON stats.
+		case OPTION_GREP_OFFSETS: search_mode = SEARCH_OFFSETS; break; // Match offsets.
+		case OPTION_GREP_COUNT: search_mode = SEARCH_COUNT; break; // Matching line count.
+		case 'e': // Search pattern.
+			grep = true;
+
+			if ( !add_pattern( &patterns, &npatterns, optarg ) ) {
+				fprintf( stderr, "Error: not enough memory for patterns.\n" );
+
+				return 2;
+			}
 
-	uint64_t compressed_size = 0;
-	RawFileHeader raw_header = { 0 };
-	read_bytes( input_file, ( uint8_t * ) &raw_header, sizeof( raw_header ) );
-	compressed_size += sizeof( raw_header );
-	FileHeader header = file_header_create( raw_header );
+			break;
+		case OPTION_GREP_FILE: // Search patterns.
+			grep = true;
 
-	if ( header.magic_number != MAGIC ) {
-		fprintf( stderr, "Error: unable to read file header. Invalid input file or input file corrupted.\n" );
+			if ( pattern_file_contents || !read_patterns( optarg, &patterns, &npatterns, &pattern_file_contents ) ) {
+				fprintf( stderr, "Error: failed to read patterns.\n" );
 
-		if ( output_file_name ) {
-			unlink( output_file_name ); // Delete output file.
-		}
+				return 2;
+			}
 
-		cleanup_memory( );
+			break;
+		case 'b': // I/O buffer size.
+			if ( !io_parse_block_size( optarg, &io_config.block_size ) ) {
+				fprintf( stderr, "Error: invalid buffer size.\n" );
 
-		return 1;
-	}
+				return 1;
+			}
 
-	if ( output_file_name ) { // Write permissions to output_file, if it exists.
-		if ( lseek( input_file, 0, SEEK_CUR ) == -1 ) { // Input file is not seekable.
-			fchmod( output_file, 0600 );
-		} else { // Input file is seekable.
-			struct stat input_file_stats;
-			fstat( input_file, &input_file_stats );
-			fchmod( output_file, input_file_stats.st_mode );
+			break;
+		default: print_help( *argv ); return 1; // Invalid flag.
 		}
 	}
 
-	uint8_t tree_dump[ header.tree_size ];
-	int tree_dump_bytes_read = read_bytes( input_file, tree_dump, header.tree_size );
+	io_configure( io_config );
 
-	if ( tree_dump_bytes_read != header.tree_size ) {
-		fprintf( stderr, "Error: input file corrupted.\n" );
+	if ( dictionary_file_name && !( dictionary = dictionary_load( dictionary_file_name ) ) ) {
+		fprintf( stderr, "Error: failed to load dictionary.\n" );
 
-		if ( output_file_name ) {
-			unlink( output_file_name ); // Delete output file.
-		}
+		return 1;
+	}
 
-		cleanup_memory( );
+	if ( grep && output_file_name ) {
+		fprintf( stderr, "Error: matches are printed to stdout, so -o can't be used with -e or --grep-file.\n" );
+		dictionary_delete( &dictionary );
 
-		return 1;
+		return 2;
+	}
+
+	if ( grep && !( search = search_create( patterns, npatterns, search_mode, STDOUT_FILENO ) ) ) {
+		fprintf( stderr, "Error: patterns must not be empty, and must total under %d bytes.\n", SEARCH_MAX_STATES );
+		dictionary_delete( &dictionary );
+
+		return 2;
 	}
 
-	compressed_size += header.tree_size;
-	Node *huffman_tree = rebuild_tree( header.tree_size, tree_dump );
+	bool success = true;
 
-	if ( !write_decoded_codes( huffman_tree, header.original_file_size, &compressed_size ) ) {
-		fprintf( stderr, "Error: input file corrupted.\n" );
+	if ( optind < argc || file_list_name ) { // Batch mode.
+		if ( input_file_name || output_file_name || stats_json_file_name || extract || grep ) {
+			fprintf( stderr, "Error: -i, -o, --stats-json, --record, -e and --grep-file can't be used with multiple input files.\n" );
+			success = false;
+		} else {
+			batch_options.verbose = verbose;
+			success = decompress_batch( argv + optind, argc - optind, file_list_name, &batch_options );
+		}
+	} else {
+		uint64_t compressed_size = 0;
+		uint64_t decompressed_size = 0;
 
-		if ( output_file_name ) {
-			unlink( output_file_name ); // Delete output file.
+		if ( verbose || stats_json_file_name ) {
+			stats = stats_create( );
 		}
 
-		delete_tree( &huffman_tree );
-		cleanup_memory( );
+		container_configure( batch_options.threads ? batch_options.threads : thread_pool_default_threads( ), stats );
+		success = decompress_file( input_file_name, output_file_name, &compressed_size, &decompressed_size );
 
-		return 1;
-	}
+		if ( success && verbose ) {
+			double space_saving = 100 * ( 1 - ( ( double ) compressed_size / decompressed_size ) );
+			fprintf( stderr, "Compressed file size: %" PRIu64 " bytes\n", compressed_size );
+			fprintf( stderr, "Decompressed file size: %" PRIu64 " bytes\n", decompressed_size );
+			fprintf( stderr, "Space saving: %.2f%%\n", space_saving );
+			fprintf( stderr, "Kernels: %s\n", kernels_name( ) );
+			stats_print( stats, stderr, decompressed_size );
+		}
+
+		if ( success && stats_json_file_name && !stats_save_json( stats, stats_json_file_name, "huffman_decode", compressed_size, decompressed_size, decompressed_size ) ) {
+			fprintf( stderr, "Error: failed to save stats.\n" );
+			success = false;
+		}
 
-	if ( verbose ) {
-		double space_saving = 100 * ( 1 - ( ( double ) compressed_size / header.original_file_size ) );
-		fprintf( stderr, "Compressed file size: %" PRIu64 " bytes\n", compressed_size );
-		fprintf( stderr, "Decompressed file size: %" PRIu64 " bytes\n", header.original_file_size );
-		fprintf( stderr, "Space saving: %.2f%%\n", space_saving );
+		stats_delete( &stats );
 	}
 
-	delete_tree( &huffman_tree );
-	cleanup_memory( );
+	dictionary_delete( &dictionary );
+
+	if ( grep ) { // Like grep: 0 if anything matched, 1 if nothing did, 2 on errors.
+		int status = !success ? 2 : search_matches( search ) > 0 ? 0 : 1;
+		search_delete( &search );
+		free( patterns );
+		free( pattern_file_contents );
+
+		return status;
+	}
 
-	return 0;
+	return success ? 0 : 1;
 }
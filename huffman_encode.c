@@ -1,23 +1,99 @@
+#include "ans.h"
+#include "archive.h"
+#include "batch.h"
+#include "bwt.h"
 #include "defines.h"
+#include "dictionary.h"
+#include "estimate.h"
 #include "file_header.h"
 #include "huffman.h"
 #include "io.h"
+#include "kernels.h"
+#include "lz.h"
+#include "parallel_encode.h"
 #include "raw_file_header.h"
+#include "records.h"
+#include "report.h"
+#include "split.h"
+#include "spool.h"
+#include "stats.h"
+#include "stream.h"
+#include "stride.h"
+#include "thread_pool.h"
 
+#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-#define SIZE_OF_TEMP_FILE_NAME 35 // Max size of the temporary file name.
-#define OPTIONS                "hvi:o:" // Valid options for the program.
+#define OPTIONS                "hvi:o:b:j:S:O:F:D:" // Valid options for the program.
+#define DEFAULT_SUFFIX         ".huff" // Suffix of compressed files in batch mode.
+#define PAIR_TABLE_MIN_INPUT   ( 256 * BLOCK ) // Smallest input encoded two symbols per lookup.
 
-static int input_file = -1;
-static int output_file = -1;
+enum { OPTION_DIRECT = 256, OPTION_NO_FADVISE, OPTION_STATS_JSON, OPTION_ESTIMATE, OPTION_MIN_SAVING, OPTION_BWT, OPTION_ENTROPY_TRACE, OPTION_TRACE_WINDOW, OPTION_RECORDS, OPTION_SPLIT, OPTION_SPOOL_MEMORY, OPTION_ANS, OPTION_STREAM, OPTION_FLUSH_BYTES, OPTION_FLUSH_MS, OPTION_APPEND, OPTION_STRIDE, OPTION_LZ }; // Long-only options.
+
+static struct option long_options[] = {
+	{ "help", no_argument, NULL, 'h' },
+	{ "verbose", no_argument, NULL, 'v' },
+	{ "input", required_argument, NULL, 'i' },
+	{ "output", required_argument, NULL, 'o' },
+	{ "block-size", required_argument, NULL, 'b' },
+	{ "direct", no_argument, NULL, OPTION_DIRECT },
+	{ "no-fadvise", no_argument, NULL, OPTION_NO_FADVISE },
+	{ "jobs", required_argument, NULL, 'j' },
+	{ "suffix", required_argument, NULL, 'S' },
+	{ "output-dir", required_argument, NULL, 'O' },
+	{ "files-from", required_argument, NULL, 'F' },
+	{ "dictionary", required_argument, NULL, 'D' },
+	{ "stats-json", required_argument, NULL, OPTION_STATS_JSON },
+	{ "estimate", no_argument, NULL, OPTION_ESTIMATE },
+	{ "min-saving", required_argument, NULL, OPTION_MIN_SAVING },
+	{ "bwt", no_argument, NULL, OPTION_BWT },
+	{ "entropy-trace", required_argument, NULL, OPTION_ENTROPY_TRACE },
+	{ "trace-window", required_argument, NULL, OPTION_TRACE_WINDOW },
+	{ "records", required_argument, NULL, OPTION_RECORDS },
+	{ "split", no_argument, NULL, OPTION_SPLIT },
+	{ "spool-memory", required_argument, NULL, OPTION_SPOOL_MEMORY },
+	{ "ans", no_argument, NULL, OPTION_ANS },
+	{ "stream", no_argument, NULL, OPTION_STREAM },
+	{ "flush-bytes", required_argument, NULL, OPTION_FLUSH_BYTES },
+	{ "flush-ms", required_argument, NULL, OPTION_FLUSH_MS },
+	{ "append", no_argument, NULL, OPTION_APPEND },
+	{ "stride", required_argument, NULL, OPTION_STRIDE },
+	{ "lz", required_argument, NULL, OPTION_LZ },
+	{ NULL, 0, NULL, 0 },
+};
+
+static Dictionary *dictionary = NULL; // Shared code table to encode with, if one was given.
+static Stats *stats = NULL; // Per-phase timings, kept when compressing a single file with -v or --stats-json.
+static bool check_saving = false; // Whether to store files predicted to save less than min_saving.
+static double min_saving = 0; // Predicted space saving in percent below which files are stored instead.
+static uint32_t encode_threads = 1; // Threads to encode a single large file with.
+static bool transform = false; // Whether to Huffman code the Burrows-Wheeler transform of the input.
+static CodeReport *report = NULL; // Code statistics, kept when compressing a single file with -v.
+static char *trace_file_name = NULL; // File to save the entropy of each window of the input to, if given.
+static uint32_t trace_window = TRACE_WINDOW; // Bytes per window of the entropy trace.
+static bool records = false; // Whether to encode the input as separately decodable records.
+static RecordFormat record_format = RECORDS_LINES; // How the input's records are delimited.
+static bool split = false; // Whether to split the input into blocks that each get their own table.
+static bool ans = false; // Whether to code with tANS instead of Huffman codes.
+static uint64_t spool_memory = SPOOL_MEMORY_LIMIT; // Bytes of piped or transformed input to keep in memory before spilling to a file.
+static bool stream = false; // Whether to encode the input as it arrives, in flushed segments.
+static uint64_t flush_bytes = STREAM_FLUSH_BYTES; // Most input per segment when streaming.
+static uint32_t flush_ms = STREAM_FLUSH_MS; // Most milliseconds input waits before it's flushed when streaming.
+static bool append = false; // Whether to append the input to an archive as a new segment, instead of replacing the output file.
+static bool strided = false; // Whether to code each byte position of fixed-size records with its own table.
+static uint32_t stride = 0; // Bytes per record when strided, or 0 to detect it from each input.
+static uint32_t lz_level = 0; // How hard to look for LZ77 matches before coding, or 0 to code bytes directly.
 
 // Description:
 // Prints the help message to stderr.
@@ -29,28 +105,32 @@ static int output_file = -1;
 // Nothing.
 static void print_help( char *program_path ) {
 	fprintf( stderr,
-	    "SYNOPSIS\n   A Huffman encoder implementation.\n\nUSAGE\n   %s [-hv] [-i infile] [-o outfile]\n\nOPTIONS\n   -h             Prints the program help text.\n   -v             Prints "
-	    "compression statistics to stderr.\n   -i infile      Input file to compress.\n   -o outfile     File to output the compressed data to.\n",
-	    program_path );
+	    "SYNOPSIS\n   A Huffman encoder implementation.\n\nUSAGE\n   %s [-hv] [-i infile] [-o outfile] [-b size] [-D dict] [--direct] [--no-fadvise] [--stats-json file] [--min-saving percent] [--bwt] [--entropy-trace file [--trace-window size]] [--records format] [--split] [--ans] [--stream [--flush-bytes size] [--flush-ms ms]] [--spool-memory size] [--append] [--stride n|auto] [--lz level]\n   %s [-hv] [-j threads] [-S suffix] [-O dir] [-F list] [file...]\n   %s --estimate [-F list] [file...]\n\nOPTIONS\n   -h             Prints the program help text.\n   -v             Prints "
+	    "compression statistics to stderr.\n   -i infile      Input file to compress.\n   -o outfile     File to output the compressed data to.\n   -b size        I/O buffer size, a multiple of 4K up to 64M "
+	    "(default: 256K).\n   -D dict        Encodes with a dictionary made by huffman_train, in one pass and without a tree.\n   --direct       Bypasses the page cache with O_DIRECT where the file system supports it.\n   --no-fadvise   Doesn't give the kernel readahead and cache eviction hints.\n   --stats-json file\n                  Saves per-phase timings and hardware counters as JSON (\"-\" for stderr).\n   --min-saving percent\n                  Stores files uncompressed if a sample predicts a smaller space saving.\n   --bwt          Applies a Burrows-Wheeler and move-to-front transform to each 1M block before coding it.\n   --entropy-trace file\n                  Saves the entropy and coded bits per byte of each window of the input (\"-\" for stderr).\n   --trace-window size\n                  Bytes per window of the entropy trace, a multiple of 4K up to 64M (default: 1M).\n   --records format\n                  Encodes lines (\"lines\") or records after 32-bit little-endian lengths (\"length\")\n                  so each can be decoded on its own.\n   --split        Splits the input into blocks with their own tables where the byte statistics change.\n   --ans          Codes with tANS, from counts normalized to 8192, instead of Huffman codes.\n   --stream       Encodes input as it arrives, flushing it in segments the decoder outputs right away.\n   --flush-bytes size\n                  Most input per streamed segment, up to 64M (default: 64K).\n   --flush-ms ms  Most milliseconds streamed input waits before it's flushed, 0 for every read, up to an hour (default: 100).\n   --spool-memory size\n                  Bytes of piped input kept in memory before spilling to $TMPDIR (default: 256M, 0 for none).\n   --stride n|auto\n                  Codes each byte position of n-byte records with its own table, detecting n if \"auto\".\n   --lz level     Replaces repeated strings with LZ77 matches before coding, level 1 (fastest) to 5 (smallest).\n   --append       Appends the input to outfile as a new segment, making outfile an archive if it's empty or missing.\n   --estimate     Only prints the predicted space saving of each file, from a sample of it.\n\nBATCH OPTIONS\n   file...        Input files to compress, each to "
+	    "its own output file.\n   -F list        Reads input file names from list, one per line (\"-\" for stdin).\n   -j threads     Number of files to compress at once, or threads to compress a single large file with (default: one per CPU).\n   -S suffix      "
+	    "Suffix appended to output file names (default: .huff).\n   -O dir         Directory to write output files to (default: next to the input files).\n",
+	    program_path, program_path, program_path );
 }
 
 // Description:
-// Cleans up memory used by the program if it's been allocated.
+// Closes the input and output files if they've been opened.
 //
 // Parameters:
-// Nothing.
+// int *input_file - A pointer to the input file.
+// int *output_file - A pointer to the output file.
 //
 // Returns:
 // Nothing.
-static void cleanup_memory( ) {
-	if ( output_file != -1 ) {
-		close( output_file );
-		output_file = -1;
+static void cleanup_files( int *input_file, int *output_file ) {
+	if ( *output_file != -1 ) {
+		close( *output_file );
+		*output_file = -1;
 	}
 
-	if ( input_file != -1 ) {
-		close( input_file );
-		input_file = -1;
+	if ( *input_file != -1 ) {
+		close( *input_file );
+		*input_file = -1;
 	}
 }
 
@@ -60,17 +140,20 @@ static void cleanup_memory( ) {
 // Parameters:
 // char *input_file_name - The input file name given by the user.
 // char *output_file_name - The output file name given by the user.
+// int *input_file - A pointer to the input file, set if input_file_name is given.
+// int *output_file - A pointer to the output file, set if output_file_name is given.
 //
 // Returns:
 // bool - Whether processing was successful.
-static bool process_input_output_files( char *input_file_name, char *output_file_name ) {
-	if ( input_file_name && ( input_file = open( input_file_name, O_RDONLY ) ) <= 0 ) {
+static bool process_input_output_files( char *input_file_name, char *output_file_name, int *input_file, int *output_file ) {
+	if ( input_file_name && ( *input_file = io_open( input_file_name, O_RDONLY, 0 ) ) <= 0 ) {
 		fprintf( stderr, "Error: failed to open infile.\n" );
 
 		return false;
 	}
 
-	if ( output_file_name && ( output_file = open( output_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0600 ) ) <= 0 ) {
+	// Archives are only ever added to, and are read to find where the next segment goes.
+	if ( output_file_name && ( *output_file = io_open( output_file_name, append ? O_RDWR | O_CREAT : O_WRONLY | O_CREAT | O_TRUNC, 0600 ) ) <= 0 ) {
 		fprintf( stderr, "Error: failed to open outfile.\n" );
 
 		return false;
@@ -80,210 +163,1693 @@ static bool process_input_output_files( char *input_file_name, char *output_file
 }
 
 // Description:
-// Generates a histogram for the input file, and creates a temporary file
-// to use as the input file, if the input file is not seekable.
+// Generates a histogram for the input file, and spools the input file to a
+// memory file (or a temporary file past spool_memory bytes) to use as the input
+// file, if the input file is not seekable.
 //
 // Parameters:
+// int *input_file - A pointer to the input file, replaced with the spooled file if one is made.
 // uint64_t histogram[static ALPHABET] - The histogram to write to.
+// uint32_t *unique_symbols - The pointer to the uint32_t to set to the number of unique symbols found in the input.
 //
 // Returns:
-// uint32_t - The number of unique symbols found in the input.
-static uint32_t generate_histogram_and_temp_input_file( uint64_t histogram[ static ALPHABET ] ) {
-	int temp_file_fd = -1;
+// bool - Whether the input could be spooled, if it had to be.
+static bool generate_histogram_and_temp_input_file( int *input_file, uint64_t histogram[ static ALPHABET ], uint32_t *unique_symbols ) {
+	Spool *spool = NULL;
 
-	// Create a temporary file with file's contents to allow for seeking.
-	if ( lseek( input_file, 0, SEEK_CUR ) == -1 ) { // input_file not seekable.
-		char temp_file_name[ SIZE_OF_TEMP_FILE_NAME ];
-		// Build "unique" file name.
-		snprintf( temp_file_name, SIZE_OF_TEMP_FILE_NAME, "/tmp/huffman.%d", getpid( ) );
-		temp_file_fd = open( temp_file_name, O_RDWR | O_CREAT | O_EXCL | O_TRUNC, 0600 );
-		unlink( temp_file_name ); // Unlink, so temp file is deleted when program exits.
+	// Spool the file's contents to allow for seeking.
+	if ( lseek( *input_file, 0, SEEK_CUR ) == -1 && !( spool = spool_create( spool_memory ) ) ) { // input_file not seekable.
+		return false;
 	}
 
-	uint32_t unique_symbols = 0;
-	uint8_t read_buffer[ BLOCK ] = { 0 };
-	uint32_t read_byte_top = 0; // Next byte to read.
+	uint32_t block_size = io_block_size( );
+	uint8_t *read_buffer = io_buffer_create( block_size );
 	uint32_t read_byte_buffer_size = 0; // Number of bytes read into buffer.
-	bool more_to_read = true;
+	bool success = read_buffer != NULL;
+
+	while ( success && ( read_byte_buffer_size = read_bytes( *input_file, read_buffer, block_size ) ) != 0 ) {
+		// Spool the bytes if input file is not seekable.
+		success = !spool || spool_write( spool, read_buffer, read_byte_buffer_size );
+		histogram_update( histogram, read_buffer, read_byte_buffer_size );
+	}
 
-	while ( more_to_read ) {
-		if ( read_byte_top == 0 ) { // Refill buffer.
-			read_byte_buffer_size = read_bytes( input_file, read_buffer, BLOCK );
+	io_buffer_delete( &read_buffer );
+	*unique_symbols = 0;
 
-			// Write to temp file if input file is not seekable.
-			if ( read_byte_buffer_size && temp_file_fd != -1 ) {
-				write_bytes( temp_file_fd, read_buffer, read_byte_buffer_size );
-			}
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		if ( histogram[ i ] != 0 ) { // Found a unique symbol.
+			( *unique_symbols )++;
 		}
+	}
 
-		if ( read_byte_buffer_size != 0 ) {
-			uint8_t byte = read_buffer[ read_byte_top ];
+	if ( spool && success ) { // Set input file to the spooled file if input_file is not seekable.
+		close( *input_file );
+		*input_file = spool_finish( &spool );
+	}
 
-			if ( histogram[ byte ] == 0 ) { // Found a unique symbol.
-				unique_symbols++;
-			}
+	spool_delete( &spool );
 
-			histogram[ byte ]++; // Add to histogram.
-			read_byte_top++;
+	return success;
+}
 
-			if ( read_byte_top == read_byte_buffer_size ) { // Done with read buffer.
-				read_byte_top = 0;
-			}
-		} else {
-			more_to_read = false;
-		}
+// Description:
+// Replaces the input file with a spooled file of its blocks after the
+// Burrows-Wheeler, move-to-front and zero-run transform, and generates the
+// histogram of the transformed bytes.
+//
+// Parameters:
+// int *input_file - A pointer to the input file, replaced with the spooled file.
+// uint64_t histogram[static ALPHABET] - The histogram to write to.
+// struct stat *input_file_stats - The stats of the input file to set, with the size it turned out to have.
+//
+// Returns:
+// bool - Whether the input was transformed.
+static bool transform_input_file( int *input_file, uint64_t histogram[ static ALPHABET ], struct stat *input_file_stats ) {
+	fstat( *input_file, input_file_stats );
+	Spool *spool = spool_create( spool_memory );
+	Bwt *bwt = bwt_create( );
+	uint8_t *block = io_buffer_create( BWT_BLOCK );
+	uint8_t *coded = ( uint8_t * ) malloc( BWT_CODED_MAX( BWT_BLOCK ) );
+	bool success = spool && bwt && block && coded;
+	uint64_t input_size = 0;
+	uint32_t nbytes = 0;
+
+	while ( success && ( nbytes = read_bytes( *input_file, block, BWT_BLOCK ) ) != 0 ) {
+		uint32_t ncoded = bwt_forward( bwt, block, nbytes, coded );
+		success = ncoded != 0 && spool_write( spool, coded, ncoded );
+		histogram_update( histogram, coded, ncoded );
+		input_size += nbytes;
 	}
 
-	if ( temp_file_fd != -1 ) { // Set input file to temp file if input_file is not seekable.
-		close( input_file );
-		input_file = temp_file_fd;
+	free( coded );
+	io_buffer_delete( &block );
+	bwt_delete( &bwt );
+	input_file_stats->st_size = input_size;
+
+	if ( spool && success ) {
+		close( *input_file );
+		*input_file = spool_finish( &spool );
 	}
 
-	return unique_symbols;
+	spool_delete( &spool );
+
+	return success;
 }
 
 // Description:
 // Writes a Huffman tree dump to the output file.
 //
 // Parameters:
+// BitWriter *writer - The bit writer for the output file.
 // Node *huffman_tree - The root node of the Huffman tree to write.
 // uint64_t *compressed_size - Pointer to uint64_t to add number of bytes written to.
 //
 // Returns:
 // Nothing.
-static void write_tree_to_outfile( Node *huffman_tree, uint64_t *compressed_size ) {
-	if ( !huffman_tree ) {
-		return;
-	}
-
-	write_tree_to_outfile( huffman_tree->left, compressed_size );
-	write_tree_to_outfile( huffman_tree->right, compressed_size );
-
-	if ( !huffman_tree->left && !huffman_tree->right ) { // Node is a leaf.
-		// Write 'L' followed by the symbol.
-		uint8_t symbol[ 2 ] = { 'L', huffman_tree->symbol };
-		write_bytes( output_file, symbol, 2 );
-		*compressed_size += 2;
-	} else { // Node is an interior node.
-		// Write 'I'.
-		uint8_t symbol = 'I';
-		write_bytes( output_file, &symbol, 1 );
-		*compressed_size += 1;
-	}
+static void write_tree_to_outfile( BitWriter *writer, Node *huffman_tree, uint64_t *compressed_size ) {
+	uint8_t tree_dump[ MAX_TREE_SIZE ];
+	uint16_t tree_size = dump_tree( huffman_tree, tree_dump );
+	*compressed_size += bit_writer_write_bytes( writer, tree_dump, tree_size );
 }
 
 // Description:
 // Writes codes for each symbol in the input file.
 //
 // Parameters:
-// Code huffman_code_table[static ALPHABET] - The code table for the Huffman tree.
+// int input_file - The input file.
+// BitWriter *writer - The bit writer for the output file.
+// PackedCodes *codes - The packed code table for the Huffman tree.
+// uint64_t *compressed_size - Pointer to uint64_t to add the number of bytes written to,
+// including any header bytes still buffered in the bit writer.
 //
 // Returns:
-// uint64_t - The size of all of the codes in bytes (rounded up).
-static uint64_t write_codes_for_symbols( Code huffman_code_table[ static ALPHABET ] ) {
+// bool - Whether the read buffer could be allocated.
+static bool write_codes_for_symbols( int input_file, BitWriter *writer, PackedCodes *codes, uint64_t *compressed_size ) {
+	uint32_t block_size = io_block_size( );
+	uint8_t *read_buffer = io_buffer_create( block_size );
+
+	if ( !read_buffer ) {
+		return false;
+	}
+
+	stats_phase( stats, "encode" );
 	lseek( input_file, 0, SEEK_SET ); // Seek to beginning of file.
-	uint64_t byte_count = 0;
-	uint8_t read_buffer[ BLOCK ] = { 0 };
-	uint32_t read_byte_top = 0; // Next byte to read.
+	uint64_t input_offset = 0;
 	uint32_t read_byte_buffer_size = 0; // Number of bytes read into buffer.
-	bool more_to_read = true;
 
 	// Loop through all symbols in file and write code for symbol.
-	while ( more_to_read ) {
-		if ( read_byte_top == 0 ) { // Refill buffer.
-			read_byte_buffer_size = read_bytes( input_file, read_buffer, BLOCK );
-		}
+	while ( ( read_byte_buffer_size = read_bytes( input_file, read_buffer, block_size ) ) != 0 ) {
+		*compressed_size += write_codes( writer, codes, read_buffer, read_byte_buffer_size );
+		io_advise_consumed( input_file, input_offset, read_byte_buffer_size ); // Second pass is done with this block.
+		input_offset += read_byte_buffer_size;
+	}
+
+	io_buffer_delete( &read_buffer );
+	stats_phase( stats, "flush" );
+	*compressed_size += flush_codes( writer ); // Flush write code buffer.
+	stats_phase( stats, NULL );
+
+	return true;
+}
+
+// Description:
+// Reads all of a file into memory.
+//
+// Parameters:
+// int input_file - The input file.
+// uint64_t *nbytes - The pointer to the uint64_t to set to the number of bytes read.
+//
+// Returns:
+// uint8_t * - The newly allocated contents of the file, or NULL on failure.
+static uint8_t *read_whole_file( int input_file, uint64_t *nbytes ) {
+	uint64_t capacity = io_block_size( );
+	uint8_t *buf = ( uint8_t * ) malloc( capacity );
+	uint32_t bytes_read;
+	*nbytes = 0;
 
-		if ( read_byte_buffer_size != 0 ) {
-			uint8_t byte = read_buffer[ read_byte_top ];
-			byte_count += write_code( output_file, &huffman_code_table[ byte ] );
-			read_byte_top++;
+	while ( buf && ( bytes_read = read_bytes( input_file, buf + *nbytes, capacity - *nbytes ) ) != 0 ) {
+		*nbytes += bytes_read;
 
-			if ( read_byte_top == read_byte_buffer_size ) { // Done with read buffer.
-				read_byte_top = 0;
+		if ( *nbytes == capacity ) {
+			capacity *= 2;
+			uint8_t *grown = ( uint8_t * ) realloc( buf, capacity );
+
+			if ( !grown ) {
+				free( buf );
+				buf = NULL;
 			}
-		} else {
-			more_to_read = false;
+
+			buf = grown;
 		}
 	}
 
-	byte_count += flush_codes( output_file ); // Flush write code buffer.
+	return buf;
+}
+
+// Description:
+// Compresses the input file with a dictionary in a single pass: there's no histogram
+// pass and no tree dump, just a short header naming the dictionary.
+//
+// Parameters:
+// int input_file - The input file.
+// BitWriter *writer - The bit writer for the output file.
+// uint64_t *original_size - The pointer to the uint64_t to set to the input size.
+//
+// Returns:
+// uint64_t - The number of bytes written to the output file, or 0 on failure.
+static uint64_t write_dictionary_encoded_file( int input_file, BitWriter *writer, uint64_t *original_size ) {
+	stats_phase( stats, "header" );
+	uint8_t header[ DICTIONARY_HEADER_MAX_SIZE ];
+	PackedCodes codes;
+	code_table_pack( dictionary->table, &codes );
+	struct stat input_file_stats;
+	fstat( input_file, &input_file_stats );
+
+	if ( lseek( input_file, 0, SEEK_CUR ) != -1 ) { // Seekable, so the size is known up front.
+		*original_size = input_file_stats.st_size;
+		uint64_t byte_count = bit_writer_write_bytes( writer, header, dictionary_file_header_create( dictionary, *original_size, header ) );
+
+		return write_codes_for_symbols( input_file, writer, &codes, &byte_count ) ? byte_count : 0;
+	}
+
+	// Piped input: the size has to be known before the codes, so buffer it (dictionaries are for small inputs).
+	stats_phase( stats, "read" );
+	uint8_t *input = read_whole_file( input_file, original_size );
+
+	if ( !input ) {
+		stats_phase( stats, NULL );
+
+		return 0;
+	}
+
+	stats_phase( stats, "header" );
+	uint64_t byte_count = bit_writer_write_bytes( writer, header, dictionary_file_header_create( dictionary, *original_size, header ) );
+	stats_phase( stats, "encode" );
+	byte_count += write_codes( writer, &codes, input, *original_size );
+	stats_phase( stats, "flush" );
+	byte_count += flush_codes( writer );
+	stats_phase( stats, NULL );
+	free( input );
 
 	return byte_count;
 }
 
 // Description:
-// The entry point of the program.
+// Parses the space saving given to --min-saving, in percent.
 //
 // Parameters:
-// int argc - The argument count.
-// char **argv - An array of argument strings.
+// char *text - The text to parse.
+// double *percent - The pointer to the double to set the saving to.
 //
 // Returns:
-// int - The exit status of the program (0 = success, otherwise error).
-int main( int argc, char **argv ) {
-	int opt = 0;
-	bool verbose = false;
-	char *input_file_name = NULL;
-	char *output_file_name = NULL;
+// bool - Whether the text is a decimal number from 0 up to, but not including, 100.
+static bool parse_min_saving( char *text, double *percent ) {
+	char *end = NULL;
+	double value = strtod( text, &end );
 
-	while ( ( opt = getopt( argc, argv, OPTIONS ) ) != -1 ) { // Process each option specified.
-		switch ( opt ) {
-		case 'h': print_help( *argv ); return 0; // Help.
-		case 'v': verbose = true; break; // Verbose.
-		case 'i': input_file_name = optarg; break; // Input file.
-		case 'o': output_file_name = optarg; break; // Output file.
-		default: print_help( *argv ); return 1; // Invalid flag.
-		}
+	// Only plain decimals: -Ofast assumes there are no NaNs, so one couldn't be caught by the range check.
+	if ( !( isdigit( ( unsigned char ) *text ) || *text == '.' ) || *end != '\0' || value >= 100 ) {
+		return false;
 	}
 
-	input_file = STDIN_FILENO;
-	output_file = STDOUT_FILENO;
+	*percent = value;
 
-	if ( !process_input_output_files( input_file_name, output_file_name ) ) {
-		cleanup_memory( );
+	return true;
+}
 
-		return 1;
+// Description:
+// Checks whether a file is predicted to save less space than --min-saving asks for.
+//
+// Parameters:
+// int input_file - The input file. Sampled if no histogram is given.
+// uint64_t *histogram - The histogram of the whole file, or NULL to sample it.
+// uint64_t file_size - The size of the file, if the histogram is given.
+//
+// Returns:
+// bool - Whether the file should be stored uncompressed.
+static bool below_min_saving( int input_file, uint64_t *histogram, uint64_t file_size ) {
+	Estimate estimate;
+
+	if ( histogram ) {
+		estimate_from_histogram( histogram, file_size, &estimate );
+	} else if ( !estimate_file( input_file, &estimate ) ) {
+		return false;
+	}
+
+	return estimate_saving( &estimate ) < min_saving;
+}
+
+// Description:
+// Writes a file without compressing it: a file header with the stored magic number
+// and no tree, then the input as is.
+//
+// Parameters:
+// int input_file - The input file. Must be seekable.
+// BitWriter *writer - The bit writer for the output file.
+// uint64_t *original_size - The pointer to the uint64_t to set to the input size.
+//
+// Returns:
+// uint64_t - The number of bytes written to the output file, or 0 on failure.
+static uint64_t write_stored_file( int input_file, BitWriter *writer, uint64_t *original_size ) {
+	uint32_t block_size = io_block_size( );
+	uint8_t *read_buffer = io_buffer_create( block_size );
+
+	if ( !read_buffer ) {
+		return 0;
+	}
+
+	struct stat input_file_stats;
+	fstat( input_file, &input_file_stats );
+	lseek( input_file, 0, SEEK_SET );
+	FileHeader header = { MAGIC_STORED, 0, input_file_stats.st_size };
+	RawFileHeader raw_header = raw_file_header_create( header );
+	uint64_t byte_count = bit_writer_write_bytes( writer, ( uint8_t * ) &raw_header, sizeof( raw_header ) );
+	uint32_t read_byte_buffer_size = 0;
+
+	while ( ( read_byte_buffer_size = read_bytes( input_file, read_buffer, block_size ) ) != 0 ) {
+		byte_count += bit_writer_write_bytes( writer, read_buffer, read_byte_buffer_size );
+	}
+
+	io_buffer_delete( &read_buffer );
+	*original_size = header.original_file_size;
+
+	return byte_count + flush_codes( writer );
+}
+
+// Description:
+// Codes a file with tANS instead of Huffman codes. The histogram is normalized
+// to ANS_TABLE_SIZE and dumped in place of the tree, then each ANS_BLOCK of the
+// input is written as its coded size and its coded bytes.
+//
+// Parameters:
+// int input_file - The input file, which must be seekable.
+// BitWriter *writer - The bit writer for the output file.
+// uint64_t histogram[static ALPHABET] - The histogram of the input file.
+// uint64_t file_size - The size of the input file.
+// uint64_t *compressed_size - The pointer to the uint64_t to set to the output size.
+//
+// Returns:
+// bool - Whether the file was coded.
+static bool write_ans_file( int input_file, BitWriter *writer, uint64_t histogram[ static ALPHABET ], uint64_t file_size, uint64_t *compressed_size ) {
+	stats_phase( stats, "build_table" );
+	uint16_t counts[ ALPHABET ];
+	uint8_t header[ sizeof( RawFileHeader ) + ANS_MAX_COUNTS_SIZE ];
+	FileHeader output_header = { MAGIC_ANS, 0, file_size };
+	AnsEncoder *encoder = NULL;
+
+	if ( ans_normalize( histogram, counts ) ) { // An empty file has no counts.
+		output_header.tree_size = ans_counts_dump( counts, header + sizeof( RawFileHeader ) );
+		encoder = ans_encoder_create( counts );
+	}
+
+	RawFileHeader output_raw_header = raw_file_header_create( output_header );
+	memcpy( header, &output_raw_header, sizeof( output_raw_header ) );
+	uint8_t *block = io_buffer_create( ANS_BLOCK );
+	uint8_t *coded = ( uint8_t * ) malloc( ANS_BLOCK_HEADER_SIZE + ANS_CODED_MAX( ANS_BLOCK ) );
+	bool success = ( encoder || file_size == 0 ) && block && coded;
+	uint64_t offset = 0;
+
+	if ( success ) {
+		stats_phase( stats, "encode" );
+		bit_writer_write_bytes( writer, header, sizeof( output_raw_header ) + output_header.tree_size );
+		lseek( input_file, 0, SEEK_SET );
+	}
+
+	while ( success && offset < file_size ) {
+		uint32_t wanted = file_size - offset < ANS_BLOCK ? file_size - offset : ANS_BLOCK;
+		uint32_t nbytes = read_bytes( input_file, block, wanted );
+		uint32_t ncoded = ans_encode( encoder, block, nbytes, coded + ANS_BLOCK_HEADER_SIZE );
+
+		store_little_endian( coded, ncoded, ANS_BLOCK_HEADER_SIZE );
+		bit_writer_write_bytes( writer, coded, ANS_BLOCK_HEADER_SIZE + ncoded );
+		io_advise_consumed( input_file, offset, nbytes );
+		success = nbytes == wanted; // Fails if the input changed.
+		offset += nbytes;
 	}
 
+	if ( success ) {
+		stats_phase( stats, "flush" );
+		flush_codes( writer );
+		*compressed_size = bit_writer_tell( writer ) / 8;
+	} else {
+		fprintf( stderr, block && coded ? "Error: failed to read infile.\n" : "Error: out of memory.\n" );
+	}
+
+	stats_phase( stats, NULL );
+	ans_encoder_delete( &encoder );
+	io_buffer_delete( &block );
+	free( coded );
+
+	return success;
+}
+
+// Description:
+// Encodes a file as records that can each be decoded on their own: one tree for
+// all of them, then each record's codes starting on a byte boundary, then an
+// index giving where each record's codes start and how long it is.
+//
+// Parameters:
+// int *input_file - A pointer to the input file, replaced with a temporary file if it isn't seekable.
+// int output_file - The output file.
+// uint64_t *original_size - The pointer to the uint64_t to set to the input size.
+// uint64_t *compressed_size - The pointer to the uint64_t to set to the output size.
+//
+// Returns:
+// bool - Whether the records were encoded.
+static bool write_records_file( int *input_file, int output_file, uint64_t *original_size, uint64_t *compressed_size ) {
 	uint64_t histogram[ ALPHABET ] = { 0 };
-	uint32_t unique_symbols = generate_histogram_and_temp_input_file( histogram );
+	stats_phase( stats, "histogram" );
+
+	if ( lseek( *input_file, 0, SEEK_CUR ) == -1 ) { // Records are read twice, so piped input is spooled first.
+		uint32_t unique_symbols = 0;
+
+		if ( !generate_histogram_and_temp_input_file( input_file, histogram, &unique_symbols ) ) {
+			fprintf( stderr, "Error: failed to spool infile.\n" );
+			stats_phase( stats, NULL );
+
+			return false;
+		}
+
+		memset( histogram, 0, sizeof( histogram ) );
+	}
+
+	lseek( *input_file, 0, SEEK_SET );
+	RecordReader *reader = record_reader_create( *input_file, record_format );
+	uint8_t *record = NULL;
+	uint32_t nbytes = 0;
+	uint64_t count = 0;
+
+	while ( reader && record_reader_next( reader, &record, &nbytes ) ) {
+		histogram_update( histogram, record, nbytes );
+		count++;
+	}
+
+	if ( !reader || record_reader_failed( reader ) ) {
+		fprintf( stderr, reader ? "Error: record too long or cut off (records are limited to 16MB).\n" : "Error: out of memory.\n" );
+		record_reader_delete( &reader );
+		stats_phase( stats, NULL );
 
+		return false;
+	}
+
+	record_reader_delete( &reader );
+	struct stat input_file_stats;
+	fstat( *input_file, &input_file_stats );
+	*original_size = input_file_stats.st_size;
+
+	stats_phase( stats, "build_tree" );
 	Node *huffman_tree = build_tree( histogram );
 	Code huffman_code_table[ ALPHABET ] = { 0 };
 	build_codes( huffman_tree, huffman_code_table );
+	PackedCodes codes;
+	code_table_pack( huffman_code_table, &codes );
+
+	if ( *original_size >= PAIR_TABLE_MIN_INPUT ) {
+		code_pairs_create( &codes );
+	}
+
+	stats_phase( stats, "header" );
+	uint8_t header[ sizeof( RawFileHeader ) + MAX_TREE_SIZE + RECORDS_HEADER_SIZE ];
+	FileHeader output_header = { MAGIC_RECORDS, dump_tree( huffman_tree, header + sizeof( RawFileHeader ) ), *original_size };
+	RawFileHeader output_raw_header = raw_file_header_create( output_header );
+	memcpy( header, &output_raw_header, sizeof( output_raw_header ) );
+	uint32_t header_size = sizeof( output_raw_header ) + output_header.tree_size;
+	records_header_create( record_format, count, header + header_size );
+	header_size += RECORDS_HEADER_SIZE;
+	delete_tree( &huffman_tree );
+
+	BitWriter *writer = bit_writer_create( output_file );
+	uint8_t *index = ( uint8_t * ) malloc( count * RECORD_INDEX_ENTRY + 1 );
+	reader = record_reader_create( *input_file, record_format );
+	bool success = writer && index && reader;
+
+	if ( success ) {
+		stats_phase( stats, "encode" );
+		bit_writer_write_bytes( writer, header, header_size );
+		lseek( *input_file, 0, SEEK_SET );
+
+		uint64_t encoded = 0;
+
+		while ( success && record_reader_next( reader, &record, &nbytes ) ) {
+			uint64_t offset = bit_writer_tell( writer ) / 8 - header_size;
+
+			if ( encoded == count || offset >> RECORD_OFFSET_BITS != 0 ) { // The input changed, or the codes outgrew the index.
+				success = false;
+
+				break;
+			}
+
+			record_entry_create( offset, nbytes, index + encoded * RECORD_INDEX_ENTRY );
+			write_codes( writer, &codes, record, nbytes );
+			bit_writer_align( writer );
+			encoded++;
+		}
+
+		success = success && encoded == count;
+
+		stats_phase( stats, "index" );
+
+		for ( uint64_t i = 0; success && i < count * RECORD_INDEX_ENTRY; i += BLOCK ) {
+			bit_writer_write_bytes( writer, index + i, count * RECORD_INDEX_ENTRY - i < BLOCK ? count * RECORD_INDEX_ENTRY - i : BLOCK );
+		}
+
+		flush_codes( writer );
+		*compressed_size = bit_writer_tell( writer ) / 8;
+		stats_phase( stats, NULL );
+
+		if ( !success ) {
+			fprintf( stderr, "Error: failed to encode records.\n" );
+		}
+	} else {
+		fprintf( stderr, "Error: out of memory.\n" );
+	}
+
+	record_reader_delete( &reader );
+	free( index );
+	bit_writer_delete( &writer );
+	code_pairs_delete( &codes );
+
+	return success;
+}
+
+// Description:
+// Encodes a file in blocks that each have their own tree. The file is scanned in
+// segments, neighbouring segments are grouped into blocks wherever one table
+// codes them in fewer bytes than two (see split_plan()), and each block is
+// written as its size, its tree dump and its codes, padded to a byte boundary.
+//
+// Parameters:
+// int *input_file - A pointer to the input file, replaced with a temporary file if it isn't seekable.
+// int output_file - The output file.
+// uint64_t *original_size - The pointer to the uint64_t to set to the input size.
+// uint64_t *compressed_size - The pointer to the uint64_t to set to the output size.
+//
+// Returns:
+// bool - Whether the file was encoded.
+static bool write_split_file( int *input_file, int output_file, uint64_t *original_size, uint64_t *compressed_size ) {
+	uint64_t histogram[ ALPHABET ] = { 0 };
+	stats_phase( stats, "histogram" );
+
+	uint32_t unique_symbols = 0;
+
+	if ( lseek( *input_file, 0, SEEK_CUR ) == -1 && !generate_histogram_and_temp_input_file( input_file, histogram, &unique_symbols ) ) { // Segments are read twice, so piped input is spooled first.
+		fprintf( stderr, "Error: failed to spool infile.\n" );
+		stats_phase( stats, NULL );
+
+		return false;
+	}
 
 	struct stat input_file_stats;
-	fstat( input_file, &input_file_stats );
+	fstat( *input_file, &input_file_stats );
+	*original_size = input_file_stats.st_size;
+	uint32_t segment = split_segment_size( *original_size );
+	uint32_t nsegments = ( *original_size + segment - 1 ) / segment;
+	uint32_t( *histograms )[ ALPHABET ] = calloc( nsegments + 1, sizeof( *histograms ) );
+	uint32_t *sizes = ( uint32_t * ) malloc( ( nsegments + 1 ) * sizeof( uint32_t ) );
+	uint8_t *buffer = io_buffer_create( segment );
+	BitWriter *writer = bit_writer_create( output_file );
+	bool success = histograms && sizes && buffer && writer;
+	lseek( *input_file, 0, SEEK_SET );
 
-	if ( output_file_name ) { // Set permissions of output_file to that of input_file, if it exists (0600 if input file isn't seekable).
-		fchmod( output_file, input_file_stats.st_mode );
+	for ( uint32_t i = 0; success && i < nsegments; i++ ) {
+		memset( histogram, 0, sizeof( histogram ) );
+		sizes[ i ] = read_bytes( *input_file, buffer, segment );
+		histogram_update( histogram, buffer, sizes[ i ] );
+		success = sizes[ i ] == ( i + 1 < nsegments ? segment : *original_size - ( uint64_t ) i * segment ); // Fails if the input changed.
+
+		for ( uint32_t s = 0; s < ALPHABET; s++ ) {
+			histograms[ i ][ s ] = histogram[ s ];
+		}
 	}
 
-	uint64_t compressed_size = 0;
-	FileHeader output_header = { 0 };
-	output_header.magic_number = MAGIC;
+	stats_phase( stats, "split" );
+	uint32_t nblocks = success ? split_plan( histograms, sizes, nsegments ) : 0;
+	success = success && ( nblocks != 0 || nsegments == 0 );
 
-	if ( unique_symbols != 0 ) {
-		output_header.tree_size = 3 * unique_symbols - 1;
+	if ( success ) {
+		stats_phase( stats, "encode" );
+		FileHeader output_header = { MAGIC_SPLIT, 0, *original_size };
+		RawFileHeader output_raw_header = raw_file_header_create( output_header );
+		bit_writer_write_bytes( writer, ( uint8_t * ) &output_raw_header, sizeof( output_raw_header ) );
+		lseek( *input_file, 0, SEEK_SET );
 	}
 
-	output_header.original_file_size = input_file_stats.st_size;
-	RawFileHeader output_raw_header = raw_file_header_create( output_header );
-	write_bytes( output_file, ( uint8_t * ) &output_raw_header, sizeof( output_raw_header ) ); // Write raw file header.
-	compressed_size += sizeof( output_raw_header );
-	write_tree_to_outfile( huffman_tree, &compressed_size );
-	compressed_size += write_codes_for_symbols( huffman_code_table );
+	for ( uint32_t i = 0; success && i < nblocks; i++ ) {
+		for ( uint32_t s = 0; s < ALPHABET; s++ ) {
+			histogram[ s ] = histograms[ i ][ s ];
+		}
+
+		Node *huffman_tree = build_tree( histogram );
+		Code huffman_code_table[ ALPHABET ] = { 0 };
+		build_codes( huffman_tree, huffman_code_table );
+		PackedCodes codes;
+		code_table_pack( huffman_code_table, &codes );
+
+		if ( sizes[ i ] >= PAIR_TABLE_MIN_INPUT ) {
+			code_pairs_create( &codes );
+		}
 
-	if ( verbose ) {
-		double space_saving = 100 * ( 1 - ( ( double ) compressed_size / output_header.original_file_size ) );
-		fprintf( stderr, "Uncompressed file size: %" PRIu64 " bytes\n", output_header.original_file_size );
-		fprintf( stderr, "Compressed file size: %" PRIu64 " bytes\n", compressed_size );
-		fprintf( stderr, "Space saving: %.2f%%\n", space_saving );
+		uint8_t header[ SPLIT_BLOCK_HEADER_SIZE + MAX_TREE_SIZE ];
+		uint16_t tree_size = dump_tree( huffman_tree, header + SPLIT_BLOCK_HEADER_SIZE );
+		split_block_header_create( sizes[ i ], tree_size, header );
+		bit_writer_write_bytes( writer, header, SPLIT_BLOCK_HEADER_SIZE + tree_size );
+		delete_tree( &huffman_tree );
+
+		for ( uint32_t done = 0; success && done < sizes[ i ]; ) {
+			uint32_t wanted = sizes[ i ] - done < segment ? sizes[ i ] - done : segment;
+			uint32_t bytes_read = read_bytes( *input_file, buffer, wanted );
+			write_codes( writer, &codes, buffer, bytes_read );
+			success = bytes_read == wanted;
+			done += bytes_read;
+		}
+
+		bit_writer_align( writer );
+		code_pairs_delete( &codes );
 	}
 
-	delete_tree( &huffman_tree );
-	cleanup_memory( );
+	if ( success ) {
+		flush_codes( writer );
+		*compressed_size = bit_writer_tell( writer ) / 8;
+	} else {
+		fprintf( stderr, histograms && sizes && buffer && writer ? "Error: failed to read infile.\n" : "Error: out of memory.\n" );
+	}
+
+	stats_phase( stats, NULL );
+	bit_writer_delete( &writer );
+	io_buffer_delete( &buffer );
+	free( sizes );
+	free( histograms );
+
+	return success;
+}
+
+// Description:
+// Encodes a file of fixed-size records with a table for each byte position in a
+// record. After the header come the stride and each position's tree dump, then
+// the file in blocks of whole records. Each block's bytes are gathered by
+// position, and the columns are coded one after another with their own tables.
+//
+// Parameters:
+// int *input_file - A pointer to the input file, replaced with a temporary file if it isn't seekable.
+// int output_file - The output file.
+// uint64_t *original_size - The pointer to the uint64_t to set to the input size.
+// uint64_t *compressed_size - The pointer to the uint64_t to set to the output size.
+//
+// Returns:
+// bool - Whether the file was encoded.
+static bool write_stride_file( int *input_file, int output_file, uint64_t *original_size, uint64_t *compressed_size ) {
+	uint64_t histogram[ ALPHABET ] = { 0 };
+	uint32_t unique_symbols = 0;
+	stats_phase( stats, "histogram" );
+
+	if ( lseek( *input_file, 0, SEEK_CUR ) == -1 && !generate_histogram_and_temp_input_file( input_file, histogram, &unique_symbols ) ) { // Blocks are read twice, so piped input is spooled first.
+		fprintf( stderr, "Error: failed to spool infile.\n" );
+		stats_phase( stats, NULL );
+
+		return false;
+	}
+
+	struct stat input_file_stats;
+	fstat( *input_file, &input_file_stats );
+	*original_size = input_file_stats.st_size;
+	uint8_t *buffer = io_buffer_create( STRIDE_BLOCK );
+	uint8_t *columns = io_buffer_create( STRIDE_BLOCK );
+	bool success = buffer && columns;
+	uint32_t period = stride;
+
+	if ( success && period == 0 ) {
+		stats_phase( stats, "detect_stride" );
+		uint32_t sample_size = *original_size < STRIDE_SAMPLE ? *original_size : STRIDE_SAMPLE;
+		success = pread_bytes( *input_file, buffer, sample_size, 0 ) == sample_size;
+		period = stride_detect( buffer, sample_size );
+
+		if ( report ) {
+			fprintf( stderr, "Detected stride: %" PRIu32 "\n", period );
+		}
+	}
+
+	uint32_t block_size = stride_block_size( period ? period : 1 );
+	uint64_t ( *histograms )[ ALPHABET ] = calloc( period, sizeof( *histograms ) );
+	Code ( *tables )[ ALPHABET ] = calloc( period, sizeof( *tables ) );
+	PackedCodes *codes = ( PackedCodes * ) calloc( period, sizeof( PackedCodes ) );
+	BitWriter *writer = bit_writer_create( output_file );
+	success = success && histograms && tables && codes && writer;
+	lseek( *input_file, 0, SEEK_SET );
+	stats_phase( stats, "histogram" );
+
+	for ( uint64_t done = 0; success && done < *original_size; ) {
+		uint32_t wanted = *original_size - done < block_size ? *original_size - done : block_size;
+		success = read_bytes( *input_file, buffer, wanted ) == wanted; // Fails if the input changed.
+
+		for ( uint32_t i = 0, column = 0; success && i < wanted; i++ ) {
+			histograms[ column ][ buffer[ i ] ]++;
+			column = column + 1 == period ? 0 : column + 1;
+		}
+
+		done += wanted;
+	}
+
+	if ( success ) {
+		stats_phase( stats, "build_codes" );
+		FileHeader output_header = { MAGIC_STRIDE, 0, *original_size };
+		RawFileHeader output_raw_header = raw_file_header_create( output_header );
+		uint8_t stride_header[ STRIDE_HEADER_SIZE ];
+		store_little_endian( stride_header, period, STRIDE_HEADER_SIZE );
+		bit_writer_write_bytes( writer, ( uint8_t * ) &output_raw_header, sizeof( output_raw_header ) );
+		bit_writer_write_bytes( writer, stride_header, STRIDE_HEADER_SIZE );
+	}
+
+	for ( uint32_t column = 0; success && column < period; column++ ) {
+		uint8_t tree[ STRIDE_TREE_HEADER + MAX_TREE_SIZE ];
+		Node *huffman_tree = build_tree( histograms[ column ] );
+		build_codes( huffman_tree, tables[ column ] );
+		code_table_pack( tables[ column ], &codes[ column ] );
+		uint16_t tree_size = dump_tree( huffman_tree, tree + STRIDE_TREE_HEADER );
+		store_little_endian( tree, tree_size, STRIDE_TREE_HEADER );
+		bit_writer_write_bytes( writer, tree, STRIDE_TREE_HEADER + tree_size );
+		delete_tree( &huffman_tree );
+	}
+
+	if ( success ) {
+		stats_phase( stats, "encode" );
+		lseek( *input_file, 0, SEEK_SET );
+	}
+
+	for ( uint64_t done = 0; success && done < *original_size; ) {
+		uint32_t wanted = *original_size - done < block_size ? *original_size - done : block_size;
+		success = read_bytes( *input_file, buffer, wanted ) == wanted;
+		stride_split( buffer, wanted, period, columns );
+
+		for ( uint32_t column = 0, offset = 0; success && column < period; column++ ) {
+			uint32_t nbytes = stride_column_size( wanted, period, column );
+			write_codes( writer, &codes[ column ], columns + offset, nbytes );
+			offset += nbytes;
+		}
+
+		done += wanted;
+	}
+
+	if ( success ) {
+		flush_codes( writer );
+		*compressed_size = bit_writer_tell( writer ) / 8;
+	} else {
+		fprintf( stderr, buffer && columns && histograms && tables && codes && writer ? "Error: failed to read infile.\n" : "Error: out of memory.\n" );
+	}
+
+	stats_phase( stats, NULL );
+	bit_writer_delete( &writer );
+	free( codes );
+	free( tables );
+	free( histograms );
+	io_buffer_delete( &columns );
+	io_buffer_delete( &buffer );
+
+	return success;
+}
+
+// Description:
+// Builds the code tables of a block's streams from their histograms, and dumps
+// their trees.
+//
+// Parameters:
+// LzBlock *block - The block.
+// Code tables[static LZ_STREAMS][ALPHABET] - The code tables to build.
+// PackedCodes codes[static LZ_STREAMS] - The packed codes to set from the tables.
+// uint8_t trees[static LZ_STREAMS][MAX_TREE_SIZE] - The buffers to dump the trees to.
+// uint16_t tree_sizes[static LZ_STREAMS] - The array to set to the size of each tree dump.
+//
+// Returns:
+// uint64_t - The size of the block's tree dumps, extra bits and codes in bits.
+static uint64_t build_lz_codes( LzBlock *block, Code tables[ static LZ_STREAMS ][ ALPHABET ], PackedCodes codes[ static LZ_STREAMS ], uint8_t trees[ static LZ_STREAMS ][ MAX_TREE_SIZE ], uint16_t tree_sizes[ static LZ_STREAMS ] ) {
+	uint64_t bits = 8 * ( uint64_t ) block->extra_size;
+
+	for ( uint32_t stream = 0; stream < LZ_STREAMS; stream++ ) {
+		uint64_t histogram[ ALPHABET ] = { 0 };
+		histogram_update( histogram, block->symbols[ stream ], block->counts[ stream ] );
+		Node *huffman_tree = build_tree( histogram );
+		build_codes( huffman_tree, tables[ stream ] );
+		code_table_pack( tables[ stream ], &codes[ stream ] );
+		tree_sizes[ stream ] = dump_tree( huffman_tree, trees[ stream ] );
+		delete_tree( &huffman_tree );
+		bits += 8 * tree_sizes[ stream ];
+
+		for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+			bits += histogram[ i ] * codes[ stream ].length[ i ];
+		}
+	}
+
+	return bits;
+}
+
+// Description:
+// Encodes a file with LZ77: each block is parsed into literals and matches
+// against the last window of input, and the literals, literal run lengths,
+// match lengths and distances are Huffman coded as four streams with their own
+// tables. Blocks the matches don't make smaller are coded as literals only, as
+// they would be without LZ77. Each block is written as its header, the four tree dumps, the extra
+// bits of its lengths and distances, and the streams' codes, padded to a byte
+// boundary.
+//
+// Parameters:
+// int *input_file - A pointer to the input file, replaced with a temporary file if it isn't seekable.
+// int output_file - The output file.
+// uint64_t *original_size - The pointer to the uint64_t to set to the input size.
+// uint64_t *compressed_size - The pointer to the uint64_t to set to the output size.
+//
+// Returns:
+// bool - Whether the file was encoded.
+static bool write_lz_file( int *input_file, int output_file, uint64_t *original_size, uint64_t *compressed_size ) {
+	uint64_t histogram[ ALPHABET ] = { 0 };
+	uint32_t unique_symbols = 0;
+	stats_phase( stats, "histogram" );
+
+	if ( lseek( *input_file, 0, SEEK_CUR ) == -1 && !generate_histogram_and_temp_input_file( input_file, histogram, &unique_symbols ) ) { // The size goes in the header, so piped input is spooled first.
+		fprintf( stderr, "Error: failed to spool infile.\n" );
+		stats_phase( stats, NULL );
+
+		return false;
+	}
+
+	struct stat input_file_stats;
+	fstat( *input_file, &input_file_stats );
+	*original_size = input_file_stats.st_size;
+	LzEncoder *encoder = lz_encoder_create( lz_level );
+	LzBlock block;
+	bool allocated = lz_block_create( &block );
+	BitWriter *writer = bit_writer_create( output_file );
+	bool success = encoder && allocated && writer;
+	uint64_t matches = 0;
+	uint64_t literals = 0;
+
+	if ( success ) {
+		FileHeader output_header = { MAGIC_LZ, 0, *original_size };
+		RawFileHeader output_raw_header = raw_file_header_create( output_header );
+		bit_writer_write_bytes( writer, ( uint8_t * ) &output_raw_header, sizeof( output_raw_header ) );
+	}
+
+	for ( uint64_t done = 0; success && done < *original_size; ) {
+		uint32_t room = 0;
+		uint8_t *buffer = lz_encoder_window( encoder, &room );
+		uint32_t wanted = *original_size - done < room ? *original_size - done : room;
+		stats_phase( stats, "read" );
+
+		if ( !( success = read_bytes( *input_file, buffer, wanted ) == wanted ) ) { // Fails if the input changed.
+			break;
+		}
+
+		stats_phase( stats, "match" );
+		lz_encoder_parse( encoder, wanted, &block );
+		stats_phase( stats, "build_codes" );
+		uint8_t header[ LZ_BLOCK_HEADER_SIZE ];
+		uint8_t trees[ LZ_STREAMS ][ MAX_TREE_SIZE ];
+		uint16_t tree_sizes[ LZ_STREAMS ];
+		Code tables[ LZ_STREAMS ][ ALPHABET ];
+		PackedCodes codes[ LZ_STREAMS ];
+		uint64_t bits = build_lz_codes( &block, tables, codes, trees, tree_sizes );
+
+		if ( block.counts[ LZ_LENGTHS ] != 0 ) {
+			uint64_t counts[ ALPHABET ] = { 0 };
+			uint32_t histogram[ ALPHABET ];
+			histogram_update( counts, buffer, wanted );
+
+			for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+				histogram[ i ] = counts[ i ];
+			}
+
+			if ( split_block_cost( histogram ) - 8 * SPLIT_BLOCK_HEADER_SIZE < bits ) { // Exact sizes, tree dumps included.
+				lz_block_literals( &block, buffer, wanted );
+				build_lz_codes( &block, tables, codes, trees, tree_sizes );
+			}
+		}
+
+		stats_phase( stats, "encode" );
+		matches += block.counts[ LZ_LENGTHS ];
+		literals += block.counts[ LZ_LITERALS ];
+		lz_block_header_create( &block, tree_sizes, header );
+		bit_writer_write_bytes( writer, header, LZ_BLOCK_HEADER_SIZE );
+
+		for ( uint32_t stream = 0; stream < LZ_STREAMS; stream++ ) {
+			bit_writer_write_bytes( writer, trees[ stream ], tree_sizes[ stream ] );
+		}
+
+		bit_writer_write_bytes( writer, block.extra, block.extra_size );
+
+		for ( uint32_t stream = 0; stream < LZ_STREAMS; stream++ ) {
+			write_codes( writer, &codes[ stream ], block.symbols[ stream ], block.counts[ stream ] );
+		}
+
+		bit_writer_align( writer );
+		done += wanted;
+	}
+
+	if ( success ) {
+		flush_codes( writer );
+		*compressed_size = bit_writer_tell( writer ) / 8;
+	} else {
+		fprintf( stderr, encoder && allocated && writer ? "Error: failed to read infile.\n" : "Error: out of memory.\n" );
+	}
+
+	if ( success && report ) {
+		fprintf( stderr, "LZ77 level %" PRIu32 ": %" PRIu64 " matches, %" PRIu64 " literals\n", lz_level, matches, literals );
+	}
+
+	stats_phase( stats, NULL );
+	bit_writer_delete( &writer );
+
+	if ( allocated ) {
+		lz_block_delete( &block );
+	}
+
+	lz_encoder_delete( &encoder );
+
+	return success;
+}
+
+// Description:
+// Encodes a segment of a stream and writes it out right away: its header, a
+// tree dump if the table before it isn't kept, and its codes, padded to a byte
+// boundary so the decoder can output the segment as soon as it arrives.
+//
+// Parameters:
+// BitWriter *writer - The bit writer for the output file.
+// Code table[static ALPHABET] - The code table of the last segment, replaced if a new one is built.
+// PackedCodes *codes - The packed codes of the table.
+// bool present[static ALPHABET] - Which bytes the table has codes for, all false before the first segment.
+// uint8_t *buffer - The segment's input.
+// uint32_t nbytes - The size of the segment's input.
+//
+// Returns:
+// Nothing.
+static void write_stream_segment( BitWriter *writer, Code table[ static ALPHABET ], PackedCodes *codes, bool present[ static ALPHABET ], uint8_t *buffer, uint32_t nbytes ) {
+	uint64_t histogram[ ALPHABET ] = { 0 };
+	uint32_t counts[ ALPHABET ];
+	uint8_t header[ STREAM_SEGMENT_HEADER_SIZE + MAX_TREE_SIZE ];
+	uint16_t tree_size = 0;
+	uint64_t bits = 0;
+	histogram_update( histogram, buffer, nbytes );
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		counts[ i ] = histogram[ i ];
+	}
+
+	if ( !stream_keep_table( counts, codes->length, present ) ) {
+		code_pairs_delete( codes );
+		Node *huffman_tree = build_tree( histogram );
+		memset( table, 0, ALPHABET * sizeof( Code ) );
+		build_codes( huffman_tree, table );
+		code_table_pack( table, codes );
+		tree_size = dump_tree( huffman_tree, header + STREAM_SEGMENT_HEADER_SIZE );
+		delete_tree( &huffman_tree );
+
+		if ( nbytes >= PAIR_TABLE_MIN_INPUT ) {
+			code_pairs_create( codes );
+		}
+
+		for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+			present[ i ] = histogram[ i ] != 0;
+		}
+	}
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		bits += histogram[ i ] * codes->length[ i ];
+	}
+
+	stream_segment_header_create( nbytes, ( bits + 7 ) / 8, tree_size, header );
+	bit_writer_write_bytes( writer, header, STREAM_SEGMENT_HEADER_SIZE + tree_size );
+	write_codes( writer, codes, buffer, nbytes );
+	flush_codes( writer ); // Pads to a byte boundary.
+}
+
+// Description:
+// Gets a monotonic clock reading.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// uint64_t - The time in milliseconds.
+static uint64_t now_ms( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return ( uint64_t ) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Description:
+// Encodes the input as it arrives, for pipes that have to keep moving. Input
+// is gathered into a segment until flush_bytes of it are waiting or the oldest
+// waiting byte is flush_ms old, then the segment is coded and written out, so
+// no byte waits longer than that before the decoder can output it. A segment
+// keeps the table of the one before it unless a new one codes it in fewer
+// bits. An empty segment header ends the stream.
+//
+// Parameters:
+// int input_file - The input file.
+// int output_file - The output file.
+// uint64_t *original_size - The pointer to the uint64_t to set to the input size.
+// uint64_t *compressed_size - The pointer to the uint64_t to set to the output size.
+//
+// Returns:
+// bool - Whether the whole input was encoded and written.
+static bool write_stream_file( int input_file, int output_file, uint64_t *original_size, uint64_t *compressed_size ) {
+	uint8_t *buffer = io_buffer_create( flush_bytes );
+	BitWriter *writer = bit_writer_create( output_file );
+	Code table[ ALPHABET ] = { 0 };
+	PackedCodes codes = { 0 };
+	bool present[ ALPHABET ] = { false };
+	uint32_t filled = 0;
+	uint64_t deadline = 0;
+	bool ended = false;
+	bool success = buffer && writer;
+
+	if ( !success ) {
+		fprintf( stderr, "Error: out of memory.\n" );
+	} else {
+		FileHeader output_header = { MAGIC_STREAM, 0, 0 }; // The size isn't known until the end.
+		RawFileHeader output_raw_header = raw_file_header_create( output_header );
+		bit_writer_write_bytes( writer, ( uint8_t * ) &output_raw_header, sizeof( output_raw_header ) );
+		flush_codes( writer );
+	}
+
+	*original_size = 0;
+
+	while ( success && !ended ) {
+		int ready = 1;
+
+		if ( filled != 0 ) { // Wait for more input only until the oldest waiting byte is due.
+			uint64_t now = now_ms( );
+			struct pollfd input = { input_file, POLLIN, 0 };
+			ready = poll( &input, 1, now < deadline ? ( int ) ( deadline - now ) : 0 );
+		}
+
+		if ( ready == -1 && errno == EINTR ) {
+			continue;
+		}
+
+		if ( ready > 0 ) {
+			ssize_t bytes_read = read( input_file, buffer + filled, flush_bytes - filled );
+
+			if ( bytes_read == -1 && errno == EINTR ) {
+				continue;
+			}
+
+			if ( bytes_read == -1 ) {
+				fprintf( stderr, "Error: failed to read infile.\n" );
+				success = false;
+
+				break;
+			}
+
+			if ( filled == 0 ) {
+				deadline = now_ms( ) + flush_ms;
+			}
+
+			ended = bytes_read == 0;
+			filled += bytes_read;
+		}
+
+		if ( filled != 0 && ( ended || ready <= 0 || filled == flush_bytes || flush_ms == 0 ) ) {
+			stats_phase( stats, "encode" );
+			write_stream_segment( writer, table, &codes, present, buffer, filled );
+			stats_phase( stats, NULL );
+			*original_size += filled;
+			filled = 0;
+		}
+	}
+
+	if ( success ) {
+		uint8_t header[ STREAM_SEGMENT_HEADER_SIZE ];
+		stream_segment_header_create( 0, 0, 0, header );
+		bit_writer_write_bytes( writer, header, STREAM_SEGMENT_HEADER_SIZE );
+		flush_codes( writer );
+		*compressed_size = bit_writer_tell( writer ) / 8;
+	}
+
+	code_pairs_delete( &codes );
+	bit_writer_delete( &writer );
+	io_buffer_delete( &buffer );
+
+	return success;
+}
+
+// Description:
+// Creates a parallel encoder for the input file, if it's worth splitting into
+// chunks: it has to be a regular file of at least two chunks, written to a
+// regular file that chunks can be written into at any offset.
+//
+// Parameters:
+// int input_file - The input file.
+// int output_file - The output file.
+//
+// Returns:
+// ParallelEncoder * - The parallel encoder, or NULL to encode serially.
+static ParallelEncoder *create_parallel_encoder( int input_file, int output_file ) {
+	struct stat input_file_stats;
+	struct stat output_file_stats;
+
+	if ( encode_threads < 2 || fstat( input_file, &input_file_stats ) == -1 || fstat( output_file, &output_file_stats ) == -1 ) {
+		return NULL;
+	}
+
+	if ( !S_ISREG( input_file_stats.st_mode ) || !S_ISREG( output_file_stats.st_mode ) || ( uint64_t ) input_file_stats.st_size < 2 * ( uint64_t ) PARALLEL_CHUNK ) {
+		return NULL;
+	}
+
+	return parallel_encoder_create( input_file, output_file, input_file_stats.st_size, encode_threads );
+}
+
+// Description:
+// Sets the permissions of the output file to those of the input file (0600 if
+// the input file isn't seekable).
+//
+// Parameters:
+// int input_file - The input file.
+// int output_file - The output file.
+//
+// Returns:
+// Nothing.
+static void copy_permissions( int input_file, int output_file ) {
+	struct stat input_file_stats;
+
+	if ( lseek( input_file, 0, SEEK_CUR ) == -1 || fstat( input_file, &input_file_stats ) == -1 ) { // Input file is not seekable.
+		fchmod( output_file, 0600 );
+	} else { // Input file is seekable.
+		fchmod( output_file, input_file_stats.st_mode );
+	}
+}
+
+// Description:
+// Commits the segment just written, when appending to an archive, then closes
+// the input and output files.
+//
+// Parameters:
+// int *input_file - A pointer to the input file.
+// int *output_file - A pointer to the output file.
+// bool success - Whether the file was compressed successfully.
+// uint64_t original_size - The size of the input.
+//
+// Returns:
+// bool - Whether the file was compressed, and committed if appending.
+static bool finish_file( int *input_file, int *output_file, bool success, uint64_t original_size ) {
+	if ( success && append && !archive_commit( *output_file, original_size ) ) {
+		fprintf( stderr, "Error: failed to commit the segment to outfile.\n" );
+		success = false;
+	}
+
+	cleanup_files( input_file, output_file );
+
+	return success;
+}
+
+// Description:
+// Compresses a file.
+//
+// Parameters:
+// char *input_file_name - The input file name, or NULL for stdin.
+// char *output_file_name - The output file name, or NULL for stdout.
+// uint64_t *original_size - The pointer to the uint64_t to set to the input size.
+// uint64_t *compressed_size - The pointer to the uint64_t to set to the output size.
+//
+// Returns:
+// bool - Whether the file was compressed successfully.
+static bool compress_file( char *input_file_name, char *output_file_name, uint64_t *original_size, uint64_t *compressed_size ) {
+	int input_file = input_file_name ? -1 : STDIN_FILENO;
+	int output_file = output_file_name ? -1 : STDOUT_FILENO;
+
+	if ( !process_input_output_files( input_file_name, output_file_name, &input_file, &output_file ) ) {
+		cleanup_files( &input_file, &output_file );
+
+		return false;
+	}
+
+	bool created = false;
+
+	if ( append && !archive_begin( output_file, &created ) ) {
+		fprintf( stderr, "Error: outfile isn't an archive made with --append, or is corrupted.\n" );
+		cleanup_files( &input_file, &output_file );
+
+		return false;
+	}
+
+	// Here rather than in main(), since batch workers compress files without it. An archive keeps the permissions it was created with.
+	if ( output_file_name && ( !append || created ) ) {
+		copy_permissions( input_file, output_file );
+	}
+
+	io_advise_sequential( input_file );
+
+	if ( dictionary ) {
+		BitWriter *writer = bit_writer_create( output_file );
+		*compressed_size = writer ? write_dictionary_encoded_file( input_file, writer, original_size ) : 0;
+		bit_writer_delete( &writer );
+		cleanup_files( &input_file, &output_file );
+
+		if ( *compressed_size == 0 ) {
+			fprintf( stderr, "Error: out of memory.\n" );
+		}
+
+		return *compressed_size != 0;
+	}
+
+	if ( records ) {
+		bool success = write_records_file( &input_file, output_file, original_size, compressed_size );
+		cleanup_files( &input_file, &output_file );
+
+		return success;
+	}
+
+	if ( split ) {
+		bool success = write_split_file( &input_file, output_file, original_size, compressed_size );
+		cleanup_files( &input_file, &output_file );
+
+		return success;
+	}
+
+	if ( strided ) {
+		bool success = write_stride_file( &input_file, output_file, original_size, compressed_size );
+
+		return finish_file( &input_file, &output_file, success, *original_size );
+	}
+
+	if ( lz_level ) {
+		bool success = write_lz_file( &input_file, output_file, original_size, compressed_size );
+
+		return finish_file( &input_file, &output_file, success, *original_size );
+	}
+
+	if ( stream ) {
+		bool success = write_stream_file( input_file, output_file, original_size, compressed_size );
+		cleanup_files( &input_file, &output_file );
+
+		return success;
+	}
+
+	bool piped = lseek( input_file, 0, SEEK_CUR ) == -1;
+	bool store = false;
+	struct stat input_file_stats;
+	uint64_t histogram[ ALPHABET ] = { 0 };
+	uint32_t unique_symbols = 0;
+
+	if ( transform ) { // The transformed blocks are coded instead, so the input's own histogram doesn't matter.
+		stats_phase( stats, "transform" );
+
+		if ( !transform_input_file( &input_file, histogram, &input_file_stats ) ) {
+			fprintf( stderr, "Error: failed to transform infile.\n" );
+			stats_phase( stats, NULL );
+			cleanup_files( &input_file, &output_file );
+
+			return false;
+		}
+
+		for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+			unique_symbols += histogram[ i ] != 0;
+		}
+	} else if ( check_saving && !piped ) { // Sample the input before reading all of it.
+		stats_phase( stats, "estimate" );
+		store = below_min_saving( input_file, NULL, 0 );
+	}
+
+	ParallelEncoder *parallel = NULL;
+
+	if ( !store && !transform ) {
+		stats_phase( stats, "histogram" );
+
+		if ( !piped && output_file_name && !append && ( parallel = create_parallel_encoder( input_file, output_file ) ) ) { // Chunks are written at offsets from the start of the file.
+			parallel_encoder_histogram( parallel, histogram );
+
+			for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+				unique_symbols += histogram[ i ] != 0;
+			}
+		} else if ( !generate_histogram_and_temp_input_file( &input_file, histogram, &unique_symbols ) ) {
+			fprintf( stderr, "Error: failed to spool infile.\n" );
+			stats_phase( stats, NULL );
+			cleanup_files( &input_file, &output_file );
+
+			return false;
+		}
+	}
+
+	if ( !transform ) { // Otherwise the size is the input's, not the transformed file's.
+		fstat( input_file, &input_file_stats );
+	}
+
+	if ( check_saving && piped && !transform ) { // The whole input has been counted, so the estimate is exact.
+		store = below_min_saving( input_file, histogram, input_file_stats.st_size );
+	}
+
+	if ( store ) {
+		stats_phase( stats, "store" );
+		BitWriter *writer = bit_writer_create( output_file );
+		*compressed_size = writer ? write_stored_file( input_file, writer, original_size ) : 0;
+		stats_phase( stats, NULL );
+		bit_writer_delete( &writer );
+
+		if ( *compressed_size == 0 ) {
+			fprintf( stderr, "Error: out of memory.\n" );
+		}
+
+		return finish_file( &input_file, &output_file, *compressed_size != 0, *original_size );
+	}
+
+	if ( ans ) { // The histogram is all the tANS coder shares with the Huffman coder.
+		parallel_encoder_delete( &parallel );
+		BitWriter *writer = bit_writer_create( output_file );
+		*original_size = input_file_stats.st_size;
+		bool success = writer && write_ans_file( input_file, writer, histogram, input_file_stats.st_size, compressed_size );
+		bit_writer_delete( &writer );
+
+		return finish_file( &input_file, &output_file, success, *original_size );
+	}
+
+	stats_phase( stats, "build_tree" );
+	Node *huffman_tree = build_tree( histogram );
+	stats_phase( stats, "build_codes" );
+	Code huffman_code_table[ ALPHABET ] = { 0 };
+	build_codes( huffman_tree, huffman_code_table );
+	PackedCodes codes;
+	code_table_pack( huffman_code_table, &codes );
+
+	if ( ( uint64_t ) input_file_stats.st_size >= PAIR_TABLE_MIN_INPUT ) { // Building the 64K entries costs more than they save on small inputs.
+		code_pairs_create( &codes );
+	}
+	stats_phase( stats, "header" );
+	*compressed_size = 0;
+	FileHeader output_header = { 0 };
+	output_header.magic_number = transform ? MAGIC_BWT : MAGIC;
+
+	if ( unique_symbols != 0 ) {
+		output_header.tree_size = 3 * unique_symbols - 1;
+	}
+
+	output_header.original_file_size = input_file_stats.st_size;
+	RawFileHeader output_raw_header = raw_file_header_create( output_header );
+	*original_size = output_header.original_file_size;
+	bool success = true;
+
+	if ( report ) {
+		code_report_from_codes( histogram, codes.length, sizeof( output_raw_header ) + output_header.tree_size, report );
+	}
+
+	if ( trace_file_name ) { // The input is seekable by now, and its codes are known.
+		stats_phase( stats, "trace" );
+
+		if ( !entropy_trace_save( input_file, trace_window, codes.length, trace_file_name ) ) {
+			fprintf( stderr, "Error: failed to save entropy trace.\n" );
+			success = false;
+		}
+	}
+
+	if ( !success ) {
+		stats_phase( stats, NULL );
+	} else if ( parallel && parallel_encoder_plan( parallel, &codes ) ) {
+		// Chunks are written in place after the header, so it goes out on its own.
+		uint8_t header[ sizeof( output_raw_header ) + MAX_TREE_SIZE ];
+		memcpy( header, &output_raw_header, sizeof( output_raw_header ) );
+		uint32_t header_size = sizeof( output_raw_header ) + dump_tree( huffman_tree, header + sizeof( output_raw_header ) );
+		uint64_t code_bytes = 0;
+		success = pwrite_bytes( output_file, header, header_size, 0 ) == header_size;
+		stats_phase( stats, "encode" );
+		success = parallel_encoder_encode( parallel, header_size, &code_bytes ) && success;
+		stats_phase( stats, NULL );
+		*compressed_size = header_size + code_bytes;
+
+		if ( !success ) {
+			fprintf( stderr, "Error: failed to write outfile.\n" );
+		}
+	} else { // Codes too long for the encode kernels, or chunks too short to split.
+		BitWriter *writer = bit_writer_create( output_file );
+
+		if ( writer ) {
+			// Buffer the header and tree dump, so they go out in the same write as the first codes.
+			*compressed_size += bit_writer_write_bytes( writer, ( uint8_t * ) &output_raw_header, sizeof( output_raw_header ) ); // Write raw file header.
+			write_tree_to_outfile( writer, huffman_tree, compressed_size );
+		}
+
+		if ( !writer || !write_codes_for_symbols( input_file, writer, &codes, compressed_size ) ) {
+			fprintf( stderr, "Error: out of memory.\n" );
+			stats_phase( stats, NULL );
+			success = false;
+		}
+
+		bit_writer_delete( &writer );
+	}
+
+	parallel_encoder_delete( &parallel );
+	code_pairs_delete( &codes );
+	delete_tree( &huffman_tree );
+
+	return finish_file( &input_file, &output_file, success, *original_size );
+}
+
+// Description:
+// Compresses the files given on the command line or in a file list.
+//
+// Parameters:
+// char **file_names - The file names given on the command line.
+// uint32_t count - The number of file names given on the command line.
+// char *file_list_name - The file list to read file names from instead, if given.
+// BatchOptions *options - The batch options.
+//
+// Returns:
+// bool - Whether every file was compressed successfully.
+static bool compress_batch( char **file_names, uint32_t count, char *file_list_name, BatchOptions *options ) {
+	char **file_list = NULL;
+
+	if ( file_list_name && !( file_names = file_list = batch_read_file_list( file_list_name, &count ) ) ) {
+		fprintf( stderr, "Error: failed to read file list.\n" );
+
+		return false;
+	}
+
+	uint32_t failures = batch_run( file_names, count, options, compress_file );
+	batch_delete_file_list( &file_list, count );
+
+	return failures == 0;
+}
+
+// Description:
+// Prints the predicted compressed size and space saving of files, without compressing them.
+//
+// Parameters:
+// char **file_names - The file names given on the command line, or none for stdin.
+// uint32_t count - The number of file names given on the command line.
+// char *file_list_name - The file list to read file names from instead, if given.
+//
+// Returns:
+// bool - Whether every file could be read.
+static bool estimate_files( char **file_names, uint32_t count, char *file_list_name ) {
+	char **file_list = NULL;
+
+	if ( file_list_name && !( file_names = file_list = batch_read_file_list( file_list_name, &count ) ) ) {
+		fprintf( stderr, "Error: failed to read file list.\n" );
+
+		return false;
+	}
+
+	uint64_t total_size = 0;
+	uint64_t total_compressed_size = 0;
+	uint32_t failures = 0;
+	printf( "%14s %14s %8s %8s  %s\n", "Size", "Predicted", "Saving", "Entropy", "File" );
+
+	for ( uint32_t i = 0; i < count || ( count == 0 && i == 0 ); i++ ) {
+		char *file_name = count ? file_names[ i ] : "-";
+		int input_file = count ? io_open( file_name, O_RDONLY, 0 ) : STDIN_FILENO;
+		Estimate estimate;
+
+		if ( input_file == -1 || !estimate_file( input_file, &estimate ) ) {
+			fprintf( stderr, "Error: failed to read %s.\n", file_name );
+			failures++;
+		} else {
+			printf( "%14" PRIu64 " %14" PRIu64 " %7.2f%% %8.3f  %s\n", estimate.file_size, estimate.compressed_size, estimate_saving( &estimate ), estimate.entropy, file_name );
+			total_size += estimate.file_size;
+			total_compressed_size += estimate.compressed_size;
+		}
+
+		if ( count && input_file != -1 ) {
+			close( input_file );
+		}
+	}
+
+	if ( count > 1 ) {
+		printf( "%14" PRIu64 " %14" PRIu64 " %7.2f%% %8s  %s\n", total_size, total_compressed_size, total_size ? 100 * ( 1 - ( double ) total_compressed_size / total_size ) : 0.0, "-", "total" );
+	}
+
+	batch_delete_file_list( &file_list, count );
+
+	return failures == 0;
+}
+
+// Description:
+// The entry point of the program.
+//
+// Parameters:
+// int argc - The argument count.
+// char **argv - An array of argument strings.
+//
+// Returns:
+// int - The exit status of the program (0 = success, otherwise error).
+int main( int argc, char **argv ) {
+	int opt = 0;
+	bool verbose = false;
+	char *input_file_name = NULL;
+	char *output_file_name = NULL;
+	char *file_list_name = NULL;
+	char *dictionary_file_name = NULL;
+	char *stats_json_file_name = NULL;
+	bool estimate = false;
+	uint64_t value = 0; // A number given to an option, before it's range checked.
+	IOConfig io_config = { DEFAULT_BLOCK_SIZE, false, true };
+	BatchOptions batch_options = { DEFAULT_SUFFIX, false, NULL, 0, false };
+
+	while ( ( opt = getopt_long( argc, argv, OPTIONS, long_options, NULL ) ) != -1 ) { // Process each option specified.
+		switch ( opt ) {
+		case 'h': print_help( *argv ); return 0; // Help.
+		case 'v': verbose = true; break; // Verbose.
+		case 'i': input_file_name = optarg; break; // Input file.
+		case 'o': output_file_name = optarg; break; // Output file.
+		case OPTION_DIRECT: io_config.direct = true; break; // Direct I/O.
+		case OPTION_NO_FADVISE: io_config.advise = false; break; // No page cache hints.
+		case 'j': // Batch threads.
+			if ( !thread_pool_parse_threads( optarg, &batch_options.threads ) ) {
+				fprintf( stderr, "Error: invalid thread count.\n" );
+
+				return 1;
+			}
+
+			break;
+		case 'S': batch_options.suffix = optarg; break; // Batch output suffix.
+		case 'O': batch_options.output_dir = optarg; break; // Batch output directory.
+		case 'F': file_list_name = optarg; break; // Batch file list.
+		case 'D': dictionary_file_name = optarg; break; // Dictionary.
+		case OPTION_STATS_JSON: stats_json_file_name = optarg; break; // JSON stats.
+		case OPTION_ESTIMATE: estimate = true; break; // Estimate only.
+		case OPTION_BWT: transform = true; break; // Burrows-Wheeler transform.
+		case OPTION_ENTROPY_TRACE: trace_file_name = optarg; break; // Entropy trace.
+		case OPTION_SPLIT: split = true; break; // Block splitting.
+		case OPTION_ANS: ans = true; break; // tANS backend.
+		case OPTION_STREAM: stream = true; break; // Streaming.
+		case OPTION_APPEND: append = true; break; // Archive segments.
+		case OPTION_STRIDE: // Tables per byte position of records.
+			if ( strcmp( optarg, "auto" ) == 0 ) {
+				value = 0;
+			} else if ( !io_parse_number( optarg, &value ) || value == 0 || value > STRIDE_MAX ) {
+				fprintf( stderr, "Error: invalid stride.\n" );
+
+				return 1;
+			}
+
+			stride = value;
+			strided = true;
+			break;
+		case OPTION_LZ: // LZ77 matching level.
+			if ( !io_parse_number( optarg, &value ) || value == 0 || value > LZ_LEVELS ) {
+				fprintf( stderr, "Error: invalid LZ level.\n" );
+
+				return 1;
+			}
+
+			lz_level = value;
+
+			break;
+		case OPTION_FLUSH_BYTES: // Most input per streamed segment.
+			if ( !io_parse_size( optarg, &flush_bytes ) || flush_bytes == 0 || flush_bytes > STREAM_MAX_FLUSH ) {
+				fprintf( stderr, "Error: invalid flush size.\n" );
+
+				return 1;
+			}
+
+			stream = true;
+			break;
+		case OPTION_FLUSH_MS: // Most time input waits when streaming.
+			if ( !io_parse_number( optarg, &value ) || value > STREAM_MAX_FLUSH_MS ) {
+				fprintf( stderr, "Error: invalid flush time.\n" );
+
+				return 1;
+			}
+
+			flush_ms = value;
+			stream = true;
+			break;
+		case OPTION_RECORDS: // Record mode.
+			if ( !record_format_parse( optarg, &record_format ) ) {
+				fprintf( stderr, "Error: invalid record format.\n" );
+
+				return 1;
+			}
+
+			records = true;
+			break;
+		case OPTION_SPOOL_MEMORY: // Memory for spooling piped input.
+			if ( !io_parse_size( optarg, &spool_memory ) ) {
+				fprintf( stderr, "Error: invalid spool memory size.\n" );
+
+				return 1;
+			}
+
+			break;
+		case OPTION_TRACE_WINDOW: // Entropy trace window.
+			if ( !io_parse_block_size( optarg, &trace_window ) ) {
+				fprintf( stderr, "Error: invalid trace window.\n" );
+
+				return 1;
+			}
+
+			break;
+		case OPTION_MIN_SAVING: // Store files that won't compress.
+			if ( !parse_min_saving( optarg, &min_saving ) ) {
+				fprintf( stderr, "Error: invalid minimum saving.\n" );
+
+				return 1;
+			}
+
+			check_saving = true;
+			break;
+		case 'b': // I/O buffer size.
+			if ( !io_parse_block_size( optarg, &io_config.block_size ) ) {
+				fprintf( stderr, "Error: invalid buffer size.\n" );
+
+				return 1;
+			}
+
+			break;
+		default: print_help( *argv ); return 1; // Invalid flag.
+		}
+	}
+
+	io_configure( io_config );
+
+	if ( dictionary_file_name && !( dictionary = dictionary_load( dictionary_file_name ) ) ) {
+		fprintf( stderr, "Error: failed to load dictionary.\n" );
+
+		return 1;
+	}
+
+	bool success = true;
+
+	if ( transform && dictionary ) {
+		fprintf( stderr, "Error: -D can't be used with --bwt.\n" );
+		success = false;
+	} else if ( records && ( dictionary || transform || trace_file_name ) ) {
+		fprintf( stderr, "Error: -D, --bwt and --entropy-trace can't be used with --records.\n" );
+		success = false;
+	} else if ( check_saving && ( dictionary || transform || records ) ) {
+		fprintf( stderr, "Error: -D, --bwt and --records can't be used with --min-saving.\n" );
+		success = false;
+	} else if ( ans && ( dictionary || transform || records || split || trace_file_name ) ) {
+		fprintf( stderr, "Error: -D, --bwt, --records, --split and --entropy-trace can't be used with --ans.\n" );
+		success = false;
+	} else if ( stream && ( dictionary || transform || records || split || ans || check_saving || trace_file_name ) ) {
+		fprintf( stderr, "Error: -D, --bwt, --records, --split, --ans, --min-saving and --entropy-trace can't be used with --stream.\n" );
+		success = false;
+	} else if ( split && ( dictionary || transform || records || check_saving || trace_file_name ) ) {
+		fprintf( stderr, "Error: -D, --bwt, --records, --min-saving and --entropy-trace can't be used with --split.\n" );
+		success = false;
+	} else if ( strided && ( dictionary || transform || records || split || ans || stream || check_saving || trace_file_name ) ) {
+		fprintf( stderr, "Error: -D, --bwt, --records, --split, --ans, --stream, --min-saving and --entropy-trace can't be used with --stride.\n" );
+		success = false;
+	} else if ( lz_level && ( dictionary || transform || records || split || ans || stream || strided || check_saving || trace_file_name ) ) {
+		fprintf( stderr, "Error: -D, --bwt, --records, --split, --ans, --stream, --stride, --min-saving and --entropy-trace can't be used with --lz.\n" );
+		success = false;
+	} else if ( append && ( dictionary || records || split || stream || estimate || !output_file_name ) ) {
+		fprintf( stderr, "Error: --append needs -o, and -D, --records, --split, --stream and --estimate can't be used with it.\n" );
+		success = false;
+	} else if ( estimate ) { // Estimate mode.
+		if ( output_file_name || dictionary ) {
+			fprintf( stderr, "Error: -o and -D can't be used with --estimate.\n" );
+			success = false;
+		} else if ( input_file_name ) {
+			success = estimate_files( &input_file_name, 1, NULL );
+		} else {
+			success = estimate_files( argv + optind, argc - optind, file_list_name );
+		}
+	} else if ( optind < argc || file_list_name ) { // Batch mode.
+		if ( input_file_name || output_file_name || stats_json_file_name || trace_file_name || stream ) {
+			fprintf( stderr, "Error: -i, -o, --stats-json, --entropy-trace and --stream can't be used with multiple input files.\n" );
+			success = false;
+		} else {
+			batch_options.verbose = verbose;
+			success = compress_batch( argv + optind, argc - optind, file_list_name, &batch_options );
+		}
+	} else {
+		uint64_t original_size = 0;
+		uint64_t compressed_size = 0;
+		CodeReport code_report = { 0 }; // Left zeroed for files stored or encoded with a dictionary.
+
+		if ( verbose || stats_json_file_name ) {
+			stats = stats_create( );
+		}
+
+		if ( verbose ) {
+			report = &code_report;
+		}
+
+		encode_threads = batch_options.threads ? batch_options.threads : thread_pool_default_threads( );
+
+		success = compress_file( input_file_name, output_file_name, &original_size, &compressed_size );
+
+		if ( success && verbose ) {
+			double space_saving = 100 * ( 1 - ( ( double ) compressed_size / original_size ) );
+			fprintf( stderr, "Uncompressed file size: %" PRIu64 " bytes\n", original_size );
+			fprintf( stderr, "Compressed file size: %" PRIu64 " bytes\n", compressed_size );
+			fprintf( stderr, "Space saving: %.2f%%\n", space_saving );
+
+			if ( code_report.header_size != 0 ) {
+				code_report_print( &code_report, stderr );
+			}
+
+			fprintf( stderr, "Kernels: %s\n", kernels_name( ) );
+			stats_print( stats, stderr, original_size );
+		}
+
+		if ( success && stats_json_file_name && !stats_save_json( stats, stats_json_file_name, "huffman_encode", original_size, compressed_size, original_size ) ) {
+			fprintf( stderr, "Error: failed to save stats.\n" );
+			success = false;
+		}
+
+		stats_delete( &stats );
+	}
+
+	dictionary_delete( &dictionary );
 
-	return 0;
+	return success ? 0 : 1;
 }
@@ -0,0 +1,161 @@
+#include "defines.h"
+#include "dictionary.h"
+#include "io.h"
+#include "kernels.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define OPTIONS "hvo:I:" // Valid options for the program.
+
+// Description:
+// Prints the help message to stderr.
+//
+// Parameters:
+// char *program_path - The path to the program.
+//
+// Returns:
+// Nothing.
+static void print_help( char *program_path ) {
+	fprintf( stderr,
+	    "SYNOPSIS\n   Trains a shared Huffman dictionary on a sample corpus.\n\nUSAGE\n   %s [-hv] [-I id] -o dict [file...]\n\nOPTIONS\n   -h             Prints the program help text.\n   -v             Prints "
+	    "training statistics to stderr.\n   -o dict        File to save the dictionary to.\n   -I id          Dictionary ID, in hex (default: derived from the code table).\n   file...        Sample files "
+	    "to train on (default: stdin).\n",
+	    program_path );
+}
+
+// Description:
+// Adds the contents of a file to a histogram.
+//
+// Parameters:
+// int input_file - The input file.
+// uint64_t histogram[static ALPHABET] - The histogram to add to.
+//
+// Returns:
+// uint64_t - The number of bytes read.
+static uint64_t add_to_histogram( int input_file, uint64_t histogram[ static ALPHABET ] ) {
+	uint32_t block_size = io_block_size( );
+	uint8_t *read_buffer = io_buffer_create( block_size );
+	uint32_t read_byte_buffer_size = 0;
+	uint64_t bytes_read = 0;
+
+	while ( ( read_byte_buffer_size = read_bytes( input_file, read_buffer, block_size ) ) != 0 ) {
+		histogram_update( histogram, read_buffer, read_byte_buffer_size );
+		bytes_read += read_byte_buffer_size;
+	}
+
+	io_buffer_delete( &read_buffer );
+
+	return bytes_read;
+}
+
+// Description:
+// Parses a dictionary ID given in hexadecimal.
+//
+// Parameters:
+// char *text - The text to parse.
+// uint32_t *id - The pointer to the uint32_t to set the ID to.
+//
+// Returns:
+// bool - Whether the text is a nonzero 32-bit hexadecimal number (0 is left to mean a derived ID).
+static bool parse_id( char *text, uint32_t *id ) {
+	char *end = NULL;
+	unsigned long long value = strtoull( text, &end, 16 );
+
+	if ( end == text || *end != '\0' || *text == '-' || value == 0 || value > UINT32_MAX ) {
+		return false;
+	}
+
+	*id = value;
+
+	return true;
+}
+
+// Description:
+// The entry point of the program.
+//
+// Parameters:
+// int argc - The argument count.
+// char **argv - An array of argument strings.
+//
+// Returns:
+// int - The exit status of the program (0 = success, otherwise error).
+int main( int argc, char **argv ) {
+	int opt = 0;
+	bool verbose = false;
+	char *output_file_name = NULL;
+	uint32_t id = 0;
+
+	while ( ( opt = getopt( argc, argv, OPTIONS ) ) != -1 ) { // Process each option specified.
+		switch ( opt ) {
+		case 'h': print_help( *argv ); return 0; // Help.
+		case 'v': verbose = true; break; // Verbose.
+		case 'o': output_file_name = optarg; break; // Output file.
+		case 'I': // Dictionary ID.
+			if ( !parse_id( optarg, &id ) ) {
+				fprintf( stderr, "Error: invalid dictionary ID.\n" );
+
+				return 1;
+			}
+
+			break;
+		default: print_help( *argv ); return 1; // Invalid flag.
+		}
+	}
+
+	if ( !output_file_name ) {
+		print_help( *argv );
+
+		return 1;
+	}
+
+	uint64_t histogram[ ALPHABET ] = { 0 };
+	uint64_t sample_size = 0;
+
+	if ( optind == argc ) { // Train on stdin.
+		sample_size += add_to_histogram( STDIN_FILENO, histogram );
+	}
+
+	for ( int i = optind; i < argc; i++ ) {
+		int input_file = open( argv[ i ], O_RDONLY );
+
+		if ( input_file == -1 ) {
+			fprintf( stderr, "Error: failed to open %s.\n", argv[ i ] );
+
+			return 1;
+		}
+
+		sample_size += add_to_histogram( input_file, histogram );
+		close( input_file );
+	}
+
+	Dictionary *dictionary = dictionary_create( histogram, id );
+
+	if ( !dictionary || !dictionary_save( dictionary, output_file_name ) ) {
+		fprintf( stderr, "Error: failed to save dictionary.\n" );
+		dictionary_delete( &dictionary );
+
+		return 1;
+	}
+
+	if ( verbose ) {
+		uint64_t coded_bits = 0;
+
+		for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+			coded_bits += histogram[ i ] * dictionary->table[ i ].top;
+		}
+
+		fprintf( stderr, "Sample size: %" PRIu64 " bytes\n", sample_size );
+		fprintf( stderr, "Dictionary ID: %08" PRIx32 "\n", dictionary->id );
+		fprintf( stderr, "Average code length on samples: %.3f bits/byte\n", sample_size ? ( double ) coded_bits / sample_size : 0.0 );
+	}
+
+	dictionary_delete( &dictionary );
+
+	return 0;
+}
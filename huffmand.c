@@ -0,0 +1,648 @@
+#define _GNU_SOURCE
+
+#include "codec.h"
+#include "defines.h"
+#include "dictionary.h"
+#include "io.h"
+#include "protocol.h"
+#include "thread_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OPTIONS             "hvs:j:m:D:" // Valid options for the program.
+#define MAX_DICTIONARIES    64 // Most dictionaries the daemon can serve.
+#define MAX_CONNECTIONS     1024 // Most connections open at once; more wait in the listen backlog.
+#define DEFAULT_MAX_PAYLOAD ( 16384 * BLOCK ) // 64MB: largest request payload by default.
+#define WORKSPACE_SIZE      ( 256 * BLOCK ) // 1MB input and output buffers preallocated per thread.
+#define WORKSPACE_KEEP      ( 4096 * BLOCK ) // 16MB: larger buffers are shrunk back after a request.
+#define IDLE_TIMEOUT        30 // Seconds a connection may wait between requests.
+#define REQUEST_TIMEOUT     5 // Seconds a read or write within a request may stall.
+#define POLL_INTERVAL       1000 // Milliseconds between checks for idle connections and signals.
+
+// Description:
+// A struct for the buffers a connection is served with, reused across requests
+// and connections.
+//
+// Members:
+// CodecBuffer input - The payload of a request.
+// CodecBuffer output - The payload of a response.
+// struct Workspace *next - The next free workspace.
+typedef struct Workspace {
+	CodecBuffer input;
+	CodecBuffer output;
+	struct Workspace *next;
+} Workspace;
+
+// Description:
+// A struct for an open connection. Between requests it is polled by the main
+// thread; a worker takes it for one request, then hands it back.
+//
+// Members:
+// int fd - The connected socket.
+// bool open - Whether the connection is kept open after its last request.
+// time_t idle_since - When its last request finished, in seconds.
+// struct Connection *next - The next connection handed back.
+typedef struct Connection {
+	int fd;
+	bool open;
+	time_t idle_since;
+	struct Connection *next;
+} Connection;
+
+static volatile sig_atomic_t stopping = 0; // Set by SIGINT and SIGTERM.
+static bool verbose = false; // Whether to log each request to stderr.
+static CodecDictionary *dictionaries[ MAX_DICTIONARIES ]; // Dictionaries with cached tables.
+static uint32_t ndictionaries = 0;
+static Workspace *free_workspaces = NULL; // Workspaces not serving a request.
+static pthread_mutex_t workspace_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t max_payload = DEFAULT_MAX_PAYLOAD; // Largest request payload, and largest decompressed result.
+static Connection *handed_back = NULL; // Connections workers are done with, for the main thread to poll or close.
+static pthread_mutex_t handed_back_lock = PTHREAD_MUTEX_INITIALIZER;
+static int wake_pipe[ 2 ] = { -1, -1 }; // Written by workers to wake the main thread from poll().
+
+// Description:
+// Prints the help message to stderr.
+//
+// Parameters:
+// char *program_path - The path to the program.
+//
+// Returns:
+// Nothing.
+static void print_help( char *program_path ) {
+	fprintf( stderr,
+	    "SYNOPSIS\n   A resident Huffman compression daemon.\n\nUSAGE\n   %s [-hv] [-s socket] [-j threads] [-m size] [-D dict]...\n\nOPTIONS\n   -h             Prints the program help text.\n   -v             Logs each request to stderr.\n   -s socket      Unix "
+	    "socket to listen on (default: $XDG_RUNTIME_DIR/" SOCKET_NAME ").\n   -j threads     Number of requests served at once (default: one per CPU).\n   -m size        Largest payload of a request or decompressed result, such as 256M (default: 64M, at most "
+	    "1G).\n   -D dict        Dictionary made by huffman_train to serve, with its tables built once. May be "
+	    "given more than once.\n",
+	    program_path );
+}
+
+// Description:
+// Stops the daemon on SIGINT or SIGTERM, by interrupting poll().
+//
+// Parameters:
+// int signal - The signal.
+//
+// Returns:
+// Nothing.
+static void handle_stop( int signal ) {
+	( void ) signal;
+	stopping = 1;
+}
+
+// Description:
+// Takes a workspace off the free list, or creates one if none is free.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// Workspace * - The workspace, or NULL if out of memory.
+static Workspace *workspace_acquire( ) {
+	pthread_mutex_lock( &workspace_lock );
+	Workspace *w = free_workspaces;
+
+	if ( w ) {
+		free_workspaces = w->next;
+	}
+
+	pthread_mutex_unlock( &workspace_lock );
+
+	if ( !w && ( w = ( Workspace * ) calloc( 1, sizeof( Workspace ) ) ) ) {
+		codec_buffer_reserve( &w->input, WORKSPACE_SIZE );
+		codec_buffer_reserve( &w->output, WORKSPACE_SIZE );
+	}
+
+	return w;
+}
+
+// Description:
+// Puts a workspace back on the free list, shrinking buffers a large request grew.
+//
+// Parameters:
+// Workspace *w - The workspace.
+//
+// Returns:
+// Nothing.
+static void workspace_release( Workspace *w ) {
+	if ( w->input.capacity > WORKSPACE_KEEP ) {
+		codec_buffer_release( &w->input );
+		codec_buffer_reserve( &w->input, WORKSPACE_SIZE );
+	}
+
+	if ( w->output.capacity > WORKSPACE_KEEP ) {
+		codec_buffer_release( &w->output );
+		codec_buffer_reserve( &w->output, WORKSPACE_SIZE );
+	}
+
+	pthread_mutex_lock( &workspace_lock );
+	w->next = free_workspaces;
+	free_workspaces = w;
+	pthread_mutex_unlock( &workspace_lock );
+}
+
+// Description:
+// Frees every workspace on the free list.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// Nothing.
+static void workspace_delete_all( ) {
+	while ( free_workspaces ) {
+		Workspace *w = free_workspaces;
+		free_workspaces = w->next;
+		codec_buffer_release( &w->input );
+		codec_buffer_release( &w->output );
+		free( w );
+	}
+}
+
+// Description:
+// Finds a served dictionary by ID.
+//
+// Parameters:
+// uint32_t id - The dictionary ID.
+//
+// Returns:
+// CodecDictionary * - The dictionary, or NULL if it isn't served.
+static CodecDictionary *find_dictionary( uint32_t id ) {
+	for ( uint32_t i = 0; i < ndictionaries; i++ ) {
+		if ( dictionaries[ i ]->dictionary->id == id ) {
+			return dictionaries[ i ];
+		}
+	}
+
+	return NULL;
+}
+
+// Description:
+// Sends a response with a payload.
+//
+// Parameters:
+// int fd - The socket.
+// uint32_t status - RESPONSE_OK, or RESPONSE_ERROR if the payload is a message.
+// uint8_t *payload - The payload.
+// uint64_t size - The size of the payload.
+//
+// Returns:
+// bool - Whether the response was sent.
+static bool send_response( int fd, uint32_t status, uint8_t *payload, uint64_t size ) {
+	Response response = { status, size };
+
+	if ( !protocol_write_response( fd, &response ) ) {
+		return false;
+	}
+
+	for ( uint64_t sent = 0; sent < size; sent += PROTOCOL_MAX_PAYLOAD ) {
+		uint32_t chunk = size - sent < PROTOCOL_MAX_PAYLOAD ? size - sent : PROTOCOL_MAX_PAYLOAD;
+
+		if ( write_bytes( fd, payload + sent, chunk ) != chunk ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Description:
+// Handles a request whose payload has been read.
+//
+// Parameters:
+// Request *request - The request.
+// Workspace *w - The workspace holding the payload, whose output buffer gets the result.
+//
+// Returns:
+// CodecStatus - The result of the request.
+static CodecStatus handle_request( Request *request, Workspace *w ) {
+	if ( request->type == REQUEST_COMPRESS ) {
+		CodecDictionary *dictionary = NULL;
+
+		if ( ( request->flags & REQUEST_DICTIONARY ) && !( dictionary = find_dictionary( request->dictionary_id ) ) ) {
+			return CODEC_NO_DICTIONARY;
+		}
+
+		return codec_compress( w->input.data, w->input.size, dictionary, &w->output );
+	}
+
+	return codec_decompress( w->input.data, w->input.size, dictionaries, ndictionaries, max_payload, &w->output );
+}
+
+// Description:
+// Reads the payload of a request, growing the buffer as the payload arrives
+// rather than reserving the size the client claims up front.
+//
+// Parameters:
+// int fd - The socket.
+// CodecBuffer *b - The buffer to read into.
+// uint64_t size - The size of the payload, at most max_payload.
+//
+// Returns:
+// CodecStatus - CODEC_OK, CODEC_NO_MEMORY, or CODEC_CORRUPT if the payload ended early.
+static CodecStatus read_payload( int fd, CodecBuffer *b, uint64_t size ) {
+	b->size = 0;
+
+	while ( b->size < size ) {
+		uint64_t capacity = b->capacity > b->size ? b->capacity : 2 * b->size + WORKSPACE_SIZE;
+		capacity = capacity < size ? capacity : size;
+
+		if ( !codec_buffer_reserve( b, capacity ) ) {
+			return CODEC_NO_MEMORY;
+		}
+
+		uint32_t chunk = capacity - b->size;
+
+		if ( read_bytes( fd, b->data + b->size, chunk ) != chunk ) {
+			return CODEC_CORRUPT;
+		}
+
+		b->size += chunk;
+	}
+
+	return CODEC_OK;
+}
+
+// Description:
+// Serves one request of a connection.
+//
+// Parameters:
+// int fd - The connected socket.
+//
+// Returns:
+// bool - Whether the connection can carry another request: false if the client
+// closed it, sent a bad frame or stalled, or the response couldn't be sent.
+static bool serve_request( int fd ) {
+	Request request;
+
+	if ( !protocol_read_request( fd, &request ) ) {
+		return false;
+	}
+
+	if ( ( request.type != REQUEST_COMPRESS && request.type != REQUEST_DECOMPRESS ) || request.size > max_payload ) {
+		char *message = request.size > max_payload ? codec_status_message( CODEC_TOO_LARGE ) : "invalid request";
+		send_response( fd, RESPONSE_ERROR, ( uint8_t * ) message, strlen( message ) );
+
+		return false;
+	}
+
+	Workspace *w = workspace_acquire( );
+	CodecStatus status = w ? read_payload( fd, &w->input, request.size ) : CODEC_NO_MEMORY;
+	bool sent = false;
+
+	if ( status == CODEC_NO_MEMORY ) {
+		char *message = codec_status_message( CODEC_NO_MEMORY );
+		send_response( fd, RESPONSE_ERROR, ( uint8_t * ) message, strlen( message ) );
+	} else if ( status == CODEC_OK ) {
+		status = handle_request( &request, w );
+
+		if ( status == CODEC_OK ) {
+			sent = send_response( fd, RESPONSE_OK, w->output.data, w->output.size );
+		} else {
+			char *message = codec_status_message( status );
+			sent = send_response( fd, RESPONSE_ERROR, ( uint8_t * ) message, strlen( message ) );
+		}
+
+		if ( verbose ) {
+			fprintf( stderr, "%s %" PRIu64 " -> %" PRIu64 " bytes: %s\n", request.type == REQUEST_COMPRESS ? "compress" : "decompress", request.size, status == CODEC_OK ? w->output.size : 0, codec_status_message( status ) );
+		}
+	}
+
+	if ( w ) {
+		workspace_release( w );
+	}
+
+	return sent;
+}
+
+// Description:
+// Serves the next request of a connection, then hands the connection back to
+// the main thread, so a worker is only held while a request is in flight. Runs
+// on a worker thread.
+//
+// Parameters:
+// void *arg - The connection.
+//
+// Returns:
+// Nothing.
+static void serve_connection( void *arg ) {
+	Connection *c = ( Connection * ) arg;
+	c->open = serve_request( c->fd );
+	pthread_mutex_lock( &handed_back_lock );
+	c->next = handed_back;
+	handed_back = c;
+	pthread_mutex_unlock( &handed_back_lock );
+
+	if ( write( wake_pipe[ 1 ], "", 1 ) != 1 ) {
+		// The pipe is full, so the main thread already has a wakeup pending.
+	}
+}
+
+// Description:
+// Returns the time in seconds, from a clock that doesn't jump.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// time_t - The time in seconds.
+static time_t now_seconds( ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec;
+}
+
+// Description:
+// Closes a connection and frees it.
+//
+// Parameters:
+// Connection *c - The connection.
+//
+// Returns:
+// Nothing.
+static void connection_close( Connection *c ) {
+	close( c->fd );
+	free( c );
+}
+
+// Description:
+// Accepts a connection, if one is waiting.
+//
+// Parameters:
+// int listen_fd - The listening socket.
+//
+// Returns:
+// Connection * - The connection, or NULL if none was accepted.
+static Connection *connection_accept( int listen_fd ) {
+	int fd = accept4( listen_fd, NULL, NULL, SOCK_CLOEXEC );
+	Connection *c = fd != -1 ? ( Connection * ) calloc( 1, sizeof( Connection ) ) : NULL;
+
+	if ( !c ) {
+		if ( fd != -1 ) {
+			close( fd );
+		}
+
+		return NULL;
+	}
+
+	struct timeval timeout = { REQUEST_TIMEOUT, 0 }; // Bounds how long a stalled client holds a worker.
+	setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+	setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+	c->fd = fd;
+	c->open = true;
+	c->idle_since = now_seconds( );
+
+	return c;
+}
+
+// Description:
+// Serves connections until SIGINT or SIGTERM. Idle connections are polled here,
+// and each request that arrives is submitted to the pool as its own task.
+//
+// Parameters:
+// Listener *listener - The listener.
+// ThreadPool *pool - The pool requests are served on.
+//
+// Returns:
+// bool - Whether the daemon stopped because of a signal rather than an error.
+static bool serve( Listener *listener, ThreadPool *pool ) {
+	static Connection *idle[ MAX_CONNECTIONS ]; // Connections waiting for a request.
+	static struct pollfd fds[ MAX_CONNECTIONS + 2 ]; // The wake pipe, the listener, then the idle connections.
+	uint32_t nidle = 0;
+	uint32_t nopen = 0;
+	bool success = true;
+
+	while ( !stopping ) {
+		time_t now = now_seconds( );
+		pthread_mutex_lock( &handed_back_lock );
+		Connection *c = handed_back;
+		handed_back = NULL;
+		pthread_mutex_unlock( &handed_back_lock );
+
+		while ( c ) {
+			Connection *next = c->next;
+
+			if ( c->open ) {
+				c->idle_since = now;
+				idle[ nidle++ ] = c;
+			} else {
+				connection_close( c );
+				nopen--;
+			}
+
+			c = next;
+		}
+
+		uint32_t kept = 0;
+
+		for ( uint32_t i = 0; i < nidle; i++ ) { // Close connections idle for too long.
+			if ( now - idle[ i ]->idle_since >= IDLE_TIMEOUT ) {
+				connection_close( idle[ i ] );
+				nopen--;
+			} else {
+				idle[ kept++ ] = idle[ i ];
+			}
+		}
+
+		nidle = kept;
+		fds[ 0 ] = ( struct pollfd ) { wake_pipe[ 0 ], POLLIN, 0 };
+		fds[ 1 ] = ( struct pollfd ) { nopen < MAX_CONNECTIONS ? listener->fd : -1, POLLIN, 0 }; // A negative fd is skipped.
+
+		for ( uint32_t i = 0; i < nidle; i++ ) {
+			fds[ i + 2 ] = ( struct pollfd ) { idle[ i ]->fd, POLLIN, 0 };
+		}
+
+		if ( poll( fds, nidle + 2, POLL_INTERVAL ) == -1 ) {
+			if ( errno != EINTR ) {
+				fprintf( stderr, "Error: failed to poll connections.\n" );
+				success = false;
+
+				break;
+			}
+
+			continue;
+		}
+
+		if ( fds[ 0 ].revents ) {
+			uint8_t wakeups[ 64 ];
+
+			while ( read( wake_pipe[ 0 ], wakeups, sizeof( wakeups ) ) > 0 ) {
+				continue;
+			}
+		}
+
+		kept = 0;
+
+		for ( uint32_t i = 0; i < nidle; i++ ) { // A request arrived, or the client hung up.
+			if ( !fds[ i + 2 ].revents ) {
+				idle[ kept++ ] = idle[ i ];
+			} else if ( !thread_pool_submit( pool, serve_connection, idle[ i ] ) ) {
+				connection_close( idle[ i ] );
+				nopen--;
+			}
+		}
+
+		nidle = kept;
+
+		if ( fds[ 1 ].revents && ( c = connection_accept( listener->fd ) ) ) {
+			idle[ nidle++ ] = c;
+			nopen++;
+		}
+	}
+
+	thread_pool_wait( pool ); // Requests in flight hand their connections back.
+
+	for ( Connection *c = handed_back; c; ) {
+		Connection *next = c->next;
+		connection_close( c );
+		c = next;
+	}
+
+	for ( uint32_t i = 0; i < nidle; i++ ) {
+		connection_close( idle[ i ] );
+	}
+
+	handed_back = NULL;
+
+	return success;
+}
+
+// Description:
+// The entry point of the program.
+//
+// Parameters:
+// int argc - The argument count.
+// char **argv - The argument vector.
+//
+// Returns:
+// int - The exit status of the program (0 = success, otherwise error).
+int main( int argc, char **argv ) {
+	int opt = 0;
+	char *socket_path = NULL;
+	char *default_path = protocol_default_path( );
+	uint32_t threads = 0;
+	bool success = true;
+
+	while ( ( opt = getopt( argc, argv, OPTIONS ) ) != -1 ) { // Process each option specified.
+		switch ( opt ) {
+		case 'h': print_help( *argv ); free( default_path ); return 0; // Help.
+		case 'v': verbose = true; break; // Verbose.
+		case 's': socket_path = optarg; break; // Socket path.
+		case 'j': // Worker threads.
+			if ( !thread_pool_parse_threads( optarg, &threads ) ) {
+				fprintf( stderr, "Error: invalid thread count.\n" );
+				free( default_path );
+
+				return 1;
+			}
+
+			break;
+		case 'm': // Largest payload.
+			if ( !io_parse_size( optarg, &max_payload ) || max_payload == 0 || max_payload > PROTOCOL_MAX_PAYLOAD ) {
+				fprintf( stderr, "Error: invalid payload size.\n" );
+				free( default_path );
+
+				return 1;
+			}
+
+			break;
+		case 'D': // Dictionary.
+			if ( ndictionaries == MAX_DICTIONARIES ) {
+				fprintf( stderr, "Error: too many dictionaries.\n" );
+				success = false;
+			} else {
+				Dictionary *dictionary = dictionary_load( optarg );
+				CodecDictionary *cached = dictionary ? codec_dictionary_create( dictionary ) : NULL;
+
+				if ( !cached ) {
+					fprintf( stderr, "Error: failed to load dictionary %s.\n", optarg );
+					dictionary_delete( &dictionary );
+					success = false;
+				} else {
+					dictionaries[ ndictionaries++ ] = cached;
+				}
+			}
+
+			break;
+		default: print_help( *argv ); free( default_path ); return 1; // Invalid flag.
+		}
+	}
+
+	socket_path = socket_path ? socket_path : default_path;
+
+	if ( success && !socket_path ) {
+		fprintf( stderr, "Error: $XDG_RUNTIME_DIR isn't set, so a socket has to be given with -s.\n" );
+		success = false;
+	}
+
+	threads = threads ? threads : thread_pool_default_threads( );
+	Listener *listener = success ? protocol_listen( socket_path ) : NULL;
+
+	if ( success && !listener ) {
+		fprintf( stderr, "Error: failed to listen on %s (is huffmand already running, or is something else there?).\n", socket_path );
+		success = false;
+	}
+
+	if ( success && pipe2( wake_pipe, O_NONBLOCK | O_CLOEXEC ) == -1 ) {
+		fprintf( stderr, "Error: failed to create a pipe.\n" );
+		success = false;
+	}
+
+	ThreadPool *pool = success ? thread_pool_create( threads ) : NULL;
+
+	for ( uint32_t i = 0; pool && i < threads; i++ ) { // Preallocate a workspace per thread.
+		Workspace *w = workspace_acquire( );
+
+		if ( w ) {
+			workspace_release( w );
+		}
+	}
+
+	if ( pool ) {
+		struct sigaction action = { 0 };
+		action.sa_handler = handle_stop; // No SA_RESTART, so poll() returns EINTR.
+		sigaction( SIGINT, &action, NULL );
+		sigaction( SIGTERM, &action, NULL );
+		signal( SIGPIPE, SIG_IGN ); // Clients that hang up show up as failed writes.
+
+		if ( verbose ) {
+			fprintf( stderr, "Listening on %s with %" PRIu32 " threads and %" PRIu32 " dictionaries.\n", socket_path, threads, ndictionaries );
+		}
+
+		success = serve( listener, pool );
+	}
+
+	protocol_unlisten( &listener );
+	thread_pool_delete( &pool );
+	workspace_delete_all( );
+
+	for ( uint32_t i = 0; i < 2; i++ ) {
+		if ( wake_pipe[ i ] != -1 ) {
+			close( wake_pipe[ i ] );
+		}
+	}
+
+	for ( uint32_t i = 0; i < ndictionaries; i++ ) {
+		codec_dictionary_delete( &dictionaries[ i ] );
+	}
+
+	free( default_path );
+
+	return success ? 0 : 1;
+}
@@ -1,14 +1,315 @@
+#define _GNU_SOURCE
+
 #include "io.h"
 
 #include "code.h"
 #include "defines.h"
+#include "kernels.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <unistd.h>
 
-static uint8_t write_bit_buffer[ BLOCK ] = { 0 };
-static uint32_t write_bit_top = 0;
+#define MEMORY_WINDOW ( 1u << 28 ) // Most bytes of memory a bit reader exposes at once, so bit offsets fit in 32 bits.
+
+static IOConfig io_settings = { DEFAULT_BLOCK_SIZE, false, true };
+
+// Description:
+// A struct for a buffered bit reader. Blocks are read into an aligned data area,
+// and the unread tail of the previous block is carried just in front of it, so a
+// bit window always has WINDOW_MARGIN bytes ahead of it until the end of the file.
+// From a pipe or socket, a refill stops once it has the bytes its caller needs,
+// instead of waiting for a whole block that a streaming writer may not send yet.
+// A bit reader over memory has no buffer, and its windows are the memory itself.
+//
+// Members:
+// int infile - The input file, or -1 for memory.
+// uint8_t *memory - The memory read from instead of a file, or NULL.
+// uint64_t memory_size - The number of bytes of memory.
+// uint8_t *buffer - The read buffer: BLOCK bytes of carry area, then the data area.
+// uint8_t *start - First buffered byte, in the carry area or at the data area.
+// uint32_t size - Number of bytes buffered from start.
+// uint32_t top - Next bit to read, counted from start.
+// uint64_t offset - Offset of start in the input file.
+// bool eof - Whether the end of the input file has been read.
+// bool partial - Whether the input is a pipe or socket, read only as far as needed.
+struct BitReader {
+	int infile;
+	uint8_t *memory;
+	uint64_t memory_size;
+	uint8_t *buffer;
+	uint8_t *start;
+	uint32_t size;
+	uint32_t top;
+	uint64_t offset;
+	bool eof;
+	bool partial;
+};
+
+// Description:
+// A struct for a buffered bit writer. Codes go into a 64-bit accumulator first,
+// and only full bytes reach the buffer.
+//
+// Members:
+// int outfile - The output file.
+// uint8_t *buffer - The write buffer, with WINDOW_MARGIN bytes of overflow room.
+// uint32_t pos - Next byte to write to the buffer.
+// uint64_t bits - Bits not yet written to the buffer.
+// uint32_t count - Number of bits in bits (under 8 between calls).
+// uint64_t offset - Offset of the start of the buffer in the output file.
+struct BitWriter {
+	int outfile;
+	uint8_t *buffer;
+	uint32_t pos;
+	uint64_t bits;
+	uint32_t count;
+	uint64_t offset;
+};
+
+// Description:
+// Sets the I/O settings used by all buffers and files created afterwards.
+//
+// Parameters:
+// IOConfig config - The I/O settings.
+//
+// Returns:
+// Nothing.
+void io_configure( IOConfig config ) {
+	io_settings = config;
+}
+
+// Description:
+// Gets the configured I/O buffer size.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// uint32_t - The I/O buffer size in bytes.
+uint32_t io_block_size( ) {
+	return io_settings.block_size;
+}
+
+// Description:
+// Parses a plain decimal number, such as a count or a level, with nothing
+// before or after its digits.
+//
+// Parameters:
+// char *text - The text to parse.
+// uint64_t *value - The pointer to the uint64_t to set the number to.
+//
+// Returns:
+// bool - Whether the text is a number that fits 64 bits.
+bool io_parse_number( char *text, uint64_t *value ) {
+	char *end = NULL;
+	errno = 0;
+	uint64_t parsed = strtoull( text, &end, 10 );
+
+	if ( !isdigit( ( unsigned char ) *text ) || *end != '\0' || errno == ERANGE ) {
+		return false;
+	}
+
+	*value = parsed;
+
+	return true;
+}
+
+// Description:
+// Parses a size such as "65536", "256K", "4M" or "1G".
+//
+// Parameters:
+// char *text - The text to parse.
+// uint64_t *size - The pointer to the uint64_t to set the size to.
+//
+// Returns:
+// bool - Whether the text is a size.
+bool io_parse_size( char *text, uint64_t *size ) {
+	char *end = NULL;
+	uint64_t value = strtoull( text, &end, 10 );
+	uint32_t shift = 0;
+
+	if ( end == text || *text == '-' ) {
+		return false;
+	}
+
+	if ( *end == 'k' || *end == 'K' ) {
+		shift = 10;
+		end++;
+	} else if ( *end == 'm' || *end == 'M' ) {
+		shift = 20;
+		end++;
+	} else if ( *end == 'g' || *end == 'G' ) {
+		shift = 30;
+		end++;
+	}
+
+	if ( *end != '\0' || value > UINT64_MAX >> shift ) {
+		return false;
+	}
+
+	*size = value << shift;
+
+	return true;
+}
+
+// Description:
+// Parses a buffer size such as "65536", "256K" or "4M".
+//
+// Parameters:
+// char *text - The text to parse.
+// uint32_t *block_size - The pointer to the uint32_t to set the size to.
+//
+// Returns:
+// bool - Whether the size is valid (a multiple of BLOCK up to MAX_BLOCK_SIZE).
+bool io_parse_block_size( char *text, uint32_t *block_size ) {
+	uint64_t size = 0;
+
+	if ( !io_parse_size( text, &size ) || size < BLOCK || size > MAX_BLOCK_SIZE || size % BLOCK != 0 ) {
+		return false;
+	}
+
+	*block_size = size;
+
+	return true;
+}
+
+// Description:
+// Opens a file, using direct I/O if it's enabled and supported by the file system.
+//
+// Parameters:
+// char *path - The path of the file.
+// int flags - The flags to pass to open().
+// mode_t mode - The mode to create the file with.
+//
+// Returns:
+// int - The file descriptor, or -1 on failure.
+int io_open( char *path, int flags, mode_t mode ) {
+	int fd = -1;
+
+	if ( io_settings.direct ) {
+		fd = open( path, flags | O_DIRECT, mode );
+	}
+
+	if ( fd == -1 ) { // Direct I/O disabled or not supported.
+		fd = open( path, flags, mode );
+	}
+
+	return fd;
+}
+
+// Description:
+// Allocates an I/O buffer aligned for direct I/O, with 8 bytes of slack past the end.
+//
+// Parameters:
+// uint32_t nbytes - The size of the buffer.
+//
+// Returns:
+// uint8_t * - The buffer, or NULL on failure.
+uint8_t *io_buffer_create( uint32_t nbytes ) {
+	void *buf = NULL;
+
+	if ( posix_memalign( &buf, BLOCK, nbytes + 8 ) != 0 ) {
+		return NULL;
+	}
+
+	return buf;
+}
+
+// Description:
+// Frees an I/O buffer.
+//
+// Parameters:
+// uint8_t **buf - A pointer to the buffer to free.
+//
+// Returns:
+// Nothing.
+void io_buffer_delete( uint8_t **buf ) {
+	if ( *buf ) {
+		free( *buf );
+		*buf = NULL;
+	}
+}
+
+// Description:
+// Tells the kernel a file will be read sequentially, so it reads ahead aggressively.
+//
+// Parameters:
+// int fd - The file.
+//
+// Returns:
+// Nothing.
+void io_advise_sequential( int fd ) {
+	if ( io_settings.advise ) {
+		posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+	}
+}
+
+// Description:
+// Tells the kernel a range of a file has been read and won't be needed again, so
+// its pages don't evict other processes' page cache.
+//
+// Parameters:
+// int fd - The file.
+// uint64_t offset - The start of the range.
+// uint64_t length - The length of the range.
+//
+// Returns:
+// Nothing.
+void io_advise_consumed( int fd, uint64_t offset, uint64_t length ) {
+	if ( io_settings.advise && length != 0 ) {
+		posix_fadvise( fd, offset, length, POSIX_FADV_DONTNEED );
+	}
+}
+
+// Description:
+// Starts writeback of a range of a file that was just written and drops the range
+// before it from the page cache, which should be clean by then.
+//
+// Parameters:
+// int fd - The file.
+// uint64_t offset - The start of the range.
+// uint64_t length - The length of the range.
+//
+// Returns:
+// Nothing.
+void io_advise_written( int fd, uint64_t offset, uint64_t length ) {
+	if ( !io_settings.advise || io_settings.direct || length == 0 ) {
+		return;
+	}
+
+	if ( sync_file_range( fd, offset, length, SYNC_FILE_RANGE_WRITE ) == -1 ) { // Not a regular file.
+		return;
+	}
+
+	if ( offset >= length ) {
+		posix_fadvise( fd, offset - length, length, POSIX_FADV_DONTNEED );
+	}
+}
+
+// Description:
+// Turns off direct I/O for a file, for transfers that aren't aligned.
+//
+// Parameters:
+// int fd - The file.
+//
+// Returns:
+// bool - Whether direct I/O was on.
+static bool io_drop_direct( int fd ) {
+	int flags = fcntl( fd, F_GETFL );
+
+	if ( flags == -1 || !( flags & O_DIRECT ) ) {
+		return false;
+	}
+
+	return fcntl( fd, F_SETFL, flags & ~O_DIRECT ) != -1;
+}
 
 // Description:
 // Reads a certain number of bytes into a buffer or until no more can be read.
@@ -26,26 +327,64 @@ uint32_t read_bytes( int infile, uint8_t *buf, uint32_t nbytes ) {
 	}
 
 	uint32_t bytes_read = 0;
-	uint32_t bytes_read_current_round = 0;
+	ssize_t bytes_read_current_round = 0;
+
+	while ( bytes_read < nbytes ) {
+		bytes_read_current_round = read( infile, buf + bytes_read, nbytes - bytes_read );
+
+		if ( bytes_read_current_round == -1 && errno == EINVAL && io_drop_direct( infile ) ) { // Unaligned direct read.
+			continue;
+		}
+
+		if ( bytes_read_current_round <= 0 ) {
+			break;
+		}
 
-	while ( ( bytes_read_current_round = read( infile, buf + bytes_read, nbytes - bytes_read ) ) > 0 ) {
 		bytes_read += bytes_read_current_round;
+	}
+
+	return bytes_read;
+}
 
-		if ( bytes_read == nbytes ) { // Finished reading max number of bytes.
+// Description:
+// Reads a certain number of bytes at an offset in a file into a buffer, or until
+// no more can be read. Doesn't move the file offset.
+//
+// Parameters:
+// int infile - The input file.
+// uint8_t *buf - The buffer to read to.
+// uint32_t nbytes - The max number of bytes to read.
+// uint64_t offset - Where in the file to read the bytes from.
+//
+// Returns:
+// uint32_t - How many bytes were read.
+uint32_t pread_bytes( int infile, uint8_t *buf, uint32_t nbytes, uint64_t offset ) {
+	uint32_t bytes_read = 0;
+	ssize_t bytes_read_current_round = 0;
+
+	while ( bytes_read < nbytes ) {
+		bytes_read_current_round = pread( infile, buf + bytes_read, nbytes - bytes_read, offset + bytes_read );
+
+		if ( bytes_read_current_round == -1 && errno == EINVAL && io_drop_direct( infile ) ) { // Unaligned direct read.
+			continue;
+		}
+
+		if ( bytes_read_current_round <= 0 ) {
 			break;
 		}
+
+		bytes_read += bytes_read_current_round;
 	}
 
 	return bytes_read;
 }
 
 // Description:
-// Writes a certain number of bytes into a buffer or until no more can be written. Will
-// write to outfile when the buffer is full.
+// Writes a certain number of bytes from a buffer or until no more can be written.
 //
 // Parameters:
 // int outfile - The output file.
-// uint8_t *buf - The buffer to write to.
+// uint8_t *buf - The buffer to write from.
 // uint32_t nbytes - The max number of bytes to write.
 //
 // Returns:
@@ -56,105 +395,655 @@ uint32_t write_bytes( int outfile, uint8_t *buf, uint32_t nbytes ) {
 	}
 
 	uint32_t bytes_wrote = 0;
-	uint32_t bytes_wrote_current_round = 0;
+	ssize_t bytes_wrote_current_round = 0;
+
+	while ( bytes_wrote < nbytes ) {
+		bytes_wrote_current_round = write( outfile, buf + bytes_wrote, nbytes - bytes_wrote );
+
+		if ( bytes_wrote_current_round == -1 && errno == EINVAL && io_drop_direct( outfile ) ) { // Unaligned direct write (e.g. the tail).
+			continue;
+		}
+
+		if ( bytes_wrote_current_round <= 0 ) {
+			break;
+		}
 
-	while ( ( bytes_wrote_current_round = write( outfile, buf + bytes_wrote, nbytes - bytes_wrote ) ) > 0 ) {
 		bytes_wrote += bytes_wrote_current_round;
+	}
+
+	return bytes_wrote;
+}
+
+// Description:
+// Writes a certain number of bytes from a buffer at an offset in a file, or until
+// no more can be written. Doesn't move the file offset.
+//
+// Parameters:
+// int outfile - The output file.
+// uint8_t *buf - The buffer to write from.
+// uint32_t nbytes - The max number of bytes to write.
+// uint64_t offset - Where in the file to write the bytes.
+//
+// Returns:
+// uint32_t - How many bytes were written.
+uint32_t pwrite_bytes( int outfile, uint8_t *buf, uint32_t nbytes, uint64_t offset ) {
+	uint32_t bytes_wrote = 0;
+	ssize_t bytes_wrote_current_round = 0;
 
-		if ( bytes_wrote == nbytes ) { // Finished writing max number of bytes.
+	while ( bytes_wrote < nbytes ) {
+		bytes_wrote_current_round = pwrite( outfile, buf + bytes_wrote, nbytes - bytes_wrote, offset + bytes_wrote );
+
+		if ( bytes_wrote_current_round == -1 && errno == EINVAL && io_drop_direct( outfile ) ) { // Unaligned direct write (e.g. the tail).
+			continue;
+		}
+
+		if ( bytes_wrote_current_round <= 0 ) {
 			break;
 		}
+
+		bytes_wrote += bytes_wrote_current_round;
 	}
 
 	return bytes_wrote;
 }
 
 // Description:
-// Reads a bit from a file with a read buffer.
+// Reads at least a number of bytes from a pipe or socket, plus whatever else is
+// already waiting, up to a maximum.
 //
 // Parameters:
 // int infile - The input file.
+// uint8_t *buf - The buffer to read to.
+// uint32_t min_bytes - The number of bytes to wait for.
+// uint32_t nbytes - The max number of bytes to read.
+// bool *eof - The pointer to the bool to set if the end of the input is reached.
+//
+// Returns:
+// uint32_t - How many bytes were read.
+static uint32_t read_available( int infile, uint8_t *buf, uint32_t min_bytes, uint32_t nbytes, bool *eof ) {
+	uint32_t bytes_read = 0;
+
+	while ( bytes_read < min_bytes ) {
+		ssize_t bytes_read_current_round = read( infile, buf + bytes_read, nbytes - bytes_read );
+
+		if ( bytes_read_current_round == -1 && errno == EINTR ) {
+			continue;
+		}
+
+		if ( bytes_read_current_round <= 0 ) {
+			*eof = true;
+
+			break;
+		}
+
+		bytes_read += bytes_read_current_round;
+	}
+
+	return bytes_read;
+}
+
+// Description:
+// Creates a bit reader for a file.
+//
+// Parameters:
+// int infile - The input file.
+//
+// Returns:
+// BitReader * - A pointer to the newly created bit reader.
+BitReader *bit_reader_create( int infile ) {
+	BitReader *r = ( BitReader * ) malloc( sizeof( BitReader ) );
+
+	if ( r ) {
+		r->infile = infile;
+		r->memory = NULL;
+		r->memory_size = 0;
+		r->size = r->top = 0;
+		r->offset = 0;
+		r->eof = false;
+		struct stat input_file_stats;
+		r->partial = fstat( infile, &input_file_stats ) == 0 && ( S_ISFIFO( input_file_stats.st_mode ) || S_ISSOCK( input_file_stats.st_mode ) );
+		r->buffer = io_buffer_create( BLOCK + io_settings.block_size );
+
+		if ( !r->buffer ) {
+			free( r );
+			r = NULL;
+		} else {
+			r->start = r->buffer + BLOCK;
+		}
+	}
+
+	return r;
+}
+
+// Description:
+// Creates a bit reader for bytes already in memory, such as a request's payload.
+//
+// Parameters:
+// uint8_t *memory - The bytes, followed by 8 readable bytes, since bit windows may load whole words past the end.
+// uint64_t nbytes - The number of bytes.
+//
+// Returns:
+// BitReader * - A pointer to the newly created bit reader.
+BitReader *bit_reader_create_memory( uint8_t *memory, uint64_t nbytes ) {
+	BitReader *r = ( BitReader * ) calloc( 1, sizeof( BitReader ) );
+
+	if ( r ) {
+		r->infile = -1;
+		r->memory = r->start = memory;
+		r->memory_size = nbytes;
+		r->size = nbytes < MEMORY_WINDOW ? nbytes : MEMORY_WINDOW;
+		r->eof = r->size == nbytes;
+	}
+
+	return r;
+}
+
+// Description:
+// Frees the memory given to a bit reader.
+//
+// Parameters:
+// BitReader **r - A pointer to a pointer to the bit reader.
+//
+// Returns:
+// Nothing.
+void bit_reader_delete( BitReader **r ) {
+	if ( *r ) {
+		io_buffer_delete( &( *r )->buffer );
+		free( *r );
+		*r = NULL;
+	}
+}
+
+// Description:
+// Reads the next block into a bit reader's buffer, carrying the unread bytes
+// (at most WINDOW_MARGIN of them) to just before it. From a pipe or socket,
+// only the bytes needed and those already waiting are read.
+//
+// Parameters:
+// BitReader *r - The bit reader.
+// uint32_t needed - The number of bytes the caller needs, at most the block size.
+//
+// Returns:
+// Nothing.
+static void bit_reader_refill( BitReader *r, uint32_t needed ) {
+	uint32_t consumed = r->top / 8;
+
+	if ( r->memory ) { // Slide the window along the memory instead.
+		uint64_t remaining = r->memory_size - r->offset - consumed;
+		r->start += consumed;
+		r->offset += consumed;
+		r->top %= 8;
+		r->size = remaining < MEMORY_WINDOW ? remaining : MEMORY_WINDOW;
+		r->eof = r->size == remaining;
+
+		return;
+	}
+
+	uint8_t *data = r->buffer + BLOCK;
+	uint32_t carried = r->size - consumed;
+	io_advise_consumed( r->infile, r->offset, consumed );
+	memmove( data - carried, r->start + consumed, carried );
+	r->start = data - carried;
+	r->offset += consumed;
+	r->top %= 8;
+
+	uint32_t bytes_read = 0;
+
+	if ( r->partial ) {
+		bytes_read = read_available( r->infile, data, needed, io_settings.block_size, &r->eof );
+	} else {
+		bytes_read = read_bytes( r->infile, data, io_settings.block_size );
+		r->eof = bytes_read < io_settings.block_size; // read_bytes() only comes up short at the end of the file.
+	}
+
+	r->size = carried + bytes_read;
+	memset( r->start + r->size, 0, 8 ); // Bit windows may load whole words past the end.
+}
+
+// Description:
+// Reads bytes from a bit reader. The reader must be on a byte boundary.
+//
+// Parameters:
+// BitReader *r - The bit reader.
+// uint8_t *buf - The buffer to read to.
+// uint32_t nbytes - The max number of bytes to read.
+//
+// Returns:
+// uint32_t - How many bytes were read.
+uint32_t bit_reader_read_bytes( BitReader *r, uint8_t *buf, uint32_t nbytes ) {
+	uint32_t bytes_read = 0;
+
+	while ( bytes_read < nbytes ) {
+		if ( r->top == r->size * 8 ) {
+			if ( r->eof ) {
+				break;
+			}
+
+			bit_reader_refill( r, nbytes - bytes_read < io_settings.block_size ? nbytes - bytes_read : io_settings.block_size );
+			continue;
+		}
+
+		uint32_t available = r->size - r->top / 8;
+		uint32_t count = nbytes - bytes_read < available ? nbytes - bytes_read : available;
+		memcpy( buf + bytes_read, r->start + r->top / 8, count );
+		bytes_read += count;
+		r->top += count * 8;
+	}
+
+	return bytes_read;
+}
+
+// Description:
+// Reads a bit from a bit reader.
+//
+// Parameters:
+// BitReader *r - The bit reader.
 // uint8_t *bit - The pointer to the uint8_t to set the bit to.
 //
 // Returns:
 // bool - Whether the bit was read successfully.
-bool read_bit( int infile, uint8_t *bit ) {
-	static uint8_t read_bit_buffer[ BLOCK ] = { 0 }; // Read bit buffer.
-	static uint32_t read_bit_top = 0; // Next bit to read.
-	static uint32_t read_bit_buffer_size = 0; // Number of bytes read into buffer.
-
-	if ( read_bit_top == 0 ) { // Refill buffer.
-		read_bit_buffer_size = read_bytes( infile, read_bit_buffer, BLOCK );
+bool read_bit( BitReader *r, uint8_t *bit ) {
+	if ( r->top == r->size * 8 && !r->eof ) {
+		bit_reader_refill( r, 1 );
 	}
 
-	if ( read_bit_buffer_size == 0 ) {
+	if ( r->top == r->size * 8 ) {
 		return false;
 	}
 
-	*bit = ( 1 & ( read_bit_buffer[ read_bit_top / 8 ] >> ( read_bit_top % 8 ) ) );
-	read_bit_top++;
+	*bit = ( 1 & ( r->start[ r->top / 8 ] >> ( r->top % 8 ) ) );
+	r->top++;
 
-	if ( read_bit_top == read_bit_buffer_size * 8 ) { // Done with read bit buffer.
-		read_bit_top = 0;
+	return true;
+}
+
+// Description:
+// Gets a window onto a bit reader's buffered bits, refilling the buffer first if
+// fewer than WINDOW_MARGIN bytes are left. Bits read from the window are given
+// back with bit_reader_commit().
+//
+// Parameters:
+// BitReader *r - The bit reader.
+// BitWindow *w - The bit window to set.
+//
+// Returns:
+// bool - Whether there are bits left to read.
+bool bit_reader_window( BitReader *r, BitWindow *w ) {
+	if ( !r->eof && r->size * 8 - r->top <= 8 * WINDOW_MARGIN ) {
+		bit_reader_refill( r, WINDOW_MARGIN );
 	}
 
+	w->data = r->start;
+	w->top = r->top;
+	w->limit = ( uint64_t ) r->size * 8;
+	w->last = r->eof;
+
+	return w->top < w->limit;
+}
+
+// Description:
+// Advances a bit reader past the bits read from a window.
+//
+// Parameters:
+// BitReader *r - The bit reader.
+// BitWindow *w - The bit window from bit_reader_window().
+//
+// Returns:
+// Nothing.
+void bit_reader_commit( BitReader *r, BitWindow *w ) {
+	r->top = w->top;
+}
+
+// Description:
+// Gets the number of bits read from a bit reader's file so far.
+//
+// Parameters:
+// BitReader *r - The bit reader.
+//
+// Returns:
+// uint64_t - The number of bits read.
+uint64_t bit_reader_tell( BitReader *r ) {
+	return r->offset * 8 + r->top;
+}
+
+// Description:
+// Moves a bit reader forward past bits read some other way, such as by a
+// parallel decoder. Past the buffered bytes, the file is seeked instead of read.
+//
+// Parameters:
+// BitReader *r - The bit reader, on a regular file if it skips past its buffer.
+// uint64_t nbits - The number of bits to skip.
+//
+// Returns:
+// Nothing.
+void bit_reader_skip( BitReader *r, uint64_t nbits ) {
+	uint64_t target = r->top + nbits;
+
+	if ( target <= 8 * ( uint64_t ) r->size ) {
+		r->top = target;
+
+		return;
+	}
+
+	if ( r->memory ) { // Move the window to the byte the reader stops in.
+		uint64_t offset = r->offset + target / 8 < r->memory_size ? r->offset + target / 8 : r->memory_size;
+		uint64_t remaining = r->memory_size - offset;
+		r->start = r->memory + offset;
+		r->offset = offset;
+		r->top = remaining != 0 ? target % 8 : 0;
+		r->size = remaining < MEMORY_WINDOW ? remaining : MEMORY_WINDOW;
+		r->eof = r->size == remaining;
+
+		return;
+	}
+
+	uint64_t skipped = target / 8 - r->size; // Bytes past the buffer.
+	r->offset += r->size + skipped;
+	r->start = r->buffer + BLOCK;
+	r->size = 0;
+	r->top = 0;
+	r->eof = lseek( r->infile, skipped, SEEK_CUR ) == -1; // Reads come up short from here if it can't seek.
+	memset( r->start, 0, 8 );
+
+	if ( target % 8 != 0 && !r->eof ) { // Load the byte the reader stops partway through.
+		bit_reader_refill( r, 1 );
+		r->top = r->size != 0 ? target % 8 : 0;
+	}
+}
+
+// Description:
+// Skips the rest of the byte a bit reader is in, if it isn't on a byte boundary.
+//
+// Parameters:
+// BitReader *r - The bit reader.
+//
+// Returns:
+// Nothing.
+void bit_reader_align( BitReader *r ) {
+	r->top = ( r->top + 7 ) & ~7u;
+}
+
+// Description:
+// Gets the size of a bit reader's input, for formats with an index at the end.
+//
+// Parameters:
+// BitReader *r - The bit reader.
+// uint64_t *size - The pointer to the uint64_t to set to the size in bytes.
+//
+// Returns:
+// bool - Whether the size is known: false for a pipe or socket.
+bool bit_reader_size( BitReader *r, uint64_t *size ) {
+	struct stat input_file_stats;
+
+	if ( r->memory ) {
+		*size = r->memory_size;
+
+		return true;
+	}
+
+	if ( r->partial || fstat( r->infile, &input_file_stats ) == -1 ) {
+		return false;
+	}
+
+	*size = input_file_stats.st_size;
+
 	return true;
 }
 
 // Description:
-// Writes a code's bits to a file with a write buffer.
+// Reads bytes from anywhere in a bit reader's input, without moving the reader.
+//
+// Parameters:
+// BitReader *r - The bit reader, on memory or a seekable file.
+// uint8_t *buf - The buffer to read to.
+// uint32_t nbytes - The max number of bytes to read.
+// uint64_t offset - The offset in the input to read from.
+//
+// Returns:
+// uint32_t - How many bytes were read.
+uint32_t bit_reader_pread( BitReader *r, uint8_t *buf, uint32_t nbytes, uint64_t offset ) {
+	if ( !r->memory ) {
+		return pread_bytes( r->infile, buf, nbytes, offset );
+	}
+
+	uint64_t available = offset < r->memory_size ? r->memory_size - offset : 0;
+	nbytes = nbytes < available ? nbytes : available;
+
+	if ( nbytes != 0 ) {
+		memcpy( buf, r->memory + offset, nbytes );
+	}
+
+	return nbytes;
+}
+
+// Description:
+// Gets the file a bit reader reads, for decoders that read parts of it themselves.
+//
+// Parameters:
+// BitReader *r - The bit reader.
+//
+// Returns:
+// int - The input file, or -1 if the bit reader reads memory.
+int bit_reader_file( BitReader *r ) {
+	return r->infile;
+}
+
+// Description:
+// Creates a bit writer for a file.
 //
 // Parameters:
 // int outfile - The output file.
-// Code *c - The code to write.
+//
+// Returns:
+// BitWriter * - A pointer to the newly created bit writer.
+BitWriter *bit_writer_create( int outfile ) {
+	BitWriter *w = ( BitWriter * ) malloc( sizeof( BitWriter ) );
+
+	if ( w ) {
+		w->outfile = outfile;
+		w->pos = w->count = 0;
+		w->bits = 0;
+		w->offset = 0;
+		w->buffer = io_buffer_create( io_settings.block_size + WINDOW_MARGIN );
+
+		if ( !w->buffer ) {
+			free( w );
+			w = NULL;
+		}
+	}
+
+	return w;
+}
+
+// Description:
+// Frees the memory given to a bit writer. Doesn't flush it.
+//
+// Parameters:
+// BitWriter **w - A pointer to a pointer to the bit writer.
+//
+// Returns:
+// Nothing.
+void bit_writer_delete( BitWriter **w ) {
+	if ( *w ) {
+		io_buffer_delete( &( *w )->buffer );
+		free( *w );
+		*w = NULL;
+	}
+}
+
+// Description:
+// Writes out a block of a bit writer's buffer if it's full, moving any overflow
+// to the start of the buffer.
+//
+// Parameters:
+// BitWriter *w - The bit writer.
+//
+// Returns:
+// uint64_t - Bytes written to file.
+static uint64_t bit_writer_write_block( BitWriter *w ) {
+	uint32_t block_size = io_settings.block_size;
+
+	if ( w->pos < block_size ) {
+		return 0;
+	}
+
+	write_bytes( w->outfile, w->buffer, block_size );
+	io_advise_written( w->outfile, w->offset, block_size );
+	w->offset += block_size;
+	w->pos -= block_size;
+	memmove( w->buffer, w->buffer + block_size, w->pos );
+
+	return block_size;
+}
+
+// Description:
+// Writes bytes through a bit writer, so small writes such as the file header share
+// a write with the codes that follow. The writer must be on a byte boundary.
+//
+// Parameters:
+// BitWriter *w - The bit writer.
+// uint8_t *buf - The bytes to write.
+// uint32_t nbytes - The number of bytes to write.
 //
 // Returns:
 // uint64_t - Bytes actually written to file.
-uint64_t write_code( int outfile, Code *c ) {
+uint64_t bit_writer_write_bytes( BitWriter *w, uint8_t *buf, uint32_t nbytes ) {
 	uint64_t bytes_written = 0;
+	uint32_t block_size = io_settings.block_size;
+
+	while ( nbytes > 0 ) {
+		uint32_t available = block_size - w->pos;
+		uint32_t count = nbytes < available ? nbytes : available;
+		memcpy( w->buffer + w->pos, buf, count );
+		w->pos += count;
+		buf += count;
+		nbytes -= count;
+		bytes_written += bit_writer_write_block( w );
+	}
+
+	return bytes_written;
+}
 
-	for ( uint32_t i = 0; i < c->top; i++ ) { // Loop through all bits.
-		uint8_t bit = 1 & ( c->bytes[ i / 8 ] >> ( i % 8 ) ); // Get current bit.
+// Description:
+// Writes a code's bits through a bit writer, a byte of the code at a time. Works
+// for codes of any length.
+//
+// Parameters:
+// BitWriter *w - The bit writer.
+// Code *c - The code to write.
+//
+// Returns:
+// uint64_t - Bytes actually written to file.
+uint64_t write_code( BitWriter *w, Code *c ) {
+	for ( uint32_t i = 0; i < c->top; i += 8 ) {
+		uint32_t length = c->top - i < 8 ? c->top - i : 8;
+		w->bits |= ( uint64_t ) ( c->bytes[ i / 8 ] & ( ( 1u << length ) - 1 ) ) << w->count;
+		w->count += length;
 
-		if ( bit == 0 ) { // Clear bit.
-			write_bit_buffer[ write_bit_top / 8 ] &= ~( 1 << ( write_bit_top % 8 ) );
-		} else { // Set bit.
-			write_bit_buffer[ write_bit_top / 8 ] |= ( 1 << ( write_bit_top % 8 ) );
+		if ( w->count >= 8 ) { // Move the full byte to the buffer.
+			w->buffer[ w->pos++ ] = w->bits;
+			w->bits >>= 8;
+			w->count -= 8;
 		}
+	}
+
+	return bit_writer_write_block( w );
+}
 
-		write_bit_top++;
+// Description:
+// Writes the codes of a run of symbols through a bit writer. Uses the encode
+// kernel when every code fits the bit accumulator.
+//
+// Parameters:
+// BitWriter *w - The bit writer.
+// PackedCodes *codes - The packed codes of the symbols.
+// uint8_t *symbols - The symbols to encode.
+// uint64_t nsymbols - The number of symbols.
+//
+// Returns:
+// uint64_t - Bytes actually written to file.
+uint64_t write_codes( BitWriter *w, PackedCodes *codes, uint8_t *symbols, uint64_t nsymbols ) {
+	uint64_t bytes_written = 0;
+	uint32_t block_size = io_settings.block_size;
 
-		if ( write_bit_top == BLOCK * 8 ) { // Write bit buffer full.
-			write_bytes( outfile, write_bit_buffer, BLOCK );
-			bytes_written += BLOCK;
-			write_bit_top = 0;
+	if ( codes->max_length > MAX_PACKED_CODE ) {
+		for ( uint64_t i = 0; i < nsymbols; i++ ) {
+			bytes_written += write_code( w, &codes->table[ symbols[ i ] ] );
 		}
+
+		return bytes_written;
+	}
+
+	while ( nsymbols > 0 ) {
+		uint32_t count = ( block_size - w->pos ) / ( MAX_PACKED_CODE / 8 ); // Symbols sure to fit the rest of the block.
+
+		if ( count == 0 ) {
+			count = 1; // The overflow room takes the rest.
+		}
+
+		if ( count > nsymbols ) {
+			count = nsymbols;
+		}
+
+		w->pos += encode_symbols( codes, symbols, count, w->buffer + w->pos, &w->bits, &w->count );
+		symbols += count;
+		nsymbols -= count;
+		bytes_written += bit_writer_write_block( w );
 	}
 
 	return bytes_written;
 }
 
 // Description:
-// Finishes writing out the write bit buffer and flushes the buffer.
+// Pads a bit writer's codes with zero bits to a byte boundary, without flushing it.
 //
 // Parameters:
-// int outfile - The output file.
+// BitWriter *w - The bit writer.
 //
 // Returns:
 // uint64_t - Bytes written to file.
-uint64_t flush_codes( int outfile ) {
-	uint64_t bytes_written = 0;
+uint64_t bit_writer_align( BitWriter *w ) {
+	if ( w->count != 0 ) {
+		w->buffer[ w->pos++ ] = w->bits & ( ( 1u << w->count ) - 1 );
+		w->bits = 0;
+		w->count = 0;
+	}
 
-	if ( write_bit_top % 8 == 0 ) { // Write buffer not on byte boundary.
-		write_bytes( outfile, write_bit_buffer, write_bit_top / 8 );
-		bytes_written += write_bit_top / 8;
-	} else { // Write buffer on byte boundary.
-		write_bit_buffer[ write_bit_top / 8 ] &= ( ( 1 << ( write_bit_top % 8 ) ) - 1 ); // Zero out garbage bits in the last byte.
-		write_bytes( outfile, write_bit_buffer, write_bit_top / 8 + 1 );
-		bytes_written += write_bit_top / 8 + 1;
+	return bit_writer_write_block( w );
+}
+
+// Description:
+// Gets the number of bits written through a bit writer so far.
+//
+// Parameters:
+// BitWriter *w - The bit writer.
+//
+// Returns:
+// uint64_t - The number of bits written, including buffered ones.
+uint64_t bit_writer_tell( BitWriter *w ) {
+	return ( w->offset + w->pos ) * 8 + w->count;
+}
+
+// Description:
+// Finishes writing out a bit writer's buffer and flushes the buffer.
+//
+// Parameters:
+// BitWriter *w - The bit writer.
+//
+// Returns:
+// uint64_t - Bytes written to file.
+uint64_t flush_codes( BitWriter *w ) {
+	if ( w->count != 0 ) { // Write buffer not on byte boundary.
+		w->buffer[ w->pos++ ] = w->bits & ( ( 1u << w->count ) - 1 ); // Zero out garbage bits in the last byte.
+		w->bits = 0;
+		w->count = 0;
 	}
 
-	write_bit_top = 0;
+	uint32_t nbytes = w->pos;
+	write_bytes( w->outfile, w->buffer, nbytes );
+	io_advise_written( w->outfile, w->offset, nbytes );
+	w->offset += nbytes;
+	w->pos = 0;
 
-	return bytes_written;
+	return nbytes;
 }
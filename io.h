@@ -5,15 +5,142 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define WINDOW_MARGIN 64 // Bytes a bit window keeps ahead of its reader, enough for any code.
+
+typedef struct IOConfig {
+	uint32_t block_size;
+	bool direct;
+	bool advise;
+} IOConfig;
+
+typedef struct BitWindow {
+	uint8_t *data;
+	uint64_t top;
+	uint64_t limit;
+	bool last;
+} BitWindow;
+
+typedef struct BitReader BitReader;
+
+typedef struct BitWriter BitWriter;
+
+void io_configure( IOConfig config );
+
+uint32_t io_block_size( );
+
+bool io_parse_number( char *text, uint64_t *value );
+
+bool io_parse_size( char *text, uint64_t *size );
+
+bool io_parse_block_size( char *text, uint32_t *block_size );
+
+int io_open( char *path, int flags, mode_t mode );
+
+uint8_t *io_buffer_create( uint32_t nbytes );
+
+void io_buffer_delete( uint8_t **buf );
+
+void io_advise_sequential( int fd );
+
+void io_advise_consumed( int fd, uint64_t offset, uint64_t length );
+
+void io_advise_written( int fd, uint64_t offset, uint64_t length );
 
 uint32_t read_bytes( int infile, uint8_t *buf, uint32_t nbytes );
 
+uint32_t pread_bytes( int infile, uint8_t *buf, uint32_t nbytes, uint64_t offset );
+
 uint32_t write_bytes( int outfile, uint8_t *buf, uint32_t nbytes );
 
-bool read_bit( int infile, uint8_t *bit );
+uint32_t pwrite_bytes( int outfile, uint8_t *buf, uint32_t nbytes, uint64_t offset );
+
+BitReader *bit_reader_create( int infile );
+
+BitReader *bit_reader_create_memory( uint8_t *memory, uint64_t nbytes );
+
+void bit_reader_delete( BitReader **r );
+
+uint32_t bit_reader_read_bytes( BitReader *r, uint8_t *buf, uint32_t nbytes );
 
-uint64_t write_code( int outfile, Code *c );
+bool read_bit( BitReader *r, uint8_t *bit );
+
+bool bit_reader_window( BitReader *r, BitWindow *w );
+
+void bit_reader_commit( BitReader *r, BitWindow *w );
+
+uint64_t bit_reader_tell( BitReader *r );
+
+void bit_reader_skip( BitReader *r, uint64_t nbits );
+
+void bit_reader_align( BitReader *r );
+
+bool bit_reader_size( BitReader *r, uint64_t *size );
+
+uint32_t bit_reader_pread( BitReader *r, uint8_t *buf, uint32_t nbytes, uint64_t offset );
+
+int bit_reader_file( BitReader *r );
+
+BitWriter *bit_writer_create( int outfile );
+
+void bit_writer_delete( BitWriter **w );
+
+uint64_t bit_writer_write_bytes( BitWriter *w, uint8_t *buf, uint32_t nbytes );
+
+uint64_t write_code( BitWriter *w, Code *c );
+
+uint64_t write_codes( BitWriter *w, PackedCodes *codes, uint8_t *symbols, uint64_t nsymbols );
+
+uint64_t bit_writer_align( BitWriter *w );
+
+uint64_t bit_writer_tell( BitWriter *w );
+
+uint64_t flush_codes( BitWriter *w );
+
+// Description:
+// Writes a value to a buffer in little-endian format. Defined here so that with
+// a constant size it inlines to a single store, even in the coding kernels.
+//
+// Parameters:
+// uint8_t *buf - The buffer to write to.
+// uint64_t value - The value to write.
+// uint32_t nbytes - The number of bytes to write, up to 8.
+//
+// Returns:
+// Nothing.
+static inline void store_little_endian( uint8_t *buf, uint64_t value, uint32_t nbytes ) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy( buf, &value, nbytes );
+#else
+	for ( uint32_t i = 0; i < nbytes; i++ ) {
+		buf[ i ] = value >> ( 8 * i );
+	}
+#endif
+}
+
+// Description:
+// Reads a value from a buffer in little-endian format. Defined here so that with
+// a constant size it inlines to a single load, even in the coding kernels.
+//
+// Parameters:
+// uint8_t *buf - The buffer to read from.
+// uint32_t nbytes - The number of bytes to read, up to 8.
+//
+// Returns:
+// uint64_t - The value read.
+static inline uint64_t load_little_endian( uint8_t *buf, uint32_t nbytes ) {
+	uint64_t value = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy( &value, buf, nbytes );
+#else
+	for ( uint32_t i = 0; i < nbytes; i++ ) {
+		value |= ( uint64_t ) buf[ i ] << ( 8 * i );
+	}
+#endif
 
-uint64_t flush_codes( int outfile );
+	return value;
+}
 
 #endif
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Checks that files joined with cat decode as one when they can be joined, and
+# that huffman_decode fails, instead of dropping a file, when one can't be.
+#
+# Usage: join_check.sh (run from the build directory)
+
+if [ ! -x ./huffman_encode ] || [ ! -x ./huffman_decode ]; then
+	echo "Usage: $0 (run from the build directory)" >&2
+	exit 2
+fi
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/huffman-join.XXXXXX") || exit 2
+trap 'rm -rf "$WORK"' EXIT
+
+cat ./*.c > "$WORK/a"
+cat ./*.h > "$WORK/b"
+./huffman_encode -i "$WORK/a" -o "$WORK/a.huff" || exit 2
+./huffman_encode --lz 3 -i "$WORK/b" -o "$WORK/b.huff" || exit 2
+./huffman_encode --split -i "$WORK/b" -o "$WORK/b.split" || exit 2
+
+FAILURES=0
+
+# Prints a case's result, and counts it if it isn't the one expected.
+# Usage: check name expected(pass|fail) file...
+check() {
+	name=$1
+	expected=$2
+	shift 2
+	cat "$@" > "$WORK/joined"
+
+	if ./huffman_decode -i "$WORK/joined" -o "$WORK/out" 2> /dev/null; then
+		result=pass
+	else
+		result=fail
+	fi
+
+	if [ $result = $expected ]; then
+		echo "ok      $name"
+	else
+		echo "FAILED  $name (expected $expected, got $result)"
+		FAILURES=$((FAILURES + 1))
+	fi
+}
+
+check "plain + lz" pass "$WORK/a.huff" "$WORK/b.huff"
+cat "$WORK/a" "$WORK/b" | cmp -s - "$WORK/out" || { echo "FAILED  plain + lz decoded wrong bytes"; FAILURES=$((FAILURES + 1)); }
+check "plain + split" fail "$WORK/a.huff" "$WORK/b.split"
+check "split + plain" fail "$WORK/b.split" "$WORK/a.huff"
+
+if [ $FAILURES != 0 ]; then
+	echo "$FAILURES case(s) failed."
+	exit 1
+fi
+
+echo "All cases passed."
@@ -0,0 +1,296 @@
+#include "kernels.h"
+
+#include "code.h"
+#include "decode_table.h"
+#include "defines.h"
+#include "io.h"
+#include "node.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define KERNELS_X86 // Build BMI2 variants and pick them at startup if the CPU has BMI2.
+#endif
+
+#define KERNEL_BODY        static inline __attribute__( ( always_inline ) ) // Shared body, compiled once per instruction set.
+#define HISTOGRAM_CHUNK    ( 1u << 30 ) // Bytes counted before the 32-bit sub-histograms are merged.
+#define HISTOGRAM_LANES    4 // Sub-histograms, so repeated bytes don't wait on one counter.
+#define WINDOW_MARGIN_BITS ( 8 * WINDOW_MARGIN ) // Bits a window keeps ahead of the decoder.
+
+typedef uint32_t ( *EncodeKernel )( PackedCodes *codes, uint8_t *symbols, uint32_t nsymbols, uint8_t *out, uint64_t *bits, uint32_t *count );
+typedef uint32_t ( *DecodeKernel )( DecodeTable *t, BitWindow *w, uint8_t *out, uint32_t nsymbols, bool *corrupt );
+
+// Description:
+// Appends the codes of symbols to a 64-bit bit accumulator, storing each full byte
+// of it, two symbols at a time if the codes have a pair table. Every code must be
+// at most MAX_PACKED_CODE bits long.
+//
+// Parameters:
+// PackedCodes *codes - The packed codes.
+// uint8_t *symbols - The symbols to encode.
+// uint32_t nsymbols - The number of symbols.
+// uint8_t *out - Where to store bytes, with room for 7 bytes per symbol plus 8.
+// uint64_t *bits - The bits in the accumulator, updated on return.
+// uint32_t *count - The number of bits in the accumulator (under 8), updated on return.
+//
+// Returns:
+// uint32_t - The number of bytes stored.
+KERNEL_BODY uint32_t encode_body( PackedCodes *codes, uint8_t *symbols, uint32_t nsymbols, uint8_t *out, uint64_t *bits, uint32_t *count ) {
+	uint64_t accumulator = *bits;
+	uint32_t accumulated = *count;
+	uint8_t *p = out;
+
+	uint32_t i = 0;
+
+	if ( codes->pairs ) { // Two symbols per lookup, unless their codes are too long together.
+		for ( ; i + 1 < nsymbols; i += 2 ) {
+			uint32_t pair = codes->pairs[ symbols[ i ] | symbols[ i + 1 ] << 8 ];
+
+			if ( pair != 0 ) {
+				accumulator |= ( uint64_t ) ( pair >> PAIR_LENGTH_BITS ) << accumulated;
+				accumulated += pair & ( ( 1u << PAIR_LENGTH_BITS ) - 1 );
+			} else {
+				accumulator |= codes->bits[ symbols[ i ] ] << accumulated;
+				accumulated += codes->length[ symbols[ i ] ];
+				store_little_endian( p, accumulator, 8 );
+				p += accumulated >> 3;
+				accumulator >>= accumulated & ~7u;
+				accumulated &= 7;
+				accumulator |= codes->bits[ symbols[ i + 1 ] ] << accumulated;
+				accumulated += codes->length[ symbols[ i + 1 ] ];
+			}
+
+			store_little_endian( p, accumulator, 8 );
+			p += accumulated >> 3;
+			accumulator >>= accumulated & ~7u;
+			accumulated &= 7;
+		}
+	}
+
+	for ( ; i < nsymbols; i++ ) {
+		uint8_t symbol = symbols[ i ];
+		accumulator |= codes->bits[ symbol ] << accumulated;
+		accumulated += codes->length[ symbol ];
+		store_little_endian( p, accumulator, 8 ); // Store all 8 bytes, and keep only the full ones.
+		p += accumulated >> 3;
+		accumulator >>= accumulated & ~7u;
+		accumulated &= 7;
+	}
+
+	*bits = accumulator;
+	*count = accumulated;
+
+	return p - out;
+}
+
+// Description:
+// Decodes symbols from a bit window with a decode table, several at a time while
+// their codes fit a multi-symbol entry, falling back to walking the tree for
+// codes longer than the table's window.
+//
+// Parameters:
+// DecodeTable *t - The decode table.
+// BitWindow *w - The bit window, advanced past the decoded codes.
+// uint8_t *out - Where to write the symbols.
+// uint32_t nsymbols - The max number of symbols to decode.
+// bool *corrupt - The pointer to the bool to set if an invalid or truncated code is found.
+//
+// Returns:
+// uint32_t - The number of symbols decoded. Fewer than asked means the window needs a refill.
+KERNEL_BODY uint32_t decode_body( DecodeTable *t, BitWindow *w, uint8_t *out, uint32_t nsymbols, bool *corrupt ) {
+	uint8_t *data = w->data;
+	uint64_t top = w->top;
+	uint64_t limit = w->limit;
+	// Outside the last window, stop while a whole code is sure to be buffered.
+	uint64_t stop = w->last ? limit : ( limit > WINDOW_MARGIN_BITS ? limit - WINDOW_MARGIN_BITS : 0 );
+	bool multi_useful = t->multi_useful;
+	uint32_t i = 0;
+
+	while ( i < nsymbols && top < stop ) {
+		uint64_t window = load_little_endian( data + top / 8, 8 ) >> ( top % 8 );
+		uint32_t multi = multi_useful ? t->multi[ window & ( ( 1u << MULTI_LOOKUP_BITS ) - 1 ) ] : 0;
+
+		if ( multi != 0 && nsymbols - i >= MULTI_SYMBOLS ) { // Whole codes fit the wider window; unused symbol bytes are overwritten next.
+			out[ i ] = multi;
+			out[ i + 1 ] = multi >> 8;
+			out[ i + 2 ] = multi >> 16;
+			i += ( multi >> 24 ) & 3;
+			top += multi >> 26;
+			continue;
+		}
+
+		uint32_t index = window & ( ( 1u << LOOKUP_BITS ) - 1 );
+		uint32_t entry = t->entries[ index ];
+
+		if ( entry != 0 ) { // Code fits the lookup window.
+			out[ i++ ] = entry & 0xFF;
+			top += entry >> 8;
+			continue;
+		}
+
+		Node *node = t->nodes[ index ];
+		top += LOOKUP_BITS;
+
+		while ( node && ( node->left || node->right ) && top < limit ) { // Long code: walk the rest of it.
+			node = ( 1 & ( data[ top / 8 ] >> ( top % 8 ) ) ) ? node->right : node->left;
+			top++;
+		}
+
+		if ( !node || node->left || node->right ) { // Invalid code, or the input ended inside it.
+			*corrupt = true;
+			break;
+		}
+
+		out[ i++ ] = node->symbol;
+	}
+
+	if ( top > limit ) { // Last code ran past the end of the input.
+		*corrupt = true;
+	}
+
+	w->top = top;
+
+	return i;
+}
+
+// The encode and decode bodies built for any CPU.
+
+static uint32_t encode_portable( PackedCodes *codes, uint8_t *symbols, uint32_t nsymbols, uint8_t *out, uint64_t *bits, uint32_t *count ) {
+	return encode_body( codes, symbols, nsymbols, out, bits, count );
+}
+
+static uint32_t decode_portable( DecodeTable *t, BitWindow *w, uint8_t *out, uint32_t nsymbols, bool *corrupt ) {
+	return decode_body( t, w, out, nsymbols, corrupt );
+}
+
+#ifdef KERNELS_X86
+// The encode and decode bodies built for BMI2, so their variable shifts become shlx
+// and shrx, which don't have to go through cl or touch the flags. The histogram has
+// no variable shifts, and AVX2 has no scatter to count bytes with, so it's built once.
+
+__attribute__( ( target( "bmi,bmi2,lzcnt" ) ) ) static uint32_t encode_bmi2( PackedCodes *codes, uint8_t *symbols, uint32_t nsymbols, uint8_t *out, uint64_t *bits, uint32_t *count ) {
+	return encode_body( codes, symbols, nsymbols, out, bits, count );
+}
+
+__attribute__( ( target( "bmi,bmi2,lzcnt" ) ) ) static uint32_t decode_bmi2( DecodeTable *t, BitWindow *w, uint8_t *out, uint32_t nsymbols, bool *corrupt ) {
+	return decode_body( t, w, out, nsymbols, corrupt );
+}
+#endif
+
+static EncodeKernel encode_kernel = encode_portable;
+static DecodeKernel decode_kernel = decode_portable;
+static char *kernel_name = "portable";
+
+// Description:
+// Picks the fastest kernels the CPU supports, once at startup. Setting the
+// HUFFMAN_KERNELS environment variable to "portable" forces the fallbacks.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// Nothing.
+__attribute__( ( constructor ) ) static void kernels_select( ) {
+	char *forced = getenv( "HUFFMAN_KERNELS" );
+
+	if ( forced && strcmp( forced, "portable" ) == 0 ) {
+		return;
+	}
+
+#ifdef KERNELS_X86
+	__builtin_cpu_init( );
+
+	if ( __builtin_cpu_supports( "bmi2" ) ) {
+		encode_kernel = encode_bmi2;
+		decode_kernel = decode_bmi2;
+		kernel_name = "bmi2";
+	}
+#endif
+}
+
+// Description:
+// Counts bytes into a histogram, spreading consecutive bytes across several
+// sub-histograms so runs of the same byte don't serialize on one counter.
+//
+// Parameters:
+// uint64_t histogram[static ALPHABET] - The histogram to add to.
+// uint8_t *buf - The bytes to count.
+// uint64_t nbytes - The number of bytes.
+//
+// Returns:
+// Nothing.
+void histogram_update( uint64_t histogram[ static ALPHABET ], uint8_t *buf, uint64_t nbytes ) {
+	uint32_t counts[ HISTOGRAM_LANES ][ ALPHABET ];
+
+	while ( nbytes > 0 ) {
+		uint32_t chunk = nbytes < HISTOGRAM_CHUNK ? nbytes : HISTOGRAM_CHUNK;
+		uint32_t i = 0;
+		memset( counts, 0, sizeof( counts ) );
+
+		for ( ; i + HISTOGRAM_LANES <= chunk; i += HISTOGRAM_LANES ) {
+			counts[ 0 ][ buf[ i ] ]++;
+			counts[ 1 ][ buf[ i + 1 ] ]++;
+			counts[ 2 ][ buf[ i + 2 ] ]++;
+			counts[ 3 ][ buf[ i + 3 ] ]++;
+		}
+
+		for ( ; i < chunk; i++ ) {
+			counts[ 0 ][ buf[ i ] ]++;
+		}
+
+		for ( uint32_t symbol = 0; symbol < ALPHABET; symbol++ ) { // Merge the sub-histograms.
+			histogram[ symbol ] += ( uint64_t ) counts[ 0 ][ symbol ] + counts[ 1 ][ symbol ] + counts[ 2 ][ symbol ] + counts[ 3 ][ symbol ];
+		}
+
+		buf += chunk;
+		nbytes -= chunk;
+	}
+}
+
+// Description:
+// Appends the codes of symbols to a bit accumulator. See encode_body().
+//
+// Parameters:
+// PackedCodes *codes - The packed codes, all at most MAX_PACKED_CODE bits long.
+// uint8_t *symbols - The symbols to encode.
+// uint32_t nsymbols - The number of symbols.
+// uint8_t *out - Where to store bytes, with room for 7 bytes per symbol plus 8.
+// uint64_t *bits - The bits in the accumulator.
+// uint32_t *count - The number of bits in the accumulator.
+//
+// Returns:
+// uint32_t - The number of bytes stored.
+uint32_t encode_symbols( PackedCodes *codes, uint8_t *symbols, uint32_t nsymbols, uint8_t *out, uint64_t *bits, uint32_t *count ) {
+	return encode_kernel( codes, symbols, nsymbols, out, bits, count );
+}
+
+// Description:
+// Decodes symbols from a bit window. See decode_body().
+//
+// Parameters:
+// DecodeTable *t - The decode table.
+// BitWindow *w - The bit window.
+// uint8_t *out - Where to write the symbols.
+// uint32_t nsymbols - The max number of symbols to decode.
+// bool *corrupt - The pointer to the bool to set if an invalid or truncated code is found.
+//
+// Returns:
+// uint32_t - The number of symbols decoded.
+uint32_t decode_symbols( DecodeTable *t, BitWindow *w, uint8_t *out, uint32_t nsymbols, bool *corrupt ) {
+	return decode_kernel( t, w, out, nsymbols, corrupt );
+}
+
+// Description:
+// Gets the name of the kernels picked for this CPU.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// char * - The name of the kernels.
+char *kernels_name( ) {
+	return kernel_name;
+}
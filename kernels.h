@@ -0,0 +1,20 @@
+#ifndef __KERNELS_H__
+#define __KERNELS_H__
+
+#include "code.h"
+#include "decode_table.h"
+#include "defines.h"
+#include "io.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void histogram_update( uint64_t histogram[ static ALPHABET ], uint8_t *buf, uint64_t nbytes );
+
+uint32_t encode_symbols( PackedCodes *codes, uint8_t *symbols, uint32_t nsymbols, uint8_t *out, uint64_t *bits, uint32_t *count );
+
+uint32_t decode_symbols( DecodeTable *t, BitWindow *w, uint8_t *out, uint32_t nsymbols, bool *corrupt );
+
+char *kernels_name( );
+
+#endif
@@ -0,0 +1,632 @@
+#include "lz.h"
+
+#include "io.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ_NIL        UINT32_MAX // Position of no match.
+#define LZ_HASH_SIZE  ( 1 << LZ_HASH_BITS ) // Chains in the hash table.
+
+// Description:
+// How hard a level looks for matches.
+//
+// Members:
+// uint32_t max_chain - Most earlier positions tried for each match.
+// uint32_t good_length - Length of a match good enough to try only a quarter as many positions for a longer one.
+// uint32_t nice_length - Length of a match good enough to stop looking for a longer one.
+// uint32_t lazy_length - Longest match checked for a longer one at the next position, 0 to match greedily.
+typedef struct LzLevel {
+	uint32_t max_chain;
+	uint32_t good_length;
+	uint32_t nice_length;
+	uint32_t lazy_length;
+} LzLevel;
+
+static const LzLevel levels[ LZ_LEVELS ] = {
+	{ 4, 4, 16, 0 },
+	{ 16, 8, 32, 0 },
+	{ 16, 8, 64, 16 },
+	{ 128, 16, 128, 64 },
+	{ 1024, 32, 258, 258 },
+};
+
+// Description:
+// A struct for finding matches with hash chains over a sliding window.
+//
+// Members:
+// uint8_t *window - The window, then the block being parsed.
+// uint32_t fill - The number of bytes in the window.
+// uint32_t inserted - The first position not yet added to the hash chains.
+// uint32_t *head - The last position with each hash.
+// uint32_t *prev - The position before each one with the same hash, by position modulo LZ_WINDOW.
+// LzLevel level - How hard to look for matches.
+struct LzEncoder {
+	uint8_t *window;
+	uint32_t fill;
+	uint32_t inserted;
+	uint32_t *head;
+	uint32_t *prev;
+	LzLevel level;
+};
+
+// Description:
+// A struct for rebuilding blocks, keeping the window their matches refer to.
+//
+// Members:
+// uint8_t *window - The window, then the block being decoded.
+// uint32_t fill - The number of bytes in the window.
+struct LzDecoder {
+	uint8_t *window;
+	uint32_t fill;
+};
+
+// Description:
+// A little-endian bit buffer, for the extra bits of a block.
+//
+// Members:
+// uint8_t *data - The bytes.
+// uint32_t size - The number of whole bytes written, or the size to read.
+// uint64_t position - The number of bits read.
+// uint64_t bits - The bits not yet written.
+// uint32_t nbits - The number of bits not yet written.
+typedef struct LzBits {
+	uint8_t *data;
+	uint32_t size;
+	uint64_t position;
+	uint64_t bits;
+	uint32_t nbits;
+} LzBits;
+
+// Description:
+// Hashes the first 4 bytes at a position.
+//
+// Parameters:
+// uint8_t *p - The bytes.
+//
+// Returns:
+// uint32_t - The hash, below LZ_HASH_SIZE.
+static inline uint32_t lz_hash( uint8_t *p ) {
+	return ( ( uint32_t ) load_little_endian( p, 8 ) * 2654435761u ) >> ( 32 - LZ_HASH_BITS );
+}
+
+// Description:
+// Counts the bytes two positions have in common, 8 at a time. Both may be read
+// up to 7 bytes past the limit.
+//
+// Parameters:
+// uint8_t *a - The earlier position.
+// uint8_t *b - The later position.
+// uint32_t max_length - The most bytes to count.
+//
+// Returns:
+// uint32_t - The length of the match.
+static inline uint32_t lz_match_length( uint8_t *a, uint8_t *b, uint32_t max_length ) {
+	for ( uint32_t length = 0; length < max_length; length += 8 ) {
+		uint64_t difference = load_little_endian( a + length, 8 ) ^ load_little_endian( b + length, 8 );
+
+		if ( difference != 0 ) {
+			length += __builtin_ctzll( difference ) / 8;
+
+			return length < max_length ? length : max_length;
+		}
+	}
+
+	return max_length;
+}
+
+// Description:
+// Splits a value into the code written for it and the extra bits after it.
+// Values below LZ_DIRECT_VALUES are their own codes. Larger ones are coded by
+// their highest bit and the bit below it, followed by the rest of their bits.
+//
+// Parameters:
+// uint32_t value - The value.
+// uint32_t *nbits - The pointer to the uint32_t to set to the number of extra bits.
+//
+// Returns:
+// uint8_t - The code.
+static inline uint8_t lz_value_code( uint32_t value, uint32_t *nbits ) {
+	if ( value < LZ_DIRECT_VALUES ) {
+		*nbits = 0;
+
+		return value;
+	}
+
+	uint32_t high_bit = 31 - __builtin_clz( value );
+	*nbits = high_bit - 1;
+
+	return LZ_DIRECT_VALUES + 2 * ( high_bit - 4 ) + ( ( value >> ( high_bit - 1 ) ) & 1 );
+}
+
+// Description:
+// Appends bits to a bit buffer, writing out whole bytes.
+//
+// Parameters:
+// LzBits *b - The bit buffer.
+// uint32_t value - The bits.
+// uint32_t nbits - The number of bits, up to 31.
+//
+// Returns:
+// Nothing.
+static inline void lz_put_bits( LzBits *b, uint32_t value, uint32_t nbits ) {
+	b->bits |= ( uint64_t ) ( value & ( ( 1u << nbits ) - 1 ) ) << b->nbits;
+	b->nbits += nbits;
+
+	while ( b->nbits >= 8 ) {
+		b->data[ b->size++ ] = b->bits;
+		b->bits >>= 8;
+		b->nbits -= 8;
+	}
+}
+
+// Description:
+// Writes a value's code to a stream and its extra bits to the bit buffer.
+//
+// Parameters:
+// LzBlock *block - The block.
+// LzStream stream - The stream to write the code to.
+// LzBits *extra - The bit buffer.
+// uint32_t value - The value.
+//
+// Returns:
+// Nothing.
+static inline void lz_put_value( LzBlock *block, LzStream stream, LzBits *extra, uint32_t value ) {
+	uint32_t nbits = 0;
+	block->symbols[ stream ][ block->counts[ stream ]++ ] = lz_value_code( value, &nbits );
+	lz_put_bits( extra, value, nbits );
+}
+
+// Description:
+// Reads the value of a code, taking its extra bits from the bit buffer.
+//
+// Parameters:
+// LzBits *b - The bit buffer, with 8 readable bytes past its size.
+// uint8_t code - The code.
+// uint32_t *value - The pointer to the uint32_t to set to the value.
+//
+// Returns:
+// bool - Whether the code and its extra bits are valid.
+static inline bool lz_get_value( LzBits *b, uint8_t code, uint32_t *value ) {
+	if ( code < LZ_DIRECT_VALUES ) {
+		*value = code;
+
+		return true;
+	}
+
+	uint32_t high_bit = 4 + ( code - LZ_DIRECT_VALUES ) / 2;
+	uint32_t nbits = high_bit - 1;
+
+	if ( code > LZ_MAX_VALUE_CODE || b->position + nbits > 8 * ( uint64_t ) b->size ) {
+		return false;
+	}
+
+	uint32_t bits = ( load_little_endian( b->data + b->position / 8, 8 ) >> ( b->position % 8 ) ) & ( ( 1u << nbits ) - 1 );
+	b->position += nbits;
+	*value = ( 2u | ( code & 1 ) ) << nbits | bits;
+
+	return true;
+}
+
+// Description:
+// Allocates the streams of a block, with room for LZ_BLOCK bytes of input.
+//
+// Parameters:
+// LzBlock *b - The block to set up.
+//
+// Returns:
+// bool - Whether the streams were allocated.
+bool lz_block_create( LzBlock *b ) {
+	memset( b, 0, sizeof( LzBlock ) );
+	bool success = ( b->extra = ( uint8_t * ) calloc( LZ_MAX_EXTRA + LZ_SLACK, 1 ) );
+
+	for ( uint32_t stream = 0; success && stream < LZ_STREAMS; stream++ ) {
+		success = ( b->symbols[ stream ] = ( uint8_t * ) malloc( ( stream == LZ_LITERALS ? LZ_BLOCK : LZ_BLOCK / LZ_MIN_MATCH ) + LZ_SLACK ) );
+	}
+
+	if ( !success ) {
+		lz_block_delete( b );
+	}
+
+	return success;
+}
+
+// Description:
+// Frees the streams of a block.
+//
+// Parameters:
+// LzBlock *b - The block.
+//
+// Returns:
+// Nothing.
+void lz_block_delete( LzBlock *b ) {
+	for ( uint32_t stream = 0; stream < LZ_STREAMS; stream++ ) {
+		free( b->symbols[ stream ] );
+		b->symbols[ stream ] = NULL;
+	}
+
+	free( b->extra );
+	b->extra = NULL;
+}
+
+// Description:
+// Makes a block of literals only, for input its matches don't pay off on.
+//
+// Parameters:
+// LzBlock *b - The block.
+// uint8_t *in - The block's input.
+// uint32_t nbytes - The size of the input, up to LZ_BLOCK.
+//
+// Returns:
+// Nothing.
+void lz_block_literals( LzBlock *b, uint8_t *in, uint32_t nbytes ) {
+	memcpy( b->symbols[ LZ_LITERALS ], in, nbytes );
+	memset( b->counts, 0, sizeof( b->counts ) );
+	b->counts[ LZ_LITERALS ] = nbytes;
+	b->nbytes = nbytes;
+	b->extra_size = 0;
+}
+
+// Description:
+// Creates the header written before a block's tree dumps.
+//
+// Parameters:
+// LzBlock *b - The block.
+// uint16_t tree_sizes[static LZ_STREAMS] - The size of each stream's tree dump.
+// uint8_t header[static LZ_BLOCK_HEADER_SIZE] - The buffer to write the header to, little-endian.
+//
+// Returns:
+// Nothing.
+void lz_block_header_create( LzBlock *b, uint16_t tree_sizes[ static LZ_STREAMS ], uint8_t header[ static LZ_BLOCK_HEADER_SIZE ] ) {
+	store_little_endian( header, b->nbytes, 4 );
+	store_little_endian( header + 4, b->counts[ LZ_LITERALS ], 4 );
+	store_little_endian( header + 8, b->counts[ LZ_LENGTHS ], 4 );
+	store_little_endian( header + 12, b->extra_size, 4 );
+
+	for ( uint32_t stream = 0; stream < LZ_STREAMS; stream++ ) {
+		store_little_endian( header + 16 + 2 * stream, tree_sizes[ stream ], 2 );
+	}
+}
+
+// Description:
+// Parses the header written before a block's tree dumps, and checks its sizes
+// fit the block's streams.
+//
+// Parameters:
+// uint8_t header[static LZ_BLOCK_HEADER_SIZE] - The header.
+// LzBlock *b - The block to set the sizes of.
+// uint16_t tree_sizes[static LZ_STREAMS] - The array to set to the size of each stream's tree dump.
+//
+// Returns:
+// bool - Whether the sizes are valid.
+bool lz_block_header_parse( uint8_t header[ static LZ_BLOCK_HEADER_SIZE ], LzBlock *b, uint16_t tree_sizes[ static LZ_STREAMS ] ) {
+	b->nbytes = load_little_endian( header, 4 );
+	b->counts[ LZ_LITERALS ] = load_little_endian( header + 4, 4 );
+	b->counts[ LZ_RUNS ] = b->counts[ LZ_LENGTHS ] = b->counts[ LZ_DISTANCES ] = load_little_endian( header + 8, 4 );
+	b->extra_size = load_little_endian( header + 12, 4 );
+	bool valid = b->nbytes != 0 && b->nbytes <= LZ_BLOCK && b->counts[ LZ_LITERALS ] <= b->nbytes && b->counts[ LZ_LENGTHS ] <= b->nbytes / LZ_MIN_MATCH && b->extra_size <= LZ_MAX_EXTRA;
+
+	for ( uint32_t stream = 0; stream < LZ_STREAMS; stream++ ) {
+		tree_sizes[ stream ] = load_little_endian( header + 16 + 2 * stream, 2 );
+		valid = valid && tree_sizes[ stream ] <= MAX_TREE_SIZE;
+	}
+
+	return valid;
+}
+
+// Description:
+// Creates an encoder with an empty window.
+//
+// Parameters:
+// uint32_t level - The level, from 1 to LZ_LEVELS.
+//
+// Returns:
+// LzEncoder * - A pointer to the newly created encoder.
+LzEncoder *lz_encoder_create( uint32_t level ) {
+	LzEncoder *e = ( LzEncoder * ) calloc( 1, sizeof( LzEncoder ) );
+
+	if ( e ) {
+		e->level = levels[ level - 1 ];
+		e->window = ( uint8_t * ) calloc( LZ_WINDOW + LZ_BLOCK + LZ_SLACK, 1 );
+		e->head = ( uint32_t * ) malloc( LZ_HASH_SIZE * sizeof( uint32_t ) );
+		e->prev = ( uint32_t * ) malloc( LZ_WINDOW * sizeof( uint32_t ) );
+
+		if ( !e->window || !e->head || !e->prev ) {
+			lz_encoder_delete( &e );
+		} else {
+			memset( e->head, 0xFF, LZ_HASH_SIZE * sizeof( uint32_t ) ); // Every chain starts out empty.
+		}
+	}
+
+	return e;
+}
+
+// Description:
+// Frees the memory given to an encoder.
+//
+// Parameters:
+// LzEncoder **e - A pointer to a pointer to the encoder.
+//
+// Returns:
+// Nothing.
+void lz_encoder_delete( LzEncoder **e ) {
+	if ( *e ) {
+		free( ( *e )->window );
+		free( ( *e )->head );
+		free( ( *e )->prev );
+		free( *e );
+		*e = NULL;
+	}
+}
+
+// Description:
+// Gets where to read the next block to, sliding the window along first if it's
+// full. Positions are moved back by a whole window, so each keeps its place in
+// the prev array.
+//
+// Parameters:
+// LzEncoder *e - The encoder.
+// uint32_t *nbytes - The pointer to the uint32_t to set to the most bytes the block can have.
+//
+// Returns:
+// uint8_t * - Where to read the block to.
+uint8_t *lz_encoder_window( LzEncoder *e, uint32_t *nbytes ) {
+	if ( e->fill == LZ_WINDOW + LZ_BLOCK ) {
+		memmove( e->window, e->window + LZ_BLOCK, LZ_WINDOW );
+		e->fill -= LZ_BLOCK;
+		e->inserted -= LZ_BLOCK;
+
+		for ( uint32_t i = 0; i < LZ_HASH_SIZE; i++ ) {
+			e->head[ i ] = e->head[ i ] != LZ_NIL && e->head[ i ] >= LZ_BLOCK ? e->head[ i ] - LZ_BLOCK : LZ_NIL;
+		}
+
+		for ( uint32_t i = 0; i < LZ_WINDOW; i++ ) {
+			e->prev[ i ] = e->prev[ i ] != LZ_NIL && e->prev[ i ] >= LZ_BLOCK ? e->prev[ i ] - LZ_BLOCK : LZ_NIL;
+		}
+	}
+
+	uint32_t room = LZ_WINDOW + LZ_BLOCK - e->fill;
+	*nbytes = room < LZ_BLOCK ? room : LZ_BLOCK;
+
+	return e->window + e->fill;
+}
+
+// Description:
+// Adds a position to its hash chain.
+//
+// Parameters:
+// LzEncoder *e - The encoder.
+// uint32_t position - The position, with LZ_MIN_MATCH bytes after it read.
+//
+// Returns:
+// Nothing.
+static inline void lz_insert( LzEncoder *e, uint32_t position ) {
+	uint32_t hash = lz_hash( e->window + position );
+	e->prev[ position & ( LZ_WINDOW - 1 ) ] = e->head[ hash ];
+	e->head[ hash ] = position;
+}
+
+// Description:
+// Finds the longest match for a position among the earlier positions on its
+// hash chain, if it's longer than a given length, then adds the position to
+// the chain.
+//
+// Parameters:
+// LzEncoder *e - The encoder.
+// uint32_t position - The position, the first one not yet on a chain.
+// uint32_t end - The end of the block, at least LZ_MIN_MATCH bytes after the position.
+// uint32_t shorter - The length the match has to beat, at least LZ_MIN_MATCH - 1.
+// uint32_t *distance - The pointer to the uint32_t to set to the distance back to the match.
+//
+// Returns:
+// uint32_t - The length of the match, or 0 if there's none longer than the given length.
+static uint32_t lz_find_match( LzEncoder *e, uint32_t position, uint32_t end, uint32_t shorter, uint32_t *distance ) {
+	uint8_t *window = e->window;
+	uint32_t candidate = e->head[ lz_hash( window + position ) ];
+	uint32_t max_length = end - position;
+	uint32_t nice_length = e->level.nice_length < max_length ? e->level.nice_length : max_length;
+	uint32_t best = shorter;
+	lz_insert( e, position );
+	e->inserted = position + 1;
+
+	if ( best >= max_length ) {
+		return 0;
+	}
+
+	for ( uint32_t chain = shorter >= e->level.good_length ? e->level.max_chain / 4 + 1 : e->level.max_chain; chain != 0 && candidate != LZ_NIL && position - candidate < LZ_WINDOW; chain-- ) {
+		if ( window[ candidate + best ] == window[ position + best ] ) { // Can't beat the best match unless this byte matches.
+			uint32_t length = lz_match_length( window + candidate, window + position, max_length );
+
+			if ( length > best ) {
+				best = length;
+				*distance = position - candidate;
+
+				if ( length >= nice_length ) {
+					break;
+				}
+			}
+		}
+
+		candidate = e->prev[ candidate & ( LZ_WINDOW - 1 ) ];
+	}
+
+	return best > shorter ? best : 0;
+}
+
+// Description:
+// Parses a block read to the window into literals and matches, writing the
+// codes of the literal runs, match lengths and distances to their own streams
+// and their extra bits to the bit buffer. A greedy level takes the longest
+// match at each position; a lazy one first checks whether the next position
+// has a longer match, and if so makes this byte a literal.
+//
+// Parameters:
+// LzEncoder *e - The encoder.
+// uint32_t nbytes - The size of the block read where lz_encoder_window said.
+// LzBlock *b - The block to write the streams to.
+//
+// Returns:
+// Nothing.
+void lz_encoder_parse( LzEncoder *e, uint32_t nbytes, LzBlock *b ) {
+	uint8_t *window = e->window;
+	uint32_t end = e->fill + nbytes;
+	uint32_t limit = end >= LZ_MIN_MATCH ? end - LZ_MIN_MATCH + 1 : 0; // Positions with enough bytes after them to hash.
+	uint32_t literal_start = e->fill;
+	uint32_t position = e->fill;
+	LzBits extra = { b->extra, 0, 0, 0, 0 };
+	memset( b->counts, 0, sizeof( b->counts ) );
+	b->nbytes = nbytes;
+
+	for ( ; e->inserted < position && e->inserted < limit; e->inserted++ ) { // The end of the last block, now that the bytes after it are here.
+		lz_insert( e, e->inserted );
+	}
+
+	while ( position < limit ) {
+		uint32_t distance = 0;
+		uint32_t length = lz_find_match( e, position, end, LZ_MIN_MATCH - 1, &distance );
+
+		while ( length != 0 && length < e->level.lazy_length && position + 1 < limit ) {
+			uint32_t next_distance = 0;
+			uint32_t next_length = lz_find_match( e, position + 1, end, length, &next_distance );
+
+			if ( next_length == 0 ) {
+				break;
+			}
+
+			position++;
+			length = next_length;
+			distance = next_distance;
+		}
+
+		if ( length == 0 ) {
+			position++;
+
+			continue;
+		}
+
+		uint32_t run = position - literal_start;
+		memcpy( b->symbols[ LZ_LITERALS ] + b->counts[ LZ_LITERALS ], window + literal_start, run );
+		b->counts[ LZ_LITERALS ] += run;
+		lz_put_value( b, LZ_RUNS, &extra, run );
+		lz_put_value( b, LZ_LENGTHS, &extra, length - LZ_MIN_MATCH );
+		lz_put_value( b, LZ_DISTANCES, &extra, distance - 1 );
+		position += length;
+		literal_start = position;
+
+		for ( uint32_t stop = position < limit ? position : limit; e->inserted < stop; e->inserted++ ) {
+			lz_insert( e, e->inserted );
+		}
+	}
+
+	memcpy( b->symbols[ LZ_LITERALS ] + b->counts[ LZ_LITERALS ], window + literal_start, end - literal_start ); // Bytes after the last match.
+	b->counts[ LZ_LITERALS ] += end - literal_start;
+	lz_put_bits( &extra, 0, 7 ); // Flushes the last partial byte.
+	b->extra_size = extra.size;
+	e->fill = end;
+}
+
+// Description:
+// Creates a decoder with an empty window.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// LzDecoder * - A pointer to the newly created decoder.
+LzDecoder *lz_decoder_create( ) {
+	LzDecoder *d = ( LzDecoder * ) calloc( 1, sizeof( LzDecoder ) );
+
+	if ( d && !( d->window = ( uint8_t * ) calloc( LZ_WINDOW + LZ_BLOCK + LZ_SLACK, 1 ) ) ) {
+		lz_decoder_delete( &d );
+	}
+
+	return d;
+}
+
+// Description:
+// Frees the memory given to a decoder.
+//
+// Parameters:
+// LzDecoder **d - A pointer to a pointer to the decoder.
+//
+// Returns:
+// Nothing.
+void lz_decoder_delete( LzDecoder **d ) {
+	if ( *d ) {
+		free( ( *d )->window );
+		free( *d );
+		*d = NULL;
+	}
+}
+
+// Description:
+// Rebuilds a block from its decoded streams, after the window.
+//
+// Parameters:
+// LzDecoder *d - The decoder.
+// LzBlock *b - The block, with its streams decoded and its extra bits read.
+//
+// Returns:
+// uint8_t * - The block's bytes, valid until the next block, or NULL if the streams are corrupted.
+uint8_t *lz_decode( LzDecoder *d, LzBlock *b ) {
+	if ( d->fill + b->nbytes > LZ_WINDOW + LZ_BLOCK ) { // Keep the last window's worth of bytes.
+		memmove( d->window, d->window + d->fill - LZ_WINDOW, LZ_WINDOW );
+		d->fill = LZ_WINDOW;
+	}
+
+	uint8_t *block = d->window + d->fill;
+	uint8_t *out = block;
+	uint8_t *stop = block + b->nbytes;
+	uint8_t *literals = b->symbols[ LZ_LITERALS ];
+	uint8_t *literals_end = literals + b->counts[ LZ_LITERALS ];
+	LzBits extra = { b->extra, b->extra_size, 0, 0, 0 };
+
+	for ( uint32_t i = 0; i < b->counts[ LZ_LENGTHS ]; i++ ) {
+		uint32_t run = 0;
+		uint32_t length = 0;
+		uint32_t distance = 0;
+
+		if ( !lz_get_value( &extra, b->symbols[ LZ_RUNS ][ i ], &run ) || !lz_get_value( &extra, b->symbols[ LZ_LENGTHS ][ i ], &length ) || !lz_get_value( &extra, b->symbols[ LZ_DISTANCES ][ i ], &distance ) ) {
+			return NULL;
+		}
+
+		if ( run > literals_end - literals || run > stop - out ) {
+			return NULL;
+		}
+
+		memcpy( out, literals, run );
+		literals += run;
+		out += run;
+
+		if ( length > stop - out - LZ_MIN_MATCH || distance >= out - d->window ) {
+			return NULL;
+		}
+
+		length += LZ_MIN_MATCH;
+		distance++;
+		uint8_t *match = out - distance;
+
+		if ( distance >= 8 ) { // Copies may run up to 7 bytes past the match, into the slack.
+			for ( uint32_t copied = 0; copied < length; copied += 8 ) {
+				memcpy( out + copied, match + copied, 8 );
+			}
+		} else {
+			for ( uint32_t copied = 0; copied < length; copied++ ) {
+				out[ copied ] = match[ copied ];
+			}
+		}
+
+		out += length;
+	}
+
+	if ( literals_end - literals != stop - out || ( extra.position + 7 ) / 8 != extra.size ) { // The bytes after the last match, and every extra bit.
+		return NULL;
+	}
+
+	memcpy( out, literals, stop - out );
+	d->fill += b->nbytes;
+
+	return block;
+}
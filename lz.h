@@ -0,0 +1,58 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LZ_WINDOW             ( 16 * BLOCK ) // 64KB matches can reach back into, a power of 2 small enough for the chains to stay in cache.
+#define LZ_BLOCK              ( 256 * BLOCK ) // 1MB of input parsed and coded per block, a multiple of the window.
+#define LZ_MIN_MATCH          4 // Shortest match, and bytes hashed to find one.
+#define LZ_HASH_BITS          15 // Bits of the hash of a position's first 4 bytes.
+#define LZ_LEVELS             5 // Levels 1 and 2 match greedily, 3 to 5 lazily.
+#define LZ_DIRECT_VALUES      16 // Values coded as themselves, without extra bits.
+#define LZ_MAX_VALUE_CODE     ( LZ_DIRECT_VALUES + 2 * 27 + 1 ) // Code of the largest 32-bit value.
+#define LZ_MAX_EXTRA          ( LZ_BLOCK / LZ_MIN_MATCH * 8 ) // Most bytes of extra bits in a block: under 64 bits per match.
+#define LZ_SLACK              16 // Readable bytes kept after buffers so copies and loads can run over.
+#define LZ_BLOCK_HEADER_SIZE  24 // Block size, literal count, match count and extra bits size, 32 bits each, then 4 16-bit tree sizes.
+
+typedef enum LzStream { LZ_LITERALS, LZ_RUNS, LZ_LENGTHS, LZ_DISTANCES, LZ_STREAMS } LzStream;
+
+typedef struct LzBlock {
+	uint32_t nbytes;
+	uint8_t *symbols[ LZ_STREAMS ];
+	uint32_t counts[ LZ_STREAMS ];
+	uint8_t *extra;
+	uint32_t extra_size;
+} LzBlock;
+
+typedef struct LzEncoder LzEncoder;
+
+typedef struct LzDecoder LzDecoder;
+
+bool lz_block_create( LzBlock *b );
+
+void lz_block_delete( LzBlock *b );
+
+void lz_block_literals( LzBlock *b, uint8_t *in, uint32_t nbytes );
+
+void lz_block_header_create( LzBlock *b, uint16_t tree_sizes[ static LZ_STREAMS ], uint8_t header[ static LZ_BLOCK_HEADER_SIZE ] );
+
+bool lz_block_header_parse( uint8_t header[ static LZ_BLOCK_HEADER_SIZE ], LzBlock *b, uint16_t tree_sizes[ static LZ_STREAMS ] );
+
+LzEncoder *lz_encoder_create( uint32_t level );
+
+void lz_encoder_delete( LzEncoder **e );
+
+uint8_t *lz_encoder_window( LzEncoder *e, uint32_t *nbytes );
+
+void lz_encoder_parse( LzEncoder *e, uint32_t nbytes, LzBlock *b );
+
+LzDecoder *lz_decoder_create( );
+
+void lz_decoder_delete( LzDecoder **d );
+
+uint8_t *lz_decode( LzDecoder *d, LzBlock *b );
+
+#endif
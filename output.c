@@ -0,0 +1,416 @@
+#define _GNU_SOURCE
+
+#include "output.h"
+
+#include "defines.h"
+#include "io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define OUTPUT_CHUNK ( 1024 * BLOCK ) // 4MB per pwrite() when the output can't be mapped.
+
+typedef enum OutputMode { OUTPUT_STREAM, OUTPUT_PWRITE, OUTPUT_MAP, OUTPUT_SINK, OUTPUT_MEMORY } OutputMode;
+
+static bool output_map_enabled = true;
+
+// Description:
+// A struct for the output file of a decoder, whose final size is usually known
+// up front. Instead of a file, the bytes may go to a sink function, or be decoded
+// straight into memory the caller owns.
+//
+// Members:
+// int outfile - The output file, or -1 for a sink or memory.
+// OutputMode mode - How bytes reach the file: write(), pwrite() or a shared mapping, or a sink function or memory.
+// uint64_t size - The final size of the file, or OUTPUT_UNKNOWN_SIZE.
+// uint64_t offset - Bytes committed to the file so far.
+// uint64_t advised - Bytes handed back to the kernel so far (mapped files only).
+// uint8_t *map - The mapping of the whole file, or NULL.
+// uint8_t *buffer - The write buffer, or NULL if the file is mapped.
+// uint32_t chunk - The size of the write buffer.
+// uint32_t filled - Bytes in the write buffer.
+// bool failed - Whether a write came up short, or the sink failed.
+// OutputSink sink - The function the write buffer is handed to instead of a file, or NULL.
+// OutputReserve reserve - The function that makes room in memory, or NULL.
+// void *context - What the sink or reserve function is given.
+// uint8_t *memory - The memory bytes are decoded into, or NULL.
+// uint64_t reserved - The number of bytes of memory.
+struct Output {
+	int outfile;
+	OutputMode mode;
+	uint64_t size;
+	uint64_t offset;
+	uint64_t advised;
+	uint8_t *map;
+	uint8_t *buffer;
+	uint32_t chunk;
+	uint32_t filled;
+	bool failed;
+	OutputSink sink;
+	OutputReserve reserve;
+	void *context;
+	uint8_t *memory;
+	uint64_t reserved;
+};
+
+// Description:
+// Sets whether outputs created afterwards may be memory-mapped.
+//
+// Parameters:
+// bool map - Whether to map output files.
+//
+// Returns:
+// Nothing.
+void output_configure( bool map ) {
+	output_map_enabled = map;
+}
+
+// Description:
+// Creates the output for a file of a known size, or OUTPUT_UNKNOWN_SIZE for a
+// stream that is written sequentially. A seekable output is first
+// preallocated to its final size with fallocate(), so it isn't fragmented and
+// can't run out of space halfway. It's then mapped and decoded into directly,
+// or written with large pwrite()s if it can't be mapped. Anything else, such as
+// a pipe, is written sequentially.
+//
+// Parameters:
+// int outfile - The output file, opened for reading and writing if it's to be mapped.
+// uint64_t size - The final size of the file.
+// bool seekable - Whether the file is a regular file owned by the caller, starting at offset 0.
+//
+// Returns:
+// Output * - A pointer to the newly created output, or NULL if there's no room for the file.
+Output *output_create( int outfile, uint64_t size, bool seekable ) {
+	Output *o = ( Output * ) calloc( 1, sizeof( Output ) );
+
+	if ( !o ) {
+		return NULL;
+	}
+
+	o->outfile = outfile;
+	o->size = size;
+	o->mode = OUTPUT_STREAM;
+
+	if ( seekable && size != 0 && size != OUTPUT_UNKNOWN_SIZE ) {
+		if ( fallocate( outfile, 0, 0, size ) == 0 ) {
+			int flags = fcntl( outfile, F_GETFL );
+			o->mode = OUTPUT_PWRITE;
+
+			// Direct I/O asks to bypass the page cache, which a mapping can't do.
+			if ( output_map_enabled && flags != -1 && !( flags & O_DIRECT ) ) {
+				void *map = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, outfile, 0 );
+
+				if ( map != MAP_FAILED ) {
+					madvise( map, size, MADV_SEQUENTIAL );
+					o->map = map;
+					o->mode = OUTPUT_MAP;
+				}
+			}
+		} else if ( errno == ENOSPC || errno == EFBIG ) { // The file won't fit, so don't start.
+			free( o );
+
+			return NULL;
+		} else { // Not supported by the file system: write in place without preallocating.
+			o->mode = OUTPUT_PWRITE;
+		}
+	}
+
+	if ( o->mode != OUTPUT_MAP ) {
+		o->chunk = o->mode == OUTPUT_PWRITE && io_block_size( ) < OUTPUT_CHUNK ? OUTPUT_CHUNK : io_block_size( );
+		o->buffer = io_buffer_create( o->chunk );
+
+		if ( !o->buffer ) {
+			free( o );
+			o = NULL;
+		}
+	}
+
+	return o;
+}
+
+// Description:
+// Creates an output that hands its bytes to a sink function, a buffer at a
+// time, instead of writing them to a file.
+//
+// Parameters:
+// uint64_t size - The final size of the output, or OUTPUT_UNKNOWN_SIZE.
+// OutputSink sink - The function to hand each buffer to, which returns whether it succeeded.
+// void *context - What to give the sink function with each buffer.
+//
+// Returns:
+// Output * - A pointer to the newly created output, or NULL if there wasn't enough memory.
+Output *output_create_sink( uint64_t size, OutputSink sink, void *context ) {
+	Output *o = ( Output * ) calloc( 1, sizeof( Output ) );
+
+	if ( o ) {
+		o->outfile = -1;
+		o->size = size;
+		o->mode = OUTPUT_SINK;
+		o->sink = sink;
+		o->context = context;
+		o->chunk = io_block_size( );
+		o->buffer = io_buffer_create( o->chunk );
+
+		if ( !o->buffer ) {
+			free( o );
+			o = NULL;
+		}
+	}
+
+	return o;
+}
+
+// Description:
+// Creates an output that decodes straight into memory the caller owns, such as
+// a buffer reused across requests. Memory is asked for up front if the size is
+// known, and as it's needed otherwise.
+//
+// Parameters:
+// uint64_t size - The final size of the output, or OUTPUT_UNKNOWN_SIZE.
+// OutputReserve reserve - The function that makes room for a number of bytes, and returns the memory.
+// void *context - What to give the reserve function.
+//
+// Returns:
+// Output * - A pointer to the newly created output, or NULL if there wasn't enough memory.
+Output *output_create_memory( uint64_t size, OutputReserve reserve, void *context ) {
+	Output *o = ( Output * ) calloc( 1, sizeof( Output ) );
+
+	if ( o ) {
+		o->outfile = -1;
+		o->size = size;
+		o->mode = OUTPUT_MEMORY;
+		o->reserve = reserve;
+		o->context = context;
+		o->reserved = size != OUTPUT_UNKNOWN_SIZE ? size : 1; // The reserve function may give more.
+		o->memory = reserve( context, o->reserved, &o->reserved );
+
+		if ( !o->memory ) {
+			free( o );
+			o = NULL;
+		}
+	}
+
+	return o;
+}
+
+// Description:
+// Frees the memory given to an output and unmaps its file. Doesn't close the file.
+//
+// Parameters:
+// Output **o - A pointer to a pointer to the output.
+//
+// Returns:
+// Nothing.
+void output_delete( Output **o ) {
+	if ( *o ) {
+		if ( ( *o )->map ) {
+			munmap( ( *o )->map, ( *o )->size );
+		}
+
+		io_buffer_delete( &( *o )->buffer );
+		free( *o );
+		*o = NULL;
+	}
+}
+
+// Description:
+// Writes out an output's buffer.
+//
+// Parameters:
+// Output *o - The output.
+//
+// Returns:
+// Nothing.
+static void output_flush( Output *o ) {
+	uint32_t bytes_written;
+
+	if ( o->mode == OUTPUT_SINK ) {
+		bytes_written = o->sink( o->context, o->buffer, o->filled ) ? o->filled : 0;
+	} else if ( o->mode == OUTPUT_PWRITE ) {
+		bytes_written = pwrite_bytes( o->outfile, o->buffer, o->filled, o->offset );
+	} else {
+		bytes_written = write_bytes( o->outfile, o->buffer, o->filled );
+	}
+
+	o->failed |= bytes_written != o->filled;
+
+	if ( o->mode != OUTPUT_SINK ) {
+		io_advise_written( o->outfile, o->offset, o->filled );
+	}
+
+	o->offset += o->filled;
+	o->filled = 0;
+}
+
+// Description:
+// Gets where the next bytes of an output go: straight into the mapped file, or
+// into the write buffer.
+//
+// Parameters:
+// Output *o - The output.
+// uint32_t *nbytes - The pointer to the uint32_t to set to the number of bytes that fit.
+//
+// Returns:
+// uint8_t * - Where to put the next bytes.
+uint8_t *output_window( Output *o, uint32_t *nbytes ) {
+	uint64_t remaining = o->size - o->offset - o->filled;
+
+	if ( o->mode == OUTPUT_MEMORY ) {
+		if ( o->size == OUTPUT_UNKNOWN_SIZE && o->offset == o->reserved && !o->failed ) { // Memory for a known size is reserved up front.
+			uint8_t *memory = o->reserve( o->context, o->reserved + 1, &o->reserved );
+			o->failed = !memory;
+			o->memory = memory ? memory : o->memory;
+		}
+
+		if ( o->failed ) { // Decoding carries on into memory already given, as a sink's would into its buffer.
+			*nbytes = o->reserved < OUTPUT_CHUNK ? o->reserved : OUTPUT_CHUNK;
+
+			return o->memory;
+		}
+
+		remaining = o->reserved - o->offset < remaining ? o->reserved - o->offset : remaining;
+		*nbytes = remaining < OUTPUT_CHUNK ? remaining : OUTPUT_CHUNK;
+
+		return o->memory + o->offset;
+	}
+
+	if ( o->mode == OUTPUT_MAP ) {
+		*nbytes = remaining < io_block_size( ) ? remaining : io_block_size( );
+#ifdef MADV_POPULATE_WRITE
+		madvise( o->map + o->offset / BLOCK * BLOCK, *nbytes + o->offset % BLOCK, MADV_POPULATE_WRITE ); // Fault the window in with one call.
+#endif
+
+		return o->map + o->offset;
+	}
+
+	*nbytes = remaining < o->chunk - o->filled ? remaining : o->chunk - o->filled;
+
+	return o->buffer + o->filled;
+}
+
+// Description:
+// Commits bytes put in an output's window. Mapped pages that are done with are
+// unmapped and handed to writeback, so a large file doesn't pin its whole mapping.
+//
+// Parameters:
+// Output *o - The output.
+// uint32_t nbytes - The number of bytes put in the window.
+//
+// Returns:
+// Nothing.
+void output_commit( Output *o, uint32_t nbytes ) {
+	if ( o->mode == OUTPUT_MEMORY ) {
+		o->offset += o->failed ? 0 : nbytes;
+
+		return;
+	}
+
+	if ( o->mode == OUTPUT_MAP ) {
+		o->offset += nbytes;
+		uint64_t done = o->offset == o->size ? o->size : o->offset / BLOCK * BLOCK;
+
+		if ( done > o->advised ) {
+			madvise( o->map + o->advised, done - o->advised, MADV_DONTNEED ); // Dirty pages stay in the page cache.
+			io_advise_written( o->outfile, o->advised, done - o->advised );
+			o->advised = done;
+		}
+
+		return;
+	}
+
+	o->filled += nbytes;
+
+	if ( o->filled == o->chunk || o->offset + o->filled == o->size ) {
+		output_flush( o );
+	}
+}
+
+// Description:
+// Makes room for more bytes at the end of an output, such as another file
+// concatenated after the one it was created for. The new part of a seekable
+// file is preallocated too, and a mapping is grown to cover it; if it can't be,
+// the rest is written with pwrite() instead.
+//
+// Parameters:
+// Output *o - The output, with all of its bytes so far committed.
+// uint64_t nbytes - The number of bytes to add.
+//
+// Returns:
+// bool - Whether there's room for them.
+bool output_extend( Output *o, uint64_t nbytes ) {
+	if ( nbytes == 0 || o->size == OUTPUT_UNKNOWN_SIZE ) {
+		return true;
+	}
+
+	uint64_t size = o->size + nbytes;
+
+	if ( o->mode == OUTPUT_MEMORY ) { // The reserve function may move the memory, which has no windows out.
+		uint8_t *memory = size > o->reserved ? o->reserve( o->context, size, &o->reserved ) : o->memory;
+
+		if ( !memory ) {
+			return false;
+		}
+
+		o->memory = memory;
+	}
+
+	if ( o->mode == OUTPUT_PWRITE || o->mode == OUTPUT_MAP ) {
+		if ( fallocate( o->outfile, 0, o->size, nbytes ) != 0 && ( errno == ENOSPC || errno == EFBIG ) ) {
+			return false;
+		}
+	}
+
+	if ( o->mode == OUTPUT_MAP ) {
+		void *map = mremap( o->map, o->size, size, MREMAP_MAYMOVE );
+
+		if ( map != MAP_FAILED ) {
+			madvise( ( uint8_t * ) map + o->size, nbytes, MADV_SEQUENTIAL );
+			o->map = map;
+		} else if ( ( o->buffer = io_buffer_create( OUTPUT_CHUNK ) ) ) {
+			munmap( o->map, o->size );
+			o->map = NULL;
+			o->chunk = OUTPUT_CHUNK;
+			o->mode = OUTPUT_PWRITE;
+		} else {
+			return false;
+		}
+	}
+
+	o->size = size;
+
+	return true;
+}
+
+// Description:
+// Writes out the bytes in an output's buffer now, instead of when it fills, so
+// they reach a pipe without waiting for more.
+//
+// Parameters:
+// Output *o - The output.
+//
+// Returns:
+// Nothing.
+void output_sync( Output *o ) {
+	if ( o->filled != 0 ) {
+		output_flush( o );
+	}
+}
+
+// Description:
+// Writes out what's left in an output's buffer.
+//
+// Parameters:
+// Output *o - The output.
+//
+// Returns:
+// bool - Whether every byte of the file was written.
+bool output_finish( Output *o ) {
+	output_sync( o );
+
+	return !o->failed && ( o->offset == o->size || o->size == OUTPUT_UNKNOWN_SIZE );
+}
@@ -0,0 +1,35 @@
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define OUTPUT_UNKNOWN_SIZE UINT64_MAX // Size of an output whose length isn't known until the end, such as a stream's.
+
+typedef struct Output Output;
+
+typedef bool ( *OutputSink )( void *context, uint8_t *data, uint32_t nbytes );
+
+typedef uint8_t *( *OutputReserve )( void *context, uint64_t nbytes, uint64_t *reserved );
+
+void output_configure( bool map );
+
+Output *output_create( int outfile, uint64_t size, bool seekable );
+
+Output *output_create_sink( uint64_t size, OutputSink sink, void *context );
+
+Output *output_create_memory( uint64_t size, OutputReserve reserve, void *context );
+
+void output_delete( Output **o );
+
+uint8_t *output_window( Output *o, uint32_t *nbytes );
+
+void output_commit( Output *o, uint32_t nbytes );
+
+bool output_extend( Output *o, uint64_t nbytes );
+
+void output_sync( Output *o );
+
+bool output_finish( Output *o );
+
+#endif
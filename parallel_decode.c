@@ -0,0 +1,375 @@
+#include "parallel_decode.h"
+
+#include "decode_table.h"
+#include "defines.h"
+#include "io.h"
+#include "kernels.h"
+#include "output.h"
+#include "thread_pool.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEGMENTS_PER_THREAD 4 // Segments decoded per thread between two stitches.
+#define SYNC_BOUNDARIES     1024 // Code boundaries kept from the start of each segment.
+#define REDO_CHUNK          256 // Symbols buffered while redoing an unsynchronized prefix.
+
+typedef struct ParallelDecoder ParallelDecoder;
+
+// Description:
+// A struct for one segment of the code section, decoded from a guessed start.
+//
+// Members:
+// ParallelDecoder *decoder - The decoder the segment belongs to.
+// uint64_t start - Bit in the round buffer the segment starts at, not necessarily a code boundary.
+// uint64_t end - Bit the next segment starts at. Decoding stops at the first code boundary past it.
+// uint64_t limit - Bit the input ends at, for the decode kernel.
+// bool last - Whether the segment is the last of the code section.
+// uint8_t *symbols - The symbols decoded from the segment.
+// uint32_t nsymbols - Number of symbols decoded.
+// uint64_t boundaries[SYNC_BOUNDARIES] - Bits the first symbols started at.
+// uint32_t nboundaries - Number of boundaries kept.
+// uint64_t stop - Bit after the last symbol decoded.
+// bool corrupt - Whether decoding hit an invalid code.
+typedef struct DecodeSegment {
+	ParallelDecoder *decoder;
+	uint64_t start;
+	uint64_t end;
+	uint64_t limit;
+	bool last;
+	uint8_t *symbols;
+	uint32_t nsymbols;
+	uint64_t boundaries[ SYNC_BOUNDARIES ];
+	uint32_t nboundaries;
+	uint64_t stop;
+	bool corrupt;
+} DecodeSegment;
+
+// Description:
+// A struct for decoding a single code stream on a thread pool. The code section
+// is split into segments at arbitrary bits, and every segment is decoded as if a
+// code started there. Huffman codes resynchronize within a few symbols, so the
+// guessed parse soon runs into a boundary of the true one, and only the prefix
+// before that point has to be decoded again once the true boundary is known.
+//
+// Members:
+// int infile - The input file. Must be seekable.
+// uint64_t code_offset - Offset of the code section in the input file.
+// uint64_t code_size - Size of the code section in bytes.
+// DecodeTable *table - The decode table.
+// ThreadPool *pool - The thread pool.
+// uint32_t nsegments - Number of segments decoded per round.
+// DecodeSegment *segments - The segments of a round.
+// uint8_t *buffer - The codes of a round.
+struct ParallelDecoder {
+	int infile;
+	uint64_t code_offset;
+	uint64_t code_size;
+	DecodeTable *table;
+	ThreadPool *pool;
+	uint32_t nsegments;
+	DecodeSegment *segments;
+	uint8_t *buffer;
+};
+
+// Description:
+// Creates a parallel decoder for the code section of a file.
+//
+// Parameters:
+// int infile - The input file. Must be seekable.
+// uint64_t code_offset - Offset of the code section in the input file.
+// uint64_t code_size - Size of the code section in bytes, up to the end of the file.
+// DecodeTable *table - The decode table of the file's tree.
+// uint32_t threads - The number of worker threads.
+//
+// Returns:
+// ParallelDecoder * - A pointer to the newly created parallel decoder.
+ParallelDecoder *parallel_decoder_create( int infile, uint64_t code_offset, uint64_t code_size, DecodeTable *table, uint32_t threads ) {
+	ParallelDecoder *d = ( ParallelDecoder * ) calloc( 1, sizeof( ParallelDecoder ) );
+
+	if ( !d ) {
+		return NULL;
+	}
+
+	d->infile = infile;
+	d->code_offset = code_offset;
+	d->code_size = code_size;
+	d->table = table;
+	d->pool = thread_pool_create( threads );
+	d->nsegments = SEGMENTS_PER_THREAD * threads;
+	d->segments = ( DecodeSegment * ) calloc( d->nsegments, sizeof( DecodeSegment ) );
+	d->buffer = io_buffer_create( d->nsegments * PARALLEL_SEGMENT + WINDOW_MARGIN );
+
+	if ( !d->pool || !d->segments || !d->buffer ) {
+		parallel_decoder_delete( &d );
+
+		return NULL;
+	}
+
+	for ( uint32_t i = 0; i < d->nsegments; i++ ) {
+		d->segments[ i ].decoder = d;
+
+		if ( !( d->segments[ i ].symbols = ( uint8_t * ) malloc( 8 * PARALLEL_SEGMENT ) ) ) { // At least a bit per symbol.
+			parallel_decoder_delete( &d );
+
+			return NULL;
+		}
+	}
+
+	return d;
+}
+
+// Description:
+// Frees the memory given to a parallel decoder and stops its threads. Doesn't
+// delete the decode table.
+//
+// Parameters:
+// ParallelDecoder **d - A pointer to a pointer to the parallel decoder.
+//
+// Returns:
+// Nothing.
+void parallel_decoder_delete( ParallelDecoder **d ) {
+	if ( *d ) {
+		thread_pool_delete( &( *d )->pool );
+
+		for ( uint32_t i = 0; ( *d )->segments && i < ( *d )->nsegments; i++ ) {
+			free( ( *d )->segments[ i ].symbols );
+		}
+
+		free( ( *d )->segments );
+		io_buffer_delete( &( *d )->buffer );
+		free( *d );
+		*d = NULL;
+	}
+}
+
+// Description:
+// Sets up a bit window onto a segment's codes in the round buffer. Except in the
+// last segment, the window reaches WINDOW_MARGIN past the segment's end, so the
+// kernel stops at the first code boundary past the end.
+//
+// Parameters:
+// DecodeSegment *s - The segment.
+// uint64_t top - The bit to start decoding at.
+// BitWindow *w - The bit window to set.
+//
+// Returns:
+// Nothing.
+static void segment_window( DecodeSegment *s, uint64_t top, BitWindow *w ) {
+	w->data = s->decoder->buffer;
+	w->top = top;
+	w->limit = s->limit;
+	w->last = s->last;
+}
+
+// Description:
+// Decodes a segment from a bit, keeping where its first SYNC_BOUNDARIES symbols
+// start. Runs on a worker thread with the segment's start, which is a guess, and
+// on the stitching thread with a true boundary if the guess never synchronized.
+//
+// Parameters:
+// DecodeSegment *s - The segment.
+// uint64_t start - The bit to start decoding at.
+//
+// Returns:
+// Nothing.
+static void decode_segment( DecodeSegment *s, uint64_t start ) {
+	DecodeTable *table = s->decoder->table;
+	BitWindow w;
+	segment_window( s, start, &w );
+	s->nsymbols = 0;
+	s->nboundaries = 0;
+	s->corrupt = false;
+
+	while ( s->nboundaries < SYNC_BOUNDARIES && !s->corrupt ) {
+		uint64_t top = w.top;
+
+		if ( decode_symbols( table, &w, s->symbols + s->nsymbols, 1, &s->corrupt ) == 0 ) {
+			break;
+		}
+
+		s->boundaries[ s->nboundaries++ ] = top;
+		s->nsymbols++;
+	}
+
+	if ( s->nboundaries == SYNC_BOUNDARIES && !s->corrupt ) {
+		s->nsymbols += decode_symbols( table, &w, s->symbols + s->nsymbols, 8 * PARALLEL_SEGMENT - s->nsymbols, &s->corrupt );
+	}
+
+	s->stop = w.top;
+}
+
+// Description:
+// Decodes a segment from its guessed start, on a worker thread.
+//
+// Parameters:
+// void *arg - The DecodeSegment.
+//
+// Returns:
+// Nothing.
+static void decode_segment_task( void *arg ) {
+	DecodeSegment *s = ( DecodeSegment * ) arg;
+	decode_segment( s, s->start );
+}
+
+// Description:
+// Copies decoded symbols to the output.
+//
+// Parameters:
+// Output *output - The output.
+// uint8_t *symbols - The symbols.
+// uint64_t nsymbols - The number of symbols.
+//
+// Returns:
+// Nothing.
+static void emit_symbols( Output *output, uint8_t *symbols, uint64_t nsymbols ) {
+	while ( nsymbols != 0 ) {
+		uint32_t room = 0;
+		uint8_t *window = output_window( output, &room );
+		uint32_t n = nsymbols < room ? nsymbols : room;
+		memcpy( window, symbols, n );
+		output_commit( output, n );
+		symbols += n;
+		nsymbols -= n;
+	}
+}
+
+// Description:
+// Joins a segment onto the true parse. From the true boundary where the previous
+// segment stopped, symbols are decoded one at a time until they land on one of the
+// segment's kept boundaries; the segment's symbols from there on are then correct.
+// If they never do, the whole segment is decoded again from the true boundary.
+//
+// Parameters:
+// DecodeSegment *s - The segment, decoded from its guessed start.
+// Output *output - The output.
+// uint64_t *position - The true boundary the segment starts at, set to where it ends.
+// uint64_t *remaining - The symbols still to decode, decreased by those written.
+//
+// Returns:
+// bool - Whether the codes were valid.
+static bool stitch_segment( DecodeSegment *s, Output *output, uint64_t *position, uint64_t *remaining ) {
+	uint8_t redo[ REDO_CHUNK ];
+	uint32_t nredo = 0;
+	uint32_t k = 0;
+	bool corrupt = false;
+
+	while ( *remaining > nredo ) {
+		while ( k < s->nboundaries && s->boundaries[ k ] < *position ) {
+			k++;
+		}
+
+		if ( k < s->nboundaries && s->boundaries[ k ] == *position ) { // Synchronized.
+			break;
+		}
+
+		if ( k == s->nboundaries ) { // Never synchronized, or not within the kept boundaries.
+			emit_symbols( output, redo, nredo );
+			*remaining -= nredo;
+			nredo = 0;
+			decode_segment( s, *position );
+			k = 0;
+			break;
+		}
+
+		BitWindow w;
+		segment_window( s, *position, &w );
+
+		if ( decode_symbols( s->decoder->table, &w, redo + nredo, 1, &corrupt ) == 0 || corrupt ) {
+			return false;
+		}
+
+		*position = w.top;
+
+		if ( ++nredo == REDO_CHUNK ) {
+			emit_symbols( output, redo, nredo );
+			*remaining -= nredo;
+			nredo = 0;
+		}
+	}
+
+	emit_symbols( output, redo, nredo );
+	*remaining -= nredo;
+
+	if ( *remaining == 0 ) {
+		return true;
+	}
+
+	uint64_t available = k < s->nsymbols ? s->nsymbols - k : 0;
+	uint64_t n = available < *remaining ? available : *remaining;
+	emit_symbols( output, s->symbols + k, n );
+	*remaining -= n;
+
+	if ( n == available ) {
+		*position = s->stop;
+	} else { // Only where the segment started is kept, so the last symbols are decoded again to find where they end.
+		BitWindow w;
+		segment_window( s, *position, &w );
+		decode_symbols( s->decoder->table, &w, s->symbols + k, n, &corrupt );
+		*position = w.top;
+	}
+
+	// Past the synchronization point the parse is the true one, so an invalid code is real.
+	return *remaining == 0 || !s->corrupt;
+}
+
+// Description:
+// Decodes a code stream of a known number of symbols to an output, a round of
+// segments at a time: the segments are decoded in parallel from guessed starts,
+// then stitched onto the true parse in order.
+//
+// Parameters:
+// ParallelDecoder *d - The parallel decoder.
+// Output *output - The output.
+// uint64_t nsymbols - The number of symbols to decode.
+// uint64_t *nbits - The pointer to the uint64_t to set to the number of bits the symbols took.
+//
+// Returns:
+// bool - Whether every symbol was decoded.
+bool parallel_decoder_decode( ParallelDecoder *d, Output *output, uint64_t nsymbols, uint64_t *nbits ) {
+	uint64_t position = 0; // True boundary, in bits from the start of the code section.
+	uint64_t remaining = nsymbols;
+	uint64_t round_start = 0; // Byte of the code section the round buffer starts at.
+	bool valid = true;
+
+	while ( valid && remaining != 0 && round_start < d->code_size ) {
+		uint64_t round_size = d->code_size - round_start;
+		round_size = round_size < ( uint64_t ) d->nsegments * PARALLEL_SEGMENT ? round_size : ( uint64_t ) d->nsegments * PARALLEL_SEGMENT;
+		uint64_t wanted = round_size + WINDOW_MARGIN < d->code_size - round_start ? round_size + WINDOW_MARGIN : d->code_size - round_start;
+		uint32_t bytes_read = pread_bytes( d->infile, d->buffer, wanted, d->code_offset + round_start );
+
+		if ( bytes_read != wanted ) {
+			valid = false;
+			break;
+		}
+
+		memset( d->buffer + bytes_read, 0, d->nsegments * PARALLEL_SEGMENT + WINDOW_MARGIN - bytes_read );
+		uint32_t count = ( round_size + PARALLEL_SEGMENT - 1 ) / PARALLEL_SEGMENT;
+
+		for ( uint32_t i = 0; i < count; i++ ) {
+			DecodeSegment *s = &d->segments[ i ];
+			s->start = 8 * ( uint64_t ) i * PARALLEL_SEGMENT;
+			s->last = round_start + round_size == d->code_size && i == count - 1;
+			s->end = s->last ? 8 * round_size : s->start + 8 * PARALLEL_SEGMENT;
+			s->limit = s->last ? s->end : s->end + 8 * WINDOW_MARGIN;
+			thread_pool_submit( d->pool, decode_segment_task, s );
+		}
+
+		thread_pool_wait( d->pool );
+
+		for ( uint32_t i = 0; valid && remaining != 0 && i < count; i++ ) {
+			uint64_t relative = position - 8 * round_start;
+			valid = stitch_segment( &d->segments[ i ], output, &relative, &remaining );
+			position = relative + 8 * round_start;
+		}
+
+		io_advise_consumed( d->infile, d->code_offset + round_start, round_size );
+		round_start += round_size;
+	}
+
+	*nbits = position;
+
+	return valid && remaining == 0;
+}
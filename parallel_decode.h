@@ -0,0 +1,21 @@
+#ifndef __PARALLEL_DECODE_H__
+#define __PARALLEL_DECODE_H__
+
+#include "decode_table.h"
+#include "defines.h"
+#include "output.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PARALLEL_SEGMENT ( 64 * BLOCK ) // 256KB of codes per task.
+
+typedef struct ParallelDecoder ParallelDecoder;
+
+ParallelDecoder *parallel_decoder_create( int infile, uint64_t code_offset, uint64_t code_size, DecodeTable *table, uint32_t threads );
+
+void parallel_decoder_delete( ParallelDecoder **d );
+
+bool parallel_decoder_decode( ParallelDecoder *d, Output *output, uint64_t nsymbols, uint64_t *nbits );
+
+#endif
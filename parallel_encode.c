@@ -0,0 +1,311 @@
+#include "parallel_encode.h"
+
+#include "code.h"
+#include "defines.h"
+#include "io.h"
+#include "kernels.h"
+#include "thread_pool.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_CHUNK_BITS 16 // Chunks shorter than this could share a byte with both neighbours.
+
+typedef struct ParallelEncoder ParallelEncoder;
+
+// Description:
+// A struct for one chunk of the input of a parallel encode.
+//
+// Members:
+// ParallelEncoder *encoder - The encoder the chunk belongs to.
+// uint64_t offset - Offset of the chunk in the input file.
+// uint32_t length - Number of bytes in the chunk.
+// uint64_t histogram[ALPHABET] - The histogram of the chunk.
+// uint64_t bits - Number of bits the chunk encodes to.
+// uint64_t bit_offset - Offset of the chunk's codes in the code section, in bits.
+// uint8_t head - The chunk's bits in the byte it shares with the previous chunk.
+// uint8_t tail - The chunk's bits in the byte it shares with the next chunk.
+// bool ok - Whether the chunk was processed successfully.
+typedef struct EncodeChunk {
+	ParallelEncoder *encoder;
+	uint64_t offset;
+	uint32_t length;
+	uint64_t histogram[ ALPHABET ];
+	uint64_t bits;
+	uint64_t bit_offset;
+	uint8_t head;
+	uint8_t tail;
+	bool ok;
+} EncodeChunk;
+
+// Description:
+// A struct for encoding a file in chunks on a thread pool, producing exactly the
+// single code stream a serial encode would.
+//
+// Members:
+// int infile - The input file. Must be seekable.
+// int outfile - The output file. Must be seekable.
+// uint64_t size - The size of the input file.
+// PackedCodes *codes - The codes to encode with, once planned.
+// uint64_t output_offset - Offset of the code section in the output file.
+// uint64_t total_bits - Number of bits in the code section.
+// ThreadPool *pool - The thread pool.
+// uint32_t nchunks - Number of chunks.
+// EncodeChunk *chunks - The chunks.
+struct ParallelEncoder {
+	int infile;
+	int outfile;
+	uint64_t size;
+	PackedCodes *codes;
+	uint64_t output_offset;
+	uint64_t total_bits;
+	ThreadPool *pool;
+	uint32_t nchunks;
+	EncodeChunk *chunks;
+};
+
+// Description:
+// Creates a parallel encoder for a file, splitting it into PARALLEL_CHUNK chunks.
+//
+// Parameters:
+// int infile - The input file. Must be seekable.
+// int outfile - The output file. Must be seekable and not opened for appending.
+// uint64_t size - The size of the input file.
+// uint32_t threads - The number of worker threads.
+//
+// Returns:
+// ParallelEncoder * - A pointer to the newly created parallel encoder.
+ParallelEncoder *parallel_encoder_create( int infile, int outfile, uint64_t size, uint32_t threads ) {
+	ParallelEncoder *e = ( ParallelEncoder * ) calloc( 1, sizeof( ParallelEncoder ) );
+
+	if ( !e ) {
+		return NULL;
+	}
+
+	e->infile = infile;
+	e->outfile = outfile;
+	e->size = size;
+	e->nchunks = ( size + PARALLEL_CHUNK - 1 ) / PARALLEL_CHUNK;
+	e->chunks = ( EncodeChunk * ) calloc( e->nchunks, sizeof( EncodeChunk ) );
+	e->pool = thread_pool_create( threads );
+
+	if ( !e->chunks || !e->pool ) {
+		parallel_encoder_delete( &e );
+
+		return NULL;
+	}
+
+	for ( uint32_t i = 0; i < e->nchunks; i++ ) {
+		e->chunks[ i ].encoder = e;
+		e->chunks[ i ].offset = ( uint64_t ) i * PARALLEL_CHUNK;
+		e->chunks[ i ].length = size - e->chunks[ i ].offset < PARALLEL_CHUNK ? size - e->chunks[ i ].offset : PARALLEL_CHUNK;
+	}
+
+	return e;
+}
+
+// Description:
+// Frees the memory given to a parallel encoder and stops its threads.
+//
+// Parameters:
+// ParallelEncoder **e - A pointer to a pointer to the parallel encoder.
+//
+// Returns:
+// Nothing.
+void parallel_encoder_delete( ParallelEncoder **e ) {
+	if ( *e ) {
+		thread_pool_delete( &( *e )->pool );
+		free( ( *e )->chunks );
+		free( *e );
+		*e = NULL;
+	}
+}
+
+// Description:
+// Counts the bytes of one chunk, on a worker thread.
+//
+// Parameters:
+// void *arg - The EncodeChunk.
+//
+// Returns:
+// Nothing.
+static void parallel_histogram_chunk( void *arg ) {
+	EncodeChunk *c = ( EncodeChunk * ) arg;
+	uint32_t block_size = io_block_size( );
+	uint8_t *read_buffer = io_buffer_create( block_size );
+	uint32_t done = 0;
+	uint32_t bytes_read = 0;
+
+	while ( read_buffer && done < c->length ) {
+		uint32_t wanted = c->length - done < block_size ? c->length - done : block_size;
+
+		if ( ( bytes_read = pread_bytes( c->encoder->infile, read_buffer, wanted, c->offset + done ) ) == 0 ) {
+			break;
+		}
+
+		histogram_update( c->histogram, read_buffer, bytes_read );
+		done += bytes_read;
+	}
+
+	c->ok = done == c->length;
+	io_buffer_delete( &read_buffer );
+}
+
+// Description:
+// Builds the histogram of the whole file, a chunk per task.
+//
+// Parameters:
+// ParallelEncoder *e - The parallel encoder.
+// uint64_t histogram[static ALPHABET] - The histogram to add to.
+//
+// Returns:
+// Nothing.
+void parallel_encoder_histogram( ParallelEncoder *e, uint64_t histogram[ static ALPHABET ] ) {
+	for ( uint32_t i = 0; i < e->nchunks; i++ ) {
+		thread_pool_submit( e->pool, parallel_histogram_chunk, &e->chunks[ i ] );
+	}
+
+	thread_pool_wait( e->pool );
+
+	for ( uint32_t i = 0; i < e->nchunks; i++ ) {
+		for ( uint32_t symbol = 0; symbol < ALPHABET; symbol++ ) {
+			histogram[ symbol ] += e->chunks[ i ].histogram[ symbol ];
+		}
+	}
+}
+
+// Description:
+// Works out where each chunk's codes go in the code section: the bit length of a
+// chunk is its histogram times the code lengths, and a prefix sum of the lengths
+// gives each chunk's bit offset.
+//
+// Parameters:
+// ParallelEncoder *e - The parallel encoder, after parallel_encoder_histogram().
+// PackedCodes *codes - The codes to encode with.
+//
+// Returns:
+// bool - Whether the chunks can be encoded in parallel: every code fits the encode
+// kernel, and every chunk is long enough to share bytes with its neighbours only.
+bool parallel_encoder_plan( ParallelEncoder *e, PackedCodes *codes ) {
+	if ( codes->max_length > MAX_PACKED_CODE ) {
+		return false;
+	}
+
+	e->codes = codes;
+	e->total_bits = 0;
+
+	for ( uint32_t i = 0; i < e->nchunks; i++ ) {
+		EncodeChunk *c = &e->chunks[ i ];
+
+		if ( !c->ok ) { // Couldn't be read the first time.
+			return false;
+		}
+
+		c->bits = 0;
+
+		for ( uint32_t symbol = 0; symbol < ALPHABET; symbol++ ) {
+			c->bits += c->histogram[ symbol ] * codes->length[ symbol ];
+		}
+
+		if ( c->bits < MIN_CHUNK_BITS ) {
+			return false;
+		}
+
+		c->bit_offset = e->total_bits;
+		e->total_bits += c->bits;
+	}
+
+	return true;
+}
+
+// Description:
+// Encodes one chunk on a worker thread. The bit accumulator starts with as many
+// empty bits as the previous chunk uses of the first byte, so every byte lands at
+// the same place as in a serial encode. Whole bytes are written straight to the
+// output file, and the partial first and last bytes are kept for stitching.
+//
+// Parameters:
+// void *arg - The EncodeChunk.
+//
+// Returns:
+// Nothing.
+static void parallel_encode_chunk( void *arg ) {
+	EncodeChunk *c = ( EncodeChunk * ) arg;
+	ParallelEncoder *e = c->encoder;
+	uint32_t block_size = io_block_size( );
+	uint8_t *read_buffer = io_buffer_create( block_size );
+	uint8_t *write_buffer = io_buffer_create( block_size * ( MAX_PACKED_CODE / 8 ) + 8 );
+	uint64_t bits = 0;
+	uint32_t count = c->bit_offset % 8;
+	uint64_t position = c->bit_offset / 8; // Byte of the code section that write_buffer starts at.
+	bool shared_head = count != 0;
+	uint32_t done = 0;
+	c->ok = read_buffer && write_buffer;
+
+	while ( c->ok && done < c->length ) {
+		uint32_t wanted = c->length - done < block_size ? c->length - done : block_size;
+		uint32_t bytes_read = pread_bytes( e->infile, read_buffer, wanted, c->offset + done );
+		uint32_t nbytes = encode_symbols( e->codes, read_buffer, bytes_read, write_buffer, &bits, &count );
+		uint8_t *start = write_buffer;
+
+		if ( shared_head && nbytes != 0 ) {
+			c->head = *start++;
+			nbytes--;
+			position++;
+			shared_head = false;
+		}
+
+		c->ok = bytes_read == wanted && pwrite_bytes( e->outfile, start, nbytes, e->output_offset + position ) == nbytes;
+		position += nbytes;
+		done += bytes_read;
+	}
+
+	c->tail = bits;
+	c->ok = c->ok && position * 8 + count == c->bit_offset + c->bits; // The input changed since it was counted.
+	io_advise_consumed( e->infile, c->offset, c->length );
+	io_buffer_delete( &read_buffer );
+	io_buffer_delete( &write_buffer );
+}
+
+// Description:
+// Encodes every chunk in parallel into the code section of the output file, then
+// writes the bytes shared by neighbouring chunks.
+//
+// Parameters:
+// ParallelEncoder *e - The parallel encoder, after parallel_encoder_plan().
+// uint64_t output_offset - Offset of the code section in the output file.
+// uint64_t *nbytes - The pointer to the uint64_t to set to the size of the code section.
+//
+// Returns:
+// bool - Whether every chunk was encoded and written.
+bool parallel_encoder_encode( ParallelEncoder *e, uint64_t output_offset, uint64_t *nbytes ) {
+	e->output_offset = output_offset;
+
+	for ( uint32_t i = 0; i < e->nchunks; i++ ) {
+		thread_pool_submit( e->pool, parallel_encode_chunk, &e->chunks[ i ] );
+	}
+
+	thread_pool_wait( e->pool );
+	bool ok = true;
+
+	for ( uint32_t i = 0; i < e->nchunks; i++ ) {
+		EncodeChunk *c = &e->chunks[ i ];
+		ok = ok && c->ok;
+
+		if ( i != 0 && c->bit_offset % 8 != 0 ) { // Byte split with the previous chunk.
+			uint8_t shared = e->chunks[ i - 1 ].tail | c->head;
+			ok = ok && pwrite_bytes( e->outfile, &shared, 1, output_offset + c->bit_offset / 8 ) == 1;
+		}
+	}
+
+	if ( e->total_bits % 8 != 0 ) { // Last byte, padded with zeros.
+		uint8_t last = e->chunks[ e->nchunks - 1 ].tail;
+		ok = ok && pwrite_bytes( e->outfile, &last, 1, output_offset + e->total_bits / 8 ) == 1;
+	}
+
+	*nbytes = ( e->total_bits + 7 ) / 8;
+
+	return ok;
+}
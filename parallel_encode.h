@@ -0,0 +1,24 @@
+#ifndef __PARALLEL_ENCODE_H__
+#define __PARALLEL_ENCODE_H__
+
+#include "code.h"
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PARALLEL_CHUNK ( 1024 * BLOCK ) // 4MB of input per task.
+
+typedef struct ParallelEncoder ParallelEncoder;
+
+ParallelEncoder *parallel_encoder_create( int infile, int outfile, uint64_t size, uint32_t threads );
+
+void parallel_encoder_delete( ParallelEncoder **e );
+
+void parallel_encoder_histogram( ParallelEncoder *e, uint64_t histogram[ static ALPHABET ] );
+
+bool parallel_encoder_plan( ParallelEncoder *e, PackedCodes *codes );
+
+bool parallel_encoder_encode( ParallelEncoder *e, uint64_t output_offset, uint64_t *nbytes );
+
+#endif
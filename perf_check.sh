@@ -0,0 +1,146 @@
+#!/bin/sh
+# Runs a fixed set of encode and decode benchmarks and compares the median
+# throughput of each against a baseline file, then prints the compression
+# ratio of each --lz level.
+#
+# Usage: perf_check.sh [-u] baseline
+#   -u  Writes the measured medians to the baseline file instead of checking.
+#
+# Environment:
+#   PERF_RUNS       Runs per case (default: 5).
+#   PERF_SIZE       Size of each input in MiB (default: 32).
+#   PERF_TOLERANCE  Allowed slowdown in percent before a case fails (default: 10).
+
+RUNS=${PERF_RUNS:-5}
+SIZE=${PERF_SIZE:-32}
+TOLERANCE=${PERF_TOLERANCE:-10}
+UPDATE=0
+
+if [ "$1" = "-u" ]; then
+	UPDATE=1
+	shift
+fi
+
+BASELINE=$1
+
+if [ -z "$BASELINE" ] || [ ! -x ./huffman_encode ] || [ ! -x ./huffman_decode ]; then
+	echo "Usage: $0 [-u] baseline (run from the build directory)" >&2
+	exit 2
+fi
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/huffman-perf.XXXXXX") || exit 2
+trap 'rm -rf "$WORK"' EXIT
+
+# English-like text with a skewed word distribution, the same on every run.
+awk -v bytes=$((SIZE * 1048576)) 'BEGIN {
+	srand( 1 );
+	split( "the of and to a in is it that was for on are with as his they be at one have this from or had by word but what some we can out other were all there when up use your how said an each she which do their time if will way about many then them write would like so these her long make thing see him two has look more day could go come did number sound no most people my over know water than call first who may down side been now find", words, " " );
+	for ( n = 0; n < bytes; ) {
+		w = words[ int( 1 + length( words ) * rand( ) * rand( ) ) ];
+		line = line w ( rand( ) < 0.1 ? ".\n" : " " );
+		if ( length( line ) > 4096 ) { printf "%s", line; n += length( line ); line = "" }
+	}
+}' | head -c $((SIZE * 1048576)) > "$WORK/text"
+head -c $((SIZE * 1048576)) /dev/urandom > "$WORK/random" # Incompressible: throughput doesn't depend on the exact bytes.
+
+for input in text random; do
+	./huffman_encode -i "$WORK/$input" -o "$WORK/$input.huff" || exit 2
+done
+
+./huffman_encode --ans -i "$WORK/text" -o "$WORK/text.ans" || exit 2 # Random input gets near-flat 8-bit codes from either backend, so only text compares them.
+
+RATIOS="$WORK/ratios"
+LZ_LEVELS="1 2 3 4 5"
+
+for level in $LZ_LEVELS; do
+	./huffman_encode --lz $level -i "$WORK/text" -o "$WORK/text.lz$level" || exit 2
+	echo "lz$level-text $(wc -c < "$WORK/text") $(wc -c < "$WORK/text.lz$level")" >> "$RATIOS"
+done
+
+# Prints the median throughput of a command in MB/s of uncompressed data, or
+# nothing if the command fails.
+measure() {
+	bytes=$1
+	shift
+
+	for run in $(seq "$RUNS"); do
+		start=$(date +%s%N)
+		"$@" || return
+		end=$(date +%s%N)
+		echo "$bytes $start $end"
+	done | awk '{ print $1 / ( ( $3 - $2 ) / 1e9 ) / 1e6 }' | sort -n | awk '{ v[ NR ] = $1 } END { if ( NR == '"$RUNS"' ) printf "%.1f\n", NR % 2 ? v[ ( NR + 1 ) / 2 ] : ( v[ NR / 2 ] + v[ NR / 2 + 1 ] ) / 2 }'
+}
+
+RESULTS="$WORK/results"
+
+for input in text random; do
+	bytes=$(wc -c < "$WORK/$input")
+
+	programs="encode decode"
+
+	if [ $input = text ]; then
+		programs="$programs encode-ans decode-ans"
+
+		for level in $LZ_LEVELS; do
+			programs="$programs encode-lz$level decode-lz$level"
+		done
+	fi
+
+	for program in $programs; do
+		case $program in
+			encode) median=$(measure "$bytes" ./huffman_encode -i "$WORK/$input" -o "$WORK/out") ;;
+			decode) median=$(measure "$bytes" ./huffman_decode -i "$WORK/$input.huff" -o "$WORK/out") ;;
+			encode-ans) median=$(measure "$bytes" ./huffman_encode --ans -i "$WORK/$input" -o "$WORK/out") ;;
+			decode-ans) median=$(measure "$bytes" ./huffman_decode -i "$WORK/$input.ans" -o "$WORK/out") ;;
+			encode-lz*) median=$(measure "$bytes" ./huffman_encode --lz "${program#encode-lz}" -i "$WORK/$input" -o "$WORK/out") ;;
+			decode-lz*) median=$(measure "$bytes" ./huffman_decode -i "$WORK/$input.${program#decode-}" -o "$WORK/out") ;;
+		esac
+
+		if [ -z "$median" ]; then
+			echo "Error: $program-$input failed." >&2
+			exit 2
+		fi
+
+		echo "$program-$input $median" >> "$RESULTS"
+	done
+done
+
+# Prints the compression ratio of each --lz level, which doesn't depend on the
+# machine and so isn't kept in the baseline.
+print_ratios() {
+	awk 'NR == 1 { printf "%-16s %8s\n", "Case", "Ratio" } { printf "%-16s %8.2f\n", $1, $2 / $3 }' "$RATIOS"
+}
+
+if [ $UPDATE = 1 ]; then
+	{
+		echo "# Median throughput in MB/s of uncompressed data, written by perf_check.sh -u."
+		echo "# Machine: $(uname -m), $(getconf _NPROCESSORS_ONLN) CPUs; input size: $SIZE MiB; runs: $RUNS."
+		cat "$RESULTS"
+	} > "$BASELINE"
+	cat "$RESULTS"
+	print_ratios
+	exit 0
+fi
+
+if [ ! -r "$BASELINE" ]; then
+	echo "Error: can't read baseline $BASELINE (create it with $0 -u)." >&2
+	exit 2
+fi
+
+awk -v tolerance="$TOLERANCE" '
+	FNR == NR { if ( $0 !~ /^#/ && NF == 2 ) baseline[ $1 ] = $2; next }
+	FNR == 1 { printf "%-16s %14s %14s %9s\n", "Case", "Baseline MB/s", "Median MB/s", "Change" }
+	{
+		if ( !( $1 in baseline ) ) { printf "%-16s %14s %14.1f %9s\n", $1, "-", $2, "new"; next }
+		change = 100 * ( $2 - baseline[ $1 ] ) / baseline[ $1 ]
+		regressed = change < -tolerance
+		failures += regressed
+		printf "%-16s %14.1f %14.1f %+8.1f%%%s\n", $1, baseline[ $1 ], $2, change, regressed ? "  REGRESSION" : ""
+	}
+	END {
+		if ( failures ) { printf "%d case(s) slower than the baseline by more than %s%%.\n", failures, tolerance; exit 1 }
+		printf "No regressions beyond %s%%.\n", tolerance
+	}' "$BASELINE" "$RESULTS"
+status=$?
+print_ratios
+exit $status
@@ -0,0 +1,285 @@
+#include "protocol.h"
+
+#include "io.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define REQUEST_FRAME_SIZE  20 // Magic number, type, flags, 2 reserved bytes, dictionary ID and payload size.
+#define RESPONSE_FRAME_SIZE 16 // Magic number, status and payload size.
+#define LISTEN_BACKLOG      64 // Connections the kernel queues before accept().
+
+// Description:
+// Fills in the address of a Unix domain socket.
+//
+// Parameters:
+// char *path - The path of the socket.
+// struct sockaddr_un *address - The address to fill in.
+//
+// Returns:
+// bool - Whether the path fits in the address.
+static bool socket_address( char *path, struct sockaddr_un *address ) {
+	memset( address, 0, sizeof( *address ) );
+	address->sun_family = AF_UNIX;
+
+	if ( strlen( path ) >= sizeof( address->sun_path ) ) {
+		return false;
+	}
+
+	strcpy( address->sun_path, path );
+
+	return true;
+}
+
+// Description:
+// Builds the default socket path, in the user's runtime directory so other users
+// can't take it over or have it removed.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// char * - The path, to be freed by the caller, or NULL if $XDG_RUNTIME_DIR isn't set.
+char *protocol_default_path( ) {
+	char *directory = getenv( "XDG_RUNTIME_DIR" );
+
+	if ( !directory || directory[ 0 ] == '\0' ) {
+		return NULL;
+	}
+
+	size_t size = strlen( directory ) + sizeof( "/" SOCKET_NAME );
+	char *path = ( char * ) malloc( size );
+
+	if ( path ) {
+		snprintf( path, size, "%s/" SOCKET_NAME, directory );
+	}
+
+	return path;
+}
+
+// Description:
+// Removes a socket file left behind by a daemon that has exited. Only a socket
+// owned by this user that refuses connections is removed; anything else at the
+// path, including a socket a daemon is still serving, is left alone.
+//
+// Parameters:
+// char *path - The path of the socket.
+//
+// Returns:
+// bool - Whether the path is free to bind.
+static bool remove_stale_socket( char *path ) {
+	struct stat path_stats;
+
+	if ( lstat( path, &path_stats ) == -1 ) {
+		return errno == ENOENT;
+	}
+
+	if ( !S_ISSOCK( path_stats.st_mode ) || path_stats.st_uid != getuid( ) ) {
+		return false;
+	}
+
+	struct sockaddr_un address;
+	int probe = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+
+	if ( probe == -1 || !socket_address( path, &address ) ) {
+		if ( probe != -1 ) {
+			close( probe );
+		}
+
+		return false;
+	}
+
+	bool stale = connect( probe, ( struct sockaddr * ) &address, sizeof( address ) ) == -1 && errno == ECONNREFUSED;
+	close( probe );
+
+	return stale && unlink( path ) == 0;
+}
+
+// Description:
+// Creates a Unix domain socket listening at a path. The socket file is
+// remembered so protocol_unlisten() only removes the one it created.
+//
+// Parameters:
+// char *path - The path of the socket.
+//
+// Returns:
+// Listener * - The listener, or NULL on failure.
+Listener *protocol_listen( char *path ) {
+	struct sockaddr_un address;
+	struct stat path_stats;
+
+	if ( !socket_address( path, &address ) || !remove_stale_socket( path ) ) {
+		return NULL;
+	}
+
+	Listener *l = ( Listener * ) calloc( 1, sizeof( Listener ) );
+
+	if ( !l ) {
+		return NULL;
+	}
+
+	l->fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+
+	if ( l->fd == -1 || bind( l->fd, ( struct sockaddr * ) &address, sizeof( address ) ) == -1 ) {
+		if ( l->fd != -1 ) {
+			close( l->fd );
+		}
+
+		free( l );
+
+		return NULL;
+	}
+
+	if ( lstat( path, &path_stats ) == -1 || listen( l->fd, LISTEN_BACKLOG ) == -1 || !( l->path = strdup( path ) ) ) {
+		close( l->fd );
+		unlink( path ); // Just bound, so it's ours.
+		free( l );
+
+		return NULL;
+	}
+
+	l->device = path_stats.st_dev;
+	l->inode = path_stats.st_ino;
+
+	return l;
+}
+
+// Description:
+// Closes a listener, removing its socket file if it is still the one it created.
+//
+// Parameters:
+// Listener **l - The listener.
+//
+// Returns:
+// Nothing.
+void protocol_unlisten( Listener **l ) {
+	if ( *l ) {
+		struct stat path_stats;
+		close( ( *l )->fd );
+
+		if ( lstat( ( *l )->path, &path_stats ) == 0 && path_stats.st_dev == ( *l )->device && path_stats.st_ino == ( *l )->inode ) {
+			unlink( ( *l )->path );
+		}
+
+		free( ( *l )->path );
+		free( *l );
+		*l = NULL;
+	}
+}
+
+// Description:
+// Connects to a Unix domain socket.
+//
+// Parameters:
+// char *path - The path of the socket.
+//
+// Returns:
+// int - The connected socket, or -1 on failure.
+int protocol_connect( char *path ) {
+	struct sockaddr_un address;
+
+	if ( !socket_address( path, &address ) ) {
+		return -1;
+	}
+
+	int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+
+	if ( fd != -1 && connect( fd, ( struct sockaddr * ) &address, sizeof( address ) ) == -1 ) {
+		close( fd );
+		fd = -1;
+	}
+
+	return fd;
+}
+
+// Description:
+// Writes the frame of a request. Its payload follows.
+//
+// Parameters:
+// int fd - The socket.
+// Request *r - The request.
+//
+// Returns:
+// bool - Whether the frame was written.
+bool protocol_write_request( int fd, Request *r ) {
+	uint8_t frame[ REQUEST_FRAME_SIZE ] = { 0 };
+	store_little_endian( frame, PROTOCOL_MAGIC, 4 );
+	frame[ 4 ] = r->type;
+	frame[ 5 ] = r->flags;
+	store_little_endian( frame + 8, r->dictionary_id, 4 );
+	store_little_endian( frame + 12, r->size, 8 );
+
+	return write_bytes( fd, frame, REQUEST_FRAME_SIZE ) == REQUEST_FRAME_SIZE;
+}
+
+// Description:
+// Reads the frame of a request.
+//
+// Parameters:
+// int fd - The socket.
+// Request *r - The request to fill in.
+//
+// Returns:
+// bool - Whether a whole frame with the right magic number was read.
+bool protocol_read_request( int fd, Request *r ) {
+	uint8_t frame[ REQUEST_FRAME_SIZE ];
+
+	if ( read_bytes( fd, frame, REQUEST_FRAME_SIZE ) != REQUEST_FRAME_SIZE || load_little_endian( frame, 4 ) != PROTOCOL_MAGIC ) {
+		return false;
+	}
+
+	r->type = frame[ 4 ];
+	r->flags = frame[ 5 ];
+	r->dictionary_id = load_little_endian( frame + 8, 4 );
+	r->size = load_little_endian( frame + 12, 8 );
+
+	return true;
+}
+
+// Description:
+// Writes the frame of a response. Its payload follows.
+//
+// Parameters:
+// int fd - The socket.
+// Response *r - The response.
+//
+// Returns:
+// bool - Whether the frame was written.
+bool protocol_write_response( int fd, Response *r ) {
+	uint8_t frame[ RESPONSE_FRAME_SIZE ];
+	store_little_endian( frame, PROTOCOL_MAGIC, 4 );
+	store_little_endian( frame + 4, r->status, 4 );
+	store_little_endian( frame + 8, r->size, 8 );
+
+	return write_bytes( fd, frame, RESPONSE_FRAME_SIZE ) == RESPONSE_FRAME_SIZE;
+}
+
+// Description:
+// Reads the frame of a response.
+//
+// Parameters:
+// int fd - The socket.
+// Response *r - The response to fill in.
+//
+// Returns:
+// bool - Whether a whole frame with the right magic number was read.
+bool protocol_read_response( int fd, Response *r ) {
+	uint8_t frame[ RESPONSE_FRAME_SIZE ];
+
+	if ( read_bytes( fd, frame, RESPONSE_FRAME_SIZE ) != RESPONSE_FRAME_SIZE || load_little_endian( frame, 4 ) != PROTOCOL_MAGIC ) {
+		return false;
+	}
+
+	r->status = load_little_endian( frame + 4, 4 );
+	r->size = load_little_endian( frame + 8, 8 );
+
+	return true;
+}
@@ -0,0 +1,52 @@
+#ifndef __PROTOCOL_H__
+#define __PROTOCOL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define PROTOCOL_MAGIC        0x121DDBE0 // Magic number of daemon request and response frames.
+#define PROTOCOL_MAX_PAYLOAD  ( 1u << 30 ) // Largest payload, compressed or not, the daemon handles.
+#define SOCKET_NAME           "huffmand.sock" // Socket huffmand listens on by default, in $XDG_RUNTIME_DIR.
+#define REQUEST_DICTIONARY    0x01 // Request flag: compress with the dictionary given by ID.
+#define RESPONSE_OK           0 // Response status: the payload is the result.
+#define RESPONSE_ERROR        1 // Response status: the payload is an error message.
+
+typedef enum RequestType { REQUEST_COMPRESS = 1, REQUEST_DECOMPRESS = 2 } RequestType;
+
+typedef struct Request {
+	uint8_t type;
+	uint8_t flags;
+	uint32_t dictionary_id;
+	uint64_t size;
+} Request;
+
+typedef struct Response {
+	uint32_t status;
+	uint64_t size;
+} Response;
+
+typedef struct Listener {
+	int fd;
+	char *path;
+	dev_t device;
+	ino_t inode;
+} Listener;
+
+char *protocol_default_path( );
+
+Listener *protocol_listen( char *path );
+
+void protocol_unlisten( Listener **l );
+
+int protocol_connect( char *path );
+
+bool protocol_write_request( int fd, Request *r );
+
+bool protocol_read_request( int fd, Request *r );
+
+bool protocol_write_response( int fd, Response *r );
+
+bool protocol_read_response( int fd, Response *r );
+
+#endif
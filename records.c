@@ -0,0 +1,245 @@
+#include "records.h"
+
+#include "io.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Description:
+// A struct for reading records from a file one at a time.
+//
+// Members:
+// int infile - The input file.
+// RecordFormat format - How records are delimited.
+// uint8_t *buffer - The buffered input, with room for the longest record plus a block.
+// uint32_t capacity - The size of the buffer.
+// uint32_t start - Where the unread bytes start in the buffer.
+// uint32_t size - Where the unread bytes end in the buffer.
+// bool eof - Whether the whole file has been buffered.
+// bool failed - Whether a record was too long or cut off.
+struct RecordReader {
+	int infile;
+	RecordFormat format;
+	uint8_t *buffer;
+	uint32_t capacity;
+	uint32_t start;
+	uint32_t size;
+	bool eof;
+	bool failed;
+};
+
+// Description:
+// Creates a record reader for a file.
+//
+// Parameters:
+// int infile - The input file, read from its current offset.
+// RecordFormat format - How records are delimited.
+//
+// Returns:
+// RecordReader * - A pointer to the newly created record reader.
+RecordReader *record_reader_create( int infile, RecordFormat format ) {
+	RecordReader *r = ( RecordReader * ) calloc( 1, sizeof( RecordReader ) );
+
+	if ( r ) {
+		r->infile = infile;
+		r->format = format;
+		r->capacity = RECORD_PREFIX_SIZE + RECORD_MAX_SIZE + io_block_size( );
+
+		if ( !( r->buffer = io_buffer_create( r->capacity ) ) ) {
+			free( r );
+			r = NULL;
+		}
+	}
+
+	return r;
+}
+
+// Description:
+// Frees the memory given to a record reader. Doesn't close its file.
+//
+// Parameters:
+// RecordReader **r - A pointer to a pointer to the record reader.
+//
+// Returns:
+// Nothing.
+void record_reader_delete( RecordReader **r ) {
+	if ( *r ) {
+		io_buffer_delete( &( *r )->buffer );
+		free( *r );
+		*r = NULL;
+	}
+}
+
+// Description:
+// Moves the unread bytes of a record reader to the start of its buffer, and
+// reads as much of the file after them as fits.
+//
+// Parameters:
+// RecordReader *r - The record reader.
+//
+// Returns:
+// bool - Whether any bytes were read.
+static bool record_reader_refill( RecordReader *r ) {
+	uint32_t block_size = io_block_size( );
+
+	if ( r->eof ) {
+		return false;
+	}
+
+	memmove( r->buffer, r->buffer + r->start, r->size - r->start );
+	r->size -= r->start;
+	r->start = 0;
+	uint32_t wanted = ( r->capacity - r->size ) / block_size * block_size; // Whole blocks, for O_DIRECT.
+	uint32_t bytes_read = read_bytes( r->infile, r->buffer + r->size, wanted );
+	r->eof = bytes_read < wanted;
+	r->size += bytes_read;
+
+	return bytes_read != 0;
+}
+
+// Description:
+// Reads the next record. A line keeps its newline, so the records of a file put
+// together are the file; the last line may lack one. A length-delimited record
+// is the bytes after its 32-bit little-endian length.
+//
+// Parameters:
+// RecordReader *r - The record reader.
+// uint8_t **record - The pointer to set to the record, valid until the next call.
+// uint32_t *nbytes - The pointer to the uint32_t to set to the length of the record.
+//
+// Returns:
+// bool - Whether a record was read. False at the end of the file, or if it failed.
+bool record_reader_next( RecordReader *r, uint8_t **record, uint32_t *nbytes ) {
+	while ( !r->failed ) {
+		uint8_t *data = r->buffer + r->start;
+		uint32_t available = r->size - r->start;
+		uint32_t length = 0;
+		uint32_t skip = 0;
+		bool found = false;
+
+		if ( r->format == RECORDS_LINES ) {
+			uint8_t *newline = ( uint8_t * ) memchr( data, '\n', available );
+			found = newline || ( r->eof && available != 0 );
+			length = newline ? newline - data + 1 : available;
+		} else if ( available >= RECORD_PREFIX_SIZE ) {
+			length = load_little_endian( data, RECORD_PREFIX_SIZE );
+			skip = RECORD_PREFIX_SIZE;
+			found = length <= available - skip;
+		}
+
+		if ( length > RECORD_MAX_SIZE ) {
+			r->failed = true;
+		} else if ( found ) {
+			*record = data + skip;
+			*nbytes = length;
+			r->start += skip + length;
+
+			return true;
+		} else if ( !record_reader_refill( r ) ) {
+			r->failed = r->start != r->size; // Only a cut-off record is left.
+
+			break;
+		}
+	}
+
+	return false;
+}
+
+// Description:
+// Checks whether a record reader stopped at a record that was too long or cut off.
+//
+// Parameters:
+// RecordReader *r - The record reader.
+//
+// Returns:
+// bool - Whether reading failed.
+bool record_reader_failed( RecordReader *r ) {
+	return r->failed;
+}
+
+// Description:
+// Parses the name of a record format.
+//
+// Parameters:
+// char *text - The name: "lines" or "length".
+// RecordFormat *format - The pointer to the RecordFormat to set.
+//
+// Returns:
+// bool - Whether the name was valid.
+bool record_format_parse( char *text, RecordFormat *format ) {
+	if ( strcmp( text, "lines" ) == 0 ) {
+		*format = RECORDS_LINES;
+	} else if ( strcmp( text, "length" ) == 0 ) {
+		*format = RECORDS_LENGTH;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+// Description:
+// Creates the records header written after the tree dump.
+//
+// Parameters:
+// RecordFormat format - How the records were delimited.
+// uint64_t count - The number of records.
+// uint8_t header[static RECORDS_HEADER_SIZE] - The buffer to write the header to.
+//
+// Returns:
+// Nothing.
+void records_header_create( RecordFormat format, uint64_t count, uint8_t header[ static RECORDS_HEADER_SIZE ] ) {
+	header[ 0 ] = format;
+	store_little_endian( header + 1, count, 8 );
+}
+
+// Description:
+// Parses a records header.
+//
+// Parameters:
+// uint8_t header[static RECORDS_HEADER_SIZE] - The header.
+// RecordFormat *format - The pointer to the RecordFormat to set.
+// uint64_t *count - The pointer to the uint64_t to set to the number of records.
+//
+// Returns:
+// bool - Whether the format is known.
+bool records_header_parse( uint8_t header[ static RECORDS_HEADER_SIZE ], RecordFormat *format, uint64_t *count ) {
+	*format = header[ 0 ];
+	*count = load_little_endian( header + 1, 8 );
+
+	return *format == RECORDS_LINES || *format == RECORDS_LENGTH;
+}
+
+// Description:
+// Creates the index entry of a record: the offset of its codes from the start of
+// the code section in the low RECORD_OFFSET_BITS bits, and its length above them,
+// little-endian.
+//
+// Parameters:
+// uint64_t offset - The offset of the record's codes.
+// uint32_t nbytes - The length of the record.
+// uint8_t entry[static RECORD_INDEX_ENTRY] - The buffer to write the entry to.
+//
+// Returns:
+// Nothing.
+void record_entry_create( uint64_t offset, uint32_t nbytes, uint8_t entry[ static RECORD_INDEX_ENTRY ] ) {
+	store_little_endian( entry, offset | ( uint64_t ) nbytes << RECORD_OFFSET_BITS, RECORD_INDEX_ENTRY );
+}
+
+// Description:
+// Parses the index entry of a record.
+//
+// Parameters:
+// uint8_t entry[static RECORD_INDEX_ENTRY] - The entry.
+// uint64_t *offset - The pointer to the uint64_t to set to the offset of the record's codes.
+// uint32_t *nbytes - The pointer to the uint32_t to set to the length of the record.
+//
+// Returns:
+// Nothing.
+void record_entry_parse( uint8_t entry[ static RECORD_INDEX_ENTRY ], uint64_t *offset, uint32_t *nbytes ) {
+	uint64_t word = load_little_endian( entry, RECORD_INDEX_ENTRY );
+	*offset = word & ( ( ( uint64_t ) 1 << RECORD_OFFSET_BITS ) - 1 );
+	*nbytes = word >> RECORD_OFFSET_BITS;
+}
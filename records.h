@@ -0,0 +1,35 @@
+#ifndef __RECORDS_H__
+#define __RECORDS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RECORDS_HEADER_SIZE 9 // Record format and 64-bit record count, after the tree dump.
+#define RECORD_INDEX_ENTRY  8 // Bytes per record in the index at the end of the file.
+#define RECORD_OFFSET_BITS  40 // Low bits of an index entry holding the offset of a record's codes.
+#define RECORD_MAX_SIZE     ( ( 1u << ( 64 - RECORD_OFFSET_BITS ) ) - 1 ) // Longest record an index entry can hold.
+#define RECORD_PREFIX_SIZE  4 // Bytes of the length in front of each length-delimited record.
+
+typedef enum RecordFormat { RECORDS_LINES = 1, RECORDS_LENGTH = 2 } RecordFormat;
+
+typedef struct RecordReader RecordReader;
+
+RecordReader *record_reader_create( int infile, RecordFormat format );
+
+void record_reader_delete( RecordReader **r );
+
+bool record_reader_next( RecordReader *r, uint8_t **record, uint32_t *nbytes );
+
+bool record_reader_failed( RecordReader *r );
+
+bool record_format_parse( char *text, RecordFormat *format );
+
+void records_header_create( RecordFormat format, uint64_t count, uint8_t header[ static RECORDS_HEADER_SIZE ] );
+
+bool records_header_parse( uint8_t header[ static RECORDS_HEADER_SIZE ], RecordFormat *format, uint64_t *count );
+
+void record_entry_create( uint64_t offset, uint32_t nbytes, uint8_t entry[ static RECORD_INDEX_ENTRY ] );
+
+void record_entry_parse( uint8_t entry[ static RECORD_INDEX_ENTRY ], uint64_t *offset, uint32_t *nbytes );
+
+#endif
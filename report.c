@@ -0,0 +1,113 @@
+#include "report.h"
+
+#include "defines.h"
+#include "estimate.h"
+#include "io.h"
+#include "kernels.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Description:
+// Describes how close the codes built for a histogram come to its entropy.
+//
+// Parameters:
+// uint64_t histogram[static ALPHABET] - The histogram the codes were built from.
+// uint16_t lengths[static ALPHABET] - The length of each symbol's code in bits.
+// uint64_t header_size - The bytes written before the codes: the file header and tree dump.
+// CodeReport *r - The report to fill in.
+//
+// Returns:
+// Nothing.
+void code_report_from_codes( uint64_t histogram[ static ALPHABET ], uint16_t lengths[ static ALPHABET ], uint64_t header_size, CodeReport *r ) {
+	uint64_t coded_bits = 0;
+	memset( r, 0, sizeof( CodeReport ) );
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		if ( histogram[ i ] != 0 ) {
+			r->symbols += histogram[ i ];
+			r->unique_symbols++;
+			r->codes[ lengths[ i ] ]++;
+			r->coded[ lengths[ i ] ] += histogram[ i ];
+			coded_bits += histogram[ i ] * lengths[ i ];
+			r->max_length = lengths[ i ] > r->max_length ? lengths[ i ] : r->max_length;
+		}
+	}
+
+	r->entropy = histogram_entropy( histogram );
+	r->code_length = r->symbols ? ( double ) coded_bits / r->symbols : 0;
+	r->header_size = header_size;
+}
+
+// Description:
+// Prints a code report: entropy, average and longest code, header overhead, and
+// how many symbols and bytes each code length covers.
+//
+// Parameters:
+// CodeReport *r - The report.
+// FILE *stream - The stream to print to.
+//
+// Returns:
+// Nothing.
+void code_report_print( CodeReport *r, FILE *stream ) {
+	uint64_t code_bytes = ( uint64_t ) ( r->code_length * r->symbols + 7 ) / 8;
+	fprintf( stream, "Entropy: %.4f bits/byte\n", r->entropy );
+	fprintf( stream, "Average code length: %.4f bits/byte (%.2f%% above entropy)\n", r->code_length, r->entropy > 0 ? 100 * ( r->code_length / r->entropy - 1 ) : 0 );
+	fprintf( stream, "Distinct symbols: %" PRIu32 "\n", r->unique_symbols );
+	fprintf( stream, "Max code length: %" PRIu32 " bits\n", r->max_length );
+	fprintf( stream, "Header overhead: %" PRIu64 " bytes (%.2f%% of output)\n", r->header_size, 100.0 * r->header_size / ( r->header_size + code_bytes ) );
+	fprintf( stream, "  %-6s %8s %10s\n", "Length", "Symbols", "Bytes (%)" );
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		if ( r->codes[ i ] != 0 ) {
+			fprintf( stream, "  %-6" PRIu32 " %8" PRIu32 " %10.2f\n", i, r->codes[ i ], 100.0 * r->coded[ i ] / r->symbols );
+		}
+	}
+}
+
+// Description:
+// Saves the entropy of each window of a file, and the average length the file's
+// codes give its bytes, as tab-separated lines. Doesn't move the file offset.
+//
+// Parameters:
+// int infile - The input file, which must be seekable.
+// uint32_t window - The bytes per window.
+// uint16_t lengths[static ALPHABET] - The length of each symbol's code in bits.
+// char *file_name - The file to save the trace to, or "-" for stderr.
+//
+// Returns:
+// bool - Whether the trace was saved.
+bool entropy_trace_save( int infile, uint32_t window, uint16_t lengths[ static ALPHABET ], char *file_name ) {
+	uint8_t *buf = io_buffer_create( window );
+	FILE *stream = !buf ? NULL : strcmp( file_name, "-" ) == 0 ? stderr : fopen( file_name, "w" );
+	uint64_t offset = 0;
+	uint32_t nbytes = 0;
+
+	if ( !stream ) {
+		io_buffer_delete( &buf );
+
+		return false;
+	}
+
+	fprintf( stream, "# offset\tbytes\tentropy\tcode_length\n" );
+
+	while ( ( nbytes = pread_bytes( infile, buf, window, offset ) ) != 0 ) {
+		uint64_t histogram[ ALPHABET ] = { 0 };
+		uint64_t coded_bits = 0;
+		histogram_update( histogram, buf, nbytes );
+
+		for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+			coded_bits += histogram[ i ] * lengths[ i ];
+		}
+
+		fprintf( stream, "%" PRIu64 "\t%" PRIu32 "\t%.4f\t%.4f\n", offset, nbytes, histogram_entropy( histogram ), ( double ) coded_bits / nbytes );
+		offset += nbytes;
+	}
+
+	io_buffer_delete( &buf );
+
+	return stream == stderr ? fflush( stream ) == 0 : fclose( stream ) == 0;
+}
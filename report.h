@@ -0,0 +1,29 @@
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_WINDOW ( 256 * BLOCK ) // Default bytes per line of an entropy trace.
+
+typedef struct CodeReport {
+	uint64_t symbols;
+	uint32_t unique_symbols;
+	double entropy;
+	double code_length;
+	uint32_t max_length;
+	uint32_t codes[ ALPHABET ];
+	uint64_t coded[ ALPHABET ];
+	uint64_t header_size;
+} CodeReport;
+
+void code_report_from_codes( uint64_t histogram[ static ALPHABET ], uint16_t lengths[ static ALPHABET ], uint64_t header_size, CodeReport *r );
+
+void code_report_print( CodeReport *r, FILE *stream );
+
+bool entropy_trace_save( int infile, uint32_t window, uint16_t lengths[ static ALPHABET ], char *file_name );
+
+#endif
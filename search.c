@@ -0,0 +1,380 @@
+#include "search.h"
+
+#include "defines.h"
+#include "io.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEARCH_MATCH   1 // Transition flag: the state it leads to ends at least one pattern.
+#define SEARCH_NEWLINE 2 // Transition flag: the byte is a newline, which no pattern contains.
+
+// Description:
+// A struct for searching decoded bytes for any of a set of patterns, a buffer
+// at a time, with an Aho-Corasick automaton. The automaton is a full table of
+// transitions, so each byte costs one lookup however many patterns there are.
+// Each entry holds the next state times ALPHABET, so it indexes the table
+// directly, and flags in its low bits.
+//
+// Members:
+// uint32_t *next - The transition of each state on each byte.
+// uint32_t *terminal - Which pattern (plus 1) each state ends, or 0.
+// uint32_t *suffix - The next state along each state's suffix links that ends a pattern, or 0.
+// char **patterns - The patterns, which must outlive the search.
+// uint32_t *lengths - The length of each pattern.
+// SearchMode mode - Whether to print matching lines, the offset of each match, or a count of matching lines.
+// int outfile - The file to print results to.
+// uint32_t state - The current state, times ALPHABET.
+// uint64_t offset - The number of bytes scanned before the current buffer.
+// uint8_t *carry - The start of the current line, from earlier buffers.
+// uint64_t carry_size - The number of bytes in carry.
+// uint64_t carry_capacity - The number of bytes carry can hold.
+// bool in_match - Whether the current line matched, and the rest of it still has to be printed.
+// uint64_t matches - The number of matching lines, or of matches when printing offsets.
+// uint8_t *print - Results waiting to be written.
+// uint32_t printed - The number of bytes in print.
+// bool failed - Whether writing results failed.
+struct Search {
+	uint32_t *next;
+	uint32_t *terminal;
+	uint32_t *suffix;
+	char **patterns;
+	uint32_t *lengths;
+	SearchMode mode;
+	int outfile;
+	uint32_t state;
+	uint64_t offset;
+	uint8_t *carry;
+	uint64_t carry_size;
+	uint64_t carry_capacity;
+	bool in_match;
+	uint64_t matches;
+	uint8_t *print;
+	uint32_t printed;
+	bool failed;
+};
+
+// Description:
+// Builds a search's automaton: a trie of the patterns, then, breadth first,
+// each state's failure link and the transitions it inherits from it.
+//
+// Parameters:
+// Search *s - The search, with its patterns, lengths and zeroed tables.
+// uint32_t npatterns - The number of patterns.
+// uint32_t *fail - Space for the failure link of each state.
+// uint32_t *queue - Space for a queue of every state.
+//
+// Returns:
+// Nothing.
+static void search_build( Search *s, uint32_t npatterns, uint32_t *fail, uint32_t *queue ) {
+	uint32_t nstates = 1;
+
+	for ( uint32_t p = 0; p < npatterns; p++ ) {
+		uint32_t state = 0;
+
+		for ( uint32_t i = 0; i < s->lengths[ p ]; i++ ) {
+			uint32_t *child = &s->next[ state * ALPHABET + ( uint8_t ) s->patterns[ p ][ i ] ];
+
+			if ( *child == 0 ) {
+				*child = nstates++;
+			}
+
+			state = *child;
+		}
+
+		if ( s->terminal[ state ] == 0 ) { // Repeated patterns are reported once.
+			s->terminal[ state ] = p + 1;
+		}
+	}
+
+	uint32_t head = 0;
+	uint32_t tail = 0;
+	queue[ tail++ ] = 0;
+	fail[ 0 ] = 0;
+
+	while ( head < tail ) {
+		uint32_t state = queue[ head++ ];
+
+		for ( uint32_t c = 0; c < ALPHABET; c++ ) {
+			uint32_t *child = &s->next[ state * ALPHABET + c ];
+
+			if ( *child != 0 ) { // A trie edge: its failure link is where the parent's link goes on c.
+				uint32_t link = state == 0 ? 0 : s->next[ fail[ state ] * ALPHABET + c ];
+				fail[ *child ] = link;
+				s->suffix[ *child ] = s->terminal[ link ] ? link : s->suffix[ link ];
+				queue[ tail++ ] = *child;
+			} else if ( state != 0 ) { // No edge: go where the failure link goes, whose row is already complete.
+				*child = s->next[ fail[ state ] * ALPHABET + c ];
+			}
+		}
+	}
+
+	for ( uint32_t i = 0; i < nstates * ALPHABET; i++ ) {
+		uint32_t target = s->next[ i ];
+		bool match = s->terminal[ target ] || s->suffix[ target ];
+		s->next[ i ] = target * ALPHABET | ( match ? SEARCH_MATCH : 0 ) | ( i % ALPHABET == '\n' ? SEARCH_NEWLINE : 0 );
+	}
+}
+
+// Description:
+// Creates a search for any of a set of patterns.
+//
+// Parameters:
+// char **patterns - The patterns, none empty or with a newline, which must outlive the search.
+// uint32_t npatterns - The number of patterns.
+// SearchMode mode - Whether to print matching lines, the offset of each match, or a count of matching lines.
+// int outfile - The file to print results to.
+//
+// Returns:
+// Search * - A pointer to the newly created search, or NULL if the patterns are invalid or too long, or memory ran out.
+Search *search_create( char **patterns, uint32_t npatterns, SearchMode mode, int outfile ) {
+	uint64_t nstates = 1;
+
+	for ( uint32_t i = 0; i < npatterns; i++ ) {
+		size_t length = strlen( patterns[ i ] );
+
+		if ( length == 0 || memchr( patterns[ i ], '\n', length ) ) {
+			return NULL;
+		}
+
+		nstates += length;
+	}
+
+	if ( npatterns == 0 || nstates > SEARCH_MAX_STATES ) {
+		return NULL;
+	}
+
+	Search *s = ( Search * ) calloc( 1, sizeof( Search ) );
+	uint32_t *fail = ( uint32_t * ) malloc( nstates * sizeof( uint32_t ) );
+	uint32_t *queue = ( uint32_t * ) malloc( nstates * sizeof( uint32_t ) );
+
+	if ( s ) {
+		s->next = ( uint32_t * ) calloc( nstates * ALPHABET, sizeof( uint32_t ) );
+		s->terminal = ( uint32_t * ) calloc( nstates, sizeof( uint32_t ) );
+		s->suffix = ( uint32_t * ) calloc( nstates, sizeof( uint32_t ) );
+		s->lengths = ( uint32_t * ) malloc( npatterns * sizeof( uint32_t ) );
+		s->print = ( uint8_t * ) malloc( SEARCH_PRINT_SIZE );
+		s->patterns = patterns;
+		s->mode = mode;
+		s->outfile = outfile;
+	}
+
+	if ( !s || !fail || !queue || !s->next || !s->terminal || !s->suffix || !s->lengths || !s->print ) {
+		search_delete( &s );
+	} else {
+		for ( uint32_t i = 0; i < npatterns; i++ ) {
+			s->lengths[ i ] = strlen( patterns[ i ] );
+		}
+
+		search_build( s, npatterns, fail, queue );
+	}
+
+	free( fail );
+	free( queue );
+
+	return s;
+}
+
+// Description:
+// Frees the memory given to a search.
+//
+// Parameters:
+// Search **s - A pointer to a pointer to the search.
+//
+// Returns:
+// Nothing.
+void search_delete( Search **s ) {
+	if ( *s ) {
+		free( ( *s )->next );
+		free( ( *s )->terminal );
+		free( ( *s )->suffix );
+		free( ( *s )->lengths );
+		free( ( *s )->carry );
+		free( ( *s )->print );
+		free( *s );
+		*s = NULL;
+	}
+}
+
+// Description:
+// Adds bytes to a search's results, writing the results out when they fill
+// the buffer.
+//
+// Parameters:
+// Search *s - The search.
+// uint8_t *data - The bytes.
+// uint64_t nbytes - The number of bytes.
+//
+// Returns:
+// Nothing.
+static void search_print( Search *s, uint8_t *data, uint64_t nbytes ) {
+	if ( nbytes == 0 ) { // Such as an empty carried line, whose data may be NULL.
+		return;
+	}
+
+	if ( s->printed + nbytes > SEARCH_PRINT_SIZE ) {
+		s->failed |= write_bytes( s->outfile, s->print, s->printed ) != s->printed;
+		s->printed = 0;
+	}
+
+	if ( nbytes > SEARCH_PRINT_SIZE ) { // Long lines skip the buffer.
+		for ( uint64_t done = 0; done < nbytes; done += SEARCH_PRINT_SIZE ) {
+			uint32_t count = nbytes - done < SEARCH_PRINT_SIZE ? nbytes - done : SEARCH_PRINT_SIZE;
+			s->failed |= write_bytes( s->outfile, data + done, count ) != count;
+		}
+
+		return;
+	}
+
+	memcpy( s->print + s->printed, data, nbytes );
+	s->printed += nbytes;
+}
+
+// Description:
+// Prints the offset and pattern of each match that ends in a state.
+//
+// Parameters:
+// Search *s - The search.
+// uint32_t state - The state, not multiplied by ALPHABET.
+// uint64_t end - The offset just past the last byte of the matches.
+//
+// Returns:
+// Nothing.
+static void search_print_offsets( Search *s, uint32_t state, uint64_t end ) {
+	for ( uint32_t match = s->terminal[ state ] ? state : s->suffix[ state ]; match != 0; match = s->suffix[ match ] ) {
+		uint32_t pattern = s->terminal[ match ] - 1;
+		char prefix[ 24 ];
+		int length = snprintf( prefix, sizeof( prefix ), "%" PRIu64 ":", end - s->lengths[ pattern ] );
+		search_print( s, ( uint8_t * ) prefix, length );
+		search_print( s, ( uint8_t * ) s->patterns[ pattern ], s->lengths[ pattern ] );
+		search_print( s, ( uint8_t * ) "\n", 1 );
+		s->matches++;
+	}
+}
+
+// Description:
+// Scans the next buffer of decoded bytes. Matches may span buffers, and so may
+// the lines that are printed. Made to be an output's sink.
+//
+// Parameters:
+// void *search - The search.
+// uint8_t *data - The bytes.
+// uint32_t nbytes - The number of bytes.
+//
+// Returns:
+// bool - Whether the results so far were written out.
+bool search_scan( void *search, uint8_t *data, uint32_t nbytes ) {
+	Search *s = ( Search * ) search;
+	uint32_t *next = s->next;
+	uint32_t state = s->state;
+	uint32_t line_start = 0;
+	uint32_t i = 0;
+
+	if ( s->in_match ) { // The rest of a matching line from an earlier buffer.
+		uint8_t *newline = ( uint8_t * ) memchr( data, '\n', nbytes );
+		line_start = i = newline ? newline - data + 1 : nbytes;
+		s->in_match = !newline;
+
+		if ( s->mode == SEARCH_LINES ) {
+			search_print( s, data, i );
+		}
+	}
+
+	for ( ; i < nbytes; i++ ) {
+		uint32_t entry = next[ state + data[ i ] ];
+		state = entry & ~( uint32_t ) ( ALPHABET - 1 );
+
+		if ( !( entry & ( SEARCH_MATCH | SEARCH_NEWLINE ) ) ) {
+			continue;
+		}
+
+		if ( entry & SEARCH_NEWLINE ) { // No pattern spans lines, so the state is back at the root.
+			line_start = i + 1;
+			s->carry_size = 0;
+		} else if ( s->mode == SEARCH_OFFSETS ) {
+			search_print_offsets( s, state / ALPHABET, s->offset + i + 1 );
+		} else { // The line matches, so the rest of it doesn't need scanning.
+			uint8_t *newline = ( uint8_t * ) memchr( data + i, '\n', nbytes - i );
+			uint32_t end = newline ? newline - data + 1 : nbytes;
+			s->matches++;
+
+			if ( s->mode == SEARCH_LINES ) {
+				search_print( s, s->carry, s->carry_size );
+				search_print( s, data + line_start, end - line_start );
+			}
+
+			s->carry_size = 0;
+			s->in_match = !newline;
+			line_start = end;
+			state = 0;
+			i = end - 1;
+		}
+	}
+
+	if ( s->mode == SEARCH_LINES && !s->in_match && line_start < nbytes ) { // Keep the start of the line for if it matches later.
+		uint64_t size = s->carry_size + nbytes - line_start;
+
+		if ( size > s->carry_capacity ) {
+			uint64_t capacity = size > 2 * s->carry_capacity ? size : 2 * s->carry_capacity;
+			uint8_t *carry = ( uint8_t * ) realloc( s->carry, capacity );
+
+			if ( !carry ) {
+				return false;
+			}
+
+			s->carry = carry;
+			s->carry_capacity = capacity;
+		}
+
+		memcpy( s->carry + s->carry_size, data + line_start, nbytes - line_start );
+		s->carry_size = size;
+	}
+
+	s->state = state;
+	s->offset += nbytes;
+
+	return !s->failed;
+}
+
+// Description:
+// Ends a search: ends a matching last line that had no newline, prints the
+// count of matching lines if that's all that was asked for, and writes out
+// the results.
+//
+// Parameters:
+// Search *s - The search.
+//
+// Returns:
+// bool - Whether all of the results were written out.
+bool search_finish( Search *s ) {
+	if ( s->in_match && s->mode == SEARCH_LINES ) {
+		search_print( s, ( uint8_t * ) "\n", 1 );
+	}
+
+	if ( s->mode == SEARCH_COUNT ) {
+		char count[ 24 ];
+		int length = snprintf( count, sizeof( count ), "%" PRIu64 "\n", s->matches );
+		search_print( s, ( uint8_t * ) count, length );
+	}
+
+	s->failed |= write_bytes( s->outfile, s->print, s->printed ) != s->printed;
+	s->printed = 0;
+
+	return !s->failed;
+}
+
+// Description:
+// Gets the number of matches a search found.
+//
+// Parameters:
+// Search *s - The search.
+//
+// Returns:
+// uint64_t - The number of matching lines, or of matches when printing offsets.
+uint64_t search_matches( Search *s ) {
+	return s->matches;
+}
@@ -0,0 +1,24 @@
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SEARCH_MAX_STATES 16384 // Most automaton states, 1KB each: the total length of the patterns, plus 1.
+#define SEARCH_PRINT_SIZE ( 64 * 1024 ) // Bytes of results buffered before they're written out.
+
+typedef enum SearchMode { SEARCH_LINES, SEARCH_OFFSETS, SEARCH_COUNT } SearchMode;
+
+typedef struct Search Search;
+
+Search *search_create( char **patterns, uint32_t npatterns, SearchMode mode, int outfile );
+
+void search_delete( Search **s );
+
+bool search_scan( void *search, uint8_t *data, uint32_t nbytes );
+
+bool search_finish( Search *s );
+
+uint64_t search_matches( Search *s );
+
+#endif
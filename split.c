@@ -0,0 +1,202 @@
+#include "split.h"
+
+#include "io.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Description:
+// Compares two symbol counts, for sorting them in ascending order.
+//
+// Parameters:
+// const void *a - A pointer to the first count.
+// const void *b - A pointer to the second count.
+//
+// Returns:
+// int - Negative, zero or positive as the first count is less than, equal to or greater than the second.
+static int compare_counts( const void *a, const void *b ) {
+	uint64_t x = *( const uint64_t * ) a;
+	uint64_t y = *( const uint64_t * ) b;
+
+	return ( x > y ) - ( x < y );
+}
+
+// Description:
+// Picks the size of the segments a file is scanned in: SPLIT_SEGMENT, doubled
+// until the file has at most SPLIT_MAX_SEGMENTS of them.
+//
+// Parameters:
+// uint64_t file_size - The size of the file.
+//
+// Returns:
+// uint32_t - The bytes per segment.
+uint32_t split_segment_size( uint64_t file_size ) {
+	uint32_t segment = SPLIT_SEGMENT;
+
+	while ( file_size / segment >= SPLIT_MAX_SEGMENTS && segment < SPLIT_MAX_BLOCK ) {
+		segment *= 2;
+	}
+
+	return segment;
+}
+
+// Description:
+// Gets the exact size of a block coded with its own table: the histogram times
+// the Huffman code lengths built from it, plus the block header and tree dump.
+// Any Huffman tree of a histogram codes it in the same number of bits, the sum
+// of the tree's internal node weights, so they're added up from the two-queue
+// construction without building the tree.
+//
+// Parameters:
+// uint32_t histogram[static ALPHABET] - The histogram of the block.
+//
+// Returns:
+// uint64_t - The size of the block in bits, leaving out the padding to a byte boundary.
+uint64_t split_block_cost( uint32_t histogram[ static ALPHABET ] ) {
+	uint64_t leaves[ ALPHABET ];
+	uint64_t internal[ ALPHABET ];
+	uint32_t nleaves = 0;
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		if ( histogram[ i ] != 0 ) {
+			leaves[ nleaves++ ] = histogram[ i ];
+		}
+	}
+
+	if ( nleaves == 0 ) {
+		return 8 * SPLIT_BLOCK_HEADER_SIZE;
+	}
+
+	qsort( leaves, nleaves, sizeof( uint64_t ), compare_counts );
+	uint32_t leaf = 0;
+	uint32_t head = 0;
+	uint32_t tail = 0;
+	uint64_t bits = 0;
+
+	for ( uint32_t i = 1; i < nleaves; i++ ) { // Join the two lightest of the leaves and joined nodes left.
+		uint64_t weight = 0;
+
+		for ( uint32_t j = 0; j < 2; j++ ) {
+			if ( leaf < nleaves && ( head == tail || leaves[ leaf ] <= internal[ head ] ) ) {
+				weight += leaves[ leaf++ ];
+			} else {
+				weight += internal[ head++ ];
+			}
+		}
+
+		internal[ tail++ ] = weight; // Joined nodes come out in ascending order too.
+		bits += weight;
+	}
+
+	return bits + 8 * ( SPLIT_BLOCK_HEADER_SIZE + 3 * nleaves - 1 );
+}
+
+// Description:
+// Groups segments into blocks that each get their own table. Starting from one
+// block per segment, each sweep joins neighbouring blocks wherever one table for
+// both codes them in fewer bits than two tables, counting each table's header,
+// until a sweep joins nothing. Neighbours that were compared in an earlier sweep
+// and haven't changed since aren't compared again.
+//
+// Parameters:
+// uint32_t (*histograms)[ALPHABET] - The histogram of each segment, replaced with the histogram of each block.
+// uint32_t *sizes - The size of each segment in bytes, replaced with the size of each block.
+// uint32_t nsegments - The number of segments.
+//
+// Returns:
+// uint32_t - The number of blocks, or 0 if there wasn't enough memory (or no segments).
+uint32_t split_plan( uint32_t ( *histograms )[ ALPHABET ], uint32_t *sizes, uint32_t nsegments ) {
+	uint64_t *costs = ( uint64_t * ) malloc( ( nsegments + 1 ) * sizeof( uint64_t ) );
+	bool *changed = ( bool * ) malloc( nsegments + 1 );
+	uint32_t joined[ ALPHABET ];
+	uint32_t nblocks = nsegments;
+	bool joining = true;
+
+	if ( !costs || !changed ) {
+		free( costs );
+		free( changed );
+
+		return 0;
+	}
+
+	for ( uint32_t i = 0; i < nblocks; i++ ) {
+		costs[ i ] = split_block_cost( histograms[ i ] );
+		changed[ i ] = true;
+	}
+
+	while ( joining ) {
+		uint32_t kept = 0;
+		joining = false;
+
+		for ( uint32_t i = 0; i < nblocks; kept++ ) {
+			bool join = false;
+			uint64_t cost = 0;
+
+			if ( i + 1 < nblocks && ( changed[ i ] || changed[ i + 1 ] ) && ( uint64_t ) sizes[ i ] + sizes[ i + 1 ] <= SPLIT_MAX_BLOCK ) {
+				for ( uint32_t s = 0; s < ALPHABET; s++ ) {
+					joined[ s ] = histograms[ i ][ s ] + histograms[ i + 1 ][ s ];
+				}
+
+				cost = split_block_cost( joined );
+				join = cost <= costs[ i ] + costs[ i + 1 ];
+			}
+
+			if ( join ) {
+				memcpy( histograms[ kept ], joined, sizeof( joined ) );
+				sizes[ kept ] = sizes[ i ] + sizes[ i + 1 ];
+				costs[ kept ] = cost;
+				changed[ kept ] = true;
+				joining = true;
+				i += 2;
+			} else {
+				if ( kept != i ) {
+					memcpy( histograms[ kept ], histograms[ i ], sizeof( joined ) );
+					sizes[ kept ] = sizes[ i ];
+					costs[ kept ] = costs[ i ];
+				}
+
+				changed[ kept ] = false;
+				i++;
+			}
+		}
+
+		nblocks = kept;
+	}
+
+	free( costs );
+	free( changed );
+
+	return nblocks;
+}
+
+// Description:
+// Creates the header written before each block's tree dump.
+//
+// Parameters:
+// uint32_t nbytes - The size of the block's input.
+// uint16_t tree_size - The size of the block's tree dump.
+// uint8_t header[static SPLIT_BLOCK_HEADER_SIZE] - The buffer to write the header to, little-endian.
+//
+// Returns:
+// Nothing.
+void split_block_header_create( uint32_t nbytes, uint16_t tree_size, uint8_t header[ static SPLIT_BLOCK_HEADER_SIZE ] ) {
+	store_little_endian( header, nbytes, 4 );
+	store_little_endian( header + 4, tree_size, 2 );
+}
+
+// Description:
+// Parses the header written before a block's tree dump.
+//
+// Parameters:
+// uint8_t header[static SPLIT_BLOCK_HEADER_SIZE] - The header.
+// uint32_t *nbytes - The pointer to the uint32_t to set to the size of the block's input.
+// uint16_t *tree_size - The pointer to the uint16_t to set to the size of the block's tree dump.
+//
+// Returns:
+// Nothing.
+void split_block_header_parse( uint8_t header[ static SPLIT_BLOCK_HEADER_SIZE ], uint32_t *nbytes, uint16_t *tree_size ) {
+	*nbytes = load_little_endian( header, 4 );
+	*tree_size = load_little_endian( header + 4, 2 );
+}
@@ -0,0 +1,24 @@
+#ifndef __SPLIT_H__
+#define __SPLIT_H__
+
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SPLIT_SEGMENT           ( 16 * BLOCK ) // 64KB of input per scanned segment, at least.
+#define SPLIT_MAX_SEGMENTS      65536 // Most segments a file is scanned in, which bounds the histograms kept.
+#define SPLIT_MAX_BLOCK         ( 16384 * BLOCK ) // 64MB most input per block, so its histogram fits 32-bit counts.
+#define SPLIT_BLOCK_HEADER_SIZE 6 // 32-bit block size and 16-bit tree size, before each block's tree dump.
+
+uint32_t split_segment_size( uint64_t file_size );
+
+uint64_t split_block_cost( uint32_t histogram[ static ALPHABET ] );
+
+uint32_t split_plan( uint32_t ( *histograms )[ ALPHABET ], uint32_t *sizes, uint32_t nsegments );
+
+void split_block_header_create( uint32_t nbytes, uint16_t tree_size, uint8_t header[ static SPLIT_BLOCK_HEADER_SIZE ] );
+
+void split_block_header_parse( uint8_t header[ static SPLIT_BLOCK_HEADER_SIZE ], uint32_t *nbytes, uint16_t *tree_size );
+
+#endif
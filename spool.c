@@ -0,0 +1,190 @@
+#define _GNU_SOURCE
+
+#include "spool.h"
+
+#include "io.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Description:
+// A struct for spooling piped input so it can be read more than once. Bytes go
+// to an anonymous memory file until it would pass the memory limit, and from
+// then on to an unnamed temporary file.
+//
+// Members:
+// int fd - The memory file or temporary file the bytes are in.
+// uint64_t size - The number of bytes spooled.
+// uint64_t memory_limit - The most bytes to keep in memory.
+// bool in_memory - Whether fd is a memory file.
+struct Spool {
+	int fd;
+	uint64_t size;
+	uint64_t memory_limit;
+	bool in_memory;
+};
+
+// Description:
+// Creates a temporary file that no other process can open: an O_TMPFILE file in
+// $TMPDIR (or /tmp), or where that isn't supported, a file with a random name
+// that's unlinked as soon as it's created.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// int - The temporary file, or -1 on failure.
+static int spool_create_file( ) {
+	char *dir = getenv( "TMPDIR" );
+	char path[ PATH_MAX ];
+
+	if ( !dir || *dir == '\0' ) {
+		dir = "/tmp";
+	}
+
+	int fd = open( dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600 );
+
+	if ( fd == -1 && snprintf( path, PATH_MAX, "%s/%s", dir, SPOOL_TEMPLATE ) < PATH_MAX && ( fd = mkostemp( path, O_CLOEXEC ) ) != -1 ) {
+		unlink( path ); // Deleted when it's closed.
+	}
+
+	return fd;
+}
+
+// Description:
+// Creates a spool.
+//
+// Parameters:
+// uint64_t memory_limit - The most bytes to keep in memory, or 0 to spool straight to a file.
+//
+// Returns:
+// Spool * - A pointer to the newly created spool, or NULL if no file could be made.
+Spool *spool_create( uint64_t memory_limit ) {
+	Spool *s = ( Spool * ) calloc( 1, sizeof( Spool ) );
+
+	if ( !s ) {
+		return NULL;
+	}
+
+	s->memory_limit = memory_limit;
+	s->fd = -1;
+#ifdef MFD_CLOEXEC
+	if ( memory_limit != 0 ) {
+		s->fd = memfd_create( "huffman-spool", MFD_CLOEXEC );
+		s->in_memory = s->fd != -1;
+	}
+#endif
+
+	if ( s->fd == -1 && ( s->fd = spool_create_file( ) ) == -1 ) {
+		free( s );
+		s = NULL;
+	}
+
+	return s;
+}
+
+// Description:
+// Frees the memory given to a spool and closes its file.
+//
+// Parameters:
+// Spool **s - A pointer to a pointer to the spool.
+//
+// Returns:
+// Nothing.
+void spool_delete( Spool **s ) {
+	if ( *s ) {
+		if ( ( *s )->fd != -1 ) {
+			close( ( *s )->fd );
+		}
+
+		free( *s );
+		*s = NULL;
+	}
+}
+
+// Description:
+// Moves the bytes of a spool from memory to a temporary file.
+//
+// Parameters:
+// Spool *s - The spool.
+//
+// Returns:
+// bool - Whether the bytes were moved.
+static bool spool_spill( Spool *s ) {
+	uint32_t block_size = io_block_size( );
+	uint8_t *buf = io_buffer_create( block_size );
+	int fd = spool_create_file( );
+	bool success = buf && fd != -1;
+
+	for ( uint64_t offset = 0; success && offset < s->size; offset += block_size ) {
+		uint32_t nbytes = s->size - offset < block_size ? s->size - offset : block_size;
+		success = pread_bytes( s->fd, buf, nbytes, offset ) == nbytes && write_bytes( fd, buf, nbytes ) == nbytes;
+	}
+
+	io_buffer_delete( &buf );
+
+	if ( !success ) {
+		if ( fd != -1 ) {
+			close( fd );
+		}
+
+		return false;
+	}
+
+	close( s->fd );
+	s->fd = fd;
+	s->in_memory = false;
+
+	return true;
+}
+
+// Description:
+// Adds bytes to the end of a spool, spilling it to a file first if they would
+// take it past its memory limit, or if memory runs out.
+//
+// Parameters:
+// Spool *s - The spool.
+// uint8_t *buf - The bytes to add.
+// uint32_t nbytes - The number of bytes.
+//
+// Returns:
+// bool - Whether all of the bytes were added.
+bool spool_write( Spool *s, uint8_t *buf, uint32_t nbytes ) {
+	if ( s->in_memory && s->size + nbytes > s->memory_limit && !spool_spill( s ) ) {
+		return false;
+	}
+
+	uint32_t written = write_bytes( s->fd, buf, nbytes );
+	s->size += written;
+
+	if ( written < nbytes && s->in_memory && spool_spill( s ) ) { // The memory file ran out of room below the limit.
+		uint32_t rest = write_bytes( s->fd, buf + written, nbytes - written );
+		s->size += rest;
+		written += rest;
+	}
+
+	return written == nbytes;
+}
+
+// Description:
+// Frees a spool and hands over its file, rewound to the start.
+//
+// Parameters:
+// Spool **s - A pointer to a pointer to the spool.
+//
+// Returns:
+// int - The file with the spooled bytes, which the caller has to close.
+int spool_finish( Spool **s ) {
+	int fd = ( *s )->fd;
+	lseek( fd, 0, SEEK_SET );
+	( *s )->fd = -1;
+	spool_delete( s );
+
+	return fd;
+}
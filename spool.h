@@ -0,0 +1,20 @@
+#ifndef __SPOOL_H__
+#define __SPOOL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SPOOL_MEMORY_LIMIT ( 256ull << 20 ) // 256MB of piped input kept in memory by default before spilling to a file.
+#define SPOOL_TEMPLATE     "huffman.XXXXXX" // Name of spill files, in $TMPDIR or /tmp.
+
+typedef struct Spool Spool;
+
+Spool *spool_create( uint64_t memory_limit );
+
+void spool_delete( Spool **s );
+
+bool spool_write( Spool *s, uint8_t *buf, uint32_t nbytes );
+
+int spool_finish( Spool **s );
+
+#endif
@@ -0,0 +1,340 @@
+#define _GNU_SOURCE
+
+#include "stats.h"
+
+#include "kernels.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#define STATS_MAX_PHASES 16 // Max number of distinct phases.
+#define STATS_COUNTERS   4 // Cycles, instructions, branch misses and cache misses.
+
+static char *counter_names[ STATS_COUNTERS ] = { "cycles", "instructions", "branch_misses", "cache_misses" };
+
+// Description:
+// A struct for the totals of one phase.
+//
+// Members:
+// char *name - The name of the phase.
+// uint64_t nanoseconds - Time spent in the phase.
+// uint64_t counts[STATS_COUNTERS] - Hardware events counted in the phase.
+typedef struct StatsPhase {
+	char *name;
+	uint64_t nanoseconds;
+	uint64_t counts[ STATS_COUNTERS ];
+} StatsPhase;
+
+// Description:
+// A struct for per-phase timing and hardware counters of the calling thread.
+//
+// Members:
+// int counters[STATS_COUNTERS] - The perf event file descriptors, or -1 if unavailable.
+// StatsPhase phases[STATS_MAX_PHASES] - The phases seen so far, in order.
+// uint32_t nphases - The number of phases seen so far.
+// StatsPhase *current - The running phase, or NULL.
+// struct timespec started - When the running phase started.
+// uint64_t started_counts[STATS_COUNTERS] - The counters when the running phase started.
+struct Stats {
+	int counters[ STATS_COUNTERS ];
+	StatsPhase phases[ STATS_MAX_PHASES ];
+	uint32_t nphases;
+	StatsPhase *current;
+	struct timespec started;
+	uint64_t started_counts[ STATS_COUNTERS ];
+};
+
+// Description:
+// Opens a hardware counter for the calling thread, counting user space only so it
+// works without extra privileges.
+//
+// Parameters:
+// uint32_t counter - The index of the counter in counter_names.
+//
+// Returns:
+// int - The perf event file descriptor, or -1 if the counter is unavailable.
+static int stats_open_counter( uint32_t counter ) {
+#ifdef __linux__
+	static uint64_t configs[ STATS_COUNTERS ] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES };
+	struct perf_event_attr attr;
+	memset( &attr, 0, sizeof( attr ) );
+	attr.size = sizeof( attr );
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = configs[ counter ];
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+#else
+	( void ) counter;
+
+	return -1;
+#endif
+}
+
+// Description:
+// Reads the current time and counters.
+//
+// Parameters:
+// Stats *s - The stats.
+// struct timespec *now - The pointer to the timespec to set to the current time.
+// uint64_t counts[static STATS_COUNTERS] - The counter values to set.
+//
+// Returns:
+// Nothing.
+static void stats_sample( Stats *s, struct timespec *now, uint64_t counts[ static STATS_COUNTERS ] ) {
+	for ( uint32_t i = 0; i < STATS_COUNTERS; i++ ) {
+		if ( s->counters[ i ] == -1 || read( s->counters[ i ], &counts[ i ], sizeof( counts[ i ] ) ) != sizeof( counts[ i ] ) ) {
+			counts[ i ] = 0;
+		}
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, now );
+}
+
+// Description:
+// Creates stats for the calling thread, opening whichever hardware counters are available.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// Stats * - A pointer to the newly created stats.
+Stats *stats_create( ) {
+	Stats *s = ( Stats * ) calloc( 1, sizeof( Stats ) );
+
+	if ( s ) {
+		for ( uint32_t i = 0; i < STATS_COUNTERS; i++ ) {
+			s->counters[ i ] = stats_open_counter( i );
+		}
+	}
+
+	return s;
+}
+
+// Description:
+// Frees the memory given to stats and closes their counters.
+//
+// Parameters:
+// Stats **s - A pointer to a pointer to the stats.
+//
+// Returns:
+// Nothing.
+void stats_delete( Stats **s ) {
+	if ( *s ) {
+		for ( uint32_t i = 0; i < STATS_COUNTERS; i++ ) {
+			if ( ( *s )->counters[ i ] != -1 ) {
+				close( ( *s )->counters[ i ] );
+			}
+		}
+
+		free( *s );
+		*s = NULL;
+	}
+}
+
+// Description:
+// Ends the running phase, if any, and starts another. Time and counts of a phase
+// entered more than once are added up. Does nothing if the stats are NULL, so
+// callers don't need to check whether stats are being kept.
+//
+// Parameters:
+// Stats *s - The stats, or NULL.
+// char *name - The name of the phase to start, or NULL to just end the running one.
+//
+// Returns:
+// Nothing.
+void stats_phase( Stats *s, char *name ) {
+	if ( !s ) {
+		return;
+	}
+
+	struct timespec now;
+	uint64_t counts[ STATS_COUNTERS ];
+	stats_sample( s, &now, counts );
+
+	if ( s->current ) {
+		s->current->nanoseconds += ( now.tv_sec - s->started.tv_sec ) * 1000000000ull + now.tv_nsec - s->started.tv_nsec;
+
+		for ( uint32_t i = 0; i < STATS_COUNTERS; i++ ) {
+			s->current->counts[ i ] += counts[ i ] - s->started_counts[ i ];
+		}
+
+		s->current = NULL;
+	}
+
+	if ( !name ) {
+		return;
+	}
+
+	for ( uint32_t i = 0; i < s->nphases; i++ ) {
+		if ( strcmp( s->phases[ i ].name, name ) == 0 ) {
+			s->current = &s->phases[ i ];
+		}
+	}
+
+	if ( !s->current && s->nphases < STATS_MAX_PHASES ) {
+		s->current = &s->phases[ s->nphases++ ];
+		s->current->name = name;
+	}
+
+	memcpy( s->started_counts, counts, sizeof( counts ) );
+	s->started = now;
+}
+
+// Description:
+// Sums the time and counts of every phase.
+//
+// Parameters:
+// Stats *s - The stats.
+// StatsPhase *total - The phase to set to the totals.
+//
+// Returns:
+// Nothing.
+static void stats_total( Stats *s, StatsPhase *total ) {
+	memset( total, 0, sizeof( StatsPhase ) );
+	total->name = "total";
+
+	for ( uint32_t i = 0; i < s->nphases; i++ ) {
+		total->nanoseconds += s->phases[ i ].nanoseconds;
+
+		for ( uint32_t j = 0; j < STATS_COUNTERS; j++ ) {
+			total->counts[ j ] += s->phases[ i ].counts[ j ];
+		}
+	}
+}
+
+// Description:
+// Prints a row of the phase table.
+//
+// Parameters:
+// Stats *s - The stats.
+// FILE *stream - The stream to print to.
+// StatsPhase *phase - The phase.
+// uint64_t nbytes - The number of bytes cycles/byte is counted against.
+//
+// Returns:
+// Nothing.
+static void stats_print_phase( Stats *s, FILE *stream, StatsPhase *phase, uint64_t nbytes ) {
+	fprintf( stream, "  %-14s %10.3f", phase->name, phase->nanoseconds / 1e6 );
+
+	for ( uint32_t i = 0; i < STATS_COUNTERS; i++ ) {
+		if ( s->counters[ i ] != -1 ) {
+			fprintf( stream, " %14" PRIu64, phase->counts[ i ] );
+		} else {
+			fprintf( stream, " %14s", "-" );
+		}
+	}
+
+	if ( s->counters[ 0 ] != -1 && nbytes != 0 ) {
+		fprintf( stream, " %12.3f\n", ( double ) phase->counts[ 0 ] / nbytes );
+	} else {
+		fprintf( stream, " %12s\n", "-" );
+	}
+}
+
+// Description:
+// Prints a table of the time and hardware counts of every phase.
+//
+// Parameters:
+// Stats *s - The stats, or NULL to print nothing.
+// FILE *stream - The stream to print to.
+// uint64_t nbytes - The number of bytes cycles/byte is counted against.
+//
+// Returns:
+// Nothing.
+void stats_print( Stats *s, FILE *stream, uint64_t nbytes ) {
+	if ( !s ) {
+		return;
+	}
+
+	StatsPhase total;
+	stats_total( s, &total );
+	fprintf( stream, "  %-14s %10s %14s %14s %14s %14s %12s\n", "Phase", "Time (ms)", "Cycles", "Instructions", "Branch misses", "Cache misses", "Cycles/byte" );
+
+	for ( uint32_t i = 0; i < s->nphases; i++ ) {
+		stats_print_phase( s, stream, &s->phases[ i ], nbytes );
+	}
+
+	stats_print_phase( s, stream, &total, nbytes );
+
+	if ( s->counters[ 0 ] == -1 ) {
+		fprintf( stream, "Hardware counters unavailable (perf_event_open failed).\n" );
+	}
+}
+
+// Description:
+// Writes a phase as a JSON object.
+//
+// Parameters:
+// Stats *s - The stats.
+// FILE *stream - The stream to write to.
+// StatsPhase *phase - The phase.
+// uint64_t nbytes - The number of bytes cycles/byte is counted against.
+//
+// Returns:
+// Nothing.
+static void stats_write_json_phase( Stats *s, FILE *stream, StatsPhase *phase, uint64_t nbytes ) {
+	fprintf( stream, "{\"name\": \"%s\", \"seconds\": %.9f", phase->name, phase->nanoseconds / 1e9 );
+
+	for ( uint32_t i = 0; i < STATS_COUNTERS; i++ ) {
+		if ( s->counters[ i ] != -1 ) {
+			fprintf( stream, ", \"%s\": %" PRIu64, counter_names[ i ], phase->counts[ i ] );
+		} else {
+			fprintf( stream, ", \"%s\": null", counter_names[ i ] );
+		}
+	}
+
+	if ( s->counters[ 0 ] != -1 && nbytes != 0 ) {
+		fprintf( stream, ", \"cycles_per_byte\": %.6f}", ( double ) phase->counts[ 0 ] / nbytes );
+	} else {
+		fprintf( stream, ", \"cycles_per_byte\": null}" );
+	}
+}
+
+// Description:
+// Saves the stats as a JSON object, for tools that track performance over time.
+//
+// Parameters:
+// Stats *s - The stats.
+// char *file_name - The file to save to, or "-" for stderr.
+// char *program - The name of the program.
+// uint64_t input_size - The number of bytes read.
+// uint64_t output_size - The number of bytes written.
+// uint64_t nbytes - The number of bytes cycles/byte is counted against.
+//
+// Returns:
+// bool - Whether the stats were saved successfully.
+bool stats_save_json( Stats *s, char *file_name, char *program, uint64_t input_size, uint64_t output_size, uint64_t nbytes ) {
+	FILE *stream = !s ? NULL : strcmp( file_name, "-" ) == 0 ? stderr : fopen( file_name, "w" );
+
+	if ( !stream ) {
+		return false;
+	}
+
+	StatsPhase total;
+	stats_total( s, &total );
+	fprintf( stream, "{\"program\": \"%s\", \"kernels\": \"%s\", \"input_bytes\": %" PRIu64 ", \"output_bytes\": %" PRIu64 ", \"total\": ", program, kernels_name( ), input_size, output_size );
+	stats_write_json_phase( s, stream, &total, nbytes );
+	fprintf( stream, ", \"phases\": [" );
+
+	for ( uint32_t i = 0; i < s->nphases; i++ ) {
+		fputs( i == 0 ? "" : ", ", stream );
+		stats_write_json_phase( s, stream, &s->phases[ i ], nbytes );
+	}
+
+	fprintf( stream, "]}\n" );
+
+	return stream == stderr ? fflush( stream ) == 0 : fclose( stream ) == 0;
+}
@@ -0,0 +1,20 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Stats Stats;
+
+Stats *stats_create( );
+
+void stats_delete( Stats **s );
+
+void stats_phase( Stats *s, char *name );
+
+void stats_print( Stats *s, FILE *stream, uint64_t nbytes );
+
+bool stats_save_json( Stats *s, char *file_name, char *program, uint64_t input_size, uint64_t output_size, uint64_t nbytes );
+
+#endif
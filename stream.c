@@ -0,0 +1,69 @@
+#include "stream.h"
+
+#include "io.h"
+#include "split.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Description:
+// Decides whether a segment is coded with the table of the segment before it,
+// or gets a table of its own. The old table is kept if it has a code for every
+// byte in the segment, and codes it in no more bits than a new table would,
+// counting the new table's tree dump.
+//
+// Parameters:
+// uint32_t histogram[static ALPHABET] - The histogram of the segment.
+// uint16_t lengths[static ALPHABET] - The code lengths of the old table.
+// bool present[static ALPHABET] - Which bytes the old table has codes for.
+//
+// Returns:
+// bool - Whether to keep the old table.
+bool stream_keep_table( uint32_t histogram[ static ALPHABET ], uint16_t lengths[ static ALPHABET ], bool present[ static ALPHABET ] ) {
+	uint64_t bits = 0;
+
+	for ( uint32_t i = 0; i < ALPHABET; i++ ) {
+		if ( histogram[ i ] != 0 && !present[ i ] ) {
+			return false;
+		}
+
+		bits += ( uint64_t ) histogram[ i ] * lengths[ i ];
+	}
+
+	return bits + 8 * SPLIT_BLOCK_HEADER_SIZE <= split_block_cost( histogram ); // Both costs leave out the segment header.
+}
+
+// Description:
+// Creates the header written before each segment's tree dump, which also marks
+// where the segment before it was flushed.
+//
+// Parameters:
+// uint32_t nbytes - The size of the segment's input, or 0 for the end of the stream.
+// uint32_t ncoded - The size of the segment's codes, padded to a byte boundary.
+// uint16_t tree_size - The size of the segment's tree dump, or 0 if it keeps the table before it.
+// uint8_t header[static STREAM_SEGMENT_HEADER_SIZE] - The buffer to write the header to, little-endian.
+//
+// Returns:
+// Nothing.
+void stream_segment_header_create( uint32_t nbytes, uint32_t ncoded, uint16_t tree_size, uint8_t header[ static STREAM_SEGMENT_HEADER_SIZE ] ) {
+	store_little_endian( header, nbytes, 4 );
+	store_little_endian( header + 4, ncoded, 4 );
+	store_little_endian( header + 8, tree_size, 2 );
+}
+
+// Description:
+// Parses the header written before a segment's tree dump.
+//
+// Parameters:
+// uint8_t header[static STREAM_SEGMENT_HEADER_SIZE] - The header.
+// uint32_t *nbytes - The pointer to the uint32_t to set to the size of the segment's input.
+// uint32_t *ncoded - The pointer to the uint32_t to set to the size of the segment's codes.
+// uint16_t *tree_size - The pointer to the uint16_t to set to the size of the segment's tree dump.
+//
+// Returns:
+// Nothing.
+void stream_segment_header_parse( uint8_t header[ static STREAM_SEGMENT_HEADER_SIZE ], uint32_t *nbytes, uint32_t *ncoded, uint16_t *tree_size ) {
+	*nbytes = load_little_endian( header, 4 );
+	*ncoded = load_little_endian( header + 4, 4 );
+	*tree_size = load_little_endian( header + 8, 2 );
+}
@@ -0,0 +1,21 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STREAM_FLUSH_BYTES          ( 16 * BLOCK ) // 64KB of input per segment by default.
+#define STREAM_FLUSH_MS             100 // Default milliseconds input may wait before it's flushed.
+#define STREAM_MAX_FLUSH            ( 16384 * BLOCK ) // 64MB most input per segment, so its histogram fits 32-bit counts.
+#define STREAM_MAX_FLUSH_MS         3600000 // An hour, most milliseconds input may wait, well within poll()'s int timeout.
+#define STREAM_SEGMENT_HEADER_SIZE  10 // 32-bit input size, 32-bit code size and 16-bit tree size, before each segment's tree dump.
+
+bool stream_keep_table( uint32_t histogram[ static ALPHABET ], uint16_t lengths[ static ALPHABET ], bool present[ static ALPHABET ] );
+
+void stream_segment_header_create( uint32_t nbytes, uint32_t ncoded, uint16_t tree_size, uint8_t header[ static STREAM_SEGMENT_HEADER_SIZE ] );
+
+void stream_segment_header_parse( uint8_t header[ static STREAM_SEGMENT_HEADER_SIZE ], uint32_t *nbytes, uint32_t *ncoded, uint16_t *tree_size );
+
+#endif
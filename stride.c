@@ -0,0 +1,149 @@
+#include "stride.h"
+
+#include "split.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Description:
+// Estimates the size of a sample coded with one table per byte position modulo
+// a stride, from the exact Huffman cost of each position's histogram.
+//
+// Parameters:
+// uint8_t *sample - The sample.
+// uint32_t nbytes - The size of the sample.
+// uint32_t stride - The stride.
+//
+// Returns:
+// uint64_t - The size in bits, tree dumps included, or UINT64_MAX if there wasn't enough memory.
+static uint64_t stride_cost( uint8_t *sample, uint32_t nbytes, uint32_t stride ) {
+	uint32_t( *histograms )[ ALPHABET ] = calloc( stride, sizeof( *histograms ) );
+	uint64_t bits = 0;
+
+	if ( !histograms ) {
+		return UINT64_MAX;
+	}
+
+	for ( uint32_t i = 0, column = 0; i < nbytes; i++ ) {
+		histograms[ column ][ sample[ i ] ]++;
+		column = column + 1 == stride ? 0 : column + 1;
+	}
+
+	for ( uint32_t column = 0; column < stride; column++ ) {
+		bits += split_block_cost( histograms[ column ] );
+	}
+
+	free( histograms );
+
+	return bits;
+}
+
+// Description:
+// Detects the record size of an array of fixed-size records from a sample of
+// it. The autocorrelation of the bytes, the share of them equal to the byte a
+// given distance before, peaks at the record size and its multiples, so the
+// smallest distance that comes close to the highest peak is taken. It's only
+// used if tables for each position of it are estimated to code the sample in
+// fewer bits than one table.
+//
+// Parameters:
+// uint8_t *sample - The sample, from the start of the input.
+// uint32_t nbytes - The size of the sample.
+//
+// Returns:
+// uint32_t - The detected stride, or 1 if none pays for its tables.
+uint32_t stride_detect( uint8_t *sample, uint32_t nbytes ) {
+	uint32_t max_stride = nbytes / STRIDE_MIN_RECORDS < STRIDE_MAX ? nbytes / STRIDE_MIN_RECORDS : STRIDE_MAX;
+	double rates[ STRIDE_MAX + 1 ] = { 0 };
+	double best = 0;
+
+	for ( uint32_t stride = 2; stride <= max_stride; stride++ ) {
+		uint32_t matches = 0;
+
+		for ( uint32_t i = stride; i < nbytes; i++ ) {
+			matches += sample[ i ] == sample[ i - stride ];
+		}
+
+		rates[ stride ] = ( double ) matches / ( nbytes - stride );
+		best = rates[ stride ] > best ? rates[ stride ] : best;
+	}
+
+	for ( uint32_t stride = 2; stride <= max_stride; stride++ ) {
+		if ( rates[ stride ] >= STRIDE_PEAK * best ) {
+			uint64_t one_table = stride_cost( sample, nbytes, 1 );
+			uint64_t tables = stride_cost( sample, nbytes, stride );
+
+			return tables < STRIDE_MIN_GAIN * one_table ? stride : 1;
+		}
+	}
+
+	return 1;
+}
+
+// Description:
+// Gets the size of the blocks a file is coded in: STRIDE_BLOCK, rounded down to
+// a whole number of records, so every block starts at position 0.
+//
+// Parameters:
+// uint32_t stride - The stride.
+//
+// Returns:
+// uint32_t - The bytes per block.
+uint32_t stride_block_size( uint32_t stride ) {
+	return STRIDE_BLOCK / stride * stride;
+}
+
+// Description:
+// Gets the number of bytes of a block at a position.
+//
+// Parameters:
+// uint32_t nbytes - The size of the block.
+// uint32_t stride - The stride.
+// uint32_t column - The position, below the stride.
+//
+// Returns:
+// uint32_t - The number of bytes at the position.
+uint32_t stride_column_size( uint32_t nbytes, uint32_t stride, uint32_t column ) {
+	return nbytes / stride + ( column < nbytes % stride );
+}
+
+// Description:
+// Gathers the bytes of a block at each position into a column, so each column
+// can be coded with its position's table in one run.
+//
+// Parameters:
+// uint8_t *in - The block.
+// uint32_t nbytes - The size of the block.
+// uint32_t stride - The stride.
+// uint8_t *columns - The buffer to write the columns to, one after another, nbytes in all.
+//
+// Returns:
+// Nothing.
+void stride_split( uint8_t *in, uint32_t nbytes, uint32_t stride, uint8_t *columns ) {
+	for ( uint32_t column = 0; column < stride; column++ ) {
+		for ( uint32_t i = column; i < nbytes; i += stride ) {
+			*columns++ = in[ i ];
+		}
+	}
+}
+
+// Description:
+// Puts the columns of a block back in their positions: the inverse of
+// stride_split().
+//
+// Parameters:
+// uint8_t *columns - The columns, one after another.
+// uint32_t nbytes - The size of the block.
+// uint32_t stride - The stride.
+// uint8_t *out - The buffer to write the block to.
+//
+// Returns:
+// Nothing.
+void stride_join( uint8_t *columns, uint32_t nbytes, uint32_t stride, uint8_t *out ) {
+	for ( uint32_t column = 0; column < stride; column++ ) {
+		for ( uint32_t i = column; i < nbytes; i += stride ) {
+			out[ i ] = *columns++;
+		}
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef __STRIDE_H__
+#define __STRIDE_H__
+
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STRIDE_MAX          256 // Most bytes per record, each position of which gets its own table.
+#define STRIDE_BLOCK        ( 256 * BLOCK ) // 1MB of input per block, rounded down to whole records.
+#define STRIDE_SAMPLE       ( 256 * BLOCK ) // Bytes at the start of the input the stride is detected from.
+#define STRIDE_MIN_RECORDS  16 // Fewest whole records in the sample for a stride to be considered.
+#define STRIDE_PEAK         0.9 // Share of the best match rate the detected stride has to reach.
+#define STRIDE_MIN_GAIN     0.99 // Most a stride's estimated size can be, relative to one table's, to be used.
+#define STRIDE_HEADER_SIZE  2 // 16-bit stride, after the file header.
+#define STRIDE_TREE_HEADER  2 // 16-bit tree size, before each position's tree dump.
+
+uint32_t stride_detect( uint8_t *sample, uint32_t nbytes );
+
+uint32_t stride_block_size( uint32_t stride );
+
+uint32_t stride_column_size( uint32_t nbytes, uint32_t stride, uint32_t column );
+
+void stride_split( uint8_t *in, uint32_t nbytes, uint32_t stride, uint8_t *columns );
+
+void stride_join( uint8_t *columns, uint32_t nbytes, uint32_t stride, uint8_t *out );
+
+#endif
@@ -0,0 +1,422 @@
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define INITIAL_QUEUE_CAPACITY 64 // Tasks each worker queue holds before growing.
+
+// Description:
+// A struct for a task waiting to run.
+//
+// Members:
+// ThreadPoolTask function - The function to run.
+// void *arg - The argument to pass to the function.
+typedef struct Task {
+	ThreadPoolTask function;
+	void *arg;
+} Task;
+
+// Description:
+// A struct for a worker's double-ended task queue. The owner pushes and pops at the
+// tail, and other workers steal from the head.
+//
+// Members:
+// pthread_mutex_t lock - Guards the queue.
+// uint32_t head - Index of the oldest task.
+// uint32_t size - Number of tasks in the queue.
+// uint32_t capacity - Capacity of the queue.
+// Task *items - The ring buffer backing the queue.
+typedef struct WorkQueue {
+	pthread_mutex_t lock;
+	uint32_t head;
+	uint32_t size;
+	uint32_t capacity;
+	Task *items;
+} WorkQueue;
+
+// Description:
+// A struct for the work-stealing thread pool.
+//
+// Members:
+// uint32_t threads - Number of worker threads.
+// pthread_t *workers - The worker threads.
+// WorkQueue *queues - One task queue per worker.
+// pthread_mutex_t lock - Guards the counters and condition variables below.
+// pthread_cond_t work_available - Signaled when tasks are queued or the pool stops.
+// pthread_cond_t work_done - Signaled when the last pending task finishes.
+// uint64_t queued - Tasks sitting in queues.
+// uint64_t pending - Tasks submitted but not finished.
+// uint32_t next_queue - Queue to give the next task submitted from outside the pool.
+// bool stopping - Whether the workers should exit.
+struct ThreadPool {
+	uint32_t threads;
+	pthread_t *workers;
+	WorkQueue *queues;
+	pthread_mutex_t lock;
+	pthread_cond_t work_available;
+	pthread_cond_t work_done;
+	uint64_t queued;
+	uint64_t pending;
+	uint32_t next_queue;
+	bool stopping;
+};
+
+// Description:
+// A struct for the arguments of a worker thread.
+//
+// Members:
+// ThreadPool *pool - The pool the worker belongs to.
+// uint32_t index - The index of the worker's queue.
+typedef struct WorkerArgs {
+	ThreadPool *pool;
+	uint32_t index;
+} WorkerArgs;
+
+static _Thread_local ThreadPool *current_pool = NULL; // Pool of the current worker thread.
+static _Thread_local uint32_t current_index = 0; // Queue index of the current worker thread.
+
+// Description:
+// Pushes a task to the tail of a work queue, growing it if needed.
+//
+// Parameters:
+// WorkQueue *q - The work queue.
+// Task task - The task.
+//
+// Returns:
+// bool - Whether the operation was successful.
+static bool work_queue_push( WorkQueue *q, Task task ) {
+	pthread_mutex_lock( &q->lock );
+
+	if ( q->size == q->capacity ) { // Grow, unwrapping the ring buffer.
+		Task *items = ( Task * ) malloc( 2 * q->capacity * sizeof( Task ) );
+
+		if ( !items ) {
+			pthread_mutex_unlock( &q->lock );
+
+			return false;
+		}
+
+		for ( uint32_t i = 0; i < q->size; i++ ) {
+			items[ i ] = q->items[ ( q->head + i ) % q->capacity ];
+		}
+
+		free( q->items );
+		q->items = items;
+		q->head = 0;
+		q->capacity *= 2;
+	}
+
+	q->items[ ( q->head + q->size ) % q->capacity ] = task;
+	q->size++;
+	pthread_mutex_unlock( &q->lock );
+
+	return true;
+}
+
+// Description:
+// Takes a task from a work queue: the newest one for the owner, the oldest one for a thief.
+//
+// Parameters:
+// WorkQueue *q - The work queue.
+// bool steal - Whether to take from the head instead of the tail.
+// Task *task - The pointer to the Task to set to the taken task.
+//
+// Returns:
+// bool - Whether a task was taken.
+static bool work_queue_take( WorkQueue *q, bool steal, Task *task ) {
+	bool taken = false;
+	pthread_mutex_lock( &q->lock );
+
+	if ( q->size != 0 ) {
+		if ( steal ) {
+			*task = q->items[ q->head ];
+			q->head = ( q->head + 1 ) % q->capacity;
+		} else {
+			*task = q->items[ ( q->head + q->size - 1 ) % q->capacity ];
+		}
+
+		q->size--;
+		taken = true;
+	}
+
+	pthread_mutex_unlock( &q->lock );
+
+	return taken;
+}
+
+// Description:
+// Finds a task to run: first from the given queue, then by stealing from the others.
+//
+// Parameters:
+// ThreadPool *p - The thread pool.
+// uint32_t index - The queue to look in first.
+// Task *task - The pointer to the Task to set to the found task.
+//
+// Returns:
+// bool - Whether a task was found.
+static bool thread_pool_find_task( ThreadPool *p, uint32_t index, Task *task ) {
+	for ( uint32_t i = 0; i < p->threads; i++ ) {
+		if ( work_queue_take( &p->queues[ ( index + i ) % p->threads ], i != 0, task ) ) {
+			pthread_mutex_lock( &p->lock );
+			p->queued--;
+			pthread_mutex_unlock( &p->lock );
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Description:
+// Runs a task and marks it finished.
+//
+// Parameters:
+// ThreadPool *p - The thread pool.
+// Task task - The task.
+//
+// Returns:
+// Nothing.
+static void thread_pool_run_task( ThreadPool *p, Task task ) {
+	task.function( task.arg );
+	pthread_mutex_lock( &p->lock );
+	p->pending--;
+
+	if ( p->pending == 0 ) {
+		pthread_cond_broadcast( &p->work_done );
+	}
+
+	pthread_mutex_unlock( &p->lock );
+}
+
+// Description:
+// The main loop of a worker thread.
+//
+// Parameters:
+// void *arg - The WorkerArgs of the worker.
+//
+// Returns:
+// void * - Nothing.
+static void *thread_pool_worker( void *arg ) {
+	WorkerArgs worker = *( WorkerArgs * ) arg;
+	ThreadPool *p = worker.pool;
+	free( arg );
+	current_pool = p;
+	current_index = worker.index;
+
+	while ( true ) {
+		Task task;
+
+		if ( thread_pool_find_task( p, worker.index, &task ) ) {
+			thread_pool_run_task( p, task );
+			continue;
+		}
+
+		pthread_mutex_lock( &p->lock );
+
+		while ( p->queued == 0 && !p->stopping ) {
+			pthread_cond_wait( &p->work_available, &p->lock );
+		}
+
+		bool stop = p->stopping && p->queued == 0;
+		pthread_mutex_unlock( &p->lock );
+
+		if ( stop ) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+// Description:
+// Creates a work-stealing thread pool.
+//
+// Parameters:
+// uint32_t threads - The number of worker threads (at least 1).
+//
+// Returns:
+// ThreadPool * - A pointer to the newly created thread pool.
+ThreadPool *thread_pool_create( uint32_t threads ) {
+	ThreadPool *p = ( ThreadPool * ) calloc( 1, sizeof( ThreadPool ) );
+
+	if ( !p ) {
+		return NULL;
+	}
+
+	p->threads = threads ? threads : 1;
+	p->workers = ( pthread_t * ) calloc( p->threads, sizeof( pthread_t ) );
+	p->queues = ( WorkQueue * ) calloc( p->threads, sizeof( WorkQueue ) );
+	pthread_mutex_init( &p->lock, NULL );
+	pthread_cond_init( &p->work_available, NULL );
+	pthread_cond_init( &p->work_done, NULL );
+
+	if ( !p->workers || !p->queues ) {
+		free( p->workers );
+		free( p->queues );
+		free( p );
+
+		return NULL;
+	}
+
+	for ( uint32_t i = 0; i < p->threads; i++ ) {
+		pthread_mutex_init( &p->queues[ i ].lock, NULL );
+		p->queues[ i ].capacity = INITIAL_QUEUE_CAPACITY;
+		p->queues[ i ].items = ( Task * ) malloc( INITIAL_QUEUE_CAPACITY * sizeof( Task ) );
+	}
+
+	for ( uint32_t i = 0; i < p->threads; i++ ) {
+		WorkerArgs *args = ( WorkerArgs * ) malloc( sizeof( WorkerArgs ) );
+		args->pool = p;
+		args->index = i;
+		pthread_create( &p->workers[ i ], NULL, thread_pool_worker, args );
+	}
+
+	return p;
+}
+
+// Description:
+// Waits for all tasks to finish, stops the workers and frees the thread pool.
+//
+// Parameters:
+// ThreadPool **p - A pointer to a pointer to the thread pool.
+//
+// Returns:
+// Nothing.
+void thread_pool_delete( ThreadPool **p ) {
+	if ( !*p ) {
+		return;
+	}
+
+	thread_pool_wait( *p );
+	pthread_mutex_lock( &( *p )->lock );
+	( *p )->stopping = true;
+	pthread_cond_broadcast( &( *p )->work_available );
+	pthread_mutex_unlock( &( *p )->lock );
+
+	for ( uint32_t i = 0; i < ( *p )->threads; i++ ) {
+		pthread_join( ( *p )->workers[ i ], NULL );
+		pthread_mutex_destroy( &( *p )->queues[ i ].lock );
+		free( ( *p )->queues[ i ].items );
+	}
+
+	pthread_mutex_destroy( &( *p )->lock );
+	pthread_cond_destroy( &( *p )->work_available );
+	pthread_cond_destroy( &( *p )->work_done );
+	free( ( *p )->workers );
+	free( ( *p )->queues );
+	free( *p );
+	*p = NULL;
+}
+
+// Description:
+// Gets the number of worker threads in a thread pool.
+//
+// Parameters:
+// ThreadPool *p - The thread pool.
+//
+// Returns:
+// uint32_t - The number of worker threads.
+uint32_t thread_pool_size( ThreadPool *p ) {
+	return p->threads;
+}
+
+// Description:
+// Submits a task to a thread pool. Tasks submitted by a worker go to its own queue,
+// and other tasks are spread across the queues.
+//
+// Parameters:
+// ThreadPool *p - The thread pool.
+// ThreadPoolTask task - The function to run.
+// void *arg - The argument to pass to the function.
+//
+// Returns:
+// bool - Whether the task was submitted.
+bool thread_pool_submit( ThreadPool *p, ThreadPoolTask task, void *arg ) {
+	Task t = { task, arg };
+	uint32_t index;
+	pthread_mutex_lock( &p->lock );
+
+	if ( current_pool == p ) {
+		index = current_index;
+	} else {
+		index = p->next_queue;
+		p->next_queue = ( p->next_queue + 1 ) % p->threads;
+	}
+
+	p->pending++;
+	p->queued++;
+	pthread_mutex_unlock( &p->lock );
+
+	if ( !work_queue_push( &p->queues[ index ], t ) ) {
+		pthread_mutex_lock( &p->lock );
+		p->pending--;
+		p->queued--;
+		pthread_mutex_unlock( &p->lock );
+
+		return false;
+	}
+
+	pthread_mutex_lock( &p->lock );
+	pthread_cond_signal( &p->work_available );
+	pthread_mutex_unlock( &p->lock );
+
+	return true;
+}
+
+// Description:
+// Waits for every submitted task to finish. Must not be called from a task.
+//
+// Parameters:
+// ThreadPool *p - The thread pool.
+//
+// Returns:
+// Nothing.
+void thread_pool_wait( ThreadPool *p ) {
+	pthread_mutex_lock( &p->lock );
+
+	while ( p->pending != 0 ) {
+		pthread_cond_wait( &p->work_done, &p->lock );
+	}
+
+	pthread_mutex_unlock( &p->lock );
+}
+
+// Description:
+// Gets the default number of worker threads: one per online CPU.
+//
+// Parameters:
+// Nothing.
+//
+// Returns:
+// uint32_t - The default number of worker threads.
+uint32_t thread_pool_default_threads( ) {
+	long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+
+	return cpus > 0 ? cpus : 1;
+}
+
+// Description:
+// Parses a number of worker threads given on the command line.
+//
+// Parameters:
+// char *text - The text to parse.
+// uint32_t *threads - The pointer to the uint32_t to set the number of threads to.
+//
+// Returns:
+// bool - Whether the text is a number from 1 to THREAD_POOL_MAX_THREADS.
+bool thread_pool_parse_threads( char *text, uint32_t *threads ) {
+	char *end = NULL;
+	unsigned long value = strtoul( text, &end, 10 );
+
+	if ( end == text || *end != '\0' || *text == '-' || value == 0 || value > THREAD_POOL_MAX_THREADS ) {
+		return false;
+	}
+
+	*threads = value;
+
+	return true;
+}
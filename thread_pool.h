@@ -0,0 +1,27 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define THREAD_POOL_MAX_THREADS 1024 // Most worker threads a pool can be asked for.
+
+typedef struct ThreadPool ThreadPool;
+
+typedef void ( *ThreadPoolTask )( void *arg );
+
+ThreadPool *thread_pool_create( uint32_t threads );
+
+void thread_pool_delete( ThreadPool **p );
+
+uint32_t thread_pool_size( ThreadPool *p );
+
+bool thread_pool_submit( ThreadPool *p, ThreadPoolTask task, void *arg );
+
+void thread_pool_wait( ThreadPool *p );
+
+uint32_t thread_pool_default_threads( );
+
+bool thread_pool_parse_threads( char *text, uint32_t *threads );
+
+#endif